@@ -41,12 +41,14 @@ static inline void
 spa_type_format_audio_map(struct spa_type_map *map, struct spa_type_format_audio *type)
 {
 	if (type->format == 0) {
-		type->format = spa_type_map_get_id(map, SPA_TYPE_FORMAT_AUDIO__format);
-		type->flags = spa_type_map_get_id(map, SPA_TYPE_FORMAT_AUDIO__flags);
-		type->layout = spa_type_map_get_id(map, SPA_TYPE_FORMAT_AUDIO__layout);
-		type->rate = spa_type_map_get_id(map, SPA_TYPE_FORMAT_AUDIO__rate);
-		type->channels = spa_type_map_get_id(map, SPA_TYPE_FORMAT_AUDIO__channels);
-		type->channel_mask = spa_type_map_get_id(map, SPA_TYPE_FORMAT_AUDIO__channelMask);
+		bool ids = spa_type_map_has_ids(map);
+
+		type->format = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_FORMAT_AUDIO__format);
+		type->flags = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_FORMAT_AUDIO__flags);
+		type->layout = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_FORMAT_AUDIO__layout);
+		type->rate = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_FORMAT_AUDIO__rate);
+		type->channels = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_FORMAT_AUDIO__channels);
+		type->channel_mask = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_FORMAT_AUDIO__channelMask);
 	}
 }
 
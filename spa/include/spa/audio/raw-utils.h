@@ -25,6 +25,7 @@ extern "C" {
 #endif
 
 #include <spa/type-map.h>
+#include <spa/type-ids.h>
 #include <spa/audio/raw.h>
 
 #if __BYTE_ORDER == __BIG_ENDIAN
@@ -74,11 +75,13 @@ static inline void
 spa_type_audio_format_map(struct spa_type_map *map, struct spa_type_audio_format *type)
 {
 	if (type->ENCODED == 0) {
+		bool ids = spa_type_map_has_ids(map);
+
 		type->UNKNOWN = 0;
-		type->ENCODED = spa_type_map_get_id(map, SPA_TYPE_AUDIO_FORMAT__ENCODED);
+		type->ENCODED = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_AUDIO_FORMAT__ENCODED);
 
-		type->S8 = spa_type_map_get_id(map, SPA_TYPE_AUDIO_FORMAT__S8);
-		type->U8 = spa_type_map_get_id(map, SPA_TYPE_AUDIO_FORMAT__U8);
+		type->S8 = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_AUDIO_FORMAT__S8);
+		type->U8 = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_AUDIO_FORMAT__U8);
 
 		type->S16 = spa_type_map_get_id(map, _SPA_TYPE_AUDIO_FORMAT_NE("S16"));
 		type->U16 = spa_type_map_get_id(map, _SPA_TYPE_AUDIO_FORMAT_NE("U16"));
@@ -27,6 +27,7 @@ extern "C" {
 #include <spa/defs.h>
 #include <spa/meta.h>
 #include <spa/type-map.h>
+#include <spa/type-ids.h>
 
 /** \page page_buffer Buffers
  *
@@ -55,10 +56,12 @@ struct spa_type_data {
 static inline void spa_type_data_map(struct spa_type_map *map, struct spa_type_data *type)
 {
 	if (type->MemPtr == 0) {
-		type->MemPtr = spa_type_map_get_id(map, SPA_TYPE_DATA__MemPtr);
-		type->MemFd = spa_type_map_get_id(map, SPA_TYPE_DATA__MemFd);
-		type->DmaBuf = spa_type_map_get_id(map, SPA_TYPE_DATA__DmaBuf);
-		type->Id = spa_type_map_get_id(map, SPA_TYPE_DATA__Id);
+		bool ids = spa_type_map_has_ids(map);
+
+		type->MemPtr = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_DATA__MemPtr);
+		type->MemFd = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_DATA__MemFd);
+		type->DmaBuf = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_DATA__DmaBuf);
+		type->Id = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_DATA__Id);
 	}
 }
 
@@ -43,6 +43,26 @@ enum spa_clock_state {
 #include <spa/plugin.h>
 #include <spa/props.h>
 
+/**
+ * spa_clock_stats:
+ * @rate: the sample rate of the device
+ * @quantum: the number of samples the device wakes up for
+ * @fill: the samples in the device buffer at the last wakeup
+ * @size: the size of the device buffer in samples
+ * @xruns: the number of underruns and overruns
+ *
+ * Statistics of the device behind a clock. The fields are updated with
+ * relaxed atomic stores from the data thread, other threads can read them
+ * at any time.
+ */
+struct spa_clock_stats {
+	uint32_t rate;
+	uint32_t quantum;
+	uint32_t fill;
+	uint32_t size;
+	uint32_t xruns;
+};
+
 /**
  * spa_clock:
  *
@@ -51,7 +71,7 @@ enum spa_clock_state {
 struct spa_clock {
 	/* the version of this clock. This can be used to expand this
 	 * structure in the future */
-#define SPA_VERSION_CLOCK	0
+#define SPA_VERSION_CLOCK	1
 	uint32_t version;
 
 	const struct spa_dict *info;
@@ -108,6 +128,13 @@ struct spa_clock {
 			 int32_t *rate,
 			 int64_t *ticks,
 			 int64_t *monotonic_time);
+	/**
+	 * spa_clock::stats:
+	 *
+	 * Since version 1: the statistics of the device or %NULL when the
+	 * clock has none.
+	 */
+	const struct spa_clock_stats *stats;
 };
 
 #define spa_clock_get_props(n,...)	(n)->get_props((n),__VA_ARGS__)
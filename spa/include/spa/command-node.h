@@ -25,6 +25,7 @@ extern "C" {
 #endif
 
 #include <spa/type-map.h>
+#include <spa/type-ids.h>
 #include <spa/command.h>
 
 #define SPA_TYPE_COMMAND__Node			SPA_TYPE_COMMAND_BASE "Node"
@@ -50,12 +51,14 @@ static inline void
 spa_type_command_node_map(struct spa_type_map *map, struct spa_type_command_node *type)
 {
 	if (type->Pause == 0) {
-		type->Pause = spa_type_map_get_id(map, SPA_TYPE_COMMAND_NODE__Pause);
-		type->Start = spa_type_map_get_id(map, SPA_TYPE_COMMAND_NODE__Start);
-		type->Flush = spa_type_map_get_id(map, SPA_TYPE_COMMAND_NODE__Flush);
-		type->Drain = spa_type_map_get_id(map, SPA_TYPE_COMMAND_NODE__Drain);
-		type->Marker = spa_type_map_get_id(map, SPA_TYPE_COMMAND_NODE__Marker);
-		type->ClockUpdate = spa_type_map_get_id(map, SPA_TYPE_COMMAND_NODE__ClockUpdate);
+		bool ids = spa_type_map_has_ids(map);
+
+		type->Pause = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_COMMAND_NODE__Pause);
+		type->Start = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_COMMAND_NODE__Start);
+		type->Flush = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_COMMAND_NODE__Flush);
+		type->Drain = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_COMMAND_NODE__Drain);
+		type->Marker = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_COMMAND_NODE__Marker);
+		type->ClockUpdate = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_COMMAND_NODE__ClockUpdate);
 	}
 }
 
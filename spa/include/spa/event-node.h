@@ -27,6 +27,7 @@ extern "C" {
 #include <spa/defs.h>
 #include <spa/event.h>
 #include <spa/type-map.h>
+#include <spa/type-ids.h>
 #include <spa/node.h>
 
 #define SPA_TYPE_EVENT__Node		SPA_TYPE_EVENT_BASE "Node"
@@ -48,10 +49,12 @@ static inline void
 spa_type_event_node_map(struct spa_type_map *map, struct spa_type_event_node *type)
 {
 	if (type->Error == 0) {
-		type->Error = spa_type_map_get_id(map, SPA_TYPE_EVENT_NODE__Error);
-		type->Buffering = spa_type_map_get_id(map, SPA_TYPE_EVENT_NODE__Buffering);
-		type->RequestRefresh = spa_type_map_get_id(map, SPA_TYPE_EVENT_NODE__RequestRefresh);
-		type->RequestClockUpdate = spa_type_map_get_id(map, SPA_TYPE_EVENT_NODE__RequestClockUpdate);
+		bool ids = spa_type_map_has_ids(map);
+
+		type->Error = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_EVENT_NODE__Error);
+		type->Buffering = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_EVENT_NODE__Buffering);
+		type->RequestRefresh = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_EVENT_NODE__RequestRefresh);
+		type->RequestClockUpdate = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_EVENT_NODE__RequestClockUpdate);
 	}
 }
 
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+#
+# Generates type-ids.h, the table of reserved ids for the types defined
+# in the spa headers.
+#
+# usage: gen-type-ids.py <output> <header>...
+#
+# Every SPA_TYPE*__Name define with a constant string value gets an id.
+# SPA_TYPE__TypeMap is always id 0, the other types follow in the order
+# of the headers (sorted by path) and of the defines in them. The last
+# id is a marker type with a checksum of the table, a map that has the
+# marker at its reserved id has the same table.
+
+import os
+import re
+import sys
+
+DEFINE = re.compile(r'^\s*#\s*define\s+(SPA_TYPE\w*)\s+(.*)$')
+TOKEN = re.compile(r'"(?:[^"\\]|\\.)*"|\w+|\S')
+
+
+def read_defines(path):
+    defines = []
+    with open(path) as f:
+        text = f.read().replace('\\\n', ' ')
+    for line in text.splitlines():
+        m = DEFINE.match(line)
+        if m:
+            value = re.sub(r'/\*.*?\*/|//.*$', '', m.group(2)).strip()
+            defines.append((m.group(1), value))
+    return defines
+
+
+def evaluate(name, values, exprs, stack=()):
+    if name in values:
+        return values[name]
+    if name not in exprs or name in stack:
+        return None
+    result = ''
+    for tok in TOKEN.findall(exprs[name]):
+        if tok.startswith('"'):
+            result += tok[1:-1]
+        elif re.match(r'^\w+$', tok):
+            value = evaluate(tok, values, exprs, stack + (name,))
+            if value is None:
+                return None
+            result += value
+        else:
+            return None
+    values[name] = result
+    return result
+
+
+def fnv1a(data):
+    h = 2166136261
+    for c in data.encode():
+        h = ((h ^ c) * 16777619) & 0xffffffff
+    return h
+
+
+def main():
+    output = sys.argv[1]
+    headers = sorted(sys.argv[2:], key=lambda p: p.split('/spa/')[-1])
+
+    exprs = {}
+    order = []
+    for h in headers:
+        for name, value in read_defines(h):
+            if name not in exprs:
+                exprs[name] = value
+                order.append(name)
+
+    values = {}
+    types = []
+    seen = {}
+    aliases = []
+    for name in ['SPA_TYPE__TypeMap'] + order:
+        if '__' not in name or name in seen:
+            continue
+        value = evaluate(name, values, exprs)
+        if value is None:
+            continue
+        seen[name] = value
+        first = next((n for n, v in types if v == value), None)
+        if first is not None:
+            aliases.append((name, first))
+        else:
+            types.append((name, value))
+
+    checksum = fnv1a('\n'.join(v for n, v in types))
+
+    with open(output, 'w') as f:
+        f.write('''/* Generated by gen-type-ids.py from the spa headers, do not edit. */
+
+#ifndef __SPA_TYPE_IDS_H__
+#define __SPA_TYPE_IDS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#include <spa/type-map.h>
+
+/** marker type, the last reserved id. A map that has this type at
+ * SPA_TYPE__TypeIds_ID has the ids of this table. The markers of other
+ * tables have the same base and another checksum */
+#define SPA_TYPE_TYPE_IDS_BASE		SPA_TYPE_BASE "TypeIds:"
+#define SPA_TYPE__TypeIds		SPA_TYPE_TYPE_IDS_BASE "%08x"
+
+/** reserved ids for the well-known types, the name is the define of the
+ * type with _ID appended */
+enum spa_type_id {
+''' % checksum)
+        for name, value in types:
+            f.write('\t%s_ID,\n' % name)
+        for name, first in aliases:
+            f.write('\t%s_ID = %s_ID,\n' % (name, first))
+        f.write('''\tSPA_TYPE__TypeIds_ID,
+	SPA_TYPE_ID_N_RESERVED
+};
+
+static const char * const spa_type_ids[] = {
+''')
+        for name, value in types:
+            f.write('\t"%s",\n' % value)
+        f.write('''\tSPA_TYPE__TypeIds,
+};
+
+/** check if \\a type is the marker of a table of reserved ids, this one
+ * or another one */
+static inline bool spa_type_is_ids_marker(const char *type)
+{
+	return strncmp(type, SPA_TYPE_TYPE_IDS_BASE, strlen(SPA_TYPE_TYPE_IDS_BASE)) == 0;
+}
+
+/** check if \\a map has the reserved ids */
+static inline bool spa_type_map_has_ids(const struct spa_type_map *map)
+{
+	const char *type = spa_type_map_get_type(map, SPA_TYPE__TypeIds_ID);
+	return type != NULL && strcmp(type, SPA_TYPE__TypeIds) == 0;
+}
+
+/** add the reserved types to a new \\a map, only SPA_TYPE__TypeMap can be
+ * mapped already */
+static inline int spa_type_map_add_ids(struct spa_type_map *map)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_TYPE_ID_N_RESERVED; i++) {
+		if (spa_type_map_get_id(map, spa_type_ids[i]) != i)
+			return SPA_RESULT_ERROR;
+	}
+	return SPA_RESULT_OK;
+}
+
+/** get the id of a well-known type, without a lookup when \\a ids is true
+ * because the map has the reserved ids */
+#define SPA_TYPE_MAP_ID(map,ids,name)	((ids) ? name##_ID : spa_type_map_get_id(map, name))
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_TYPE_IDS_H__ */
+''')
+
+
+if __name__ == '__main__':
+    main()
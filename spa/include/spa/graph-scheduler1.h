@@ -83,7 +83,7 @@ static inline bool spa_graph_data_iterate(struct spa_graph_data *data)
 
 		switch (n->state) {
 		case SPA_GRAPH_STATE_IN:
-			state = spa_node_process_input(n->implementation);
+			state = spa_graph_node_process_input(n);
 			if (state == SPA_RESULT_NEED_BUFFER)
 				n->state = SPA_GRAPH_STATE_CHECK_IN;
 			else if (state == SPA_RESULT_HAVE_BUFFER)
@@ -95,7 +95,7 @@ static inline bool spa_graph_data_iterate(struct spa_graph_data *data)
 			break;
 
 		case SPA_GRAPH_STATE_OUT:
-			state = spa_node_process_output(n->implementation);
+			state = spa_graph_node_process_output(n);
 			if (state == SPA_RESULT_NEED_BUFFER)
 				n->state = SPA_GRAPH_STATE_CHECK_IN;
 			else if (state == SPA_RESULT_HAVE_BUFFER)
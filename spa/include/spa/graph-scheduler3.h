@@ -26,6 +26,18 @@ extern "C" {
 
 #include <spa/graph.h>
 
+/* peers in another graph are never processed here, they get the port
+ * handed over with port_ready and run in their own thread */
+static inline void spa_graph_impl_output_remote(struct spa_graph_node *node)
+{
+	struct spa_graph_port *p;
+
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
+		if (spa_graph_port_is_remote(p) && p->io->status == SPA_RESULT_HAVE_BUFFER)
+			spa_graph_port_ready(p->peer->node->graph, p->peer);
+	}
+}
+
 static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *node)
 {
 	struct spa_graph_port *p;
@@ -44,7 +56,12 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 			continue;
 		pnode = pport->node;
 		debug("node %p peer %p io %d\n", node, pnode, pport->io->status);
-		if (pport->io->status == SPA_RESULT_NEED_BUFFER) {
+		if (pnode->graph != node->graph) {
+			/* the peer pushes the buffer to us when it has one */
+			if (pport->io->status == SPA_RESULT_NEED_BUFFER)
+				spa_graph_port_ready(pnode->graph, pport);
+		}
+		else if (pport->io->status == SPA_RESULT_NEED_BUFFER) {
 			if (pnode->ready_link.next == NULL)
 				spa_list_append(&ready, &pnode->ready_link);
 		}
@@ -53,7 +70,7 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 	}
 
 	spa_list_for_each_safe(n, t, &ready, ready_link) {
-		n->state = spa_node_process_output(n->implementation);
+		n->state = spa_graph_node_process_output(n);
 		debug("peer %p processed out %d\n", n, n->state);
 		if (n->state == SPA_RESULT_NEED_BUFFER)
 			spa_graph_need_input(n->graph, n);
@@ -70,14 +87,15 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 	debug("node %p ready_in:%d required_in:%d\n", node, node->ready_in, node->required_in);
 
 	if (node->required_in > 0 && node->ready_in == node->required_in) {
-		node->state = spa_node_process_input(node->implementation);
+		node->state = spa_graph_node_process_input(node);
 		debug("node %p processed in %d\n", node, node->state);
 		if (node->state == SPA_RESULT_HAVE_BUFFER) {
 			spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
 				if (p->io->status == SPA_RESULT_HAVE_BUFFER)
-					if (p->peer)
+					if (p->peer && !spa_graph_port_is_remote(p))
 				                p->peer->node->ready_in++;
 			}
+			spa_graph_impl_output_remote(node);
 		}
 	}
 	return SPA_RESULT_OK;
@@ -99,6 +117,11 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 		if ((pport = p->peer) == NULL)
 			continue;
 		pnode = pport->node;
+		if (pnode->graph != node->graph) {
+			if (pport->io->status == SPA_RESULT_HAVE_BUFFER)
+				spa_graph_port_ready(pnode->graph, pport);
+			continue;
+		}
 		if (pport->io->status == SPA_RESULT_HAVE_BUFFER)
 			pnode->ready_in++;
 
@@ -111,7 +134,7 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 	}
 
 	spa_list_for_each_safe(n, t, &ready, ready_link) {
-		n->state = spa_node_process_input(n->implementation);
+		n->state = spa_graph_node_process_input(n);
 		debug("node %p chain processed in %d\n", n, n->state);
 		if (n->state == SPA_RESULT_HAVE_BUFFER)
 			spa_graph_have_output(n->graph, n);
@@ -127,9 +150,11 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 		n->ready_link.next = NULL;
 	}
 
-	node->state = spa_node_process_output(node->implementation);
+	node->state = spa_graph_node_process_output(node);
 	debug("node %p processed out %d\n", node, node->state);
-	if (node->state == SPA_RESULT_NEED_BUFFER) {
+	if (node->state == SPA_RESULT_HAVE_BUFFER)
+		spa_graph_impl_output_remote(node);
+	else if (node->state == SPA_RESULT_NEED_BUFFER) {
 		node->ready_in = 0;
 		spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
 			if (p->io->status == SPA_RESULT_OK && !(node->flags & SPA_GRAPH_NODE_FLAG_ASYNC))
@@ -139,10 +164,53 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 	return SPA_RESULT_OK;
 }
 
+static inline int spa_graph_impl_port_ready(void *data, struct spa_graph_port *port)
+{
+	struct spa_graph_node *node = port->node;
+	struct spa_graph_port *p;
+
+	debug("node %p port %p ready %d\n", node, port, port->io->status);
+
+	/* unlinked while the port was queued */
+	if (port->peer == NULL)
+		return SPA_RESULT_OK;
+
+	if (port->direction == SPA_DIRECTION_INPUT) {
+		if (port->io->status != SPA_RESULT_HAVE_BUFFER)
+			return SPA_RESULT_OK;
+
+		node->ready_in++;
+		if (node->required_in == 0 || node->ready_in < node->required_in)
+			return SPA_RESULT_OK;
+
+		node->state = spa_graph_node_process_input(node);
+		debug("node %p remote processed in %d\n", node, node->state);
+		if (node->state == SPA_RESULT_HAVE_BUFFER)
+			spa_graph_have_output(node->graph, node);
+		else {
+			node->ready_in = 0;
+			spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
+				if (p->io->status == SPA_RESULT_OK &&
+				    !(node->flags & SPA_GRAPH_NODE_FLAG_ASYNC))
+					node->ready_in++;
+			}
+		}
+	} else {
+		node->state = spa_graph_node_process_output(node);
+		debug("node %p remote processed out %d\n", node, node->state);
+		if (node->state == SPA_RESULT_NEED_BUFFER)
+			spa_graph_need_input(node->graph, node);
+		else if (node->state == SPA_RESULT_HAVE_BUFFER)
+			spa_graph_impl_output_remote(node);
+	}
+	return SPA_RESULT_OK;
+}
+
 static const struct spa_graph_callbacks spa_graph_impl_default = {
 	SPA_VERSION_GRAPH_CALLBACKS,
 	.need_input = spa_graph_impl_need_input,
 	.have_output = spa_graph_impl_have_output,
+	.port_ready = spa_graph_impl_port_ready,
 };
 
 
@@ -25,10 +25,13 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <time.h>
 
 #include <spa/defs.h>
+#include <spa/histogram.h>
 #include <spa/list.h>
 #include <spa/node.h>
+#include <spa/probe.h>
 
 #if 0
 #define debug(...)	printf(__VA_ARGS__)
@@ -41,11 +44,17 @@ struct spa_graph_node;
 struct spa_graph_port;
 
 struct spa_graph_callbacks {
-#define SPA_VERSION_GRAPH_CALLBACKS	0
+#define SPA_VERSION_GRAPH_CALLBACKS	1
 	uint32_t version;
 
 	int (*need_input) (void *data, struct spa_graph_node *node);
 	int (*have_output) (void *data, struct spa_graph_node *node);
+
+	/** since version 1: \a port of a node in this graph was made ready by
+	 * its peer in another graph. This is called from the thread of the
+	 * other graph, the port should be processed in the thread of this
+	 * graph. An input port has a buffer, an output port needs one. */
+	int (*port_ready) (void *data, struct spa_graph_port *port);
 };
 
 struct spa_graph {
@@ -56,8 +65,15 @@ struct spa_graph {
 
 #define spa_graph_need_input(g,n)	((g)->callbacks->need_input((g)->callbacks_data, (n)))
 #define spa_graph_have_output(g,n)	((g)->callbacks->have_output((g)->callbacks_data, (n)))
+#define spa_graph_port_ready(g,p)	((g)->callbacks->port_ready((g)->callbacks_data, (p)))
 #define spa_graph_reuse_buffer(g,n,p,i)	((g)->callbacks->reuse_buffer((g)->callbacks_data, (n),(p),(i)))
 
+/** statistics of a node, written by the thread of the graph */
+struct spa_graph_node_stats {
+	struct spa_histogram process_time;	/**< time in process_input and
+						  *  process_output in nsec */
+};
+
 struct spa_graph_node {
 	struct spa_list link;		/**< link in graph nodes list */
 	struct spa_graph *graph;	/**< owner graph */
@@ -70,6 +86,8 @@ struct spa_graph_node {
 	int state;			/**< state of the node */
 	struct spa_node *implementation;/**< node implementation */
 	void *scheduler_data;		/**< scheduler private data */
+	struct spa_graph_node_stats *stats;	/**< statistics or NULL */
+	const char *name;		/**< name for the probes, not owned */
 };
 
 struct spa_graph_port {
@@ -104,6 +122,8 @@ spa_graph_node_init(struct spa_graph_node *node)
 	spa_list_init(&node->ports[SPA_DIRECTION_OUTPUT]);
 	node->flags = 0;
 	node->required_in = node->ready_in = 0;
+	node->stats = NULL;
+	node->name = "";
 	debug("node %p init\n", node);
 }
 
@@ -150,6 +170,66 @@ spa_graph_port_add(struct spa_graph_node *node,
 		node->required_in++;
 }
 
+static inline uint64_t spa_graph_node_stats_start(struct spa_graph_node *node)
+{
+	struct timespec ts;
+
+	if (node->stats == NULL)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static inline void spa_graph_node_stats_end(struct spa_graph_node *node, uint64_t start)
+{
+	struct timespec ts;
+
+	if (node->stats == NULL)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	spa_histogram_add(&node->stats->process_time, SPA_TIMESPEC_TO_TIME(&ts) - start);
+}
+
+/** process the input of \a node, the spa:process_input_start and
+ * spa:process_input_end probes have the node and its name as arguments,
+ * the end probe also has the result.
+ * The time is added to the stats of the node when it has them. */
+static inline int spa_graph_node_process_input(struct spa_graph_node *node)
+{
+	uint64_t start;
+	int res;
+
+	spa_probe2(spa, process_input_start, node, node->name);
+	start = spa_graph_node_stats_start(node);
+	res = spa_node_process_input(node->implementation);
+	spa_graph_node_stats_end(node, start);
+	spa_probe3(spa, process_input_end, node, node->name, res);
+
+	return res;
+}
+
+/** process the output of \a node, with the spa:process_output_start and
+ * spa:process_output_end probes and the stats */
+static inline int spa_graph_node_process_output(struct spa_graph_node *node)
+{
+	uint64_t start;
+	int res;
+
+	spa_probe2(spa, process_output_start, node, node->name);
+	start = spa_graph_node_stats_start(node);
+	res = spa_node_process_output(node->implementation);
+	spa_graph_node_stats_end(node, start);
+	spa_probe3(spa, process_output_end, node, node->name, res);
+
+	return res;
+}
+
+/** check if the peer of \a port is in another graph */
+static inline bool spa_graph_port_is_remote(struct spa_graph_port *port)
+{
+	return port->peer && port->peer->node->graph != port->node->graph;
+}
+
 static inline void spa_graph_node_remove(struct spa_graph_node *node)
 {
 	debug("node %p remove\n", node);
@@ -0,0 +1,133 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_HISTOGRAM_H__
+#define __SPA_HISTOGRAM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <spa/defs.h>
+
+#define SPA_HISTOGRAM_BUCKETS	32
+
+/**
+ * spa_histogram:
+ * @count: number of values
+ * @total: sum of all values
+ * @max: the largest value
+ * @buckets: bucket 0 counts the values below 2, bucket n the values
+ *           in [2^n, 2^(n+1)) and the last bucket everything above
+ *
+ * A histogram of nanosecond values with power of 2 buckets. There can be
+ * one thread that adds values, other threads can read it at any time
+ * without locking. A reader can see a value in @count before it is in
+ * @buckets, it should not expect the fields to agree exactly.
+ */
+struct spa_histogram {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	uint64_t buckets[SPA_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * spa_histogram_bucket:
+ * @value: a value
+ *
+ * Returns: the bucket of @value
+ */
+static inline uint32_t spa_histogram_bucket(uint64_t value)
+{
+	uint32_t bucket = value < 2 ? 0 : 63 - __builtin_clzll(value);
+	return SPA_MIN(bucket, SPA_HISTOGRAM_BUCKETS - 1);
+}
+
+/**
+ * spa_histogram_add:
+ * @hist: a #struct spa_histogram
+ * @value: the value to add
+ *
+ * Add @value to @hist. Only one thread can add values.
+ */
+static inline void spa_histogram_add(struct spa_histogram *hist, uint64_t value)
+{
+	uint64_t *bucket = &hist->buckets[spa_histogram_bucket(value)];
+
+	__atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&hist->total, hist->total + value, __ATOMIC_RELAXED);
+	if (value > hist->max)
+		__atomic_store_n(&hist->max, value, __ATOMIC_RELAXED);
+	__atomic_store_n(&hist->count, hist->count + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * spa_histogram_read:
+ * @hist: a #struct spa_histogram
+ * @copy: result
+ *
+ * Make a copy of @hist that can be used with the other functions while
+ * the writer keeps on adding values to @hist.
+ */
+static inline void spa_histogram_read(const struct spa_histogram *hist,
+				      struct spa_histogram *copy)
+{
+	uint32_t i;
+
+	copy->count = 0;
+	for (i = 0; i < SPA_HISTOGRAM_BUCKETS; i++) {
+		copy->buckets[i] = __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+		copy->count += copy->buckets[i];
+	}
+	copy->total = __atomic_load_n(&hist->total, __ATOMIC_RELAXED);
+	copy->max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+}
+
+/**
+ * spa_histogram_percentile:
+ * @hist: a #struct spa_histogram
+ * @percentile: the percentile, between 0 and 100
+ *
+ * Returns: an upper bound of the @percentile value, the end of the bucket
+ * that contains it. The result is never larger than the maximum value.
+ */
+static inline uint64_t spa_histogram_percentile(const struct spa_histogram *hist,
+						uint32_t percentile)
+{
+	uint64_t target, sum = 0;
+	uint32_t i;
+
+	if (hist->count == 0)
+		return 0;
+
+	target = (hist->count * SPA_MIN(percentile, 100) + 99) / 100;
+	for (i = 0; i < SPA_HISTOGRAM_BUCKETS - 1; i++) {
+		sum += hist->buckets[i];
+		if (sum >= target && sum > 0)
+			return SPA_MIN((2ULL << i) - 1, hist->max);
+	}
+	return hist->max;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_HISTOGRAM_H__ */
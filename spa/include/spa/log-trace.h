@@ -0,0 +1,264 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_LOG_TRACE_H__
+#define __SPA_LOG_TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#include <spa/defs.h>
+#include <spa/ringbuffer.h>
+
+/* Layout of the binary trace in shared memory
+ *
+ * When the logger is configured with a trace shm name, trace messages are
+ * not formatted. The logger records the call site once in the catalog and
+ * then writes only the catalog offset, a timestamp and the raw arguments
+ * into a ring that belongs to the calling thread. spa-trace reads the
+ * rings, live or after the process exited, and formats the messages.
+ *
+ * The memory contains the header, the catalog, the ring headers and the
+ * data of the rings, in that order.
+ */
+
+#define SPA_LOG_TRACE_MAGIC		0x52545053	/* "SPTR" */
+#define SPA_LOG_TRACE_VERSION		1
+
+#define SPA_LOG_TRACE_MAX_ARGS		16	/**< more arguments are formatted as text */
+#define SPA_LOG_TRACE_MAX_STRING	96	/**< string arguments are truncated */
+#define SPA_LOG_TRACE_MAX_TEXT		512	/**< size of a formatted message */
+#define SPA_LOG_TRACE_MAX_RECORD	2048
+
+/** the type of an argument, which is recorded as 8 bytes */
+enum spa_log_trace_arg {
+	SPA_LOG_TRACE_ARG_INT,		/**< int and everything promoted to it */
+	SPA_LOG_TRACE_ARG_LONG,
+	SPA_LOG_TRACE_ARG_LONG_LONG,
+	SPA_LOG_TRACE_ARG_SIZE,		/**< size_t */
+	SPA_LOG_TRACE_ARG_INTMAX,	/**< intmax_t */
+	SPA_LOG_TRACE_ARG_PTRDIFF,	/**< ptrdiff_t */
+	SPA_LOG_TRACE_ARG_DOUBLE,
+	SPA_LOG_TRACE_ARG_POINTER,
+	SPA_LOG_TRACE_ARG_STRING,	/**< 8 bytes length, the bytes, padded to 8 */
+};
+
+/** n_args of a point with a format that can't be recorded, its records
+ * contain the formatted message as one string argument */
+#define SPA_LOG_TRACE_TEXT		((uint32_t)-1)
+
+/**
+ * spa_log_trace_header:
+ * @magic: SPA_LOG_TRACE_MAGIC
+ * @version: SPA_LOG_TRACE_VERSION
+ * @n_rings: the number of rings
+ * @ring_size: the size of the data of a ring, a power of 2
+ * @catalog_size: the size of the catalog
+ * @catalog_used: the bytes in use in the catalog
+ * @lost: records that were dropped because there was no free ring or
+ *        no space in the catalog
+ */
+struct spa_log_trace_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t n_rings;
+	uint32_t ring_size;
+	uint32_t catalog_size;
+	uint32_t catalog_used;
+	uint32_t lost;
+	uint32_t padding[9];
+};
+
+/**
+ * spa_log_trace_point:
+ * @size: the size of the point with its strings
+ * @line: the line number
+ * @level: the log level
+ * @n_args: the number of arguments or SPA_LOG_TRACE_TEXT
+ * @args: the #enum spa_log_trace_arg of the arguments
+ *
+ * A call site in the catalog, followed by the file name, the function
+ * and the format, each 0 terminated. A point is never removed.
+ */
+struct spa_log_trace_point {
+	uint32_t size;
+	int32_t line;
+	uint32_t level;
+	uint32_t n_args;
+	uint8_t args[SPA_LOG_TRACE_MAX_ARGS];
+};
+
+/**
+ * spa_log_trace_ring:
+ * @rb: the ringbuffer of the records
+ * @tid: the thread writing to the ring, 0 when the ring is free
+ * @lost: records that were dropped because the ring was full
+ *
+ * A ring has one writer and one reader. The writer does not overwrite
+ * records that were not read.
+ */
+struct spa_log_trace_ring {
+	struct spa_ringbuffer rb;
+	uint32_t tid;
+	uint32_t lost;
+	uint32_t padding[10];
+};
+
+/**
+ * spa_log_trace_record:
+ * @size: the size of the record with the arguments, a multiple of 8
+ * @point: the offset of the point in the catalog or
+ *         SPA_LOG_TRACE_POINT_THREAD
+ * @time: CLOCK_MONOTONIC time in nanoseconds
+ *
+ * A record in a ring, followed by the arguments
+ */
+struct spa_log_trace_record {
+	uint32_t size;
+	uint32_t point;
+	uint64_t time;
+};
+
+/** the point of the first record after a thread took a ring, its argument
+ * is the thread id that is used for the following records */
+#define SPA_LOG_TRACE_POINT_THREAD	SPA_ID_INVALID
+
+#define SPA_LOG_TRACE_CATALOG_OFFSET	sizeof(struct spa_log_trace_header)
+
+#define spa_log_trace_size(n_rings,ring_size,catalog_size)			\
+	(SPA_LOG_TRACE_CATALOG_OFFSET + (size_t)(catalog_size) +		\
+	 (size_t)(n_rings) * (sizeof(struct spa_log_trace_ring) + (ring_size)))
+
+#define spa_log_trace_get_point(h,offset)					\
+	SPA_MEMBER(h, SPA_LOG_TRACE_CATALOG_OFFSET + (offset), struct spa_log_trace_point)
+
+#define spa_log_trace_get_ring(h,i)						\
+	SPA_MEMBER(h, SPA_LOG_TRACE_CATALOG_OFFSET + (h)->catalog_size +	\
+		   (size_t)(i) * sizeof(struct spa_log_trace_ring), struct spa_log_trace_ring)
+
+#define spa_log_trace_get_ring_data(h,i)					\
+	SPA_MEMBER(h, spa_log_trace_size((h)->n_rings, 0, (h)->catalog_size) +	\
+		   (size_t)(i) * (h)->ring_size, void)
+
+/**
+ * spa_log_trace_parse_spec:
+ * @p: a conversion in a printf format, after the '%'
+ * @args: array to append the argument types to
+ * @n_args: the number of types in @args, updated
+ * @max_args: the size of @args
+ *
+ * Parse a conversion and append the types of the arguments it consumes,
+ * a '*' width or precision adds an int before the value.
+ *
+ * Returns: a pointer after the conversion or %NULL when the conversion
+ *          can't be recorded
+ */
+static inline const char *
+spa_log_trace_parse_spec(const char *p, uint8_t *args, uint32_t *n_args, uint32_t max_args)
+{
+	enum spa_log_trace_arg type = SPA_LOG_TRACE_ARG_INT;
+
+#define ADD_ARG(t)	if (*n_args >= max_args) return NULL; args[(*n_args)++] = (t);
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		ADD_ARG(SPA_LOG_TRACE_ARG_INT);
+		p++;
+	}
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			ADD_ARG(SPA_LOG_TRACE_ARG_INT);
+			p++;
+		}
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+
+	switch (*p) {
+	case 'h':
+		p += p[1] == 'h' ? 2 : 1;
+		break;
+	case 'l':
+		if (p[1] == 'l') {
+			type = SPA_LOG_TRACE_ARG_LONG_LONG;
+			p += 2;
+		} else {
+			type = SPA_LOG_TRACE_ARG_LONG;
+			p++;
+		}
+		break;
+	case 'q':
+		type = SPA_LOG_TRACE_ARG_LONG_LONG;
+		p++;
+		break;
+	case 'z':
+		type = SPA_LOG_TRACE_ARG_SIZE;
+		p++;
+		break;
+	case 'j':
+		type = SPA_LOG_TRACE_ARG_INTMAX;
+		p++;
+		break;
+	case 't':
+		type = SPA_LOG_TRACE_ARG_PTRDIFF;
+		p++;
+		break;
+	}
+
+	switch (*p) {
+	case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+		break;
+	case 'c':
+		if (type != SPA_LOG_TRACE_ARG_INT)
+			return NULL;
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		if (type != SPA_LOG_TRACE_ARG_INT && type != SPA_LOG_TRACE_ARG_LONG)
+			return NULL;
+		type = SPA_LOG_TRACE_ARG_DOUBLE;
+		break;
+	case 'p':
+		type = SPA_LOG_TRACE_ARG_POINTER;
+		break;
+	case 's':
+		if (type != SPA_LOG_TRACE_ARG_INT)
+			return NULL;
+		type = SPA_LOG_TRACE_ARG_STRING;
+		break;
+	default:
+		/* %n, %m, long doubles and wide characters */
+		return NULL;
+	}
+	ADD_ARG(type);
+#undef ADD_ARG
+
+	return p + 1;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_LOG_TRACE_H__ */
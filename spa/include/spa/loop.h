@@ -39,6 +39,7 @@ struct spa_loop_utils;
 #include <spa/defs.h>
 #include <spa/list.h>
 #include <spa/hook.h>
+#include <spa/histogram.h>
 
 enum spa_io {
 	SPA_IO_IN = (1 << 0),
@@ -58,6 +59,10 @@ struct spa_source {
 	int fd;
 	enum spa_io mask;
 	enum spa_io rmask;
+	/** when not 0, the CLOCK_MONOTONIC time in nsec at which the source
+	 *  expects to be dispatched, such as the expiry of its timerfd. The
+	 *  loop measures the wakeup latency against it and clears it. */
+	uint64_t deadline;
 };
 
 typedef int (*spa_invoke_func_t) (struct spa_loop *loop,
@@ -114,6 +119,15 @@ struct spa_loop_control_hooks {
 	void (*after) (void *data);
 };
 
+/** Statistics of a loop. The loop thread updates them, any thread can
+ * read them without locking, see spa_histogram_read(). */
+struct spa_loop_stats {
+	uint64_t iterations;			/**< number of iterations */
+	struct spa_histogram wakeup_latency;	/**< dispatch time minus the deadline
+						  *  of timers and sources */
+	struct spa_histogram dispatch_time;	/**< time spent in source callbacks */
+};
+
 /**
  * spa_loop_control:
  *
@@ -122,7 +136,7 @@ struct spa_loop_control_hooks {
 struct spa_loop_control {
 	/* the version of this structure. This can be used to expand this
 	 * structure in the future */
-#define SPA_VERSION_LOOP_CONTROL	0
+#define SPA_VERSION_LOOP_CONTROL	1
 	uint32_t version;
 
 	int (*get_fd) (struct spa_loop_control *ctrl);
@@ -139,6 +153,9 @@ struct spa_loop_control {
 	void (*leave) (struct spa_loop_control *ctrl);
 
 	int (*iterate) (struct spa_loop_control *ctrl, int timeout);
+
+	/** Get the statistics of the loop, since version 1 */
+	const struct spa_loop_stats *(*get_stats) (struct spa_loop_control *ctrl);
 };
 
 #define spa_loop_control_get_fd(l)		(l)->get_fd(l)
@@ -146,6 +163,7 @@ struct spa_loop_control {
 #define spa_loop_control_enter(l)		(l)->enter(l)
 #define spa_loop_control_iterate(l,...)		(l)->iterate((l),__VA_ARGS__)
 #define spa_loop_control_leave(l)		(l)->leave(l)
+#define spa_loop_control_get_stats(l)		(l)->get_stats(l)
 
 
 typedef void (*spa_source_io_func_t) (void *data, int fd, enum spa_io mask);
@@ -184,6 +202,8 @@ struct spa_loop_utils {
 
 	struct spa_source *(*add_timer) (struct spa_loop_utils *utils,
 					 spa_source_timer_func_t func, void *data);
+	/** arm or disarm a timer. Unlike the other functions this can
+	 * also be called from another thread while the loop is running */
 	int (*update_timer) (struct spa_source *source,
 			     struct timespec *value,
 			     struct timespec *interval,
@@ -27,6 +27,7 @@ extern "C" {
 #include <spa/defs.h>
 #include <spa/ringbuffer.h>
 #include <spa/type-map.h>
+#include <spa/type-ids.h>
 
 /** \page page_meta Metadata
  *
@@ -52,11 +53,13 @@ struct spa_type_meta {
 static inline void spa_type_meta_map(struct spa_type_map *map, struct spa_type_meta *type)
 {
 	if (type->Header == 0) {
-		type->Header = spa_type_map_get_id(map, SPA_TYPE_META__Header);
-		type->Pointer = spa_type_map_get_id(map, SPA_TYPE_META__Pointer);
-		type->VideoCrop = spa_type_map_get_id(map, SPA_TYPE_META__VideoCrop);
-		type->Ringbuffer = spa_type_map_get_id(map, SPA_TYPE_META__Ringbuffer);
-		type->Shared = spa_type_map_get_id(map, SPA_TYPE_META__Shared);
+		bool ids = spa_type_map_has_ids(map);
+
+		type->Header = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_META__Header);
+		type->Pointer = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_META__Pointer);
+		type->VideoCrop = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_META__VideoCrop);
+		type->Ringbuffer = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_META__Ringbuffer);
+		type->Shared = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_META__Shared);
 	}
 }
 
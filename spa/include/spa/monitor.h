@@ -31,6 +31,7 @@ struct spa_monitor;
 #include <spa/defs.h>
 #include <spa/dict.h>
 #include <spa/event.h>
+#include <spa/type-ids.h>
 
 #define SPA_TYPE_EVENT__Monitor		SPA_TYPE_EVENT_BASE "Monitor"
 #define SPA_TYPE_EVENT_MONITOR_BASE	SPA_TYPE_EVENT__Monitor ":"
@@ -73,18 +74,20 @@ struct spa_type_monitor {
 static inline void spa_type_monitor_map(struct spa_type_map *map, struct spa_type_monitor *type)
 {
 	if (type->Monitor == 0) {
-		type->Monitor = spa_type_map_get_id(map, SPA_TYPE__Monitor);
-		type->Added = spa_type_map_get_id(map, SPA_TYPE_EVENT_MONITOR__Added);
-		type->Removed = spa_type_map_get_id(map, SPA_TYPE_EVENT_MONITOR__Removed);
-		type->Changed = spa_type_map_get_id(map, SPA_TYPE_EVENT_MONITOR__Changed);
-		type->MonitorItem = spa_type_map_get_id(map, SPA_TYPE__MonitorItem);
-		type->id = spa_type_map_get_id(map, SPA_TYPE_MONITOR_ITEM__id);
-		type->flags = spa_type_map_get_id(map, SPA_TYPE_MONITOR_ITEM__flags);
-		type->state = spa_type_map_get_id(map, SPA_TYPE_MONITOR_ITEM__state);
-		type->name = spa_type_map_get_id(map, SPA_TYPE_MONITOR_ITEM__name);
-		type->klass = spa_type_map_get_id(map, SPA_TYPE_MONITOR_ITEM__class);
-		type->info = spa_type_map_get_id(map, SPA_TYPE_MONITOR_ITEM__info);
-		type->factory = spa_type_map_get_id(map, SPA_TYPE_MONITOR_ITEM__factory);
+		bool ids = spa_type_map_has_ids(map);
+
+		type->Monitor = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Monitor);
+		type->Added = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_EVENT_MONITOR__Added);
+		type->Removed = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_EVENT_MONITOR__Removed);
+		type->Changed = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_EVENT_MONITOR__Changed);
+		type->MonitorItem = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__MonitorItem);
+		type->id = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_MONITOR_ITEM__id);
+		type->flags = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_MONITOR_ITEM__flags);
+		type->state = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_MONITOR_ITEM__state);
+		type->name = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_MONITOR_ITEM__name);
+		type->klass = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_MONITOR_ITEM__class);
+		type->info = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_MONITOR_ITEM__info);
+		type->factory = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_MONITOR_ITEM__factory);
 	}
 }
 
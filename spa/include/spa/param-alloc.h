@@ -27,6 +27,7 @@ extern "C" {
 #include <spa/defs.h>
 #include <spa/param.h>
 #include <spa/type-map.h>
+#include <spa/type-ids.h>
 
 #define SPA_TYPE__ParamAlloc			SPA_TYPE_PARAM_BASE "Alloc"
 #define SPA_TYPE_PARAM_ALLOC_BASE		SPA_TYPE__ParamAlloc ":"
@@ -38,6 +39,7 @@ extern "C" {
 #define SPA_TYPE_PARAM_ALLOC_BUFFERS__stride	SPA_TYPE_PARAM_ALLOC_BUFFERS_BASE "stride"
 #define SPA_TYPE_PARAM_ALLOC_BUFFERS__buffers	SPA_TYPE_PARAM_ALLOC_BUFFERS_BASE "buffers"
 #define SPA_TYPE_PARAM_ALLOC_BUFFERS__align	SPA_TYPE_PARAM_ALLOC_BUFFERS_BASE "align"
+#define SPA_TYPE_PARAM_ALLOC_BUFFERS__hugepages	SPA_TYPE_PARAM_ALLOC_BUFFERS_BASE "hugepages"
 
 struct spa_type_param_alloc_buffers {
 	uint32_t Buffers;
@@ -45,6 +47,7 @@ struct spa_type_param_alloc_buffers {
 	uint32_t stride;
 	uint32_t buffers;
 	uint32_t align;
+	uint32_t hugepages;
 };
 
 static inline void
@@ -52,11 +55,14 @@ spa_type_param_alloc_buffers_map(struct spa_type_map *map,
 				 struct spa_type_param_alloc_buffers *type)
 {
 	if (type->Buffers == 0) {
-		type->Buffers = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC__Buffers);
-		type->size = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_BUFFERS__size);
-		type->stride = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_BUFFERS__stride);
-		type->buffers = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_BUFFERS__buffers);
-		type->align = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_BUFFERS__align);
+		bool ids = spa_type_map_has_ids(map);
+
+		type->Buffers = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC__Buffers);
+		type->size = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_BUFFERS__size);
+		type->stride = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_BUFFERS__stride);
+		type->buffers = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_BUFFERS__buffers);
+		type->align = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_BUFFERS__align);
+		type->hugepages = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_BUFFERS__hugepages);
 	}
 }
 
@@ -85,13 +91,15 @@ spa_type_param_alloc_meta_enable_map(struct spa_type_map *map,
 				     struct spa_type_param_alloc_meta_enable *type)
 {
 	if (type->MetaEnable == 0) {
-		type->MetaEnable = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC__MetaEnable);
-		type->type = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_META_ENABLE__type);
-		type->size = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_META_ENABLE__size);
-		type->ringbufferSize = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_META_ENABLE__ringbufferSize);
-		type->ringbufferStride = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_META_ENABLE__ringbufferStride);
-		type->ringbufferBlocks = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_META_ENABLE__ringbufferBlocks);
-		type->ringbufferAlign = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_META_ENABLE__ringbufferAlign);
+		bool ids = spa_type_map_has_ids(map);
+
+		type->MetaEnable = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC__MetaEnable);
+		type->type = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_META_ENABLE__type);
+		type->size = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_META_ENABLE__size);
+		type->ringbufferSize = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_META_ENABLE__ringbufferSize);
+		type->ringbufferStride = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_META_ENABLE__ringbufferStride);
+		type->ringbufferBlocks = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_META_ENABLE__ringbufferBlocks);
+		type->ringbufferAlign = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_META_ENABLE__ringbufferAlign);
 	}
 }
 
@@ -121,15 +129,17 @@ spa_type_param_alloc_video_padding_map(struct spa_type_map *map,
 				       struct spa_type_param_alloc_video_padding *type)
 {
 	if (type->VideoPadding == 0) {
-		type->VideoPadding = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC__VideoPadding);
-		type->top = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__top);
-		type->bottom = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__bottom);
-		type->left = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__left);
-		type->right = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__right);
-		type->strideAlign[0] = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__strideAlign0);
-		type->strideAlign[1] = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__strideAlign1);
-		type->strideAlign[2] = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__strideAlign2);
-		type->strideAlign[3] = spa_type_map_get_id(map, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__strideAlign3);
+		bool ids = spa_type_map_has_ids(map);
+
+		type->VideoPadding = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC__VideoPadding);
+		type->top = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__top);
+		type->bottom = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__bottom);
+		type->left = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__left);
+		type->right = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__right);
+		type->strideAlign[0] = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__strideAlign0);
+		type->strideAlign[1] = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__strideAlign1);
+		type->strideAlign[2] = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__strideAlign2);
+		type->strideAlign[3] = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PARAM_ALLOC_VIDEO_PADDING__strideAlign3);
 	}
 }
 
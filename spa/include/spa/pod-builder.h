@@ -46,6 +46,10 @@ struct spa_pod_builder {
 
 #define SPA_POD_BUILDER_INIT(buffer,size)  { buffer, size, }
 
+/** a builder without memory, it only measures the size of the pods in
+ * its offset, which can then be used to size the buffer of the real builder */
+#define SPA_POD_BUILDER_INIT_MEASURE  { NULL, 0, }
+
 #define SPA_POD_BUILDER_DEREF(b,ref,type)    SPA_MEMBER((b)->data, (ref), type)
 
 static inline void spa_pod_builder_init(struct spa_pod_builder *builder, void *data, uint32_t size)
@@ -56,6 +60,13 @@ static inline void spa_pod_builder_init(struct spa_pod_builder *builder, void *d
 	builder->stack = NULL;
 }
 
+/** check if the pods did not fit in the buffer of \a builder and were
+ * truncated. The offset of the builder contains the size that was needed. */
+static inline bool spa_pod_builder_overflow(const struct spa_pod_builder *builder)
+{
+	return builder->offset > builder->size;
+}
+
 static inline uint32_t
 spa_pod_builder_push(struct spa_pod_builder *builder,
 		     struct spa_pod_frame *frame,
@@ -0,0 +1,276 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_POD_SCHEMA_H__
+#define __SPA_POD_SCHEMA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <spa/defs.h>
+#include <spa/pod-iter.h>
+#include <spa/pod-builder.h>
+
+/** A field of a schema, the pod type and the offset of the member in
+ * the C structure that holds the value.
+ *
+ * BOOL, ID and INT are stored in a 32 bit integer, LONG in a 64 bit
+ * integer, FLOAT and DOUBLE in a float and double, STRING in a
+ * const char pointer, RECTANGLE and FRACTION in a struct spa_rectangle and
+ * struct spa_fraction. ARRAY, STRUCT, OBJECT, PROP and POD are stored as a
+ * pointer to the pod. The negative container types also accept a NONE pod,
+ * which is stored as NULL. */
+struct spa_pod_schema_field {
+	int32_t type;		/**< the pod type */
+	uint32_t offset;	/**< offset of the member in the structure */
+};
+
+/** The layout of a struct pod and of the C structure it is parsed into */
+struct spa_pod_schema {
+	uint32_t n_fields;
+	const struct spa_pod_schema_field *fields;
+};
+
+/** make a field for \a member of \a st with \a type, the member must have
+ * \a size or compilation fails */
+#define SPA_POD_SCHEMA_FIELD(type,st,member,size)					\
+	{ type, offsetof(st, member) +							\
+		0 * sizeof(char[sizeof(((st *) 0)->member) == (size) ? 1 : -1]) }
+
+#define SPA_POD_SCHEMA_BOOL(st,m)	SPA_POD_SCHEMA_FIELD(SPA_POD_TYPE_BOOL, st, m, sizeof(int32_t))
+#define SPA_POD_SCHEMA_ID(st,m)		SPA_POD_SCHEMA_FIELD(SPA_POD_TYPE_ID, st, m, sizeof(uint32_t))
+#define SPA_POD_SCHEMA_INT(st,m)	SPA_POD_SCHEMA_FIELD(SPA_POD_TYPE_INT, st, m, sizeof(int32_t))
+#define SPA_POD_SCHEMA_LONG(st,m)	SPA_POD_SCHEMA_FIELD(SPA_POD_TYPE_LONG, st, m, sizeof(int64_t))
+#define SPA_POD_SCHEMA_FLOAT(st,m)	SPA_POD_SCHEMA_FIELD(SPA_POD_TYPE_FLOAT, st, m, sizeof(float))
+#define SPA_POD_SCHEMA_DOUBLE(st,m)	SPA_POD_SCHEMA_FIELD(SPA_POD_TYPE_DOUBLE, st, m, sizeof(double))
+#define SPA_POD_SCHEMA_STRING(st,m)	SPA_POD_SCHEMA_FIELD(SPA_POD_TYPE_STRING, st, m, sizeof(char *))
+#define SPA_POD_SCHEMA_RECTANGLE(st,m)	SPA_POD_SCHEMA_FIELD(SPA_POD_TYPE_RECTANGLE, st, m, \
+							     sizeof(struct spa_rectangle))
+#define SPA_POD_SCHEMA_FRACTION(st,m)	SPA_POD_SCHEMA_FIELD(SPA_POD_TYPE_FRACTION, st, m, \
+							     sizeof(struct spa_fraction))
+/** a pod pointer, \a type is one of the container types or POD */
+#define SPA_POD_SCHEMA_POD(type,st,m)	SPA_POD_SCHEMA_FIELD(type, st, m, sizeof(void *))
+
+/** define a static schema \a name with the given fields */
+#define SPA_POD_SCHEMA_DEFINE(name,...)							\
+	static const struct spa_pod_schema_field name##_fields[] = { __VA_ARGS__ };	\
+	static const struct spa_pod_schema name = { SPA_N_ELEMENTS(name##_fields), name##_fields }
+
+/**
+ * Parse the fields of \a schema from the current position of \a iter into
+ * \a dest. All fields are checked against the remaining size of the iterator,
+ * strings must be 0 terminated and values must have the size of their type.
+ * On success the iterator is positioned after the last field, extra fields
+ * in the pod are not an error.
+ *
+ * \return true on success, false when the pod does not match the schema
+ */
+static inline bool
+spa_pod_schema_parse_iter(struct spa_pod_iter *iter, const struct spa_pod_schema *schema,
+			  void *dest)
+{
+	uint32_t i, offset = iter->offset;
+
+	for (i = 0; i < schema->n_fields; i++) {
+		const struct spa_pod_schema_field *f = &schema->fields[i];
+		const struct spa_pod *pod;
+		void *d = SPA_MEMBER(dest, f->offset, void);
+		uint32_t body_size;
+		int32_t type;
+
+		if (offset > iter->size || iter->size - offset < sizeof(struct spa_pod))
+			return false;
+
+		pod = SPA_MEMBER(iter->data, offset, const struct spa_pod);
+		body_size = pod->size;
+		if (body_size > iter->size - offset - sizeof(struct spa_pod))
+			return false;
+
+		type = f->type;
+		if (type < 0) {
+			if (pod->type == SPA_POD_TYPE_NONE) {
+				*(const struct spa_pod **) d = NULL;
+				goto next;
+			}
+			type = -type;
+		}
+		if ((int32_t) pod->type != type && type != SPA_POD_TYPE_POD)
+			return false;
+
+		switch (type) {
+		case SPA_POD_TYPE_BOOL:
+		case SPA_POD_TYPE_ID:
+		case SPA_POD_TYPE_INT:
+			if (body_size < sizeof(int32_t))
+				return false;
+			*(int32_t *) d = SPA_POD_VALUE(struct spa_pod_int, pod);
+			break;
+		case SPA_POD_TYPE_LONG:
+			if (body_size < sizeof(int64_t))
+				return false;
+			*(int64_t *) d = SPA_POD_VALUE(struct spa_pod_long, pod);
+			break;
+		case SPA_POD_TYPE_FLOAT:
+			if (body_size < sizeof(float))
+				return false;
+			*(float *) d = SPA_POD_VALUE(struct spa_pod_float, pod);
+			break;
+		case SPA_POD_TYPE_DOUBLE:
+			if (body_size < sizeof(double))
+				return false;
+			*(double *) d = SPA_POD_VALUE(struct spa_pod_double, pod);
+			break;
+		case SPA_POD_TYPE_STRING:
+		{
+			const char *s = SPA_POD_CONTENTS(struct spa_pod_string, pod);
+			if (body_size < 1 || s[body_size - 1] != '\0')
+				return false;
+			*(const char **) d = s;
+			break;
+		}
+		case SPA_POD_TYPE_RECTANGLE:
+			if (body_size < sizeof(struct spa_rectangle))
+				return false;
+			*(struct spa_rectangle *) d = SPA_POD_VALUE(struct spa_pod_rectangle, pod);
+			break;
+		case SPA_POD_TYPE_FRACTION:
+			if (body_size < sizeof(struct spa_fraction))
+				return false;
+			*(struct spa_fraction *) d = SPA_POD_VALUE(struct spa_pod_fraction, pod);
+			break;
+		case SPA_POD_TYPE_OBJECT:
+			if (body_size < sizeof(struct spa_pod_object_body))
+				return false;
+			/* fallthrough */
+		case SPA_POD_TYPE_ARRAY:
+		case SPA_POD_TYPE_STRUCT:
+		case SPA_POD_TYPE_PROP:
+		case SPA_POD_TYPE_POD:
+			*(const struct spa_pod **) d = pod;
+			break;
+		default:
+			return false;
+		}
+	      next:
+		offset += SPA_ROUND_UP_N(body_size + sizeof(struct spa_pod), 8);
+	}
+	iter->offset = offset;
+	return true;
+}
+
+/**
+ * Parse the struct pod in \a data of \a size into \a dest
+ *
+ * \return true on success, false when \a data is not a struct pod or does
+ *	not match the schema
+ */
+static inline bool
+spa_pod_schema_parse(const struct spa_pod_schema *schema, const void *data, uint32_t size,
+		     void *dest)
+{
+	struct spa_pod_iter it;
+
+	return spa_pod_iter_struct(&it, data, size) &&
+	       spa_pod_schema_parse_iter(&it, schema, dest);
+}
+
+/**
+ * Add the fields of \a schema with the values in \a src to \a builder. A NULL
+ * string is added as an empty string and a NULL pod as a NONE pod.
+ */
+static inline void
+spa_pod_schema_add(struct spa_pod_builder *builder, const struct spa_pod_schema *schema,
+		   const void *src)
+{
+	static const struct spa_pod none = { 0, SPA_POD_TYPE_NONE };
+	uint32_t i;
+
+	for (i = 0; i < schema->n_fields; i++) {
+		const struct spa_pod_schema_field *f = &schema->fields[i];
+		const void *s = SPA_MEMBER(src, f->offset, const void);
+
+		switch (f->type) {
+		case SPA_POD_TYPE_BOOL:
+			spa_pod_builder_bool(builder, *(const int32_t *) s);
+			break;
+		case SPA_POD_TYPE_ID:
+			spa_pod_builder_id(builder, *(const uint32_t *) s);
+			break;
+		case SPA_POD_TYPE_INT:
+			spa_pod_builder_int(builder, *(const int32_t *) s);
+			break;
+		case SPA_POD_TYPE_LONG:
+			spa_pod_builder_long(builder, *(const int64_t *) s);
+			break;
+		case SPA_POD_TYPE_FLOAT:
+			spa_pod_builder_float(builder, *(const float *) s);
+			break;
+		case SPA_POD_TYPE_DOUBLE:
+			spa_pod_builder_double(builder, *(const double *) s);
+			break;
+		case SPA_POD_TYPE_STRING:
+			spa_pod_builder_string(builder, *(const char * const *) s);
+			break;
+		case SPA_POD_TYPE_RECTANGLE:
+		{
+			const struct spa_rectangle *r = s;
+			spa_pod_builder_rectangle(builder, r->width, r->height);
+			break;
+		}
+		case SPA_POD_TYPE_FRACTION:
+		{
+			const struct spa_fraction *r = s;
+			spa_pod_builder_fraction(builder, r->num, r->denom);
+			break;
+		}
+		default:
+		{
+			const struct spa_pod *pod = *(const struct spa_pod * const *) s;
+			if (pod == NULL)
+				pod = &none;
+			spa_pod_builder_raw_padded(builder, pod, SPA_POD_SIZE(pod));
+			break;
+		}
+		}
+	}
+}
+
+/** Build a struct pod with the fields of \a schema and the values in \a src */
+static inline uint32_t
+spa_pod_schema_build(struct spa_pod_builder *builder, const struct spa_pod_schema *schema,
+		     const void *src)
+{
+	struct spa_pod_frame f;
+	uint32_t ref;
+
+	ref = spa_pod_builder_push_struct(builder, &f);
+	spa_pod_schema_add(builder, schema, src);
+	spa_pod_builder_pop(builder, &f);
+
+	return ref;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_POD_SCHEMA_H__ */
@@ -0,0 +1,63 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_PROBE_H__
+#define __SPA_PROBE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Static tracepoints
+ *
+ * When <sys/sdt.h> is available, the probes are USDT probes that perf,
+ * bpftrace and systemtap can attach to. A probe that is not attached is a
+ * nop instruction, the arguments should be values that are at hand
+ * anyway. Define SPA_PROBES_DISABLED to compile them out completely.
+ *
+ * The probes are named provider:name, the scripts in spa/tools/bpftrace
+ * list the probes and their arguments.
+ */
+
+#if !defined(SPA_PROBES_DISABLED) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SPA_PROBES_ENABLED	1
+#endif
+#endif
+
+#ifdef SPA_PROBES_ENABLED
+#define spa_probe(p,n)			DTRACE_PROBE(p,n)
+#define spa_probe1(p,n,a)		DTRACE_PROBE1(p,n,a)
+#define spa_probe2(p,n,a,b)		DTRACE_PROBE2(p,n,a,b)
+#define spa_probe3(p,n,a,b,c)		DTRACE_PROBE3(p,n,a,b,c)
+#define spa_probe4(p,n,a,b,c,d)		DTRACE_PROBE4(p,n,a,b,c,d)
+#else
+#define spa_probe(p,n)			do { } while (0)
+#define spa_probe1(p,n,a)		do { } while (0)
+#define spa_probe2(p,n,a,b)		do { } while (0)
+#define spa_probe3(p,n,a,b,c)		do { } while (0)
+#define spa_probe4(p,n,a,b,c,d)		do { } while (0)
+#endif
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_PROBE_H__ */
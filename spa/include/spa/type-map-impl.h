@@ -24,55 +24,126 @@
 extern "C" {
 #endif
 
+#include <string.h>
+
 #include <spa/type-map.h>
+#include <spa/type-ids.h>
+
+/** FNV-1a hash of a type string */
+static inline uint32_t spa_type_map_hash(const char *type)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*type)
+		hash = (hash ^ (uint8_t) *type++) * 16777619u;
+
+	return hash;
+}
+
+/* A simple type map, the strings are not copied. The map starts with the
+ * reserved ids of type-ids.h. The types are found with an open addressing
+ * hash table of twice the maximum number of types, which keeps lookups
+ * short. The storage is defined with SPA_TYPE_MAP_IMPL_DEFINE, which
+ * starts with the same fields as this structure. */
+struct spa_type_map_impl {
+	struct spa_type_map map;
+	uint32_t n_types;
+	uint32_t max_types;
+	char **types;
+	uint32_t *hashes;
+	uint32_t *index;
+};
+
+#define SPA_TYPE_MAP_IMPL_INDEX_SIZE(impl)	((impl)->max_types * 2)
 
 static inline uint32_t
-spa_type_map_impl_get_id (struct spa_type_map *map, const char *type)
+spa_type_map_impl_add (struct spa_type_map_impl *impl, const char *type)
+{
+	uint32_t id, hash, size, pos;
+
+	hash = spa_type_map_hash(type);
+	size = SPA_TYPE_MAP_IMPL_INDEX_SIZE(impl);
+
+	for (pos = hash % size; (id = impl->index[pos]) != 0; pos = (pos + 1) % size) {
+		if (impl->hashes[id - 1] == hash && strcmp(impl->types[id - 1], type) == 0)
+			return id - 1;
+	}
+	if (impl->n_types >= impl->max_types)
+		return SPA_ID_INVALID;
+
+	id = impl->n_types++;
+	impl->types[id] = (char *) type;
+	impl->hashes[id] = hash;
+	impl->index[pos] = id + 1;
+
+	return id;
+}
+
+static inline void spa_type_map_impl_init_ids (struct spa_type_map_impl *impl)
 {
-	struct { struct spa_type_map map; uint32_t n_types; char *types[1]; } *impl = (void*) map;
-	uint32_t i = 0;
+	uint32_t i;
 
-	for (i = 1; i <= impl->n_types; i++) {
-		if (strcmp(impl->types[i], type) == 0)
-			return i;
+	if (impl->n_types == 0) {
+		for (i = 0; i < SPA_TYPE_ID_N_RESERVED; i++)
+			spa_type_map_impl_add(impl, spa_type_ids[i]);
 	}
-	impl->types[i] = (char *) type;
-	impl->n_types++;
-        return i;
+}
+
+static inline uint32_t
+spa_type_map_impl_get_id (struct spa_type_map *map, const char *type)
+{
+	struct spa_type_map_impl *impl = (struct spa_type_map_impl *) map;
+
+	if (type == NULL)
+		return SPA_ID_INVALID;
+
+	spa_type_map_impl_init_ids(impl);
+	return spa_type_map_impl_add(impl, type);
 }
 
 static inline const char *
 spa_type_map_impl_get_type (const struct spa_type_map *map, uint32_t id)
 {
-	struct { struct spa_type_map map; uint32_t n_types; char *types[1]; } *impl = (void*) map;
-        if (id <= impl->n_types)
-                return impl->types[id];
-        return NULL;
+	struct spa_type_map_impl *impl = (struct spa_type_map_impl *) map;
+
+	spa_type_map_impl_init_ids(impl);
+	if (id < impl->n_types)
+		return impl->types[id];
+	return NULL;
 }
 
 static inline size_t spa_type_map_impl_get_size (const struct spa_type_map *map)
 {
-	struct { struct spa_type_map map; uint32_t n_types; char *types[1]; } *impl = (void*) map;
+	struct spa_type_map_impl *impl = (struct spa_type_map_impl *) map;
+
+	spa_type_map_impl_init_ids(impl);
 	return impl->n_types;
 }
 
 #define SPA_TYPE_MAP_IMPL_DEFINE(name,maxtypes)	\
 struct  {					\
 	struct spa_type_map map;		\
-	unsigned int n_types;			\
-	char *types[maxtypes];			\
+	uint32_t n_types;			\
+	uint32_t max_types;			\
+	char **types;				\
+	uint32_t *hashes;			\
+	uint32_t *index;			\
+	char *type_data[maxtypes];		\
+	uint32_t hash_data[maxtypes];		\
+	uint32_t index_data[(maxtypes) * 2];	\
 } name
 
-#define SPA_TYPE_MAP_IMPL_INIT			\
+#define SPA_TYPE_MAP_IMPL_INIT(name,maxtypes)	\
 	{ { SPA_VERSION_TYPE_MAP,		\
 	    NULL,				\
 	    spa_type_map_impl_get_id,		\
 	    spa_type_map_impl_get_type,		\
 	    spa_type_map_impl_get_size,},	\
-	  0, { NULL, } }
+	  0, maxtypes,				\
+	  name.type_data, name.hash_data, name.index_data, }
 
 #define SPA_TYPE_MAP_IMPL(name,maxtypes)		\
-	SPA_TYPE_MAP_IMPL_DEFINE(name,maxtypes) = SPA_TYPE_MAP_IMPL_INIT
+	SPA_TYPE_MAP_IMPL_DEFINE(name,maxtypes) = SPA_TYPE_MAP_IMPL_INIT(name,maxtypes)
 
 #ifdef __cplusplus
 }  /* extern "C" */
@@ -0,0 +1,183 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <lib/pod-arena.h>
+
+#define DEFAULT_MIN_SIZE	4096
+
+struct spa_pod_arena_block {
+	struct spa_pod_arena_block *next;
+	uint32_t size;
+	uint8_t data[0];
+};
+
+static void free_blocks(struct spa_pod_arena_block *block)
+{
+	struct spa_pod_arena_block *next;
+
+	for (; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+}
+
+/* make room for at least size bytes, the contents up to the current
+ * offset are copied and the old block is kept until the next reset */
+static int grow(struct spa_pod_arena *arena, uint32_t size)
+{
+	struct spa_pod_arena_block *block, *old = arena->blocks;
+	uint32_t new_size = old ? old->size : arena->min_size;
+
+	while (new_size < size) {
+		if (new_size > UINT32_MAX / 2)
+			return SPA_RESULT_NO_MEMORY;
+		new_size *= 2;
+	}
+
+	block = malloc(sizeof(struct spa_pod_arena_block) + new_size);
+	if (block == NULL)
+		return SPA_RESULT_NO_MEMORY;
+
+	block->next = old;
+	block->size = new_size;
+	if (old)
+		memcpy(block->data, old->data, SPA_MIN(arena->builder.offset, old->size));
+
+	arena->blocks = block;
+	arena->builder.data = block->data;
+	arena->builder.size = new_size;
+
+	return SPA_RESULT_OK;
+}
+
+static uint32_t
+write_pod(struct spa_pod_builder *b, uint32_t ref, const void *data, uint32_t size)
+{
+	struct spa_pod_arena *arena = SPA_CONTAINER_OF(b, struct spa_pod_arena, builder);
+
+	if (arena->error)
+		return -1;
+
+	if (ref == -1) {
+		ref = b->offset;
+		if (size > UINT32_MAX - ref ||
+		    (ref + size > b->size && grow(arena, ref + size) < 0)) {
+			arena->error = true;
+			return -1;
+		}
+	}
+	memcpy(SPA_MEMBER(b->data, ref, void), data, size);
+	return ref;
+}
+
+static void reset(struct spa_pod_arena *arena)
+{
+	struct spa_pod_builder *b = &arena->builder;
+
+	if (arena->blocks) {
+		free_blocks(arena->blocks->next);
+		arena->blocks->next = NULL;
+	}
+	b->offset = 0;
+	b->stack = NULL;
+	b->in_array = b->first = false;
+	arena->error = false;
+}
+
+void spa_pod_arena_init(struct spa_pod_arena *arena, uint32_t min_size)
+{
+	spa_zero(*arena);
+	arena->min_size = min_size ? SPA_ROUND_UP_N(min_size, 8) : DEFAULT_MIN_SIZE;
+	arena->builder.write = write_pod;
+}
+
+void spa_pod_arena_clear(struct spa_pod_arena *arena)
+{
+	free_blocks(arena->blocks);
+	arena->blocks = NULL;
+	arena->builder.data = NULL;
+	arena->builder.size = 0;
+	reset(arena);
+}
+
+/* make sure that size bytes can be written without growing, use this with
+ * the offset of a builder without memory that measured the message first */
+int spa_pod_arena_reserve(struct spa_pod_arena *arena, uint32_t size)
+{
+	if (size <= arena->builder.size)
+		return SPA_RESULT_OK;
+	return grow(arena, size);
+}
+
+/* reset the arena and get its builder, returns NULL when the builder of the
+ * arena is still in use */
+struct spa_pod_builder *spa_pod_arena_begin(struct spa_pod_arena *arena)
+{
+	if (arena->in_use)
+		return NULL;
+
+	reset(arena);
+	arena->in_use = true;
+
+	return &arena->builder;
+}
+
+/* release the builder, returns SPA_RESULT_NO_MEMORY when the pods in the
+ * arena are incomplete */
+int spa_pod_arena_end(struct spa_pod_arena *arena)
+{
+	arena->in_use = false;
+	return arena->error ? SPA_RESULT_NO_MEMORY : SPA_RESULT_OK;
+}
+
+static pthread_key_t thread_key;
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+
+static void thread_arena_free(void *data)
+{
+	spa_pod_arena_clear(data);
+	free(data);
+}
+
+static void thread_key_create(void)
+{
+	pthread_key_create(&thread_key, thread_arena_free);
+}
+
+/* get the arena of the calling thread, it is freed when the thread exits */
+struct spa_pod_arena *spa_pod_arena_get_thread(void)
+{
+	struct spa_pod_arena *arena;
+
+	pthread_once(&thread_once, thread_key_create);
+
+	if ((arena = pthread_getspecific(thread_key)) == NULL) {
+		if ((arena = malloc(sizeof(struct spa_pod_arena))) == NULL)
+			return NULL;
+		spa_pod_arena_init(arena, 0);
+		pthread_setspecific(thread_key, arena);
+	}
+	return arena;
+}
@@ -0,0 +1,71 @@
+/* Simple Plugin API
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_LIBPOD_ARENA_H__
+#define __SPA_LIBPOD_ARENA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <spa/pod-builder.h>
+
+struct spa_pod_arena_block;
+
+/** An arena for building pods
+ *
+ * The arena has a builder that grows its memory when it runs out of
+ * space, the pods stay contiguous so that they can be walked and
+ * dereferenced like pods in a fixed buffer.
+ *
+ * The memory is kept between messages, a builder is obtained with
+ * spa_pod_arena_begin(), which resets the arena, and released again with
+ * spa_pod_arena_end(). After the first few messages the arena has the
+ * size of the largest message and building does not allocate anymore.
+ *
+ * When the arena grows, the old block is chained to the new one and kept
+ * until the next reset so that pointers into the pods stay readable,
+ * they point to the old contents however. Use SPA_POD_BUILDER_DEREF()
+ * again after adding to the builder to modify a pod.
+ */
+struct spa_pod_arena {
+	struct spa_pod_builder builder;		/**< builder writing into the arena */
+	struct spa_pod_arena_block *blocks;	/**< current block, older blocks chained */
+	uint32_t min_size;			/**< size of the first block */
+	bool in_use;				/**< between begin and end */
+	bool error;				/**< an allocation failed */
+};
+
+void spa_pod_arena_init(struct spa_pod_arena *arena, uint32_t min_size);
+
+void spa_pod_arena_clear(struct spa_pod_arena *arena);
+
+int spa_pod_arena_reserve(struct spa_pod_arena *arena, uint32_t size);
+
+struct spa_pod_builder *spa_pod_arena_begin(struct spa_pod_arena *arena);
+
+int spa_pod_arena_end(struct spa_pod_arena *arena);
+
+struct spa_pod_arena *spa_pod_arena_get_thread(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __SPA_LIBPOD_ARENA_H__ */
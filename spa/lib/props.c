@@ -24,53 +24,135 @@
 
 #include <spa/props.h>
 
-static int compare_value(enum spa_pod_type type, const void *r1, const void *r2)
+typedef int (*compare_func_t) (const void *r1, const void *r2);
+
+static int compare_none(const void *r1, const void *r2)
 {
-	switch (type) {
-	case SPA_POD_TYPE_INVALID:
+	return 0;
+}
+
+static int compare_id(const void *r1, const void *r2)
+{
+	return *(const uint32_t *) r1 == *(const uint32_t *) r2 ? 0 : 1;
+}
+
+static int compare_int(const void *r1, const void *r2)
+{
+	int32_t v1 = *(const int32_t *) r1, v2 = *(const int32_t *) r2;
+	return (v1 > v2) - (v1 < v2);
+}
+
+static int compare_long(const void *r1, const void *r2)
+{
+	int64_t v1 = *(const int64_t *) r1, v2 = *(const int64_t *) r2;
+	return (v1 > v2) - (v1 < v2);
+}
+
+static int compare_float(const void *r1, const void *r2)
+{
+	float v1 = *(const float *) r1, v2 = *(const float *) r2;
+	return (v1 > v2) - (v1 < v2);
+}
+
+static int compare_double(const void *r1, const void *r2)
+{
+	double v1 = *(const double *) r1, v2 = *(const double *) r2;
+	return (v1 > v2) - (v1 < v2);
+}
+
+static int compare_string(const void *r1, const void *r2)
+{
+	return strcmp(r1, r2);
+}
+
+static int compare_rectangle(const void *r1, const void *r2)
+{
+	const struct spa_rectangle *rec1 = r1, *rec2 = r2;
+
+	if (rec1->width == rec2->width && rec1->height == rec2->height)
 		return 0;
+	else if (rec1->width < rec2->width || rec1->height < rec2->height)
+		return -1;
+	else
+		return 1;
+}
+
+static int compare_fraction(const void *r1, const void *r2)
+{
+	const struct spa_fraction *f1 = r1, *f2 = r2;
+	int64_t n1, n2;
+
+	n1 = ((int64_t) f1->num) * f2->denom;
+	n2 = ((int64_t) f2->num) * f1->denom;
+	return (n1 > n2) - (n1 < n2);
+}
+
+/* compare two values for ranges and equality */
+static compare_func_t get_compare_func(uint32_t type)
+{
+	switch (type) {
 	case SPA_POD_TYPE_BOOL:
 	case SPA_POD_TYPE_ID:
-		return *(int32_t *) r1 == *(uint32_t *) r2 ? 0 : 1;
+		return compare_id;
 	case SPA_POD_TYPE_INT:
-		return *(int32_t *) r1 - *(int32_t *) r2;
+		return compare_int;
 	case SPA_POD_TYPE_LONG:
-		return *(int64_t *) r1 - *(int64_t *) r2;
+		return compare_long;
 	case SPA_POD_TYPE_FLOAT:
-		return *(float *) r1 - *(float *) r2;
+		return compare_float;
 	case SPA_POD_TYPE_DOUBLE:
-		return *(double *) r1 - *(double *) r2;
+		return compare_double;
 	case SPA_POD_TYPE_STRING:
-		return strcmp(r1, r2);
+		return compare_string;
 	case SPA_POD_TYPE_RECTANGLE:
-	{
-		const struct spa_rectangle *rec1 = (struct spa_rectangle *) r1,
-		    *rec2 = (struct spa_rectangle *) r2;
-		if (rec1->width == rec2->width && rec1->height == rec2->height)
-			return 0;
-		else if (rec1->width < rec2->width || rec1->height < rec2->height)
-			return -1;
-		else
-			return 1;
-	}
+		return compare_rectangle;
 	case SPA_POD_TYPE_FRACTION:
-	{
-		const struct spa_fraction *f1 = (struct spa_fraction *) r1,
-		    *f2 = (struct spa_fraction *) r2;
-		int64_t n1, n2;
-		n1 = ((int64_t) f1->num) * f2->denom;
-		n2 = ((int64_t) f2->num) * f1->denom;
-		if (n1 < n2)
-			return -1;
-		else if (n1 > n2)
-			return 1;
-		else
-			return 0;
+		return compare_fraction;
+	default:
+		return compare_none;
 	}
+}
+
+static int order_id(const void *r1, const void *r2)
+{
+	uint32_t v1 = *(const uint32_t *) r1, v2 = *(const uint32_t *) r2;
+	return (v1 > v2) - (v1 < v2);
+}
+
+static int order_rectangle(const void *r1, const void *r2)
+{
+	const struct spa_rectangle *rec1 = r1, *rec2 = r2;
+
+	if (rec1->width != rec2->width)
+		return rec1->width < rec2->width ? -1 : 1;
+	return (rec1->height > rec2->height) - (rec1->height < rec2->height);
+}
+
+/* a total order on the values that is 0 for the same values as the compare
+ * function, used to sort enums. NULL when the values can't be ordered */
+static compare_func_t get_order_func(uint32_t type)
+{
+	switch (type) {
+	case SPA_POD_TYPE_BOOL:
+	case SPA_POD_TYPE_ID:
+		return order_id;
+	case SPA_POD_TYPE_RECTANGLE:
+		return order_rectangle;
+	case SPA_POD_TYPE_INT:
+	case SPA_POD_TYPE_LONG:
+	case SPA_POD_TYPE_FLOAT:
+	case SPA_POD_TYPE_DOUBLE:
+	case SPA_POD_TYPE_STRING:
+	case SPA_POD_TYPE_FRACTION:
+		return get_compare_func(type);
 	default:
-		break;
+		return NULL;
 	}
-	return 0;
+}
+
+static int compare_value(enum spa_pod_type type, const void *r1, const void *r2)
+{
+	return get_compare_func(type)(r1, r2);
 }
 
 static void fix_default(struct spa_pod_prop *prop)
@@ -129,6 +211,269 @@ static inline struct spa_pod_prop *find_prop(const struct spa_pod *pod, uint32_t
 	return NULL;
 }
 
+/* below this number of comparisons, enums are intersected with nested loops */
+#ifndef ENUM_LINEAR_MAX
+#define ENUM_LINEAR_MAX		64
+#endif
+/* the maximum number of values that are sorted on the stack */
+#define ENUM_SORT_MAX		256
+
+#define VALUE(alt,i,size)	SPA_MEMBER(alt, (i) * (size), void)
+
+static bool is_sorted(compare_func_t order, const void *alt, int nalt, uint32_t size)
+{
+	int i;
+
+	for (i = 1; i < nalt; i++)
+		if (order(VALUE(alt, i - 1, size), VALUE(alt, i, size)) > 0)
+			return false;
+	return true;
+}
+
+static inline void swap_values(const void **vals, int i, int j)
+{
+	const void *t = vals[i];
+	vals[i] = vals[j];
+	vals[j] = t;
+}
+
+static void sift_down(compare_func_t order, const void **vals, int root, int n)
+{
+	int child;
+
+	while ((child = 2 * root + 1) < n) {
+		if (child + 1 < n && order(vals[child], vals[child + 1]) < 0)
+			child++;
+		if (order(vals[root], vals[child]) >= 0)
+			break;
+		swap_values(vals, root, child);
+		root = child;
+	}
+}
+
+static void sort_values(compare_func_t order, const void **vals, int n)
+{
+	int i;
+
+	for (i = n / 2 - 1; i >= 0; i--)
+		sift_down(order, vals, i, n);
+	for (i = n - 1; i > 0; i--) {
+		swap_values(vals, 0, i);
+		sift_down(order, vals, 0, i);
+	}
+}
+
+/* copy the values of \a alt1 that are also in \a alt2, once for every equal
+ * value in \a alt2 and in the order of \a alt1. Returns the number of copied
+ * values. */
+static int
+intersect_enum(struct spa_pod_builder *b, uint32_t type,
+	       const void *alt1, int nalt1, uint32_t size1,
+	       const void *alt2, int nalt2, uint32_t size2)
+{
+	compare_func_t compare = get_compare_func(type), order = get_order_func(type);
+	const void *sorted[ENUM_SORT_MAX];
+	int i, j, k, n_copied = 0;
+	bool merge = false;
+
+	if (order != NULL && nalt1 * nalt2 > ENUM_LINEAR_MAX)
+		merge = is_sorted(order, alt1, nalt1, size1) &&
+			is_sorted(order, alt2, nalt2, size2);
+
+	/* without merge, the values of alt2 must fit in sorted */
+	if (order == NULL || nalt1 * nalt2 <= ENUM_LINEAR_MAX ||
+	    (!merge && nalt2 > ENUM_SORT_MAX)) {
+		for (i = 0; i < nalt1; i++) {
+			const void *a1 = VALUE(alt1, i, size1);
+			for (j = 0; j < nalt2; j++) {
+				if (compare(a1, VALUE(alt2, j, size2)) == 0) {
+					spa_pod_builder_raw(b, a1, size1);
+					n_copied++;
+				}
+			}
+		}
+		return n_copied;
+	}
+
+	if (merge) {
+		/* merge the sorted enums */
+		for (i = 0, j = 0; i < nalt1 && j < nalt2;) {
+			const void *a1 = VALUE(alt1, i, size1);
+			int res = order(a1, VALUE(alt2, j, size2));
+
+			if (res < 0)
+				i++;
+			else if (res > 0)
+				j++;
+			else {
+				for (k = j; k < nalt2 && order(a1, VALUE(alt2, k, size2)) == 0; k++) {
+					spa_pod_builder_raw(b, a1, size1);
+					n_copied++;
+				}
+				i++;
+			}
+		}
+		return n_copied;
+	}
+
+	/* sort the values of alt2 and look up the values of alt1 */
+	for (j = 0; j < nalt2; j++)
+		sorted[j] = VALUE(alt2, j, size2);
+	sort_values(order, sorted, nalt2);
+
+	for (i = 0; i < nalt1; i++) {
+		const void *a1 = VALUE(alt1, i, size1);
+		int lo = 0, hi = nalt2;
+
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (order(sorted[mid], a1) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for (k = lo; k < nalt2 && order(a1, sorted[k]) == 0; k++) {
+			spa_pod_builder_raw(b, a1, size1);
+			n_copied++;
+		}
+	}
+	return n_copied;
+}
+
+/* copy the values of \a alt that are inside the range \a min and \a max */
+static int
+intersect_range(struct spa_pod_builder *b, compare_func_t compare,
+		const void *alt, int nalt, uint32_t size, const void *min, const void *max)
+{
+	int i, n_copied = 0;
+
+	for (i = 0; i < nalt; i++) {
+		const void *a = VALUE(alt, i, size);
+		if (compare(a, min) < 0 || compare(a, max) > 0)
+			continue;
+		spa_pod_builder_raw(b, a, size);
+		n_copied++;
+	}
+	return n_copied;
+}
+
+/* steps are supported on the integer types and the rectangle, which has
+ * a step for the width and the height */
+static int step_n_components(uint32_t type)
+{
+	switch (type) {
+	case SPA_POD_TYPE_INT:
+	case SPA_POD_TYPE_LONG:
+		return 1;
+	case SPA_POD_TYPE_RECTANGLE:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+static int64_t step_get(uint32_t type, const void *val, int c)
+{
+	switch (type) {
+	case SPA_POD_TYPE_INT:
+		return *(const int32_t *) val;
+	case SPA_POD_TYPE_LONG:
+		return *(const int64_t *) val;
+	default:
+		return ((const uint32_t *) val)[c];
+	}
+}
+
+static void step_set(uint32_t type, void *val, int c, int64_t v)
+{
+	switch (type) {
+	case SPA_POD_TYPE_INT:
+		*(int32_t *) val = v;
+		break;
+	case SPA_POD_TYPE_LONG:
+		*(int64_t *) val = v;
+		break;
+	default:
+		((uint32_t *) val)[c] = v;
+		break;
+	}
+}
+
+/* check if \a val is one of the values from \a min to \a max in \a step */
+static bool
+in_step(uint32_t type, const void *val, const void *min, const void *max, const void *step)
+{
+	int c, n = step_n_components(type);
+
+	for (c = 0; c < n; c++) {
+		int64_t v = step_get(type, val, c), lo = step_get(type, min, c);
+		int64_t s = step_get(type, step, c);
+
+		if (v < lo || v > step_get(type, max, c))
+			return false;
+		if (s > 1 && (v - lo) % s != 0)
+			return false;
+	}
+	return true;
+}
+
+/* copy the values of \a alt that are in the step range \a range */
+static int
+intersect_step(struct spa_pod_builder *b, uint32_t type,
+	       const void *alt, int nalt, uint32_t size, const void *range)
+{
+	const void *min = range, *max = VALUE(range, 1, size), *step = VALUE(range, 2, size);
+	int i, n_copied = 0;
+
+	for (i = 0; i < nalt; i++) {
+		const void *a = VALUE(alt, i, size);
+		if (!in_step(type, a, min, max, step))
+			continue;
+		spa_pod_builder_raw(b, a, size);
+		n_copied++;
+	}
+	return n_copied;
+}
+
+/* intersect a step range with a min/max range or another step range with the
+ * same step, \a range2 is NULL when there is no second step range */
+static int
+intersect_step_range(struct spa_pod_builder *b, uint32_t type, uint32_t size,
+		     const void *range1, const void *min2, const void *max2, const void *range2)
+{
+	uint8_t res[3][sizeof(int64_t)];
+	int c, n = step_n_components(type);
+
+	for (c = 0; c < n; c++) {
+		int64_t lo1 = step_get(type, range1, c);
+		int64_t hi1 = step_get(type, VALUE(range1, 1, size), c);
+		int64_t s = SPA_MAX(step_get(type, VALUE(range1, 2, size), c), 1);
+		int64_t lo, hi;
+
+		if (range2) {
+			int64_t s2 = SPA_MAX(step_get(type, VALUE(range2, 2, size), c), 1);
+			lo = step_get(type, range2, c);
+			if (s2 != s || (lo - lo1) % s != 0)
+				return SPA_RESULT_NOT_IMPLEMENTED;
+		}
+		lo = SPA_MAX(lo1, step_get(type, min2, c));
+		hi = SPA_MIN(hi1, step_get(type, max2, c));
+		/* round up to the next step */
+		lo += (s - (lo - lo1) % s) % s;
+		if (lo > hi)
+			return SPA_RESULT_INCOMPATIBLE_PROPS;
+
+		step_set(type, res[0], c, lo);
+		step_set(type, res[1], c, hi - (hi - lo) % s);
+		step_set(type, res[2], c, s);
+	}
+	spa_pod_builder_raw(b, res[0], size);
+	spa_pod_builder_raw(b, res[1], size);
+	spa_pod_builder_raw(b, res[2], size);
+
+	return SPA_RESULT_OK;
+}
+
 int
 spa_props_filter(struct spa_pod_builder *b,
 		 const struct spa_pod *props,
@@ -136,15 +481,16 @@ spa_props_filter(struct spa_pod_builder *b,
 		 const struct spa_pod *filter,
 		 uint32_t filter_size)
 {
-	int j, k;
 	const struct spa_pod *pr;
 
 	SPA_POD_FOREACH(props, props_size, pr) {
 		struct spa_pod_frame f;
 		struct spa_pod_prop *p1, *p2, *np;
-		int nalt1, nalt2;
-		void *alt1, *alt2, *a1, *a2;
-		uint32_t rt1, rt2;
+		uint32_t flags = 0;
+		int nalt1, nalt2, n_copied, res;
+		void *alt1, *alt2;
+		uint32_t rt1, rt2, type, size1, size2;
+		compare_func_t compare;
 
 		if (pr->type != SPA_POD_TYPE_PROP)
 			continue;
@@ -161,24 +507,21 @@ spa_props_filter(struct spa_pod_builder *b,
 		if (p1->body.value.type != p2->body.value.type)
 			return SPA_RESULT_INCOMPATIBLE_PROPS;
 
+		type = p1->body.value.type;
+		size1 = p1->body.value.size;
+		size2 = p2->body.value.size;
+		compare = get_compare_func(type);
+
 		rt1 = p1->body.flags & SPA_POD_PROP_RANGE_MASK;
 		rt2 = p2->body.flags & SPA_POD_PROP_RANGE_MASK;
 
-		/* else we filter. start with copying the property */
-		spa_pod_builder_push_prop(b, &f, p1->body.key, 0),
-		    np = SPA_POD_BUILDER_DEREF(b, f.ref, struct spa_pod_prop);
-
-		/* default value */
-		spa_pod_builder_raw(b, &p1->body.value,
-				    sizeof(p1->body.value) + p1->body.value.size);
-
 		alt1 = SPA_MEMBER(p1, sizeof(struct spa_pod_prop), void);
 		nalt1 = SPA_POD_PROP_N_VALUES(p1);
 		alt2 = SPA_MEMBER(p2, sizeof(struct spa_pod_prop), void);
 		nalt2 = SPA_POD_PROP_N_VALUES(p2);
 
 		if (p1->body.flags & SPA_POD_PROP_FLAG_UNSET) {
-			alt1 = SPA_MEMBER(alt1, p1->body.value.size, void);
+			alt1 = SPA_MEMBER(alt1, size1, void);
 			nalt1--;
 		} else {
 			nalt1 = 1;
@@ -186,127 +529,113 @@ spa_props_filter(struct spa_pod_builder *b,
 		}
 
 		if (p2->body.flags & SPA_POD_PROP_FLAG_UNSET) {
-			alt2 = SPA_MEMBER(alt2, p2->body.value.size, void);
+			alt2 = SPA_MEMBER(alt2, size2, void);
 			nalt2--;
 		} else {
 			nalt2 = 1;
 			rt2 = SPA_POD_PROP_RANGE_NONE;
 		}
 
-		if ((rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_NONE) ||
-		    (rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_ENUM) ||
-		    (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_NONE) ||
-		    (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_ENUM)) {
-			int n_copied = 0;
+		/* an enum of one value is the same as a fixed value */
+		if (rt1 == SPA_POD_PROP_RANGE_NONE)
+			rt1 = SPA_POD_PROP_RANGE_ENUM;
+		if (rt2 == SPA_POD_PROP_RANGE_NONE)
+			rt2 = SPA_POD_PROP_RANGE_ENUM;
+
+		if ((rt1 == SPA_POD_PROP_RANGE_MIN_MAX && nalt1 < 2) ||
+		    (rt2 == SPA_POD_PROP_RANGE_MIN_MAX && nalt2 < 2) ||
+		    (rt1 == SPA_POD_PROP_RANGE_STEP && nalt1 < 3) ||
+		    (rt2 == SPA_POD_PROP_RANGE_STEP && nalt2 < 3))
+			return SPA_RESULT_INCOMPATIBLE_PROPS;
+
+		if ((rt1 == SPA_POD_PROP_RANGE_STEP || rt2 == SPA_POD_PROP_RANGE_STEP) &&
+		    (step_n_components(type) == 0 || size1 != size2))
+			return SPA_RESULT_NOT_IMPLEMENTED;
+
+		if (rt1 == SPA_POD_PROP_RANGE_FLAGS || rt2 == SPA_POD_PROP_RANGE_FLAGS)
+			return SPA_RESULT_NOT_IMPLEMENTED;
+
+		/* else we filter. start with copying the property */
+		spa_pod_builder_push_prop(b, &f, p1->body.key, 0);
+
+		/* default value */
+		spa_pod_builder_raw(b, &p1->body.value, sizeof(p1->body.value) + size1);
+
+		if (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_ENUM) {
 			/* copy all equal values */
-			for (j = 0, a1 = alt1; j < nalt1; j++, a1 += p1->body.value.size) {
-				for (k = 0, a2 = alt2; k < nalt2; k++, a2 += p2->body.value.size) {
-					if (compare_value(p1->body.value.type, a1, a2) == 0) {
-						spa_pod_builder_raw(b, a1, p1->body.value.size);
-						n_copied++;
-					}
-				}
-			}
+			n_copied = intersect_enum(b, type, alt1, nalt1, size1, alt2, nalt2, size2);
 			if (n_copied == 0)
 				return SPA_RESULT_INCOMPATIBLE_PROPS;
-			np->body.flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+			flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
 		}
-
-		if ((rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_MIN_MAX) ||
-		    (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_MIN_MAX)) {
-			int n_copied = 0;
+		else if (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_MIN_MAX) {
 			/* copy all values inside the range */
-			for (j = 0, a1 = alt1, a2 = alt2; j < nalt1; j++, a1 += p1->body.value.size) {
-				if (compare_value(p1->body.value.type, a1, a2) < 0)
-					continue;
-				if (compare_value(p1->body.value.type, a1, a2 + p2->body.value.size)
-				    > 0)
-					continue;
-				spa_pod_builder_raw(b, a1, p1->body.value.size);
-				n_copied++;
-			}
+			n_copied = intersect_range(b, compare, alt1, nalt1, size1,
+						   alt2, VALUE(alt2, 1, size2));
 			if (n_copied == 0)
 				return SPA_RESULT_INCOMPATIBLE_PROPS;
-			np->body.flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+			flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
 		}
-
-		if ((rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_STEP) ||
-		    (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_STEP)) {
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		}
-
-		if ((rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_NONE) ||
-		    (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_ENUM)) {
-			int n_copied = 0;
+		else if (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_ENUM) {
 			/* copy all values inside the range */
-			for (k = 0, a1 = alt1, a2 = alt2; k < nalt2; k++, a2 += p2->body.value.size) {
-				if (compare_value(p1->body.value.type, a2, a1) < 0)
-					continue;
-				if (compare_value(p1->body.value.type, a2, a1 + p1->body.value.size)
-				    > 0)
-					continue;
-				spa_pod_builder_raw(b, a2, p2->body.value.size);
-				n_copied++;
-			}
+			n_copied = intersect_range(b, compare, alt2, nalt2, size2,
+						   alt1, VALUE(alt1, 1, size1));
 			if (n_copied == 0)
 				return SPA_RESULT_INCOMPATIBLE_PROPS;
-			np->body.flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+			flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
 		}
-
-		if (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_MIN_MAX) {
-			if (compare_value(p1->body.value.type, alt1, alt2) < 0)
-				spa_pod_builder_raw(b, alt2, p2->body.value.size);
+		else if (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_MIN_MAX) {
+			if (compare(alt1, alt2) < 0)
+				spa_pod_builder_raw(b, alt2, size2);
 			else
-				spa_pod_builder_raw(b, alt1, p1->body.value.size);
+				spa_pod_builder_raw(b, alt1, size1);
 
-			alt1 += p1->body.value.size;
-			alt2 += p2->body.value.size;
+			alt1 = VALUE(alt1, 1, size1);
+			alt2 = VALUE(alt2, 1, size2);
 
-			if (compare_value(p1->body.value.type, alt1, alt2) < 0)
-				spa_pod_builder_raw(b, alt1, p1->body.value.size);
+			if (compare(alt1, alt2) < 0)
+				spa_pod_builder_raw(b, alt1, size1);
 			else
-				spa_pod_builder_raw(b, alt2, p2->body.value.size);
+				spa_pod_builder_raw(b, alt2, size2);
 
-			np->body.flags |= SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET;
+			flags |= SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET;
+		}
+		else if (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_STEP) {
+			/* copy all values on the steps */
+			n_copied = intersect_step(b, type, alt1, nalt1, size1, alt2);
+			if (n_copied == 0)
+				return SPA_RESULT_INCOMPATIBLE_PROPS;
+			flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+		}
+		else if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_ENUM) {
+			/* copy all values on the steps */
+			n_copied = intersect_step(b, type, alt2, nalt2, size2, alt1);
+			if (n_copied == 0)
+				return SPA_RESULT_INCOMPATIBLE_PROPS;
+			flags |= SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET;
+		}
+		else {
+			/* min/max and step ranges with at least one step range */
+			if (rt1 == SPA_POD_PROP_RANGE_STEP)
+				res = intersect_step_range(b, type, size1, alt1, alt2,
+							   VALUE(alt2, 1, size2),
+							   rt2 == SPA_POD_PROP_RANGE_STEP ? alt2 : NULL);
+			else
+				res = intersect_step_range(b, type, size1, alt2, alt1,
+							   VALUE(alt1, 1, size1), NULL);
+			if (res < 0)
+				return res;
+			flags |= SPA_POD_PROP_RANGE_STEP | SPA_POD_PROP_FLAG_UNSET;
 		}
-
-		if (rt1 == SPA_POD_PROP_RANGE_NONE && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-
-		if (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_STEP)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-
-		if (rt1 == SPA_POD_PROP_RANGE_MIN_MAX && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-
-		if (rt1 == SPA_POD_PROP_RANGE_ENUM && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_NONE)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_MIN_MAX)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_STEP)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_ENUM)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_STEP && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_NONE)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_MIN_MAX)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_STEP)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_ENUM)
-			return SPA_RESULT_NOT_IMPLEMENTED;
-		if (rt1 == SPA_POD_PROP_RANGE_FLAGS && rt2 == SPA_POD_PROP_RANGE_FLAGS)
-			return SPA_RESULT_NOT_IMPLEMENTED;
 
 		spa_pod_builder_pop(b, &f);
-		fix_default(np);
+
+		/* the builder can have moved its memory or run out of space */
+		if (f.ref != -1 && !spa_pod_builder_overflow(b)) {
+			np = SPA_POD_BUILDER_DEREF(b, f.ref, struct spa_pod_prop);
+			np->body.flags |= flags;
+			fix_default(np);
+		}
 	}
 	return SPA_RESULT_OK;
 }
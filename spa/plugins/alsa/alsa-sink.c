@@ -596,6 +596,46 @@ static const struct spa_node impl_node = {
 	impl_node_process_output,
 };
 
+static int impl_clock_get_props(struct spa_clock *clock, struct spa_props **props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int impl_clock_set_props(struct spa_clock *clock, const struct spa_props *props)
+{
+	return SPA_RESULT_NOT_IMPLEMENTED;
+}
+
+static int impl_clock_get_time(struct spa_clock *clock,
+			       int32_t *rate,
+			       int64_t *ticks,
+			       int64_t *monotonic_time)
+{
+	struct state *this;
+
+	spa_return_val_if_fail(clock != NULL, SPA_RESULT_INVALID_ARGUMENTS);
+
+	this = SPA_CONTAINER_OF(clock, struct state, clock);
+
+	if (rate)
+		*rate = SPA_USEC_PER_SEC;
+	if (ticks)
+		*ticks = this->last_ticks;
+	if (monotonic_time)
+		*monotonic_time = this->last_monotonic;
+
+	return SPA_RESULT_OK;
+}
+
+static const struct spa_clock impl_clock = {
+	SPA_VERSION_CLOCK,
+	NULL,
+	SPA_CLOCK_STATE_STOPPED,
+	impl_clock_get_props,
+	impl_clock_set_props,
+	impl_clock_get_time,
+};
+
 static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id, void **interface)
 {
 	struct state *this;
@@ -607,6 +647,8 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id,
 
 	if (interface_id == this->type.node)
 		*interface = &this->node;
+	else if (interface_id == this->type.clock)
+		*interface = &this->clock;
 	else
 		return SPA_RESULT_UNKNOWN_INTERFACE;
 
@@ -658,6 +700,8 @@ impl_init(const struct spa_handle_factory *factory,
 	init_type(&this->type, this->map);
 
 	this->node = impl_node;
+	this->clock = impl_clock;
+	this->clock.stats = &this->clock_stats;
 	this->stream = SND_PCM_STREAM_PLAYBACK;
 	reset_props(&this->props);
 
@@ -674,6 +718,7 @@ impl_init(const struct spa_handle_factory *factory,
 
 static const struct spa_interface_info impl_interfaces[] = {
 	{SPA_TYPE__Node,},
+	{SPA_TYPE__Clock,},
 };
 
 static int
@@ -685,6 +730,7 @@ impl_enum_interface_info(const struct spa_handle_factory *factory,
 
 	switch (index) {
 	case 0:
+	case 1:
 		*info = &impl_interfaces[index];
 		break;
 	default:
@@ -714,6 +714,7 @@ impl_init(const struct spa_handle_factory *factory,
 
 	this->node = impl_node;
 	this->clock = impl_clock;
+	this->clock.stats = &this->clock_stats;
 	this->stream = SND_PCM_STREAM_CAPTURE;
 	reset_props(&this->props);
 
@@ -9,6 +9,8 @@
 #include <limits.h>
 #include <sys/timerfd.h>
 
+#include <spa/probe.h>
+
 #include <lib/debug.h>
 #include <lib/format.h>
 
@@ -34,6 +36,8 @@ static int spa_alsa_open(struct state *state)
 			   SND_PCM_NO_AUTO_RESAMPLE |
 			   SND_PCM_NO_AUTO_CHANNELS | SND_PCM_NO_AUTO_FORMAT), "open failed");
 
+	CHECK(snd_pcm_status_malloc(&state->status), "status alloc failed");
+
 	state->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
 	state->opened = true;
 
@@ -50,6 +54,8 @@ int spa_alsa_close(struct state *state)
 	spa_log_info(state->log, "Device closing");
 	CHECK(snd_pcm_close(state->hndl), "close failed");
 
+	snd_pcm_status_free(state->status);
+	state->status = NULL;
 	close(state->timerfd);
 	state->opened = false;
 
@@ -311,6 +317,26 @@ static int set_swparams(struct state *state)
 	return 0;
 }
 
+/* the stats are read by other threads */
+static inline void update_clock_stats(struct state *state, snd_pcm_uframes_t fill)
+{
+	struct spa_clock_stats *stats = &state->clock_stats;
+
+	__atomic_store_n(&stats->rate, state->rate, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats->quantum, state->threshold, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats->fill, fill, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats->size, state->buffer_frames, __ATOMIC_RELAXED);
+}
+
+/* an underrun of playback or an overrun of capture */
+static inline void count_xrun(struct state *state, enum spa_direction direction,
+			      snd_pcm_uframes_t frames)
+{
+	spa_probe3(spa, alsa_xrun, state, direction, frames);
+	__atomic_store_n(&state->clock_stats.xruns, state->clock_stats.xruns + 1,
+			 __ATOMIC_RELAXED);
+}
+
 static inline snd_pcm_uframes_t
 pull_frames(struct state *state,
 	    const snd_pcm_channel_area_t *my_areas,
@@ -384,6 +410,7 @@ pull_frames(struct state *state,
 	if (total_frames == 0 && do_pull) {
 		total_frames = SPA_MIN(frames, state->threshold);
 		spa_log_trace(state->log, "underrun, want %zd frames", total_frames);
+		count_xrun(state, SPA_DIRECTION_INPUT, total_frames);
 		snd_pcm_areas_silence(my_areas, offset, state->channels, total_frames, state->format);
 	}
 	return total_frames;
@@ -477,14 +504,12 @@ static void alsa_on_playback_timeout_event(struct spa_source *source)
 	struct itimerspec ts;
 	snd_pcm_uframes_t total_written = 0, filled;
 	const snd_pcm_channel_area_t *my_areas;
-	snd_pcm_status_t *status;
+	snd_pcm_status_t *status = state->status;
 	snd_htimestamp_t htstamp;
 
 	if (state->started && read(state->timerfd, &exp, sizeof(uint64_t)) != sizeof(uint64_t))
 		spa_log_warn(state->log, "error reading timerfd: %s", strerror(errno));
 
-	snd_pcm_status_alloca(&status);
-
 	if ((res = snd_pcm_status(hndl, status)) < 0) {
 		spa_log_error(state->log, "snd_pcm_status error: %s", snd_strerror(res));
 		return;
@@ -503,6 +528,8 @@ static void alsa_on_playback_timeout_event(struct spa_source *source)
 
 	spa_log_trace(state->log, "timeout %ld %d %ld %ld %ld", filled, state->threshold,
 		      state->sample_count, htstamp.tv_sec, htstamp.tv_nsec);
+	spa_probe4(spa, alsa_wakeup, state, SPA_DIRECTION_INPUT, filled, state->source.deadline);
+	update_clock_stats(state, filled);
 
 	if (filled > state->threshold) {
 		if (snd_pcm_state(hndl) == SND_PCM_STATE_SUSPENDED) {
@@ -530,6 +557,7 @@ static void alsa_on_playback_timeout_event(struct spa_source *source)
 				spa_log_error(state->log, "snd_pcm_mmap_commit error: %s", snd_strerror(res));
 				if (res != -EPIPE && res != -ESTRPIPE)
 					return;
+				count_xrun(state, SPA_DIRECTION_INPUT, written);
 			}
 			total_written += written;
 			do_pull = false;
@@ -550,6 +578,9 @@ static void alsa_on_playback_timeout_event(struct spa_source *source)
 	ts.it_interval.tv_sec = 0;
 	ts.it_interval.tv_nsec = 0;
 	timerfd_settime(state->timerfd, TFD_TIMER_ABSTIME, &ts, NULL);
+
+	/* lets the loop measure how late we wake up */
+	state->source.deadline = SPA_TIMESPEC_TO_TIME(&ts.it_value);
 }
 
 
@@ -563,14 +594,12 @@ static void alsa_on_capture_timeout_event(struct spa_source *source)
 	snd_pcm_uframes_t total_read = 0;
 	struct itimerspec ts;
 	const snd_pcm_channel_area_t *my_areas;
-	snd_pcm_status_t *status;
+	snd_pcm_status_t *status = state->status;
 	snd_htimestamp_t htstamp;
 
 	if (state->started && read(state->timerfd, &exp, sizeof(uint64_t)) != sizeof(uint64_t))
 		spa_log_warn(state->log, "error reading timerfd: %s", strerror(errno));
 
-	snd_pcm_status_alloca(&status);
-
 	if ((res = snd_pcm_status(hndl, status)) < 0) {
 		spa_log_error(state->log, "snd_pcm_status error: %s", snd_strerror(res));
 		return;
@@ -584,6 +613,8 @@ static void alsa_on_capture_timeout_event(struct spa_source *source)
 
 	spa_log_trace(state->log, "timeout %ld %d %ld %ld %ld", avail, state->threshold,
 		      state->sample_count, htstamp.tv_sec, htstamp.tv_nsec);
+	spa_probe4(spa, alsa_wakeup, state, SPA_DIRECTION_OUTPUT, avail, state->source.deadline);
+	update_clock_stats(state, avail);
 
 	if (avail < state->threshold) {
 		if (snd_pcm_state(hndl) == SND_PCM_STATE_SUSPENDED) {
@@ -611,6 +642,7 @@ static void alsa_on_capture_timeout_event(struct spa_source *source)
 				spa_log_error(state->log, "snd_pcm_mmap_commit error: %s", snd_strerror(res));
 				if (res != -EPIPE && res != -ESTRPIPE)
 					return;
+				count_xrun(state, SPA_DIRECTION_OUTPUT, read);
 			}
 			total_read += read;
 		}
@@ -621,6 +653,9 @@ static void alsa_on_capture_timeout_event(struct spa_source *source)
 	ts.it_interval.tv_sec = 0;
 	ts.it_interval.tv_nsec = 0;
 	timerfd_settime(state->timerfd, TFD_TIMER_ABSTIME, &ts, NULL);
+
+	/* lets the loop measure how late we wake up */
+	state->source.deadline = SPA_TIMESPEC_TO_TIME(&ts.it_value);
 }
 
 int spa_alsa_start(struct state *state, bool xrun_recover)
@@ -650,6 +685,7 @@ int spa_alsa_start(struct state *state, bool xrun_recover)
 	state->source.fd = state->timerfd;
 	state->source.mask = SPA_IO_IN;
 	state->source.rmask = 0;
+	state->source.deadline = 0;
 	spa_loop_add_source(state->data_loop, &state->source);
 
 	state->threshold = state->props.min_latency;
@@ -80,14 +80,16 @@ struct type {
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
-	type->clock = spa_type_map_get_id(map, SPA_TYPE__Clock);
-	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
-	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
-	type->prop_device = spa_type_map_get_id(map, SPA_TYPE_PROPS__device);
-	type->prop_device_name = spa_type_map_get_id(map, SPA_TYPE_PROPS__deviceName);
-	type->prop_card_name = spa_type_map_get_id(map, SPA_TYPE_PROPS__cardName);
-	type->prop_min_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS__minLatency);
+	bool ids = spa_type_map_has_ids(map);
+
+	type->node = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Node);
+	type->clock = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Clock);
+	type->format = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Format);
+	type->props = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Props);
+	type->prop_device = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__device);
+	type->prop_device_name = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__deviceName);
+	type->prop_card_name = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__cardName);
+	type->prop_min_latency = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__minLatency);
 
 	spa_type_meta_map(map, &type->meta);
 	spa_type_data_map(map, &type->data);
@@ -126,6 +128,7 @@ struct state {
 
 	bool opened;
 	snd_pcm_t *hndl;
+	snd_pcm_status_t *status;	/**< preallocated for the timeout handlers */
 
 	bool have_format;
 	struct spa_audio_info current_format;
@@ -159,6 +162,8 @@ struct state {
 	int64_t sample_count;
 	int64_t last_ticks;
 	int64_t last_monotonic;
+
+	struct spa_clock_stats clock_stats;	/**< stats of the clock interface */
 };
 
 #define PROP(f,key,type,...)							\
@@ -74,8 +74,10 @@ struct type {
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
-	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	bool ids = spa_type_map_has_ids(map);
+
+	type->node = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Node);
+	type->format = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Format);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
 	spa_type_format_audio_map(map, &type->format_audio);
@@ -66,14 +66,16 @@ struct type {
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
-	type->clock = spa_type_map_get_id(map, SPA_TYPE__Clock);
-	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
-	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
-	type->prop_live = spa_type_map_get_id(map, SPA_TYPE_PROPS__live);
-	type->prop_wave = spa_type_map_get_id(map, SPA_TYPE_PROPS__waveType);
-	type->prop_freq = spa_type_map_get_id(map, SPA_TYPE_PROPS__frequency);
-	type->prop_volume = spa_type_map_get_id(map, SPA_TYPE_PROPS__volume);
+	bool ids = spa_type_map_has_ids(map);
+
+	type->node = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Node);
+	type->clock = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Clock);
+	type->format = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Format);
+	type->props = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Props);
+	type->prop_live = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__live);
+	type->prop_wave = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__waveType);
+	type->prop_freq = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__frequency);
+	type->prop_volume = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__volume);
 	type->wave_sine = spa_type_map_get_id(map, SPA_TYPE_PROPS__waveType ":sine");
 	type->wave_square = spa_type_map_get_id(map, SPA_TYPE_PROPS__waveType ":square");
 	spa_type_meta_map(map, &type->meta);
@@ -22,11 +22,18 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include <spa/type-map.h>
 #include <spa/clock.h>
 #include <spa/log.h>
+#include <spa/log-trace.h>
 #include <spa/loop.h>
 #include <spa/node.h>
 #include <spa/param-alloc.h>
@@ -40,15 +47,30 @@
 
 #define TRACE_BUFFER (16*1024)
 
+#define TRACE_RINGS		16
+#define TRACE_RING_SIZE		(64*1024)
+#define TRACE_CATALOG_SIZE	(64*1024)
+#define TRACE_POINTS		1024
+
 struct type {
 	uint32_t log;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-	type->log = spa_type_map_get_id(map, SPA_TYPE__Log);
+	bool ids = spa_type_map_has_ids(map);
+
+	type->log = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Log);
 }
 
+/* a call site that is in the catalog, the format pointer is set last */
+struct trace_point {
+	const char *fmt;
+	const char *file;
+	int line;
+	uint32_t offset;
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_log log;
@@ -61,8 +83,289 @@ struct impl {
 
 	bool have_source;
 	struct spa_source source;
+
+	struct spa_log_trace_header *trace;
+	size_t trace_size;
+	pthread_key_t trace_key;
+	pthread_mutex_t trace_lock;
+	struct trace_point trace_points[TRACE_POINTS];
 };
 
+static inline uint32_t point_hash(const char *fmt, int line)
+{
+	uint64_t h = (uintptr_t) fmt * 31 + line;
+	return (h ^ (h >> 17)) & (TRACE_POINTS - 1);
+}
+
+/* add a call site to the catalog */
+static uint32_t
+add_point(struct impl *impl, enum spa_log_level level,
+	  const char *file, int line, const char *func, const char *fmt)
+{
+	struct spa_log_trace_header *h = impl->trace;
+	struct spa_log_trace_point *point;
+	uint8_t args[SPA_LOG_TRACE_MAX_ARGS];
+	uint32_t n_args = 0, offset, size, file_len, func_len, fmt_len;
+	const char *p;
+	char *str;
+
+	for (p = fmt; *p; p++) {
+		if (*p != '%')
+			continue;
+		if (p[1] == '%') {
+			p++;
+			continue;
+		}
+		if ((p = spa_log_trace_parse_spec(p + 1, args, &n_args,
+						  SPA_LOG_TRACE_MAX_ARGS)) == NULL) {
+			n_args = SPA_LOG_TRACE_TEXT;
+			break;
+		}
+		p--;
+	}
+
+	file_len = strlen(file) + 1;
+	func_len = strlen(func) + 1;
+	fmt_len = strlen(fmt) + 1;
+	size = SPA_ROUND_UP_N(sizeof(struct spa_log_trace_point) + file_len + func_len + fmt_len, 8);
+
+	offset = h->catalog_used;
+	if (offset + size > h->catalog_size)
+		return SPA_ID_INVALID;
+
+	point = spa_log_trace_get_point(h, offset);
+	point->size = size;
+	point->line = line;
+	point->level = level;
+	point->n_args = n_args;
+	if (n_args != SPA_LOG_TRACE_TEXT)
+		memcpy(point->args, args, n_args);
+	str = SPA_MEMBER(point, sizeof(struct spa_log_trace_point), char);
+	memcpy(str, file, file_len);
+	memcpy(str + file_len, func, func_len);
+	memcpy(str + file_len + func_len, fmt, fmt_len);
+
+	__atomic_store_n(&h->catalog_used, offset + size, __ATOMIC_RELEASE);
+
+	return offset;
+}
+
+/* find the catalog offset of a call site, the first time a call site is
+ * used it is added to the catalog with the lock held */
+static uint32_t
+find_point(struct impl *impl, enum spa_log_level level,
+	   const char *file, int line, const char *func, const char *fmt)
+{
+	uint32_t i, n, offset = SPA_ID_INVALID;
+	struct trace_point *tp;
+	const char *f;
+	bool locked = false;
+
+	i = point_hash(fmt, line);
+      again:
+	for (n = 0; n < TRACE_POINTS; n++, i = (i + 1) & (TRACE_POINTS - 1)) {
+		tp = &impl->trace_points[i];
+		if ((f = __atomic_load_n(&tp->fmt, __ATOMIC_ACQUIRE)) == NULL)
+			break;
+		if (f == fmt && tp->line == line && tp->file == file) {
+			offset = tp->offset;
+			goto done;
+		}
+	}
+	if (n == TRACE_POINTS)
+		goto done;
+
+	if (!locked) {
+		/* scan again with the lock, another thread might have added it */
+		pthread_mutex_lock(&impl->trace_lock);
+		locked = true;
+		i = point_hash(fmt, line);
+		goto again;
+	}
+
+	if ((offset = add_point(impl, level, file, line, func, fmt)) != SPA_ID_INVALID) {
+		tp->file = file;
+		tp->line = line;
+		tp->offset = offset;
+		__atomic_store_n(&tp->fmt, fmt, __ATOMIC_RELEASE);
+	}
+      done:
+	if (locked)
+		pthread_mutex_unlock(&impl->trace_lock);
+	return offset;
+}
+
+static void release_ring(void *data)
+{
+	struct spa_log_trace_ring *ring = data;
+	__atomic_store_n(&ring->tid, 0, __ATOMIC_RELEASE);
+}
+
+static inline void *ring_data(struct impl *impl, struct spa_log_trace_ring *ring)
+{
+	return spa_log_trace_get_ring_data(impl->trace, ring - spa_log_trace_get_ring(impl->trace, 0));
+}
+
+/* a string is its length and the bytes, padded to 8 */
+static inline uint8_t *add_string(uint8_t *p, const char *str, uint32_t max)
+{
+	uint64_t len;
+
+	if (str == NULL)
+		str = "(null)";
+	len = strnlen(str, max);
+	memcpy(p, &len, sizeof(uint64_t));
+	memcpy(p + sizeof(uint64_t), str, len);
+	return p + sizeof(uint64_t) + SPA_ROUND_UP_N(len, 8);
+}
+
+static inline void ring_lost(uint32_t *lost)
+{
+	__atomic_fetch_add(lost, 1, __ATOMIC_RELAXED);
+}
+
+static void
+write_record(struct impl *impl, struct spa_log_trace_ring *ring,
+	     struct spa_log_trace_record *rec)
+{
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&ring->rb, &index);
+	if (filled < 0 || filled + rec->size > ring->rb.size) {
+		ring_lost(&ring->lost);
+		return;
+	}
+	spa_ringbuffer_write_data(&ring->rb, ring_data(impl, ring),
+				  index & ring->rb.mask, rec, rec->size);
+	spa_ringbuffer_write_update(&ring->rb, index + rec->size);
+}
+
+static inline uint64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * SPA_NSEC_PER_SEC + now.tv_nsec;
+}
+
+/* get the ring of the calling thread, a free ring is taken the first time and
+ * the thread id is written to it */
+static struct spa_log_trace_ring *get_ring(struct impl *impl)
+{
+	struct spa_log_trace_ring *ring;
+	uint32_t i, tid, free_tid;
+
+	if ((ring = pthread_getspecific(impl->trace_key)) != NULL)
+		return ring;
+
+	tid = syscall(SYS_gettid);
+	for (i = 0; i < impl->trace->n_rings; i++) {
+		ring = spa_log_trace_get_ring(impl->trace, i);
+		free_tid = 0;
+		if (__atomic_compare_exchange_n(&ring->tid, &free_tid, tid, false,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			struct {
+				struct spa_log_trace_record rec;
+				uint64_t tid;
+			} owner = { { sizeof(owner), SPA_LOG_TRACE_POINT_THREAD, get_time() }, tid };
+
+			write_record(impl, ring, &owner.rec);
+			pthread_setspecific(impl->trace_key, ring);
+			return ring;
+		}
+	}
+	return NULL;
+}
+
+/* write the raw arguments to the ring of the thread, nothing is formatted
+ * unless the format has conversions that can't be recorded */
+static void
+trace_binary(struct impl *impl,
+	     enum spa_log_level level,
+	     const char *file,
+	     int line,
+	     const char *func,
+	     const char *fmt,
+	     va_list args)
+{
+	struct spa_log_trace_ring *ring;
+	struct spa_log_trace_point *point;
+	struct spa_log_trace_record *rec;
+	uint64_t buffer[SPA_LOG_TRACE_MAX_RECORD / sizeof(uint64_t)];
+	uint8_t *p;
+	uint32_t i, offset;
+
+	if ((ring = get_ring(impl)) == NULL) {
+		ring_lost(&impl->trace->lost);
+		return;
+	}
+	if ((offset = find_point(impl, level, file, line, func, fmt)) == SPA_ID_INVALID) {
+		ring_lost(&impl->trace->lost);
+		return;
+	}
+	point = spa_log_trace_get_point(impl->trace, offset);
+
+	rec = (struct spa_log_trace_record *) buffer;
+	rec->point = offset;
+	rec->time = get_time();
+	p = (uint8_t *) (rec + 1);
+
+	if (point->n_args == SPA_LOG_TRACE_TEXT) {
+		char text[SPA_LOG_TRACE_MAX_TEXT];
+		vsnprintf(text, sizeof(text), fmt, args);
+		p = add_string(p, text, sizeof(text));
+	} else {
+		for (i = 0; i < point->n_args; i++) {
+			union {
+				int64_t i;
+				uint64_t u;
+				double d;
+			} val;
+
+			switch (point->args[i]) {
+			case SPA_LOG_TRACE_ARG_INT:
+				val.i = va_arg(args, int);
+				break;
+			case SPA_LOG_TRACE_ARG_LONG:
+				val.i = va_arg(args, long);
+				break;
+			case SPA_LOG_TRACE_ARG_LONG_LONG:
+				val.i = va_arg(args, long long);
+				break;
+			case SPA_LOG_TRACE_ARG_SIZE:
+				val.u = va_arg(args, size_t);
+				break;
+			case SPA_LOG_TRACE_ARG_INTMAX:
+				val.i = va_arg(args, intmax_t);
+				break;
+			case SPA_LOG_TRACE_ARG_PTRDIFF:
+				val.i = va_arg(args, ptrdiff_t);
+				break;
+			case SPA_LOG_TRACE_ARG_DOUBLE:
+				val.d = va_arg(args, double);
+				break;
+			case SPA_LOG_TRACE_ARG_POINTER:
+				val.u = (uintptr_t) va_arg(args, void *);
+				break;
+			case SPA_LOG_TRACE_ARG_STRING:
+				p = add_string(p, va_arg(args, const char *),
+					       SPA_LOG_TRACE_MAX_STRING);
+				continue;
+			default:
+				/* the rest of the arguments can't be read, readers
+				 * could not decode the record */
+				ring_lost(&impl->trace->lost);
+				return;
+			}
+			memcpy(p, &val, sizeof(uint64_t));
+			p += sizeof(uint64_t);
+		}
+	}
+	rec->size = p - (uint8_t *) buffer;
+
+	write_record(impl, ring, rec);
+}
+
 static void
 impl_log_logv(struct spa_log *log,
 	      enum spa_log_level level,
@@ -78,6 +381,11 @@ impl_log_logv(struct spa_log *log,
 	int size;
 	bool do_trace;
 
+	if (level == SPA_LOG_LEVEL_TRACE && impl->trace) {
+		trace_binary(impl, level, file, line, func, fmt, args);
+		return;
+	}
+
 	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
 		level++;
 
@@ -143,6 +451,43 @@ static void on_trace_event(struct spa_source *source)
         }
 }
 
+/* create the shared memory of the binary trace, it is not unlinked so that
+ * the trace can be decoded after the process exited */
+static int init_trace(struct impl *impl, const char *name)
+{
+	struct spa_log_trace_header *h;
+	size_t size;
+	uint32_t i;
+	int fd;
+
+	size = spa_log_trace_size(TRACE_RINGS, TRACE_RING_SIZE, TRACE_CATALOG_SIZE);
+
+	if ((fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0600)) < 0)
+		return SPA_RESULT_ERRNO;
+
+	if (ftruncate(fd, size) < 0 ||
+	    (h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return SPA_RESULT_ERRNO;
+	}
+	close(fd);
+
+	h->version = SPA_LOG_TRACE_VERSION;
+	h->n_rings = TRACE_RINGS;
+	h->ring_size = TRACE_RING_SIZE;
+	h->catalog_size = TRACE_CATALOG_SIZE;
+	for (i = 0; i < TRACE_RINGS; i++)
+		spa_ringbuffer_init(&spa_log_trace_get_ring(h, i)->rb, TRACE_RING_SIZE);
+	__atomic_store_n(&h->magic, SPA_LOG_TRACE_MAGIC, __ATOMIC_RELEASE);
+
+	pthread_mutex_init(&impl->trace_lock, NULL);
+	pthread_key_create(&impl->trace_key, release_ring);
+	impl->trace = h;
+	impl->trace_size = size;
+
+	return SPA_RESULT_OK;
+}
+
 static const struct spa_log impl_log = {
 	SPA_VERSION_LOG,
 	NULL,
@@ -181,6 +526,12 @@ static int impl_clear(struct spa_handle *handle)
 		close(this->source.fd);
 		this->have_source = false;
 	}
+	if (this->trace) {
+		pthread_key_delete(this->trace_key);
+		pthread_mutex_destroy(&this->trace_lock);
+		munmap(this->trace, this->trace_size);
+		this->trace = NULL;
+	}
 	return SPA_RESULT_OK;
 }
 
@@ -194,6 +545,7 @@ impl_init(const struct spa_handle_factory *factory,
 	struct impl *this;
 	uint32_t i;
 	struct spa_loop *loop = NULL;
+	const char *str;
 
 	spa_return_val_if_fail(factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 	spa_return_val_if_fail(handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
@@ -229,6 +581,13 @@ impl_init(const struct spa_handle_factory *factory,
 
 	spa_ringbuffer_init(&this->trace_rb, TRACE_BUFFER);
 
+	if (info == NULL || (str = spa_dict_lookup(info, "log.trace-shm")) == NULL)
+		str = getenv("SPA_LOG_TRACE_SHM");
+
+	if (str && init_trace(this, str) < 0)
+		spa_log_warn(&this->log, NAME " %p: can't create trace shm %s: %s",
+			     this, str, strerror(errno));
+
 	spa_log_info(&this->log, NAME " %p: initialized", this);
 
 	return SPA_RESULT_OK;
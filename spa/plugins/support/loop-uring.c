@@ -0,0 +1,357 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <spa/defs.h>
+
+#include "loop-uring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+
+static inline int sys_io_uring_setup(uint32_t entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+				     uint32_t flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+int uring_init(struct uring *ring, uint32_t entries)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(ring, 0, sizeof(struct uring));
+	memset(&p, 0, sizeof(p));
+
+	if ((ring->fd = sys_io_uring_setup(entries, &p)) < 0)
+		return SPA_RESULT_ERRNO;
+
+	/* we need to wait with a timeout, update polls and read at the
+	 * current file position */
+	if ((p.features & IORING_FEAT_EXT_ARG) == 0 ||
+	    (p.features & IORING_FEAT_RW_CUR_POS) == 0 ||
+	    (p.features & IORING_FEAT_NODROP) == 0) {
+		errno = ENOTSUP;
+		goto error;
+	}
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ring->sq_ring_size = ring->cq_ring_size =
+			SPA_MAX(ring->sq_ring_size, ring->cq_ring_size);
+
+	sq = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto error;
+	ring->sq_ring = sq;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			goto error;
+		ring->cq_ring = cq;
+	}
+
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto error;
+	}
+
+	ring->sq_head = SPA_MEMBER(sq, p.sq_off.head, uint32_t);
+	ring->sq_tail = SPA_MEMBER(sq, p.sq_off.tail, uint32_t);
+	ring->sq_mask = *SPA_MEMBER(sq, p.sq_off.ring_mask, uint32_t);
+	ring->sq_array = SPA_MEMBER(sq, p.sq_off.array, uint32_t);
+
+	ring->cq_head = SPA_MEMBER(cq, p.cq_off.head, uint32_t);
+	ring->cq_tail = SPA_MEMBER(cq, p.cq_off.tail, uint32_t);
+	ring->cq_mask = *SPA_MEMBER(cq, p.cq_off.ring_mask, uint32_t);
+	ring->cqes = SPA_MEMBER(cq, p.cq_off.cqes, void);
+
+	return SPA_RESULT_OK;
+
+      error:
+	uring_clear(ring);
+	return SPA_RESULT_ERRNO;
+}
+
+void uring_clear(struct uring *ring)
+{
+	int save_errno = errno;
+
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+
+	memset(ring, 0, sizeof(struct uring));
+	ring->fd = -1;
+	errno = save_errno;
+}
+
+static struct io_uring_sqe *get_sqe(struct uring *ring)
+{
+	uint32_t tail = *ring->sq_tail, index;
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) > ring->sq_mask) {
+		/* full, let the kernel consume what we have */
+		if (sys_io_uring_enter(ring->fd, tail - *ring->sq_head, 0, 0, NULL, 0) < 0)
+			return NULL;
+		if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) > ring->sq_mask) {
+			errno = EBUSY;
+			return NULL;
+		}
+	}
+	index = tail & ring->sq_mask;
+	sqe = &((struct io_uring_sqe *) ring->sqes)[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	ring->sq_array[index] = index;
+
+	return sqe;
+}
+
+static inline int queue_sqe(struct uring *ring)
+{
+	/* the kernel only looks at the tail in io_uring_enter() */
+	__atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+	return SPA_RESULT_OK;
+}
+
+int uring_poll_add(struct uring *ring, int fd, uint32_t events, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = get_sqe(ring)) == NULL)
+		return SPA_RESULT_ERRNO;
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = events;
+	sqe->user_data = user_data;
+
+	return queue_sqe(ring);
+}
+
+int uring_poll_update(struct uring *ring, uint64_t old_user_data, uint32_t events,
+		      uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = get_sqe(ring)) == NULL)
+		return SPA_RESULT_ERRNO;
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = old_user_data;
+	sqe->len = IORING_POLL_UPDATE_EVENTS;
+	sqe->poll32_events = events;
+	sqe->user_data = user_data;
+
+	return queue_sqe(ring);
+}
+
+int uring_poll_remove(struct uring *ring, uint64_t old_user_data, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = get_sqe(ring)) == NULL)
+		return SPA_RESULT_ERRNO;
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = old_user_data;
+	sqe->user_data = user_data;
+
+	return queue_sqe(ring);
+}
+
+int uring_read(struct uring *ring, int fd, void *buf, uint32_t len, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = get_sqe(ring)) == NULL)
+		return SPA_RESULT_ERRNO;
+
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->off = (uint64_t) -1;
+	sqe->addr = (uintptr_t) buf;
+	sqe->len = len;
+	sqe->user_data = user_data;
+
+	return queue_sqe(ring);
+}
+
+int uring_cancel(struct uring *ring, uint64_t old_user_data, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = get_sqe(ring)) == NULL)
+		return SPA_RESULT_ERRNO;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = old_user_data;
+	sqe->user_data = user_data;
+
+	return queue_sqe(ring);
+}
+
+int uring_enter(struct uring *ring, int timeout)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	uint32_t to_submit, flags = 0, min_complete = 0;
+	int res;
+
+	to_submit = __atomic_load_n(ring->sq_tail, __ATOMIC_RELAXED) -
+		    __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+	if (timeout != 0) {
+		/* don't sleep when there is something to do */
+		if (__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) != *ring->cq_head)
+			timeout = 0;
+		else {
+			flags |= IORING_ENTER_GETEVENTS;
+			min_complete = 1;
+		}
+	}
+	if (to_submit == 0 && timeout == 0)
+		return 0;
+
+	if (timeout > 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * SPA_NSEC_PER_MSEC;
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = (uintptr_t) &ts;
+		flags |= IORING_ENTER_EXT_ARG;
+		res = sys_io_uring_enter(ring->fd, to_submit, min_complete, flags, &arg, sizeof(arg));
+	} else {
+		res = sys_io_uring_enter(ring->fd, to_submit, min_complete, flags, NULL, 0);
+	}
+	if (res < 0 && errno == ETIME)
+		res = 0;
+
+	return res;
+}
+
+bool uring_peek(struct uring *ring, uint64_t *user_data, int32_t *res)
+{
+	uint32_t head = *ring->cq_head;
+	struct io_uring_cqe *cqe;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return false;
+
+	cqe = &((struct io_uring_cqe *) ring->cqes)[head & ring->cq_mask];
+	*user_data = cqe->user_data;
+	*res = cqe->res;
+	return true;
+}
+
+void uring_advance(struct uring *ring)
+{
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#else
+
+int uring_init(struct uring *ring, uint32_t entries)
+{
+	memset(ring, 0, sizeof(struct uring));
+	ring->fd = -1;
+	errno = ENOSYS;
+	return SPA_RESULT_ERRNO;
+}
+
+void uring_clear(struct uring *ring)
+{
+}
+
+int uring_poll_add(struct uring *ring, int fd, uint32_t events, uint64_t user_data)
+{
+	errno = ENOSYS;
+	return SPA_RESULT_ERRNO;
+}
+
+int uring_poll_update(struct uring *ring, uint64_t old_user_data, uint32_t events,
+		      uint64_t user_data)
+{
+	errno = ENOSYS;
+	return SPA_RESULT_ERRNO;
+}
+
+int uring_poll_remove(struct uring *ring, uint64_t old_user_data, uint64_t user_data)
+{
+	errno = ENOSYS;
+	return SPA_RESULT_ERRNO;
+}
+
+int uring_read(struct uring *ring, int fd, void *buf, uint32_t len, uint64_t user_data)
+{
+	errno = ENOSYS;
+	return SPA_RESULT_ERRNO;
+}
+
+int uring_cancel(struct uring *ring, uint64_t old_user_data, uint64_t user_data)
+{
+	errno = ENOSYS;
+	return SPA_RESULT_ERRNO;
+}
+
+int uring_enter(struct uring *ring, int timeout)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+bool uring_peek(struct uring *ring, uint64_t *user_data, int32_t *res)
+{
+	return false;
+}
+
+void uring_advance(struct uring *ring)
+{
+}
+
+#endif
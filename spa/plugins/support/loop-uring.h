@@ -0,0 +1,83 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_LOOP_URING_H__
+#define __SPA_LOOP_URING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** \cond */
+
+/* a minimal io_uring, driven with the raw syscalls. When the kernel
+ * headers have no io_uring, uring_init() fails and the loop uses epoll. */
+struct uring {
+	int fd;
+
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t sq_mask;
+	uint32_t *sq_array;
+	void *sqes;
+
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t cq_mask;
+	void *cqes;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+};
+
+int uring_init(struct uring *ring, uint32_t entries);
+void uring_clear(struct uring *ring);
+
+/* queue requests, they are submitted with the next uring_enter().
+ * All of these fail with SPA_RESULT_ERRNO when the queue can't be
+ * flushed. @events are epoll events. */
+int uring_poll_add(struct uring *ring, int fd, uint32_t events, uint64_t user_data);
+int uring_poll_update(struct uring *ring, uint64_t old_user_data, uint32_t events,
+		      uint64_t user_data);
+int uring_poll_remove(struct uring *ring, uint64_t old_user_data, uint64_t user_data);
+int uring_read(struct uring *ring, int fd, void *buf, uint32_t len, uint64_t user_data);
+int uring_cancel(struct uring *ring, uint64_t old_user_data, uint64_t user_data);
+
+/* submit the queued requests and wait at most @timeout msec for a
+ * completion, -1 waits forever. Returns < 0 and sets errno on error. */
+int uring_enter(struct uring *ring, int timeout);
+
+/* peek at the next completion, returns false when there is none */
+bool uring_peek(struct uring *ring, uint64_t *user_data, int32_t *res);
+void uring_advance(struct uring *ring);
+
+/** \endcond */
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_LOOP_URING_H__ */
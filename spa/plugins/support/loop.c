@@ -27,31 +27,83 @@
 #include <sys/timerfd.h>
 #include <sys/eventfd.h>
 #include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <pthread.h>
 
 #include <spa/loop.h>
 #include <spa/list.h>
 #include <spa/log.h>
 #include <spa/type-map.h>
-#include <spa/ringbuffer.h>
+#include <spa/type-ids.h>
+#include <spa/dict.h>
+
+#include "loop-uring.h"
 
 #define NAME "loop"
 
-#define DATAS_SIZE (4096 * 8)
+#define QUEUE_SIZE	128	/* number of invoke slots, power of 2 */
+#define ITEM_DATA_SIZE	256	/* max data of a non-blocking invoke */
+
+/* timers live in a hierarchical wheel of WHEEL_LEVELS levels with
+ * WHEEL_SIZE slots each. A tick is 2^WHEEL_TICK_SHIFT nsec (~1ms), the
+ * wheel covers about 4.9 hours, later timers are parked in the last level
+ * and placed again when they cascade down. */
+#define WHEEL_BITS		6
+#define WHEEL_SIZE		(1 << WHEEL_BITS)
+#define WHEEL_MASK		(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS		4
+#define WHEEL_TICK_SHIFT	20
+#define WHEEL_MAX_TICKS		((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+#define URING_ENTRIES		256
+#define URING_HASH_SIZE		64	/* power of 2 */
+
+/* the kind of request, in the low bits of the io_uring user_data next to
+ * the uring_source pointer */
+#define URING_OP_POLL		0
+#define URING_OP_READ		1
+#define URING_OP_CANCEL		2
+#define URING_OP_MASK		3
 
 /** \cond */
 
+/* completion of a blocking invoke, lives on the stack of the caller */
+struct invoke_completion {
+	int32_t done;
+	int res;
+};
+
+/* a slot in the invoke queue. The sequence number tells the producers
+ * and the consumer if the slot is free or filled for a given position */
 struct invoke_item {
-	size_t item_size;
+	uint32_t sequence;
 	spa_invoke_func_t func;
 	uint32_t seq;
 	size_t size;
 	void *data;
-	bool block;
 	void *user_data;
-	int res;
+	struct invoke_completion *completion;
+	uint8_t item_data[ITEM_DATA_SIZE] __attribute__ ((aligned (8)));
 };
 
+/* a source in the io_uring backend. Polls are one-shot and armed again
+ * after dispatch, which gives the same level triggered behaviour as epoll.
+ * Event sources don't poll, their eventfd or timerfd is read by the
+ * kernel and the count is handed to the callback. The structure stays
+ * around until the kernel has completed all requests of the source. */
+struct uring_source {
+	struct spa_list link;		/* in the hash table or the dead list */
+	struct spa_source *source;	/* NULL when removed */
+	uint64_t *count;		/* where a read count goes, NULL to poll */
+	uint64_t value;			/* read buffer, owned by the kernel */
+	uint32_t events;		/* epoll events of the pending poll */
+	int pending;			/* requests in the kernel */
+	bool polling;
+	bool reading;
+	bool dispatch;
+} __attribute__ ((aligned (8)));
+
 struct type {
 	uint32_t loop;
 	uint32_t loop_control;
@@ -62,9 +114,11 @@ static void loop_signal_event(struct spa_source *source);
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-	type->loop = spa_type_map_get_id(map, SPA_TYPE__Loop);
-	type->loop_control = spa_type_map_get_id(map, SPA_TYPE__LoopControl);
-	type->loop_utils = spa_type_map_get_id(map, SPA_TYPE__LoopUtils);
+	bool ids = spa_type_map_has_ids(map);
+
+	type->loop = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Loop);
+	type->loop_control = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__LoopControl);
+	type->loop_utils = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__LoopUtils);
 }
 
 struct impl {
@@ -81,14 +135,35 @@ struct impl {
 	struct spa_list destroy_list;
 	struct spa_hook_list hooks_list;
 
+	struct spa_loop_stats stats;
+
 	int epoll_fd;
 	pthread_t thread;
 
+	/* io_uring backend, used instead of epoll when use_uring is set */
+	bool use_uring;
+	struct uring ring;
+	pthread_mutex_t uring_lock;
+	struct spa_list uring_hash[URING_HASH_SIZE];
+	struct spa_list uring_dead;
+
 	struct spa_source *wakeup;
-	int ack_fd;
 
-	struct spa_ringbuffer buffer;
-	uint8_t buffer_data[DATAS_SIZE];
+	/* all timers share one timerfd, armed to the earliest deadline. Timers
+	 * can be updated from other threads, the lock protects the wheel */
+	struct {
+		pthread_mutex_t lock;
+		struct spa_source *source;
+		uint64_t tick;		/* next tick to process */
+		uint64_t armed;		/* deadline of the timerfd or UINT64_MAX */
+		uint64_t bitmap[WHEEL_LEVELS];	/* non-empty slots */
+		struct spa_list slots[WHEEL_LEVELS][WHEEL_SIZE];
+	} wheel;
+
+	/* bounded multi-producer, single-consumer queue of invokes */
+	uint32_t enqueue_pos;
+	uint32_t dequeue_pos;
+	struct invoke_item queue[QUEUE_SIZE];
 };
 
 struct source_impl {
@@ -107,9 +182,25 @@ struct source_impl {
 	} func;
 	int signal_number;
 	bool enabled;
+	uint64_t count;		/* event count read by the io_uring backend */
+
+	/* timers */
+	struct spa_list timer_link;
+	uint64_t deadline;
+	uint64_t interval;
+	uint8_t level;
+	uint8_t slot;
+	bool queued;
 };
 /** \endcond */
 
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
 static inline uint32_t spa_io_to_epoll(enum spa_io mask)
 {
 	uint32_t events = 0;
@@ -142,13 +233,142 @@ static inline enum spa_io spa_epoll_to_io(uint32_t events)
 	return mask;
 }
 
-static int loop_add_source(struct spa_loop *loop, struct spa_source *source)
+static inline uint64_t uring_data(struct uring_source *us, int op)
 {
-	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
+	return (uintptr_t) us | op;
+}
+
+static inline struct spa_list *uring_bucket(struct impl *impl, struct spa_source *source)
+{
+	uint64_t hash = (uintptr_t) source * 0x9e3779b97f4a7c15ULL;
+	return &impl->uring_hash[(hash >> 32) & (URING_HASH_SIZE - 1)];
+}
 
-	source->loop = loop;
+static struct uring_source *uring_find(struct impl *impl, struct spa_source *source)
+{
+	struct uring_source *us;
 
-	if (source->fd != -1) {
+	spa_list_for_each(us, uring_bucket(impl, source), link) {
+		if (us->source == source)
+			return us;
+	}
+	return NULL;
+}
+
+/* queue the request that tells us when the source is ready again,
+ * called with the uring_lock */
+static int uring_arm(struct impl *impl, struct uring_source *us)
+{
+	int res;
+
+	if (us->count) {
+		if (us->reading)
+			return SPA_RESULT_OK;
+		if ((res = uring_read(&impl->ring, us->source->fd, &us->value, sizeof(uint64_t),
+				      uring_data(us, URING_OP_READ))) < 0)
+			return res;
+		us->reading = true;
+	} else {
+		if (us->polling)
+			return SPA_RESULT_OK;
+		us->events = spa_io_to_epoll(us->source->mask);
+		if ((res = uring_poll_add(&impl->ring, us->source->fd, us->events,
+					  uring_data(us, URING_OP_POLL))) < 0)
+			return res;
+		us->polling = true;
+	}
+	us->pending++;
+	return SPA_RESULT_OK;
+}
+
+/* the loop thread submits its requests when it goes to sleep, other
+ * threads need to submit right away or the loop might not see them */
+static void uring_flush(struct impl *impl)
+{
+	if (!pthread_equal(impl->thread, pthread_self()))
+		uring_enter(&impl->ring, 0);
+}
+
+static int uring_add_source(struct impl *impl, struct spa_source *source, uint64_t *count)
+{
+	struct uring_source *us;
+	int res;
+
+	if ((us = calloc(1, sizeof(struct uring_source))) == NULL)
+		return SPA_RESULT_NO_MEMORY;
+
+	us->source = source;
+	us->count = count;
+
+	pthread_mutex_lock(&impl->uring_lock);
+	spa_list_insert(uring_bucket(impl, source), &us->link);
+	if ((res = uring_arm(impl, us)) == SPA_RESULT_OK)
+		uring_flush(impl);
+	pthread_mutex_unlock(&impl->uring_lock);
+
+	return res;
+}
+
+static int uring_update_source(struct impl *impl, struct spa_source *source)
+{
+	struct uring_source *us;
+	uint32_t events = spa_io_to_epoll(source->mask);
+	int res = SPA_RESULT_OK;
+
+	pthread_mutex_lock(&impl->uring_lock);
+	if ((us = uring_find(impl, source)) == NULL) {
+		errno = ENOENT;
+		res = SPA_RESULT_ERRNO;
+	} else if (us->polling && us->events != events) {
+		/* when the poll already completed, the new events are used
+		 * when it is armed again */
+		if ((res = uring_poll_update(&impl->ring, uring_data(us, URING_OP_POLL), events,
+					     uring_data(us, URING_OP_CANCEL))) == SPA_RESULT_OK) {
+			us->events = events;
+			us->pending++;
+			uring_flush(impl);
+		}
+	}
+	pthread_mutex_unlock(&impl->uring_lock);
+
+	return res;
+}
+
+static void uring_remove_source(struct impl *impl, struct spa_source *source)
+{
+	struct uring_source *us;
+
+	pthread_mutex_lock(&impl->uring_lock);
+	if ((us = uring_find(impl, source)) != NULL) {
+		spa_list_remove(&us->link);
+		us->source = NULL;
+
+		if (us->polling &&
+		    uring_poll_remove(&impl->ring, uring_data(us, URING_OP_POLL),
+				      uring_data(us, URING_OP_CANCEL)) == SPA_RESULT_OK)
+			us->pending++;
+		if (us->reading &&
+		    uring_cancel(&impl->ring, uring_data(us, URING_OP_READ),
+				 uring_data(us, URING_OP_CANCEL)) == SPA_RESULT_OK)
+			us->pending++;
+
+		/* freed when the kernel is done with it */
+		spa_list_insert(&impl->uring_dead, &us->link);
+		uring_flush(impl);
+	}
+	pthread_mutex_unlock(&impl->uring_lock);
+}
+
+static int add_source(struct impl *impl, struct spa_source *source, uint64_t *count)
+{
+	source->loop = &impl->loop;
+
+	if (source->fd == -1)
+		return SPA_RESULT_OK;
+
+	if (impl->use_uring)
+		return uring_add_source(impl, source, count);
+	else {
 		struct epoll_event ep;
 
 		spa_zero(ep);
@@ -161,12 +381,23 @@ static int loop_add_source(struct spa_loop *loop, struct spa_source *source)
 	return SPA_RESULT_OK;
 }
 
+static int loop_add_source(struct spa_loop *loop, struct spa_source *source)
+{
+	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
+	return add_source(impl, source, NULL);
+}
+
 static int loop_update_source(struct spa_source *source)
 {
 	struct spa_loop *loop = source->loop;
 	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
 
-	if (source->fd != -1) {
+	if (source->fd == -1)
+		return SPA_RESULT_OK;
+
+	if (impl->use_uring)
+		return uring_update_source(impl, source);
+	else {
 		struct epoll_event ep;
 
 		spa_zero(ep);
@@ -184,12 +415,52 @@ static void loop_remove_source(struct spa_source *source)
 	struct spa_loop *loop = source->loop;
 	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
 
-	if (source->fd != -1)
-		epoll_ctl(impl->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+	if (source->fd != -1) {
+		if (impl->use_uring)
+			uring_remove_source(impl, source);
+		else
+			epoll_ctl(impl->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+	}
 
 	source->loop = NULL;
 }
 
+static inline void futex_wait(int32_t *addr, int32_t val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void futex_wake(int32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* claim a free slot, can be called from any number of threads */
+static struct invoke_item *queue_claim(struct impl *impl, uint32_t *pos)
+{
+	struct invoke_item *item;
+	uint32_t p = __atomic_load_n(&impl->enqueue_pos, __ATOMIC_RELAXED);
+
+	while (true) {
+		int32_t diff;
+
+		item = &impl->queue[p & (QUEUE_SIZE - 1)];
+		diff = (int32_t) (__atomic_load_n(&item->sequence, __ATOMIC_ACQUIRE) - p);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&impl->enqueue_pos, &p, p + 1, true,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return NULL;
+		} else {
+			p = __atomic_load_n(&impl->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+	*pos = p;
+	return item;
+}
+
 static int
 loop_invoke(struct spa_loop *loop,
 	    spa_invoke_func_t func,
@@ -202,56 +473,44 @@ loop_invoke(struct spa_loop *loop,
 	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
 	bool in_thread = pthread_equal(impl->thread, pthread_self());
 	struct invoke_item *item;
+	struct invoke_completion completion = { 0, SPA_RESULT_OK };
+	uint32_t pos;
 	int res;
 
 	if (in_thread) {
 		res = func(loop, false, seq, size, data, user_data);
 	} else {
-		int32_t filled, avail;
-		uint32_t idx, offset, l0;
-		uint64_t count = 1;
-
-		filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-		if (filled < 0 || filled > impl->buffer.size) {
-			spa_log_warn(impl->log, NAME " %p: queue xrun %d", impl, filled);
+		/* a blocking caller keeps its data alive until the invoke is done */
+		if (!block && size > ITEM_DATA_SIZE) {
+			spa_log_warn(impl->log, NAME " %p: invoke data too large %zd", impl, size);
 			return SPA_RESULT_ERROR;
 		}
-		avail = impl->buffer.size - filled;
-		if (avail < sizeof(struct invoke_item)) {
-			spa_log_warn(impl->log, NAME " %p: queue full %d", impl, avail);
+		if ((item = queue_claim(impl, &pos)) == NULL) {
+			spa_log_warn(impl->log, NAME " %p: queue full", impl);
 			return SPA_RESULT_ERROR;
 		}
-		offset = idx & impl->buffer.mask;
-
-		l0 = impl->buffer.size - offset;
-
-		item = SPA_MEMBER(impl->buffer_data, offset, struct invoke_item);
 		item->func = func;
 		item->seq = seq;
 		item->size = size;
-		item->block = block;
 		item->user_data = user_data;
+		item->completion = block ? &completion : NULL;
 
-		if (l0 > sizeof(struct invoke_item) + size) {
-			item->data = SPA_MEMBER(item, sizeof(struct invoke_item), void);
-			item->item_size = sizeof(struct invoke_item) + size;
-			if (l0 < sizeof(struct invoke_item) + item->item_size)
-				item->item_size = l0;
+		if (size <= ITEM_DATA_SIZE) {
+			item->data = item->item_data;
+			if (size > 0)
+				memcpy(item->item_data, data, size);
 		} else {
-			item->data = impl->buffer_data;
-			item->item_size = l0 + size;
+			item->data = (void *) data;
 		}
-		memcpy(item->data, data, size);
-
-		spa_ringbuffer_write_update(&impl->buffer, idx + item->item_size);
+		/* publish the item to the consumer */
+		__atomic_store_n(&item->sequence, pos + 1, __ATOMIC_RELEASE);
 
 		spa_loop_utils_signal_event(&impl->utils, impl->wakeup);
 
 		if (block) {
-			if (read(impl->ack_fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
-				spa_log_warn(impl->log, NAME " %p: failed to read event fd: %s",
-						impl, strerror(errno));
-			res = item->res;
+			while (__atomic_load_n(&completion.done, __ATOMIC_ACQUIRE) == 0)
+				futex_wait(&completion.done, 0);
+			res = completion.res;
 		}
 		else {
 			if (seq != SPA_ID_INVALID)
@@ -266,20 +525,28 @@ loop_invoke(struct spa_loop *loop,
 static void wakeup_func(void *data, uint64_t count)
 {
 	struct impl *impl = data;
-	uint32_t index;
-
-	while (spa_ringbuffer_get_read_index(&impl->buffer, &index) > 0) {
-		struct invoke_item *item =
-		    SPA_MEMBER(impl->buffer_data, index & impl->buffer.mask, struct invoke_item);
-		item->res = item->func(&impl->loop, true, item->seq, item->size, item->data,
-			   item->user_data);
-		spa_ringbuffer_read_update(&impl->buffer, index + item->item_size);
-
-		if (item->block) {
-			uint64_t count = 1;
-			if (write(impl->ack_fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
-				spa_log_warn(impl->log, NAME " %p: failed to write event fd: %s",
-						impl, strerror(errno));
+
+	while (true) {
+		uint32_t pos = impl->dequeue_pos;
+		struct invoke_item *item = &impl->queue[pos & (QUEUE_SIZE - 1)];
+		struct invoke_completion *completion;
+		int res;
+
+		if ((int32_t) (__atomic_load_n(&item->sequence, __ATOMIC_ACQUIRE) - (pos + 1)) < 0)
+			break;
+
+		res = item->func(&impl->loop, true, item->seq, item->size, item->data,
+				 item->user_data);
+		completion = item->completion;
+
+		/* release the slot for the producers */
+		impl->dequeue_pos = pos + 1;
+		__atomic_store_n(&item->sequence, pos + QUEUE_SIZE, __ATOMIC_RELEASE);
+
+		if (completion) {
+			completion->res = res;
+			__atomic_store_n(&completion->done, 1, __ATOMIC_RELEASE);
+			futex_wake(&completion->done);
 		}
 	}
 }
@@ -288,7 +555,7 @@ static int loop_get_fd(struct spa_loop_control *ctrl)
 {
 	struct impl *impl = SPA_CONTAINER_OF(ctrl, struct impl, control);
 
-	return impl->epoll_fd;
+	return impl->use_uring ? impl->ring.fd : impl->epoll_fd;
 }
 
 static void
@@ -314,12 +581,129 @@ static void loop_leave(struct spa_loop_control *ctrl)
 	impl->thread = 0;
 }
 
+static inline void dispatch_source(struct impl *impl, struct spa_source *source)
+{
+	uint64_t start = get_time_ns();
+
+	if (source->deadline) {
+		spa_histogram_add(&impl->stats.wakeup_latency,
+				  start > source->deadline ? start - source->deadline : 0);
+		source->deadline = 0;
+	}
+	source->func(source);
+
+	spa_histogram_add(&impl->stats.dispatch_time, get_time_ns() - start);
+}
+
+static void free_destroyed(struct impl *impl)
+{
+	struct source_impl *source, *tmp;
+
+	spa_list_for_each_safe(source, tmp, &impl->destroy_list, link)
+		free(source);
+
+	spa_list_init(&impl->destroy_list);
+}
+
+static int loop_iterate_uring(struct impl *impl, int timeout)
+{
+	struct uring_source *ready[32], *us, *tmp;
+	uint64_t user_data;
+	int32_t cres;
+	int i, res, n_ready = 0, save_errno = 0;
+	enum spa_io mask;
+
+	spa_hook_list_call(&impl->hooks_list, struct spa_loop_control_hooks, before);
+
+	/* submits the requests queued since the last time and waits */
+	if (SPA_UNLIKELY((res = uring_enter(&impl->ring, timeout)) < 0))
+		save_errno = errno;
+
+	spa_hook_list_call(&impl->hooks_list, struct spa_loop_control_hooks, after);
+
+	__atomic_store_n(&impl->stats.iterations, impl->stats.iterations + 1, __ATOMIC_RELAXED);
+
+	if (SPA_UNLIKELY(res < 0)) {
+		errno = save_errno;
+		return SPA_RESULT_ERRNO;
+	}
+
+	pthread_mutex_lock(&impl->uring_lock);
+	while (n_ready < SPA_N_ELEMENTS(ready) && uring_peek(&impl->ring, &user_data, &cres)) {
+		us = (struct uring_source *) (uintptr_t) (user_data & ~URING_OP_MASK);
+		uring_advance(&impl->ring);
+		us->pending--;
+
+		switch (user_data & URING_OP_MASK) {
+		case URING_OP_POLL:
+			us->polling = false;
+			if (us->source == NULL || cres == -ECANCELED)
+				continue;
+			mask = cres < 0 ? SPA_IO_ERR : spa_epoll_to_io(cres);
+			break;
+		case URING_OP_READ:
+			us->reading = false;
+			if (us->source == NULL || cres == -ECANCELED)
+				continue;
+			if (cres == sizeof(uint64_t)) {
+				*us->count = us->value;
+				mask = SPA_IO_IN;
+			} else {
+				spa_log_warn(impl->log, NAME " %p: failed to read fd %d: %s", impl,
+					     us->source->fd, strerror(cres < 0 ? -cres : EIO));
+				/* armed again but not dispatched */
+				mask = 0;
+			}
+			break;
+		default:
+			continue;
+		}
+		/* like with epoll, all rmasks are set before the callbacks */
+		if (!us->dispatch) {
+			us->dispatch = true;
+			us->source->rmask = 0;
+			ready[n_ready++] = us;
+		}
+		us->source->rmask |= mask;
+	}
+	pthread_mutex_unlock(&impl->uring_lock);
+
+	for (i = 0; i < n_ready; i++) {
+		struct spa_source *s = ready[i]->source;
+		if (s && s->rmask && s->fd != -1)
+			dispatch_source(impl, s);
+	}
+
+	/* the new requests go out with the next uring_enter() */
+	pthread_mutex_lock(&impl->uring_lock);
+	for (i = 0; i < n_ready; i++) {
+		us = ready[i];
+		us->dispatch = false;
+		if (us->source && uring_arm(impl, us) < 0)
+			spa_log_warn(impl->log, NAME " %p: failed to arm fd %d: %s", impl,
+				     us->source->fd, strerror(errno));
+	}
+	spa_list_for_each_safe(us, tmp, &impl->uring_dead, link) {
+		if (us->pending == 0) {
+			spa_list_remove(&us->link);
+			free(us);
+		}
+	}
+	pthread_mutex_unlock(&impl->uring_lock);
+
+	free_destroyed(impl);
+
+	return SPA_RESULT_OK;
+}
+
 static int loop_iterate(struct spa_loop_control *ctrl, int timeout)
 {
 	struct impl *impl = SPA_CONTAINER_OF(ctrl, struct impl, control);
 	struct epoll_event ep[32];
 	int i, nfds, save_errno = 0;
-	struct source_impl *source, *tmp;
+
+	if (impl->use_uring)
+		return loop_iterate_uring(impl, timeout);
 
 	spa_hook_list_call(&impl->hooks_list, struct spa_loop_control_hooks, before);
 
@@ -328,6 +712,8 @@ static int loop_iterate(struct spa_loop_control *ctrl, int timeout)
 
 	spa_hook_list_call(&impl->hooks_list, struct spa_loop_control_hooks, after);
 
+	__atomic_store_n(&impl->stats.iterations, impl->stats.iterations + 1, __ATOMIC_RELAXED);
+
 	if (SPA_UNLIKELY(nfds < 0)) {
 		errno = save_errno;
 		return SPA_RESULT_ERRNO;
@@ -343,17 +729,20 @@ static int loop_iterate(struct spa_loop_control *ctrl, int timeout)
 	for (i = 0; i < nfds; i++) {
 		struct spa_source *s = ep[i].data.ptr;
 		if (s->rmask && s->fd != -1) {
-			s->func(s);
+			dispatch_source(impl, s);
 		}
 	}
-	spa_list_for_each_safe(source, tmp, &impl->destroy_list, link)
-		free(source);
-
-	spa_list_init(&impl->destroy_list);
+	free_destroyed(impl);
 
 	return SPA_RESULT_OK;
 }
 
+static const struct spa_loop_stats *loop_get_stats(struct spa_loop_control *ctrl)
+{
+	struct impl *impl = SPA_CONTAINER_OF(ctrl, struct impl, control);
+	return &impl->stats;
+}
+
 static void source_io_func(struct spa_source *source)
 {
 	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
@@ -453,17 +842,34 @@ static void source_event_func(struct spa_source *source)
 	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
 	uint64_t count;
 
-	if (read(source->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
+	if (impl->impl->use_uring) {
+		/* already read by the kernel */
+		count = impl->count;
+	} else if (read(source->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		/* a timerfd that was set again before we got to it */
+		if (errno == EAGAIN)
+			return;
 		spa_log_warn(impl->impl->log, NAME " %p: failed to read event fd %d: %s",
 				source, source->fd, strerror(errno));
-
+	}
 	impl->func.event(source->data, count);
 }
 
-static struct spa_source *loop_add_event(struct spa_loop_utils *utils,
-					 spa_source_event_func_t func, void *data)
+/* io_uring reads the fd for us, a non-blocking fd would make that fail */
+static inline int event_fd_flags(struct impl *impl)
+{
+	return impl->use_uring ? 0 : EFD_NONBLOCK;
+}
+
+static inline int timer_fd_flags(struct impl *impl)
+{
+	return impl->use_uring ? 0 : TFD_NONBLOCK;
+}
+
+/* a source that is dispatched with the count read from an eventfd or timerfd */
+static struct spa_source *add_event(struct impl *impl, int fd,
+				    spa_source_event_func_t func, void *data)
 {
-	struct impl *impl = SPA_CONTAINER_OF(utils, struct impl, utils);
 	struct source_impl *source;
 
 	source = calloc(1, sizeof(struct source_impl));
@@ -473,19 +879,27 @@ static struct spa_source *loop_add_event(struct spa_loop_utils *utils,
 	source->source.loop = &impl->loop;
 	source->source.func = source_event_func;
 	source->source.data = data;
-	source->source.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	source->source.fd = fd;
 	source->source.mask = SPA_IO_IN;
 	source->impl = impl;
 	source->close = true;
 	source->func.event = func;
 
-	spa_loop_add_source(&impl->loop, &source->source);
+	add_source(impl, &source->source, impl->use_uring ? &source->count : NULL);
 
 	spa_list_insert(&impl->source_list, &source->link);
 
 	return &source->source;
 }
 
+static struct spa_source *loop_add_event(struct spa_loop_utils *utils,
+					 spa_source_event_func_t func, void *data)
+{
+	struct impl *impl = SPA_CONTAINER_OF(utils, struct impl, utils);
+
+	return add_event(impl, eventfd(0, EFD_CLOEXEC | event_fd_flags(impl)), func, data);
+}
+
 static void loop_signal_event(struct spa_source *source)
 {
 	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
@@ -496,16 +910,220 @@ static void loop_signal_event(struct spa_source *source)
 				source, source->fd, strerror(errno));
 }
 
-static void source_timer_func(struct spa_source *source)
+static inline bool wheel_is_empty(struct impl *impl)
 {
-	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
+	int i;
+	for (i = 0; i < WHEEL_LEVELS; i++) {
+		if (impl->wheel.bitmap[i])
+			return false;
+	}
+	return true;
+}
+
+static void wheel_insert(struct impl *impl, struct source_impl *timer)
+{
+	uint64_t tick = impl->wheel.tick;
+	uint64_t expires = timer->deadline >> WHEEL_TICK_SHIFT;
+	uint64_t delta;
+	int level;
+
+	if (expires < tick)
+		expires = tick;
+	delta = expires - tick;
+	if (delta > WHEEL_MAX_TICKS)
+		expires = tick + (delta = WHEEL_MAX_TICKS);
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < (1ULL << (WHEEL_BITS * (level + 1))))
+			break;
+	}
+	timer->level = level;
+	timer->slot = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	timer->queued = true;
+
+	spa_list_insert(impl->wheel.slots[level][timer->slot].prev, &timer->timer_link);
+	impl->wheel.bitmap[level] |= 1ULL << timer->slot;
+}
+
+static void wheel_remove(struct impl *impl, struct source_impl *timer)
+{
+	if (!timer->queued)
+		return;
+
+	spa_list_remove(&timer->timer_link);
+	if (spa_list_is_empty(&impl->wheel.slots[timer->level][timer->slot]))
+		impl->wheel.bitmap[timer->level] &= ~(1ULL << timer->slot);
+	timer->queued = false;
+}
+
+/* move all timers of a slot to the list */
+static void wheel_take_slot(struct impl *impl, int level, int slot, struct spa_list *list)
+{
+	struct spa_list *head = &impl->wheel.slots[level][slot];
+
+	spa_list_init(list);
+	if (!spa_list_is_empty(head)) {
+		spa_list_insert_list(list, head);
+		spa_list_init(head);
+	}
+	impl->wheel.bitmap[level] &= ~(1ULL << slot);
+}
+
+/* when the wheel moves to a tick where the lower levels wrap around, the
+ * timers of the next slot in the higher levels are placed again */
+static void wheel_cascade(struct impl *impl)
+{
+	uint64_t tick = impl->wheel.tick;
+	struct source_impl *timer;
+	struct spa_list list;
+	int level;
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		if ((tick >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK)
+			break;
+
+		wheel_take_slot(impl, level, (tick >> (WHEEL_BITS * level)) & WHEEL_MASK, &list);
+		while (!spa_list_is_empty(&list)) {
+			timer = spa_list_first(&list, struct source_impl, timer_link);
+			spa_list_remove(&timer->timer_link);
+			wheel_insert(impl, timer);
+		}
+	}
+}
+
+/* the next tick that needs work, never past @limit */
+static uint64_t wheel_next_tick(struct impl *impl, uint64_t limit)
+{
+	uint64_t tick = impl->wheel.tick, next;
+	int level;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		if (impl->wheel.bitmap[level])
+			break;
+	}
+	if (level == 0)
+		next = tick + 1;
+	else if (level == WHEEL_LEVELS)
+		next = limit;
+	else {
+		/* nothing in the lower levels, skip to the next cascade */
+		uint64_t mask = (1ULL << (WHEEL_BITS * level)) - 1;
+		next = (tick | mask) + 1;
+	}
+	return SPA_MIN(next, limit);
+}
+
+/* the earliest deadline of the timers or UINT64_MAX. The slots of a level
+ * are ordered but the levels overlap, a timer in the first slot of a higher
+ * level can expire before the timers in the lower levels. */
+static uint64_t wheel_next_deadline(struct impl *impl)
+{
+	uint64_t tick = impl->wheel.tick;
+	uint64_t deadline = UINT64_MAX;
+	struct source_impl *timer;
+	int level;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		uint64_t bitmap = impl->wheel.bitmap[level];
+		int start, slot;
+
+		if (bitmap == 0)
+			continue;
+
+		/* the lowest level holds the current tick, the higher levels
+		 * start at the slot after the current one */
+		start = ((tick >> (WHEEL_BITS * level)) + (level ? 1 : 0)) & WHEEL_MASK;
+		bitmap = (bitmap >> start) | (start ? bitmap << (WHEEL_SIZE - start) : 0);
+		slot = (start + __builtin_ctzll(bitmap)) & WHEEL_MASK;
+
+		spa_list_for_each(timer, &impl->wheel.slots[level][slot], timer_link)
+			deadline = SPA_MIN(deadline, timer->deadline);
+	}
+	return deadline;
+}
+
+static void wheel_arm(struct impl *impl, uint64_t deadline)
+{
+	struct itimerspec its;
+
+	if (deadline == impl->wheel.armed)
+		return;
+
+	spa_zero(its);
+	if (deadline != UINT64_MAX) {
+		/* a zero value would disarm the timer */
+		deadline = SPA_MAX(deadline, 1);
+		its.it_value.tv_sec = deadline / SPA_NSEC_PER_SEC;
+		its.it_value.tv_nsec = deadline % SPA_NSEC_PER_SEC;
+	}
+	if (timerfd_settime(impl->wheel.source->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		spa_log_warn(impl->log, NAME " %p: failed to arm timer fd: %s",
+				impl, strerror(errno));
+		return;
+	}
+	impl->wheel.armed = deadline;
+}
+
+static void wheel_expire(struct impl *impl, uint64_t now)
+{
+	struct source_impl *timer;
+	struct spa_list list;
 	uint64_t expirations;
 
-	if (read(source->fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t))
-		spa_log_warn(impl->impl->log, NAME " %p: failed to read timer fd %d: %s",
-				source, source->fd, strerror(errno));
+	/* the timers stay queued in @list, an update while the lock is
+	 * released for a callback takes them out of it */
+	wheel_take_slot(impl, 0, impl->wheel.tick & WHEEL_MASK, &list);
+
+	while (!spa_list_is_empty(&list)) {
+		timer = spa_list_first(&list, struct source_impl, timer_link);
+		spa_list_remove(&timer->timer_link);
+		timer->queued = false;
+
+		if (timer->deadline > now) {
+			/* later in the current tick */
+			wheel_insert(impl, timer);
+			continue;
+		}
+		spa_histogram_add(&impl->stats.wakeup_latency, now - timer->deadline);
+
+		if (timer->interval) {
+			expirations = 1 + (now - timer->deadline) / timer->interval;
+			timer->deadline += expirations * timer->interval;
+			wheel_insert(impl, timer);
+		} else
+			expirations = 1;
+
+		/* the callback can update timers */
+		pthread_mutex_unlock(&impl->wheel.lock);
+		timer->func.timer(timer->source.data, expirations);
+		pthread_mutex_lock(&impl->wheel.lock);
+	}
+}
+
+static void wheel_func(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	uint64_t now, now_tick;
+
+	pthread_mutex_lock(&impl->wheel.lock);
+
+	/* don't arm the timerfd from the callbacks, it's done at the end */
+	impl->wheel.armed = 0;
+
+	now = get_time_ns();
+	now_tick = now >> WHEEL_TICK_SHIFT;
 
-	impl->func.timer(source->data, expirations);
+	while (true) {
+		wheel_expire(impl, now);
+		if (impl->wheel.tick >= now_tick)
+			break;
+		impl->wheel.tick = wheel_next_tick(impl, now_tick);
+		wheel_cascade(impl);
+	}
+	impl->wheel.armed = UINT64_MAX;
+	wheel_arm(impl, wheel_next_deadline(impl));
+
+	pthread_mutex_unlock(&impl->wheel.lock);
 }
 
 static struct spa_source *loop_add_timer(struct spa_loop_utils *utils,
@@ -518,17 +1136,13 @@ static struct spa_source *loop_add_timer(struct spa_loop_utils *utils,
 	if (source == NULL)
 		return NULL;
 
+	/* timers have no fd, they are dispatched from the wheel */
 	source->source.loop = &impl->loop;
-	source->source.func = source_timer_func;
 	source->source.data = data;
-	source->source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
-	source->source.mask = SPA_IO_IN;
+	source->source.fd = -1;
 	source->impl = impl;
-	source->close = true;
 	source->func.timer = func;
 
-	spa_loop_add_source(&impl->loop, &source->source);
-
 	spa_list_insert(&impl->source_list, &source->link);
 
 	return &source->source;
@@ -538,23 +1152,39 @@ static int
 loop_update_timer(struct spa_source *source,
 		  struct timespec *value, struct timespec *interval, bool absolute)
 {
-	struct itimerspec its;
-	int flags = 0;
+	struct source_impl *timer = SPA_CONTAINER_OF(source, struct source_impl, source);
+	struct impl *impl = timer->impl;
+	uint64_t deadline = 0;
 
-	spa_zero(its);
 	if (value) {
-		its.it_value = *value;
+		deadline = SPA_TIMESPEC_TO_TIME(value);
 	} else if (interval) {
-		its.it_value = *interval;
+		deadline = SPA_TIMESPEC_TO_TIME(interval);
 		absolute = true;
 	}
-	if (interval)
-		its.it_interval = *interval;
-	if (absolute)
-		flags |= TFD_TIMER_ABSTIME;
+	if (!absolute && deadline != 0)
+		deadline += get_time_ns();
 
-	if (timerfd_settime(source->fd, flags, &its, NULL) < 0)
-		return SPA_RESULT_ERRNO;
+	pthread_mutex_lock(&impl->wheel.lock);
+
+	timer->interval = interval ? SPA_TIMESPEC_TO_TIME(interval) : 0;
+
+	wheel_remove(impl, timer);
+
+	if (wheel_is_empty(impl))
+		impl->wheel.tick = get_time_ns() >> WHEEL_TICK_SHIFT;
+
+	/* like timerfd, a zero value disarms the timer */
+	if (deadline != 0) {
+		timer->deadline = deadline;
+
+		wheel_insert(impl, timer);
+
+		if (deadline < impl->wheel.armed)
+			wheel_arm(impl, deadline);
+	}
+
+	pthread_mutex_unlock(&impl->wheel.lock);
 
 	return SPA_RESULT_OK;
 }
@@ -614,6 +1244,9 @@ static void loop_destroy_source(struct spa_source *source)
 
 	spa_list_remove(&impl->link);
 
+	pthread_mutex_lock(&loop_impl->wheel.lock);
+	wheel_remove(loop_impl, impl);
+	pthread_mutex_unlock(&loop_impl->wheel.lock);
 	spa_loop_remove_source(source->loop, source);
 
 	if (source->fd != -1 && impl->close) {
@@ -639,6 +1272,7 @@ static const struct spa_loop_control impl_loop_control = {
 	loop_enter,
 	loop_leave,
 	loop_iterate,
+	loop_get_stats,
 };
 
 static const struct spa_loop_utils impl_loop_utils = {
@@ -680,6 +1314,7 @@ static int impl_clear(struct spa_handle *handle)
 {
 	struct impl *impl;
 	struct source_impl *source, *tmp;
+	int i;
 
 	spa_return_val_if_fail(handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 
@@ -690,8 +1325,23 @@ static int impl_clear(struct spa_handle *handle)
 	spa_list_for_each_safe(source, tmp, &impl->destroy_list, link)
 	    free(source);
 
-	close(impl->ack_fd);
-	close(impl->epoll_fd);
+	if (impl->use_uring) {
+		struct uring_source *us, *t;
+
+		/* closing the ring cancels what is still pending */
+		uring_clear(&impl->ring);
+
+		for (i = 0; i < URING_HASH_SIZE; i++) {
+			spa_list_for_each_safe(us, t, &impl->uring_hash[i], link)
+				free(us);
+		}
+		spa_list_for_each_safe(us, t, &impl->uring_dead, link)
+			free(us);
+		pthread_mutex_destroy(&impl->uring_lock);
+	} else
+		close(impl->epoll_fd);
+
+	pthread_mutex_destroy(&impl->wheel.lock);
 
 	return SPA_RESULT_OK;
 }
@@ -705,6 +1355,7 @@ impl_init(const struct spa_handle_factory *factory,
 {
 	struct impl *impl;
 	uint32_t i;
+	const char *str;
 
 	spa_return_val_if_fail(factory != NULL, SPA_RESULT_INVALID_ARGUMENTS);
 	spa_return_val_if_fail(handle != NULL, SPA_RESULT_INVALID_ARGUMENTS);
@@ -729,20 +1380,55 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 	init_type(&impl->type, impl->map);
 
-	impl->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
-	if (impl->epoll_fd == -1)
-		return SPA_RESULT_ERRNO;
+	if (info == NULL || (str = spa_dict_lookup(info, "loop.backend")) == NULL)
+		str = getenv("SPA_LOOP_BACKEND");
+
+	if (str && strcmp(str, "io_uring") == 0) {
+		if (uring_init(&impl->ring, URING_ENTRIES) < 0) {
+			spa_log_warn(impl->log, NAME " %p: can't use io_uring: %s, using epoll",
+				     impl, strerror(errno));
+		} else {
+			impl->use_uring = true;
+			pthread_mutex_init(&impl->uring_lock, NULL);
+			for (i = 0; i < URING_HASH_SIZE; i++)
+				spa_list_init(&impl->uring_hash[i]);
+			spa_list_init(&impl->uring_dead);
+		}
+	} else if (str && strcmp(str, "epoll") != 0) {
+		spa_log_warn(impl->log, NAME " %p: unknown backend %s, using epoll", impl, str);
+	}
+
+	if (!impl->use_uring) {
+		impl->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (impl->epoll_fd == -1)
+			return SPA_RESULT_ERRNO;
+	}
 
 	spa_list_init(&impl->source_list);
 	spa_list_init(&impl->destroy_list);
 	spa_hook_list_init(&impl->hooks_list);
 
-	spa_ringbuffer_init(&impl->buffer, DATAS_SIZE);
+	for (i = 0; i < QUEUE_SIZE; i++)
+		impl->queue[i].sequence = i;
+	impl->enqueue_pos = impl->dequeue_pos = 0;
+
+	for (i = 0; i < WHEEL_LEVELS; i++) {
+		int j;
+		for (j = 0; j < WHEEL_SIZE; j++)
+			spa_list_init(&impl->wheel.slots[i][j]);
+		impl->wheel.bitmap[i] = 0;
+	}
+	pthread_mutex_init(&impl->wheel.lock, NULL);
+	impl->wheel.tick = get_time_ns() >> WHEEL_TICK_SHIFT;
+	impl->wheel.armed = UINT64_MAX;
+	impl->wheel.source = add_event(impl,
+			timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | timer_fd_flags(impl)),
+			wheel_func, impl);
 
 	impl->wakeup = spa_loop_utils_add_event(&impl->utils, wakeup_func, impl);
-	impl->ack_fd = eventfd(0, EFD_CLOEXEC);
 
-	spa_log_info(impl->log, NAME " %p: initialized", impl);
+	spa_log_info(impl->log, NAME " %p: initialized, using %s", impl,
+		     impl->use_uring ? "io_uring" : "epoll");
 
 	return SPA_RESULT_OK;
 }
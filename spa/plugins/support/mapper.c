@@ -25,6 +25,8 @@
 #include <sys/eventfd.h>
 
 #include <spa/type-map.h>
+#include <spa/type-map-impl.h>
+#include <spa/type-ids.h>
 #include <spa/clock.h>
 #include <spa/log.h>
 #include <spa/loop.h>
@@ -51,6 +53,11 @@ struct array {
 	void *data;
 };
 
+struct entry {
+	off_t offset;
+	uint32_t hash;
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_type_map map;
@@ -59,6 +66,10 @@ struct impl {
 
 	struct array types;
 	struct array strings;
+
+	/* open addressing hash table with id + 1 of the types, 0 is free */
+	uint32_t *index;
+	uint32_t index_size;
 };
 
 static inline void * alloc_size(struct array *array, size_t size, size_t extend)
@@ -73,32 +84,74 @@ static inline void * alloc_size(struct array *array, size_t size, size_t extend)
 	return res;
 }
 
+static inline uint32_t n_types(struct impl *impl)
+{
+	return impl->types.size / sizeof(struct entry);
+}
+
+static int grow_index(struct impl *impl)
+{
+	struct entry *entries = impl->types.data;
+	uint32_t i, pos, size, mask, *index;
+
+	size = impl->index_size ? impl->index_size * 2 : 256;
+	if ((index = calloc(size, sizeof(uint32_t))) == NULL)
+		return SPA_RESULT_NO_MEMORY;
+
+	mask = size - 1;
+	for (i = 0; i < n_types(impl); i++) {
+		for (pos = entries[i].hash & mask; index[pos] != 0; pos = (pos + 1) & mask);
+		index[pos] = i + 1;
+	}
+	free(impl->index);
+	impl->index = index;
+	impl->index_size = size;
+
+	return SPA_RESULT_OK;
+}
+
 static uint32_t
 impl_type_map_get_id(struct spa_type_map *map, const char *type)
 {
 	struct impl *impl = SPA_CONTAINER_OF(map, struct impl, map);
-	uint32_t i, len;
+	uint32_t i, len, hash, pos, mask;
+	struct entry *entries, *e;
 	void *p;
-	off_t o, *off;
 
 	if (type == NULL)
 		return SPA_ID_INVALID;
 
-	for (i = 0; i < impl->types.size / sizeof(off_t); i++) {
-		o = ((off_t *)impl->types.data)[i];
-		if (strcmp(SPA_MEMBER(impl->strings.data, o, char), type) == 0)
-			return i;
+	hash = spa_type_map_hash(type);
+
+	if (impl->index_size > 0) {
+		entries = impl->types.data;
+		mask = impl->index_size - 1;
+
+		for (pos = hash & mask; (i = impl->index[pos]) != 0; pos = (pos + 1) & mask) {
+			e = &entries[i - 1];
+			if (e->hash == hash &&
+			    strcmp(SPA_MEMBER(impl->strings.data, e->offset, char), type) == 0)
+				return i - 1;
+		}
 	}
+	/* keep the table at most half full */
+	if ((n_types(impl) + 1) * 2 > impl->index_size && grow_index(impl) < 0)
+		return SPA_ID_INVALID;
+
 	len = strlen(type);
 	p = alloc_size(&impl->strings, len+1, 1024);
 	memcpy(p, type, len + 1);
 
-	off = alloc_size(&impl->types, sizeof(off_t), 128);
-	*off = SPA_PTRDIFF(p, impl->strings.data);
-	i = SPA_PTRDIFF(off, impl->types.data) / sizeof(off_t);
+	e = alloc_size(&impl->types, sizeof(struct entry), 128 * sizeof(struct entry));
+	e->offset = SPA_PTRDIFF(p, impl->strings.data);
+	e->hash = hash;
+	i = SPA_PTRDIFF(e, impl->types.data) / sizeof(struct entry);
 
-	return i;
+	mask = impl->index_size - 1;
+	for (pos = hash & mask; impl->index[pos] != 0; pos = (pos + 1) & mask);
+	impl->index[pos] = i + 1;
 
+	return i;
 }
 
 static const char *
@@ -106,9 +159,9 @@ impl_type_map_get_type(const struct spa_type_map *map, uint32_t id)
 {
 	struct impl *impl = SPA_CONTAINER_OF(map, struct impl, map);
 
-	if (id < impl->types.size / sizeof(off_t)) {
-		off_t o = ((off_t *)impl->types.data)[id];
-		return SPA_MEMBER(impl->strings.data, o, char);
+	if (id < n_types(impl)) {
+		struct entry *e = &((struct entry *)impl->types.data)[id];
+		return SPA_MEMBER(impl->strings.data, e->offset, char);
 	}
 	return NULL;
 }
@@ -117,7 +170,7 @@ static size_t
 impl_type_map_get_size(const struct spa_type_map *map)
 {
 	struct impl *impl = SPA_CONTAINER_OF(map, struct impl, map);
-	return impl->types.size / sizeof(off_t);
+	return n_types(impl);
 }
 
 static const struct spa_type_map impl_type_map = {
@@ -157,6 +210,7 @@ static int impl_clear(struct spa_handle *handle)
 		free(impl->types.data);
 	if (impl->strings.data)
 		free(impl->strings.data);
+	free(impl->index);
 
 	return SPA_RESULT_OK;
 }
@@ -182,6 +236,12 @@ impl_init(const struct spa_handle_factory *factory,
 
 	init_type(&impl->type, &impl->map);
 
+	/* the well-known types get their reserved ids */
+	if (spa_type_map_add_ids(&impl->map) < 0) {
+		impl_clear(handle);
+		return SPA_RESULT_NO_MEMORY;
+	}
+
 	return SPA_RESULT_OK;
 }
 
@@ -52,12 +52,14 @@ struct type {
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
-	type->clock = spa_type_map_get_id(map, SPA_TYPE__Clock);
-	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
-	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
-	type->prop_live = spa_type_map_get_id(map, SPA_TYPE_PROPS__live);
-	type->prop_pattern = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType);
+	bool ids = spa_type_map_has_ids(map);
+
+	type->node = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Node);
+	type->clock = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Clock);
+	type->format = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Format);
+	type->props = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Props);
+	type->prop_live = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__live);
+	type->prop_pattern = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__patternType);
 	spa_type_meta_map(map, &type->meta);
 	spa_type_data_map(map, &type->data);
 	spa_type_event_node_map(map, &type->event_node);
@@ -47,7 +47,9 @@ struct type {
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-	type->handle_factory = spa_type_map_get_id(map, SPA_TYPE__HandleFactory);
+	bool ids = spa_type_map_has_ids(map);
+
+	type->handle_factory = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__HandleFactory);
 	spa_type_monitor_map(map, &type->monitor);
 }
 
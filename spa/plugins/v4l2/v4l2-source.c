@@ -84,13 +84,15 @@ struct type {
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
-	type->clock = spa_type_map_get_id(map, SPA_TYPE__Clock);
-	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
-	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
-	type->prop_device = spa_type_map_get_id(map, SPA_TYPE_PROPS__device);
-	type->prop_device_name = spa_type_map_get_id(map, SPA_TYPE_PROPS__deviceName);
-	type->prop_device_fd = spa_type_map_get_id(map, SPA_TYPE_PROPS__deviceFd);
+	bool ids = spa_type_map_has_ids(map);
+
+	type->node = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Node);
+	type->clock = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Clock);
+	type->format = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Format);
+	type->props = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Props);
+	type->prop_device = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__device);
+	type->prop_device_name = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__deviceName);
+	type->prop_device_fd = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__deviceFd);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
 	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
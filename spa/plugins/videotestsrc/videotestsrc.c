@@ -65,12 +65,14 @@ struct type {
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
-	type->clock = spa_type_map_get_id(map, SPA_TYPE__Clock);
-	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
-	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
-	type->prop_live = spa_type_map_get_id(map, SPA_TYPE_PROPS__live);
-	type->prop_pattern = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType);
+	bool ids = spa_type_map_has_ids(map);
+
+	type->node = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Node);
+	type->clock = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Clock);
+	type->format = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Format);
+	type->props = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Props);
+	type->prop_live = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__live);
+	type->prop_pattern = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE_PROPS__patternType);
 	type->pattern_smpte_snow = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType ":smpte-snow");
 	type->pattern_snow = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType ":snow");
 	spa_type_meta_map(map, &type->meta);
@@ -93,6 +95,9 @@ struct props {
 #define MAX_BUFFERS 16
 #define MAX_PORTS 1
 
+/* use huge pages for frames of at least this size */
+#define HUGEPAGES_MIN_SIZE (2 * 1024 * 1024)
+
 struct buffer {
 	struct spa_buffer *outbuf;
 	bool outstanding;
@@ -633,7 +638,9 @@ impl_node_port_enum_params(struct spa_node *node,
 			PROP_U_MM(&f[1], this->type.param_alloc_buffers.buffers, SPA_POD_TYPE_INT,
 				32, 2, 32),
 			PROP(&f[1], this->type.param_alloc_buffers.align, SPA_POD_TYPE_INT,
-				16));
+				16),
+			PROP(&f[1], this->type.param_alloc_buffers.hugepages, SPA_POD_TYPE_BOOL,
+				this->stride * raw_info->size.height >= HUGEPAGES_MIN_SIZE));
 			break;
 	}
 	case 1:
@@ -0,0 +1,415 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <spa/loop.h>
+#include <spa/dict.h>
+#include <spa/log-impl.h>
+#include <spa/type-map-impl.h>
+
+/* benchmark of the loop backends. Another thread wakes up the loop with
+ * an event, a pipe or a timer and we measure the time from the wakeup to
+ * the dispatch of the callback. The syscalls the loop thread makes are
+ * counted by wrapping read, write, epoll_wait, timerfd_settime and syscall,
+ * this binary is linked with -rdynamic so that the plugin uses our
+ * versions. */
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+static ssize_t (*real_read) (int fd, void *buf, size_t count);
+static ssize_t (*real_write) (int fd, const void *buf, size_t count);
+static int (*real_epoll_wait) (int epfd, struct epoll_event *events, int maxevents, int timeout);
+static int (*real_timerfd_settime) (int fd, int flags, const struct itimerspec *new_value,
+				    struct itimerspec *old_value);
+static long (*real_syscall) (long number, ...);
+
+static __thread bool count_syscalls;
+static uint64_t n_syscalls;
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+	if (count_syscalls)
+		n_syscalls++;
+	return real_read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	if (count_syscalls)
+		n_syscalls++;
+	return real_write(fd, buf, count);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+	if (count_syscalls)
+		n_syscalls++;
+	return real_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+int timerfd_settime(int fd, int flags, const struct itimerspec *new_value,
+		    struct itimerspec *old_value)
+{
+	if (count_syscalls)
+		n_syscalls++;
+	return real_timerfd_settime(fd, flags, new_value, old_value);
+}
+
+long syscall(long number, ...)
+{
+	va_list args;
+	long a[6];
+	int i;
+
+	va_start(args, number);
+	for (i = 0; i < 6; i++)
+		a[i] = va_arg(args, long);
+	va_end(args);
+
+	if (count_syscalls)
+		n_syscalls++;
+	return real_syscall(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+enum test {
+	TEST_EVENT,
+	TEST_PIPE,
+	TEST_TIMER,
+};
+
+static const char *test_names[] = { "event", "pipe", "timer" };
+
+struct data {
+	struct spa_handle *handle;
+	struct spa_loop *loop;
+	struct spa_loop_control *control;
+	struct spa_loop_utils *utils;
+	struct spa_hook hook;
+
+	pthread_t thread;
+	bool running;
+
+	enum test test;
+	int n_wakeups;
+	int64_t *latencies;
+
+	struct spa_source *event;
+	struct spa_source *timer;
+	struct spa_source pipe_source;
+	int fds[2];
+
+	int64_t sent;
+	int32_t count;
+	uint64_t n_iterations;
+};
+
+static int64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static void dispatched(struct data *d)
+{
+	int64_t now = get_time();
+
+	if (d->count < d->n_wakeups)
+		d->latencies[d->count] = now - d->sent;
+
+	/* the futex of the benchmark is not counted */
+	__atomic_store_n(&d->count, d->count + 1, __ATOMIC_RELEASE);
+	real_syscall(SYS_futex, &d->count, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void on_event(void *data, uint64_t count)
+{
+	dispatched(data);
+}
+
+static void on_timer(void *data, uint64_t expirations)
+{
+	dispatched(data);
+}
+
+static void on_pipe(struct spa_source *source)
+{
+	struct data *d = source->data;
+	uint8_t b;
+
+	if (read(d->fds[0], &b, 1) != 1)
+		fprintf(stderr, "read failed\n");
+	dispatched(d);
+}
+
+static void before_wait(void *data)
+{
+}
+
+static void after_wait(void *data)
+{
+	struct data *d = data;
+	d->n_iterations++;
+}
+
+static const struct spa_loop_control_hooks control_hooks = {
+	SPA_VERSION_LOOP_CONTROL_HOOKS,
+	before_wait,
+	after_wait,
+};
+
+static int
+do_stop(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+	void *user_data)
+{
+	struct data *d = user_data;
+	d->running = false;
+	return 0;
+}
+
+static void *loop_thread(void *user_data)
+{
+	struct data *d = user_data;
+
+	count_syscalls = true;
+	spa_loop_control_enter(d->control);
+	while (d->running)
+		spa_loop_control_iterate(d->control, -1);
+	spa_loop_control_leave(d->control);
+	count_syscalls = false;
+
+	return NULL;
+}
+
+static int make_loop(struct data *d, const char *lib, const char *backend)
+{
+	struct spa_support support[2];
+	const struct spa_handle_factory *factory;
+	spa_handle_factory_enum_func_t enum_func;
+	struct spa_dict_item items[1];
+	struct spa_dict info;
+	void *hnd, *iface;
+	uint32_t i;
+	int res;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return SPA_RESULT_ERROR;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return SPA_RESULT_ERROR;
+	}
+
+	support[0].type = SPA_TYPE__TypeMap;
+	support[0].data = &default_map.map;
+	support[1].type = SPA_TYPE__Log;
+	support[1].data = &default_log.log;
+
+	items[0].key = "loop.backend";
+	items[0].value = backend;
+	info.n_items = 1;
+	info.items = items;
+
+	for (i = 0;; i++) {
+		if ((res = enum_func(&factory, i)) < 0)
+			return res;
+		if (strcmp(factory->name, "loop") == 0)
+			break;
+	}
+
+	d->handle = calloc(1, factory->size);
+	if ((res = spa_handle_factory_init(factory, d->handle, &info, support, 2)) < 0)
+		return res;
+
+	if ((res = spa_handle_get_interface(d->handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__Loop), &iface)) < 0)
+		return res;
+	d->loop = iface;
+
+	if ((res = spa_handle_get_interface(d->handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__LoopControl), &iface)) < 0)
+		return res;
+	d->control = iface;
+
+	if ((res = spa_handle_get_interface(d->handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__LoopUtils), &iface)) < 0)
+		return res;
+	d->utils = iface;
+
+	return SPA_RESULT_OK;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	const int64_t *la = a, *lb = b;
+	return *la < *lb ? -1 : *la > *lb ? 1 : 0;
+}
+
+static int
+do_set_timer(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+	     void *user_data)
+{
+	struct data *d = user_data;
+	int64_t deadline = *(int64_t *) data;
+	struct timespec value;
+
+	value.tv_sec = deadline / SPA_NSEC_PER_SEC;
+	value.tv_nsec = deadline % SPA_NSEC_PER_SEC;
+	spa_loop_utils_update_timer(d->utils, d->timer, &value, NULL, true);
+	return 0;
+}
+
+static void wakeup(struct data *d, int i)
+{
+	uint8_t b = 0;
+
+	switch (d->test) {
+	case TEST_EVENT:
+		d->sent = get_time();
+		spa_loop_utils_signal_event(d->utils, d->event);
+		break;
+	case TEST_PIPE:
+		d->sent = get_time();
+		if (real_write(d->fds[1], &b, 1) != 1)
+			fprintf(stderr, "write failed\n");
+		break;
+	case TEST_TIMER:
+		/* timers belong to the loop thread, the latency is from the
+		 * deadline */
+		d->sent = get_time() + 100 * SPA_NSEC_PER_USEC;
+		spa_loop_invoke(d->loop, do_set_timer, SPA_ID_INVALID, sizeof(int64_t), &d->sent,
+				false, d);
+		break;
+	}
+}
+
+static int run_test(const char *lib, const char *backend, enum test test, int n_wakeups)
+{
+	struct data data = { NULL }, *d = &data;
+	struct timespec pause = { 0, 50 * SPA_NSEC_PER_USEC };
+	uint64_t syscalls;
+	int i, count;
+
+	if (make_loop(d, lib, backend) < 0) {
+		printf("can't make loop\n");
+		return -1;
+	}
+	d->test = test;
+	d->n_wakeups = n_wakeups;
+	d->latencies = calloc(n_wakeups, sizeof(int64_t));
+
+	spa_loop_control_add_hook(d->control, &d->hook, &control_hooks, d);
+
+	switch (test) {
+	case TEST_EVENT:
+		d->event = spa_loop_utils_add_event(d->utils, on_event, d);
+		break;
+	case TEST_PIPE:
+		if (pipe(d->fds) < 0)
+			return -1;
+		d->pipe_source.func = on_pipe;
+		d->pipe_source.data = d;
+		d->pipe_source.fd = d->fds[0];
+		d->pipe_source.mask = SPA_IO_IN;
+		spa_loop_add_source(d->loop, &d->pipe_source);
+		break;
+	case TEST_TIMER:
+		d->timer = spa_loop_utils_add_timer(d->utils, on_timer, d);
+		break;
+	}
+
+	d->running = true;
+	pthread_create(&d->thread, NULL, loop_thread, d);
+
+	/* let the loop go to sleep */
+	nanosleep(&pause, NULL);
+	__atomic_store_n(&n_syscalls, 0, __ATOMIC_SEQ_CST);
+	d->n_iterations = 0;
+
+	for (i = 0; i < n_wakeups; i++) {
+		wakeup(d, i);
+		while ((count = __atomic_load_n(&d->count, __ATOMIC_ACQUIRE)) == i)
+			real_syscall(SYS_futex, &d->count, FUTEX_WAIT_PRIVATE, i, NULL, NULL, 0);
+		nanosleep(&pause, NULL);
+	}
+	syscalls = __atomic_load_n(&n_syscalls, __ATOMIC_SEQ_CST);
+
+	spa_loop_invoke(d->loop, do_stop, SPA_ID_INVALID, 0, NULL, true, d);
+	pthread_join(d->thread, NULL);
+
+	qsort(d->latencies, n_wakeups, sizeof(int64_t), compare_latency);
+	printf("%-8s %-6s %7d wakeups, latency usec min %6.1f p50 %6.1f p99 %6.1f max %7.1f, "
+	       "%.2f syscalls/iteration\n",
+	       backend, test_names[test], n_wakeups,
+	       d->latencies[0] / 1000.0,
+	       d->latencies[n_wakeups / 2] / 1000.0,
+	       d->latencies[(n_wakeups * 99) / 100] / 1000.0,
+	       d->latencies[n_wakeups - 1] / 1000.0,
+	       d->n_iterations ? (double) syscalls / d->n_iterations : 0.0);
+
+	if (test == TEST_PIPE) {
+		spa_loop_remove_source(d->loop, &d->pipe_source);
+		close(d->fds[0]);
+		close(d->fds[1]);
+	}
+	spa_handle_clear(d->handle);
+	free(d->handle);
+	free(d->latencies);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *backends[] = { "epoll", "io_uring" };
+	const char *lib;
+	int i, j, n_wakeups;
+
+	real_read = dlsym(RTLD_NEXT, "read");
+	real_write = dlsym(RTLD_NEXT, "write");
+	real_epoll_wait = dlsym(RTLD_NEXT, "epoll_wait");
+	real_timerfd_settime = dlsym(RTLD_NEXT, "timerfd_settime");
+	real_syscall = dlsym(RTLD_NEXT, "syscall");
+
+	n_wakeups = argc > 1 ? atoi(argv[1]) : 10000;
+	lib = argc > 2 ? argv[2] : "build/spa/plugins/support/libspa-support.so";
+
+	for (i = 0; i < SPA_N_ELEMENTS(test_names); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(backends); j++) {
+			if (run_test(lib, backends[j], i, n_wakeups) < 0)
+				return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,223 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <spa/pod-schema.h>
+
+/* benchmark of the pod schemas against spa_pod_iter_get and
+ * spa_pod_builder_add with a message like the add_mem event of the
+ * client-node, and checks that malformed messages are rejected */
+
+#define N_ROUNDS	1000000
+
+struct msg {
+	uint32_t direction;
+	uint32_t port_id;
+	uint32_t mem_id;
+	uint32_t type;
+	uint32_t memfd_idx;
+	uint32_t flags;
+	uint32_t offset;
+	uint32_t size;
+	const char *name;
+	const struct spa_pod *filter;
+};
+
+SPA_POD_SCHEMA_DEFINE(msg_schema,
+	SPA_POD_SCHEMA_INT(struct msg, direction),
+	SPA_POD_SCHEMA_INT(struct msg, port_id),
+	SPA_POD_SCHEMA_INT(struct msg, mem_id),
+	SPA_POD_SCHEMA_ID(struct msg, type),
+	SPA_POD_SCHEMA_INT(struct msg, memfd_idx),
+	SPA_POD_SCHEMA_INT(struct msg, flags),
+	SPA_POD_SCHEMA_INT(struct msg, offset),
+	SPA_POD_SCHEMA_INT(struct msg, size),
+	SPA_POD_SCHEMA_STRING(struct msg, name),
+	SPA_POD_SCHEMA_POD(-SPA_POD_TYPE_OBJECT, struct msg, filter));
+
+static const struct msg expected = { 1, 2, 3, 4, 5, 6, 4096, 65536, "memory", NULL };
+
+static int64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void report(const char *name, int64_t t1, int64_t t2)
+{
+	printf("%-16s: %6.1f ns per message\n", name, (double) (t2 - t1) / N_ROUNDS);
+}
+
+static uint32_t build_varargs(void *buffer, uint32_t size, const struct msg *m)
+{
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, size);
+	struct spa_pod_frame f;
+
+	spa_pod_builder_struct(&b, &f,
+			       SPA_POD_TYPE_INT, m->direction,
+			       SPA_POD_TYPE_INT, m->port_id,
+			       SPA_POD_TYPE_INT, m->mem_id,
+			       SPA_POD_TYPE_ID, m->type,
+			       SPA_POD_TYPE_INT, m->memfd_idx,
+			       SPA_POD_TYPE_INT, m->flags,
+			       SPA_POD_TYPE_INT, m->offset,
+			       SPA_POD_TYPE_INT, m->size,
+			       SPA_POD_TYPE_STRING, m->name,
+			       SPA_POD_TYPE_POD, m->filter);
+	return b.offset;
+}
+
+static uint32_t build_schema(void *buffer, uint32_t size, const struct msg *m)
+{
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, size);
+
+	spa_pod_schema_build(&b, &msg_schema, m);
+	return b.offset;
+}
+
+static bool parse_varargs(const void *data, uint32_t size, struct msg *m)
+{
+	struct spa_pod_iter it;
+
+	return spa_pod_iter_struct(&it, data, size) &&
+	       spa_pod_iter_get(&it,
+				SPA_POD_TYPE_INT, &m->direction,
+				SPA_POD_TYPE_INT, &m->port_id,
+				SPA_POD_TYPE_INT, &m->mem_id,
+				SPA_POD_TYPE_ID, &m->type,
+				SPA_POD_TYPE_INT, &m->memfd_idx,
+				SPA_POD_TYPE_INT, &m->flags,
+				SPA_POD_TYPE_INT, &m->offset,
+				SPA_POD_TYPE_INT, &m->size,
+				SPA_POD_TYPE_STRING, &m->name,
+				-SPA_POD_TYPE_OBJECT, &m->filter, 0);
+}
+
+static int check_msg(const char *name, const struct msg *m)
+{
+	if (memcmp(m, &expected, offsetof(struct msg, name)) != 0 ||
+	    strcmp(m->name, expected.name) != 0 || m->filter != NULL) {
+		printf("%s: wrong result\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+/* messages that must not parse */
+static int check_malformed(const void *data, uint32_t size)
+{
+	uint8_t buffer[1024];
+	struct spa_pod *pod = (struct spa_pod *) buffer;
+	struct spa_pod *last;
+	struct msg m;
+	int failures = 0;
+
+	/* truncated, the struct claims more than there is */
+	memcpy(buffer, data, size);
+	if (spa_pod_schema_parse(&msg_schema, buffer, size - 8, &m))
+		failures++;
+
+	/* the struct is cut short, the last field is missing */
+	pod->size -= 8;
+	if (spa_pod_schema_parse(&msg_schema, buffer, size, &m))
+		failures++;
+
+	/* a string without terminating 0 */
+	memcpy(buffer, data, size);
+	memset(SPA_MEMBER(buffer, size - 16, char), 'x', 8);
+	if (spa_pod_schema_parse(&msg_schema, buffer, size, &m))
+		failures++;
+
+	/* wrong type for a field */
+	memcpy(buffer, data, size);
+	SPA_MEMBER(buffer, sizeof(struct spa_pod), struct spa_pod)->type = SPA_POD_TYPE_ID;
+	if (spa_pod_schema_parse(&msg_schema, buffer, size, &m))
+		failures++;
+
+	/* a field that claims to be bigger than the struct */
+	memcpy(buffer, data, size);
+	last = SPA_MEMBER(buffer, size - 8, struct spa_pod);
+	last->size = 64;
+	if (spa_pod_schema_parse(&msg_schema, buffer, size, &m))
+		failures++;
+
+	if (failures)
+		printf("%d malformed messages were accepted\n", failures);
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t buf1[1024], buf2[1024];
+	uint32_t size1, size2;
+	struct msg m;
+	int64_t t1, t2;
+	int i, failures = 0;
+	volatile uint32_t sum = 0;
+
+	size1 = build_varargs(buf1, sizeof(buf1), &expected);
+	size2 = build_schema(buf2, sizeof(buf2), &expected);
+	if (size1 != size2 || memcmp(buf1, buf2, size1) != 0) {
+		printf("schema builds a different message\n");
+		failures++;
+	}
+
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS; i++)
+		sum += build_varargs(buf1, sizeof(buf1), &expected);
+	t2 = get_time();
+	report("build varargs", t1, t2);
+
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS; i++)
+		sum += build_schema(buf2, sizeof(buf2), &expected);
+	t2 = get_time();
+	report("build schema", t1, t2);
+
+	memset(&m, 0, sizeof(m));
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS; i++) {
+		parse_varargs(buf1, size1, &m);
+		sum += m.size;
+	}
+	t2 = get_time();
+	report("parse varargs", t1, t2);
+	failures += check_msg("parse varargs", &m);
+
+	memset(&m, 0, sizeof(m));
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS; i++) {
+		spa_pod_schema_parse(&msg_schema, buf2, size2, &m);
+		sum += m.size;
+	}
+	t2 = get_time();
+	report("parse schema", t1, t2);
+	failures += check_msg("parse schema", &m);
+
+	failures += check_malformed(buf2, size2);
+
+	printf("%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+
+	return failures ? -1 : 0;
+}
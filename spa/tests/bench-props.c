@@ -0,0 +1,404 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <spa/type-map-impl.h>
+#include <spa/format-builder.h>
+#include <spa/video/format-utils.h>
+#include <spa/audio/format-utils.h>
+
+#include <lib/format.h>
+#include <lib/debug.h>
+
+/* the baseline, the props filter with nested loops for all enums like
+ * before enum intersection picked a strategy */
+#define ENUM_LINEAR_MAX		INT32_MAX
+#define spa_props_filter	baseline_props_filter
+#define spa_props_compare	baseline_props_compare
+#include <lib/props.c>
+#undef spa_props_filter
+#undef spa_props_compare
+
+/* benchmark of spa_format_filter with format sets like the ones of V4L2
+ * devices and ALSA cards, the types are set up like in test-props.c.
+ * The time of the baseline is printed next to it. */
+
+#define N_ROUNDS	100000
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+
+static struct {
+	uint32_t format;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+} type = { 0,};
+
+static inline void type_init(struct spa_type_map *map)
+{
+	type.format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_media_type_map(map, &type.media_type);
+	spa_type_media_subtype_map(map, &type.media_subtype);
+	spa_type_format_video_map(map, &type.format_video);
+	spa_type_video_format_map(map, &type.video_format);
+	spa_type_format_audio_map(map, &type.format_audio);
+	spa_type_audio_format_map(map, &type.audio_format);
+}
+
+static const struct spa_rectangle sizes[] = {
+	{ 160, 120 }, { 176, 144 }, { 320, 180 }, { 320, 240 }, { 352, 288 },
+	{ 424, 240 }, { 480, 270 }, { 640, 360 }, { 640, 480 }, { 800, 448 },
+	{ 800, 600 }, { 848, 480 }, { 960, 540 }, { 1024, 576 }, { 1280, 720 },
+	{ 1600, 896 }, { 1920, 1080 }, { 2304, 1296 }, { 2304, 1536 }, { 2560, 1440 },
+	{ 3840, 2160 }, { 4096, 2160 },
+};
+
+static const struct spa_fraction rates[] = {
+	{ 60, 1 }, { 50, 1 }, { 30, 1 }, { 25, 1 }, { 24, 1 }, { 20, 1 },
+	{ 15, 1 }, { 10, 1 }, { 15, 2 }, { 5, 1 },
+};
+
+static const int32_t audio_rates[] = {
+	8000, 11025, 16000, 22050, 32000, 44100, 48000, 88200, 96000, 176400, 192000,
+};
+
+static const uint32_t *video_formats(uint32_t *n_formats)
+{
+	/* all the formats after UNKNOWN and ENCODED */
+	*n_formats = sizeof(type.video_format) / sizeof(uint32_t) - 2;
+	return &type.video_format.I420;
+}
+
+static const uint32_t *audio_formats(uint32_t *n_formats)
+{
+	*n_formats = sizeof(type.audio_format) / sizeof(uint32_t) - 2;
+	return &type.audio_format.S8;
+}
+
+/* what a V4L2 device can do, all its formats, sizes and framerates */
+static struct spa_format *build_v4l2_caps(struct spa_pod_builder *b, bool step)
+{
+	struct spa_pod_frame f[2];
+	const uint32_t *formats;
+	uint32_t i, n_formats, ref;
+
+	ref = spa_pod_builder_push_format(b, &f[0], type.format,
+					  type.media_type.video, type.media_subtype.raw);
+
+	formats = video_formats(&n_formats);
+	spa_pod_builder_push_prop(b, &f[1], type.format_video.format,
+				  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_id(b, formats[0]);
+	for (i = 0; i < n_formats; i++)
+		spa_pod_builder_id(b, formats[i]);
+	spa_pod_builder_pop(b, &f[1]);
+
+	if (step) {
+		spa_pod_builder_push_prop(b, &f[1], type.format_video.size,
+					  SPA_POD_PROP_RANGE_STEP | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_rectangle(b, 640, 480);
+		spa_pod_builder_rectangle(b, 160, 120);
+		spa_pod_builder_rectangle(b, 4096, 2160);
+		spa_pod_builder_rectangle(b, 16, 8);
+	} else {
+		spa_pod_builder_push_prop(b, &f[1], type.format_video.size,
+					  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_rectangle(b, 640, 480);
+		for (i = 0; i < SPA_N_ELEMENTS(sizes); i++)
+			spa_pod_builder_rectangle(b, sizes[i].width, sizes[i].height);
+	}
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_push_prop(b, &f[1], type.format_video.framerate,
+				  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_fraction(b, 30, 1);
+	for (i = 0; i < SPA_N_ELEMENTS(rates); i++)
+		spa_pod_builder_fraction(b, rates[i].num, rates[i].denom);
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_pop(b, &f[0]);
+
+	return SPA_POD_BUILDER_DEREF(b, ref, struct spa_format);
+}
+
+/* what an application accepts, a subset of the formats in reverse order
+ * of preference, the common sizes and a range of framerates */
+static struct spa_format *build_v4l2_filter(struct spa_pod_builder *b, bool ranges)
+{
+	struct spa_pod_frame f[2];
+	const uint32_t *formats;
+	uint32_t i, n_formats, ref;
+
+	ref = spa_pod_builder_push_format(b, &f[0], type.format,
+					  type.media_type.video, type.media_subtype.raw);
+
+	formats = video_formats(&n_formats);
+	spa_pod_builder_push_prop(b, &f[1], type.format_video.format,
+				  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_id(b, formats[n_formats - 1]);
+	for (i = n_formats; i > 0; i -= 2)
+		spa_pod_builder_id(b, formats[i - 1]);
+	spa_pod_builder_pop(b, &f[1]);
+
+	if (ranges) {
+		spa_pod_builder_push_prop(b, &f[1], type.format_video.size,
+					  SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_rectangle(b, 320, 240);
+		spa_pod_builder_rectangle(b, 1, 1);
+		spa_pod_builder_rectangle(b, 1920, 1080);
+	} else {
+		spa_pod_builder_push_prop(b, &f[1], type.format_video.size,
+					  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_rectangle(b, 1280, 720);
+		for (i = SPA_N_ELEMENTS(sizes); i > 0; i -= 2)
+			spa_pod_builder_rectangle(b, sizes[i - 1].width, sizes[i - 1].height);
+	}
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_push_prop(b, &f[1], type.format_video.framerate,
+				  SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_fraction(b, 25, 1);
+	spa_pod_builder_fraction(b, 0, 1);
+	spa_pod_builder_fraction(b, 30, 1);
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_pop(b, &f[0]);
+
+	return SPA_POD_BUILDER_DEREF(b, ref, struct spa_format);
+}
+
+/* what an ALSA card can do */
+static struct spa_format *build_alsa_caps(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+	const uint32_t *formats;
+	uint32_t i, n_formats, ref;
+
+	ref = spa_pod_builder_push_format(b, &f[0], type.format,
+					  type.media_type.audio, type.media_subtype.raw);
+
+	formats = audio_formats(&n_formats);
+	spa_pod_builder_push_prop(b, &f[1], type.format_audio.format,
+				  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_id(b, type.audio_format.S16);
+	for (i = 0; i < n_formats; i++)
+		spa_pod_builder_id(b, formats[i]);
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_push_prop(b, &f[1], type.format_audio.rate,
+				  SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_int(b, 44100);
+	spa_pod_builder_int(b, 8000);
+	spa_pod_builder_int(b, 192000);
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_push_prop(b, &f[1], type.format_audio.channels,
+				  SPA_POD_PROP_RANGE_MIN_MAX | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_int(b, 2);
+	spa_pod_builder_int(b, 1);
+	spa_pod_builder_int(b, 8);
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_pop(b, &f[0]);
+
+	return SPA_POD_BUILDER_DEREF(b, ref, struct spa_format);
+}
+
+/* what a stream accepts, a few formats and the common rates */
+static struct spa_format *build_alsa_filter(struct spa_pod_builder *b)
+{
+	struct spa_pod_frame f[2];
+	uint32_t i, ref;
+
+	ref = spa_pod_builder_push_format(b, &f[0], type.format,
+					  type.media_type.audio, type.media_subtype.raw);
+
+	spa_pod_builder_push_prop(b, &f[1], type.format_audio.format,
+				  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_id(b, type.audio_format.F32);
+	spa_pod_builder_id(b, type.audio_format.F32);
+	spa_pod_builder_id(b, type.audio_format.S32);
+	spa_pod_builder_id(b, type.audio_format.S24_32);
+	spa_pod_builder_id(b, type.audio_format.S16);
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_push_prop(b, &f[1], type.format_audio.rate,
+				  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_int(b, 48000);
+	for (i = 0; i < SPA_N_ELEMENTS(audio_rates); i++)
+		spa_pod_builder_int(b, audio_rates[i]);
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_push_prop(b, &f[1], type.format_audio.channels,
+				  SPA_POD_PROP_RANGE_NONE);
+	spa_pod_builder_int(b, 2);
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_pop(b, &f[0]);
+
+	return SPA_POD_BUILDER_DEREF(b, ref, struct spa_format);
+}
+
+static int64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static uint32_t n_values(const struct spa_format *format, uint32_t key)
+{
+	struct spa_pod_prop *prop = spa_format_find_prop(format, key);
+	return prop ? SPA_POD_PROP_N_VALUES(prop) : 0;
+}
+
+/* spa_format_filter() with the baseline props filter */
+static int baseline_format_filter(const struct spa_format *format,
+				  const struct spa_format *filter,
+				  struct spa_pod_builder *result)
+{
+	struct spa_pod_frame f;
+	int res;
+
+	spa_pod_builder_push_format(result, &f, filter->body.obj_body.type,
+				    SPA_FORMAT_MEDIA_TYPE(filter),
+				    SPA_FORMAT_MEDIA_SUBTYPE(filter));
+	res = baseline_props_filter(result,
+				    SPA_POD_CONTENTS(struct spa_format, format),
+				    SPA_POD_CONTENTS_SIZE(struct spa_format, format),
+				    SPA_POD_CONTENTS(struct spa_format, filter),
+				    SPA_POD_CONTENTS_SIZE(struct spa_format, filter));
+	spa_pod_builder_pop(result, &f);
+
+	return res;
+}
+
+typedef int (*filter_func_t) (const struct spa_format *format,
+			      const struct spa_format *filter,
+			      struct spa_pod_builder *result);
+
+static double time_filter(filter_func_t func, const struct spa_format *format,
+			  const struct spa_format *filter, uint8_t *buffer, size_t size,
+			  int *res)
+{
+	struct spa_pod_builder b = { NULL, };
+	int64_t t1, t2;
+	int i;
+
+	*res = 0;
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS; i++) {
+		spa_pod_builder_init(&b, buffer, size);
+		*res |= func(format, filter, &b);
+	}
+	t2 = get_time();
+
+	return (double) (t2 - t1) / N_ROUNDS;
+}
+
+/* filter \a format with \a filter, check the number of values of each of
+ * the props in the result and report the time per filter */
+static int bench(const char *name, const struct spa_format *format,
+		 const struct spa_format *filter, const uint32_t keys[3],
+		 const uint32_t expected[3])
+{
+	uint8_t buffer[4096];
+	const struct spa_format *result = (struct spa_format *) buffer;
+	double t, baseline;
+	int i, res, baseline_res, failures = 0;
+
+	baseline = time_filter(baseline_format_filter, format, filter,
+			       buffer, sizeof(buffer), &baseline_res);
+	t = time_filter(spa_format_filter, format, filter, buffer, sizeof(buffer), &res);
+
+	printf("%-16s: %8.1f ns per filter, baseline %8.1f ns\n", name, t, baseline);
+
+	if (res != SPA_RESULT_OK) {
+		printf("%s: filter failed %d\n", name, res);
+		return 1;
+	}
+	for (i = 0; i < 3; i++) {
+		uint32_t n = n_values(result, keys[i]);
+		if (n != expected[i]) {
+			printf("%s: prop %d has %u values, expected %u\n", name, i, n, expected[i]);
+			spa_debug_format(result);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t buffer[4][4096];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_format *caps, *filter;
+	struct spa_type_map *map = &default_map.map;
+	uint32_t n_formats, video_keys[3], audio_keys[3];
+	int failures = 0;
+
+	type_init(map);
+	spa_debug_set_type_map(map);
+	video_formats(&n_formats);
+
+	video_keys[0] = type.format_video.format;
+	video_keys[1] = type.format_video.size;
+	video_keys[2] = type.format_video.framerate;
+	audio_keys[0] = type.format_audio.format;
+	audio_keys[1] = type.format_audio.rate;
+	audio_keys[2] = type.format_audio.channels;
+
+	/* enums of formats and sizes, the framerates up to 30 */
+	spa_pod_builder_init(&b, buffer[0], sizeof(buffer[0]));
+	caps = build_v4l2_caps(&b, false);
+	spa_pod_builder_init(&b, buffer[1], sizeof(buffer[1]));
+	filter = build_v4l2_filter(&b, false);
+	failures += bench("v4l2 enum", caps, filter, video_keys,
+			  (uint32_t[]) { (n_formats + 1) / 2 + 1, SPA_N_ELEMENTS(sizes) / 2 + 1, 9 });
+
+	/* size enum in a min/max range */
+	spa_pod_builder_init(&b, buffer[1], sizeof(buffer[1]));
+	filter = build_v4l2_filter(&b, true);
+	failures += bench("v4l2 range", caps, filter, video_keys,
+			  (uint32_t[]) { (n_formats + 1) / 2 + 1, 18, 9 });
+
+	/* stepwise sizes in a min/max range */
+	spa_pod_builder_init(&b, buffer[2], sizeof(buffer[2]));
+	caps = build_v4l2_caps(&b, true);
+	failures += bench("v4l2 step", caps, filter, video_keys,
+			  (uint32_t[]) { (n_formats + 1) / 2 + 1, 4, 9 });
+
+	spa_pod_builder_init(&b, buffer[0], sizeof(buffer[0]));
+	caps = build_alsa_caps(&b);
+	spa_pod_builder_init(&b, buffer[1], sizeof(buffer[1]));
+	filter = build_alsa_filter(&b);
+	failures += bench("alsa", caps, filter, audio_keys,
+			  (uint32_t[]) { 5, SPA_N_ELEMENTS(audio_rates) + 1, 2 });
+
+	printf("%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+
+	return failures ? -1 : 0;
+}
@@ -0,0 +1,163 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#include <spa/log-impl.h>
+#include <spa/type-map-impl.h>
+
+/* benchmark of the type maps. We register a number of types, the way
+ * plugins and clients do, and then look all of them up again. This is
+ * done with the static map of type-map-impl.h, with the mapper plugin
+ * and with a linear scan as the reference. */
+
+#define MAX_TYPES	16384
+
+static SPA_TYPE_MAP_IMPL(bench_map, MAX_TYPES);
+static SPA_LOG_IMPL(default_log);
+
+static int n_types;
+static char **types;
+
+/* the old implementation */
+static const char *linear_types[MAX_TYPES];
+static uint32_t n_linear_types;
+
+static uint32_t linear_get_id(struct spa_type_map *map, const char *type)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_linear_types; i++) {
+		if (strcmp(linear_types[i], type) == 0)
+			return i;
+	}
+	linear_types[n_linear_types] = type;
+	return n_linear_types++;
+}
+
+static const struct spa_type_map linear_map = {
+	SPA_VERSION_TYPE_MAP,
+	NULL,
+	linear_get_id,
+};
+
+static int64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int make_mapper(struct spa_type_map **map, const char *lib)
+{
+	struct spa_support support[1];
+	const struct spa_handle_factory *factory;
+	spa_handle_factory_enum_func_t enum_func;
+	struct spa_handle *handle;
+	void *hnd, *iface;
+	uint32_t i;
+	int res;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return SPA_RESULT_ERROR;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return SPA_RESULT_ERROR;
+	}
+
+	support[0].type = SPA_TYPE__Log;
+	support[0].data = &default_log.log;
+
+	for (i = 0;; i++) {
+		if ((res = enum_func(&factory, i)) < 0)
+			return res;
+		if (strcmp(factory->name, "mapper") == 0)
+			break;
+	}
+
+	handle = calloc(1, factory->size);
+	if ((res = spa_handle_factory_init(factory, handle, NULL, support, 1)) < 0)
+		return res;
+
+	/* the mapper registers its own type first, with id 0 */
+	if ((res = spa_handle_get_interface(handle, 0, &iface)) < 0)
+		return res;
+	*map = iface;
+
+	return SPA_RESULT_OK;
+}
+
+static int run(const char *name, struct spa_type_map *map)
+{
+	int64_t t1, t2, t3;
+	uint32_t first, id;
+	int i, failures = 0;
+
+	t1 = get_time();
+	first = spa_type_map_get_id(map, types[0]);
+	for (i = 1; i < n_types; i++)
+		spa_type_map_get_id(map, types[i]);
+	t2 = get_time();
+	for (i = 0; i < n_types; i++) {
+		id = spa_type_map_get_id(map, types[i]);
+		if (id != first + i ||
+		    (map->get_type && strcmp(spa_type_map_get_type(map, id), types[i]) != 0))
+			failures++;
+	}
+	t3 = get_time();
+
+	printf("%-8s: %d types, register %8.3f ms, lookup %8.3f ms (%6.1f ns per lookup)%s\n",
+	       name, n_types, (t2 - t1) / 1000000.0, (t3 - t2) / 1000000.0,
+	       (double) (t3 - t2) / n_types, failures ? " FAILED" : "");
+
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	struct spa_type_map *mapper;
+	int i, failures = 0;
+
+	n_types = argc > 1 ? atoi(argv[1]) : 10000;
+	n_types = SPA_CLAMP(n_types, 1, MAX_TYPES - 1);
+
+	types = calloc(n_types, sizeof(char *));
+	for (i = 0; i < n_types; i++) {
+		types[i] = malloc(64);
+		snprintf(types[i], 64, SPA_TYPE_BASE "Bench:Interface:Type%d:Name", i);
+	}
+
+	if (make_mapper(&mapper, argc > 2 ? argv[2] :
+			"build/spa/plugins/support/libspa-support.so") < 0) {
+		printf("can't make mapper\n");
+		return -1;
+	}
+
+	failures += run("linear", (struct spa_type_map *) &linear_map);
+	failures += run("static", &bench_map.map);
+	failures += run("mapper", mapper);
+
+	return failures ? -1 : 0;
+}
@@ -0,0 +1,235 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include <spa/loop.h>
+#include <spa/log-impl.h>
+#include <spa/type-map-impl.h>
+
+/* stress test of spa_loop_invoke from many threads at the same time.
+ * Every thread sends numbered invokes, blocking and non-blocking, and the
+ * loop checks that they arrive complete and in order. Blocking invokes
+ * check that each caller gets its own result. */
+
+#define MAX_THREADS	16
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+struct data {
+	struct spa_loop *loop;
+	struct spa_loop_control *control;
+	pthread_t thread;
+	bool running;
+
+	int n_threads;
+	int n_invokes;
+	uint32_t expected[MAX_THREADS];
+	int failures;
+};
+
+struct producer {
+	struct data *data;
+	int index;
+	pthread_t thread;
+};
+
+struct message {
+	uint32_t producer;
+	uint32_t count;
+	uint8_t payload[64];
+};
+
+static int
+do_message(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+	   void *user_data)
+{
+	struct data *d = user_data;
+	const struct message *m = data;
+	int i;
+
+	if (size != sizeof(struct message) || m->producer >= d->n_threads) {
+		d->failures++;
+		return -1;
+	}
+	if (m->count != d->expected[m->producer]) {
+		printf("producer %u: got %u expected %u\n", m->producer, m->count,
+		       d->expected[m->producer]);
+		d->failures++;
+	}
+	for (i = 0; i < sizeof(m->payload); i++) {
+		if (m->payload[i] != (uint8_t) (m->count + i)) {
+			d->failures++;
+			break;
+		}
+	}
+	d->expected[m->producer] = m->count + 1;
+
+	/* unique result for the blocking callers */
+	return (m->producer << 20) | m->count;
+}
+
+static int
+do_stop(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+	void *user_data)
+{
+	struct data *d = user_data;
+	d->running = false;
+	return 0;
+}
+
+static void *loop_thread(void *user_data)
+{
+	struct data *d = user_data;
+
+	spa_loop_control_enter(d->control);
+	while (d->running)
+		spa_loop_control_iterate(d->control, -1);
+	spa_loop_control_leave(d->control);
+
+	return NULL;
+}
+
+static void *producer_thread(void *user_data)
+{
+	struct producer *p = user_data;
+	struct data *d = p->data;
+	struct message m;
+	int i, j, res;
+
+	m.producer = p->index;
+
+	for (i = 0; i < d->n_invokes; i++) {
+		bool block = (i % 4) == 0;
+
+		m.count = i;
+		for (j = 0; j < sizeof(m.payload); j++)
+			m.payload[j] = i + j;
+
+		while ((res = spa_loop_invoke(d->loop, do_message, SPA_ID_INVALID,
+					      sizeof(m), &m, block, d)) == SPA_RESULT_ERROR) {
+			/* queue full, let the loop catch up */
+			usleep(100);
+		}
+		if (block && res != ((p->index << 20) | i)) {
+			printf("producer %d: got result %08x expected %08x\n", p->index, res,
+			       (p->index << 20) | i);
+			__atomic_add_fetch(&d->failures, 1, __ATOMIC_SEQ_CST);
+		}
+	}
+	return NULL;
+}
+
+static int make_loop(struct data *d, const char *lib)
+{
+	struct spa_support support[2];
+	const struct spa_handle_factory *factory;
+	spa_handle_factory_enum_func_t enum_func;
+	struct spa_handle *handle;
+	void *hnd, *iface;
+	uint32_t i;
+	int res;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return SPA_RESULT_ERROR;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return SPA_RESULT_ERROR;
+	}
+
+	support[0].type = SPA_TYPE__TypeMap;
+	support[0].data = &default_map.map;
+	support[1].type = SPA_TYPE__Log;
+	support[1].data = &default_log.log;
+
+	for (i = 0;; i++) {
+		if ((res = enum_func(&factory, i)) < 0)
+			return res;
+		if (strcmp(factory->name, "loop") == 0)
+			break;
+	}
+
+	handle = calloc(1, factory->size);
+	if ((res = spa_handle_factory_init(factory, handle, NULL, support, 2)) < 0)
+		return res;
+
+	if ((res = spa_handle_get_interface(handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__Loop), &iface)) < 0)
+		return res;
+	d->loop = iface;
+
+	if ((res = spa_handle_get_interface(handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__LoopControl), &iface)) < 0)
+		return res;
+	d->control = iface;
+
+	return SPA_RESULT_OK;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { NULL };
+	struct producer producers[MAX_THREADS];
+	int i;
+
+	data.n_threads = argc > 1 ? atoi(argv[1]) : 8;
+	data.n_invokes = argc > 2 ? atoi(argv[2]) : 100000;
+	data.n_threads = SPA_CLAMP(data.n_threads, 1, MAX_THREADS);
+
+	if (make_loop(&data, argc > 3 ? argv[3] :
+		      "build/spa/plugins/support/libspa-support.so") < 0) {
+		printf("can't make loop\n");
+		return -1;
+	}
+
+	printf("%d threads, %d invokes per thread\n", data.n_threads, data.n_invokes);
+
+	data.running = true;
+	pthread_create(&data.thread, NULL, loop_thread, &data);
+
+	for (i = 0; i < data.n_threads; i++) {
+		producers[i].data = &data;
+		producers[i].index = i;
+		pthread_create(&producers[i].thread, NULL, producer_thread, &producers[i]);
+	}
+	for (i = 0; i < data.n_threads; i++)
+		pthread_join(producers[i].thread, NULL);
+
+	spa_loop_invoke(data.loop, do_stop, SPA_ID_INVALID, 0, NULL, true, &data);
+	pthread_join(data.thread, NULL);
+
+	for (i = 0; i < data.n_threads; i++) {
+		if (data.expected[i] != data.n_invokes) {
+			printf("producer %d: %u of %d invokes arrived\n", i, data.expected[i],
+			       data.n_invokes);
+			data.failures++;
+		}
+	}
+	printf("%s: %d failures\n", data.failures ? "FAIL" : "OK", data.failures);
+
+	return data.failures ? -1 : 0;
+}
@@ -0,0 +1,289 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include <spa/loop.h>
+#include <spa/log-impl.h>
+#include <spa/type-map-impl.h>
+#include <spa/graph-scheduler3.h>
+
+/* a source node in one graph linked to a sink node in a graph that is
+ * processed by a loop in another thread. The buffers are handed over
+ * with port_ready through the invoke queue of the loop, in push and in
+ * pull mode. */
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+struct data {
+	struct spa_loop *loop;
+	struct spa_loop_control *control;
+	pthread_t thread;
+	bool running;
+
+	struct spa_graph graph[2];
+	struct spa_graph_node source, sink;
+	struct spa_graph_port out, in;
+	struct spa_port_io io;
+
+	struct spa_node source_node;
+	struct spa_node sink_node;
+
+	struct spa_graph_port *pending;
+
+	int produced;
+	int consumed;
+	int failures;
+};
+
+static struct data data;
+
+static int source_process_output(struct spa_node *node)
+{
+	struct data *d = &data;
+
+	if (d->io.status == SPA_RESULT_HAVE_BUFFER)
+		return SPA_RESULT_OK;
+
+	d->io.buffer_id = d->produced++;
+	d->io.status = SPA_RESULT_HAVE_BUFFER;
+	return SPA_RESULT_HAVE_BUFFER;
+}
+
+static int sink_process_input(struct spa_node *node)
+{
+	struct data *d = &data;
+
+	if (!pthread_equal(pthread_self(), d->thread))
+		d->failures++;
+
+	if (d->io.status == SPA_RESULT_HAVE_BUFFER) {
+		if (d->io.buffer_id != d->consumed)
+			d->failures++;
+		__atomic_store_n(&d->consumed, d->consumed + 1, __ATOMIC_RELEASE);
+		d->io.status = SPA_RESULT_NEED_BUFFER;
+	}
+	return SPA_RESULT_NEED_BUFFER;
+}
+
+static int
+do_port_ready(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+	      void *user_data)
+{
+	return spa_graph_impl_port_ready(NULL, user_data);
+}
+
+/* ports of the sink graph are processed in the loop thread */
+static int loop_port_ready(void *user_data, struct spa_graph_port *port)
+{
+	struct data *d = user_data;
+	return spa_loop_invoke(d->loop, do_port_ready, SPA_ID_INVALID, 0, NULL, false, port);
+}
+
+/* ports of the source graph are processed in the main thread */
+static int main_port_ready(void *user_data, struct spa_graph_port *port)
+{
+	struct data *d = user_data;
+	__atomic_store_n(&d->pending, port, __ATOMIC_RELEASE);
+	return SPA_RESULT_OK;
+}
+
+static const struct spa_graph_callbacks main_callbacks = {
+	SPA_VERSION_GRAPH_CALLBACKS,
+	.need_input = spa_graph_impl_need_input,
+	.have_output = spa_graph_impl_have_output,
+	.port_ready = main_port_ready,
+};
+
+static const struct spa_graph_callbacks loop_callbacks = {
+	SPA_VERSION_GRAPH_CALLBACKS,
+	.need_input = spa_graph_impl_need_input,
+	.have_output = spa_graph_impl_have_output,
+	.port_ready = loop_port_ready,
+};
+
+static int
+do_stop(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+	void *user_data)
+{
+	struct data *d = user_data;
+	d->running = false;
+	return 0;
+}
+
+static int
+do_need_input(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+	      void *user_data)
+{
+	struct data *d = user_data;
+	return spa_graph_need_input(&d->graph[1], &d->sink);
+}
+
+static void *loop_thread(void *user_data)
+{
+	struct data *d = user_data;
+
+	spa_loop_control_enter(d->control);
+	while (d->running)
+		spa_loop_control_iterate(d->control, -1);
+	spa_loop_control_leave(d->control);
+
+	return NULL;
+}
+
+static int make_loop(struct data *d, const char *lib)
+{
+	struct spa_support support[2];
+	const struct spa_handle_factory *factory;
+	spa_handle_factory_enum_func_t enum_func;
+	struct spa_handle *handle;
+	void *hnd, *iface;
+	uint32_t i;
+	int res;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return SPA_RESULT_ERROR;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return SPA_RESULT_ERROR;
+	}
+
+	support[0].type = SPA_TYPE__TypeMap;
+	support[0].data = &default_map.map;
+	support[1].type = SPA_TYPE__Log;
+	support[1].data = &default_log.log;
+
+	for (i = 0;; i++) {
+		if ((res = enum_func(&factory, i)) < 0)
+			return res;
+		if (strcmp(factory->name, "loop") == 0)
+			break;
+	}
+
+	handle = calloc(1, factory->size);
+	if ((res = spa_handle_factory_init(factory, handle, NULL, support, 2)) < 0)
+		return res;
+
+	if ((res = spa_handle_get_interface(handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__Loop), &iface)) < 0)
+		return res;
+	d->loop = iface;
+
+	if ((res = spa_handle_get_interface(handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__LoopControl), &iface)) < 0)
+		return res;
+	d->control = iface;
+
+	return SPA_RESULT_OK;
+}
+
+static void make_graph(struct data *d)
+{
+	spa_graph_init(&d->graph[0]);
+	spa_graph_set_callbacks(&d->graph[0], &main_callbacks, d);
+	spa_graph_init(&d->graph[1]);
+	spa_graph_set_callbacks(&d->graph[1], &loop_callbacks, d);
+
+	d->source_node.process_output = source_process_output;
+	d->sink_node.process_input = sink_process_input;
+
+	spa_graph_node_init(&d->source);
+	spa_graph_node_set_implementation(&d->source, &d->source_node);
+	spa_graph_node_add(&d->graph[0], &d->source);
+
+	spa_graph_node_init(&d->sink);
+	spa_graph_node_set_implementation(&d->sink, &d->sink_node);
+	spa_graph_node_add(&d->graph[1], &d->sink);
+
+	spa_graph_port_init(&d->out, SPA_DIRECTION_OUTPUT, 0, 0, &d->io);
+	spa_graph_port_add(&d->source, &d->out);
+	spa_graph_port_init(&d->in, SPA_DIRECTION_INPUT, 0, 0, &d->io);
+	spa_graph_port_add(&d->sink, &d->in);
+	spa_graph_port_link(&d->out, &d->in);
+
+	d->io.status = SPA_RESULT_NEED_BUFFER;
+}
+
+static void wait_consumed(struct data *d, int n)
+{
+	while (__atomic_load_n(&d->consumed, __ATOMIC_ACQUIRE) < n)
+		usleep(10);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data *d = &data;
+	int i, n_buffers;
+
+	n_buffers = argc > 1 ? atoi(argv[1]) : 1000;
+
+	if (make_loop(d, argc > 2 ? argv[2] :
+		      "build/spa/plugins/support/libspa-support.so") < 0) {
+		printf("can't make loop\n");
+		return -1;
+	}
+	make_graph(d);
+
+	d->running = true;
+	pthread_create(&d->thread, NULL, loop_thread, d);
+
+	/* push: the source has output, the sink consumes it in the loop. The
+	 * source can produce the next buffer ahead when the sink was fast. */
+	while (__atomic_load_n(&d->consumed, __ATOMIC_ACQUIRE) < n_buffers) {
+		if (__atomic_load_n(&d->io.status, __ATOMIC_ACQUIRE) != SPA_RESULT_NEED_BUFFER ||
+		    d->produced != d->consumed) {
+			usleep(10);
+			continue;
+		}
+		source_process_output(&d->source_node);
+		spa_graph_have_output(&d->graph[0], &d->source);
+	}
+	printf("push: produced %d consumed %d\n", d->produced, d->consumed);
+
+	/* pull: the sink asks for input in the loop, the source produces
+	 * in this thread and pushes the buffer back */
+	wait_consumed(d, d->produced);
+	for (i = d->consumed; i < 2 * n_buffers; i++) {
+		struct spa_graph_port *port;
+
+		spa_loop_invoke(d->loop, do_need_input, SPA_ID_INVALID, 0, NULL, true, d);
+		while ((port = __atomic_exchange_n(&d->pending, NULL, __ATOMIC_ACQ_REL)) == NULL)
+			usleep(10);
+		spa_graph_impl_port_ready(NULL, port);
+		wait_consumed(d, i + 1);
+	}
+	printf("pull: produced %d consumed %d\n", d->produced, d->consumed);
+
+	spa_loop_invoke(d->loop, do_stop, SPA_ID_INVALID, 0, NULL, true, d);
+	pthread_join(d->thread, NULL);
+
+	if (d->consumed != d->produced || d->consumed < 2 * n_buffers)
+		d->failures++;
+	printf("%s: %d failures\n", d->failures ? "FAIL" : "OK", d->failures);
+
+	return d->failures ? -1 : 0;
+}
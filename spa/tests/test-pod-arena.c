@@ -0,0 +1,187 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <spa/pod.h>
+#include <spa/pod-builder.h>
+#include <spa/pod-iter.h>
+
+#include <lib/props.h>
+#include <lib/pod-arena.h>
+
+/* builds a list of props that is bigger than the first block of the arena
+ * and checks that nothing is truncated, that the memory is reused after a
+ * reset and that measuring gives the size of the real message */
+
+#define N_PROPS		200
+
+static void build_props(struct spa_pod_builder *b, int n_props)
+{
+	struct spa_pod_frame f[2];
+	int i;
+
+	spa_pod_builder_push_object(b, &f[0], 0, 0);
+	for (i = 0; i < n_props; i++) {
+		spa_pod_builder_push_prop(b, &f[1], i,
+					  SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_int(b, i);
+		spa_pod_builder_int(b, i);
+		spa_pod_builder_int(b, i + 1);
+		spa_pod_builder_int(b, i + 2);
+		spa_pod_builder_pop(b, &f[1]);
+	}
+	spa_pod_builder_pop(b, &f[0]);
+}
+
+static int check_props(const void *data, uint32_t size, int n_props, int n_values)
+{
+	const struct spa_pod_object *obj = data;
+	const struct spa_pod *pr;
+	int n = 0;
+
+	if (size < sizeof(struct spa_pod_object) || SPA_POD_SIZE(obj) > size)
+		return 1;
+
+	SPA_POD_OBJECT_FOREACH(obj, pr) {
+		const struct spa_pod_prop *p = (const struct spa_pod_prop *) pr;
+		if (p->body.key != n || SPA_POD_PROP_N_VALUES(p) != n_values)
+			return 1;
+		n++;
+	}
+	return n != n_props;
+}
+
+int main(int argc, char *argv[])
+{
+	struct spa_pod_arena arena;
+	struct spa_pod_builder *b, measure = SPA_POD_BUILDER_INIT_MEASURE;
+	struct spa_pod_builder fixed;
+	uint8_t buffer[1024];
+	uint8_t *data;
+	uint32_t size;
+	int failures = 0;
+
+	/* measure first */
+	build_props(&measure, N_PROPS);
+	if (measure.offset <= 1024 || spa_pod_builder_overflow(&measure) == false) {
+		printf("measured size %u\n", measure.offset);
+		failures++;
+	}
+
+	/* a fixed buffer reports that the props did not fit */
+	spa_pod_builder_init(&fixed, buffer, sizeof(buffer));
+	build_props(&fixed, N_PROPS);
+	if (!spa_pod_builder_overflow(&fixed) || fixed.offset != measure.offset) {
+		printf("fixed buffer overflow not detected\n");
+		failures++;
+	}
+
+	/* the arena grows from 256 bytes */
+	spa_pod_arena_init(&arena, 256);
+	b = spa_pod_arena_begin(&arena);
+	if (spa_pod_arena_begin(&arena) != NULL) {
+		printf("arena can be used twice\n");
+		failures++;
+	}
+	build_props(b, N_PROPS);
+	if (spa_pod_arena_end(&arena) < 0 || spa_pod_builder_overflow(b) ||
+	    b->offset != measure.offset || check_props(b->data, b->offset, N_PROPS, 4)) {
+		printf("arena props are wrong\n");
+		failures++;
+	}
+
+	/* after the reset the same memory is used and nothing grows */
+	data = b->data;
+	size = b->size;
+	b = spa_pod_arena_begin(&arena);
+	build_props(b, N_PROPS);
+	spa_pod_arena_end(&arena);
+	if (b->data != data || b->size != size ||
+	    check_props(b->data, b->offset, N_PROPS, 4)) {
+		printf("arena was not reused\n");
+		failures++;
+	}
+
+	/* filter into the arena, each prop keeps 2 of its values plus the
+	 * default, the flags are set on the filtered prop */
+	{
+		struct spa_pod_arena filter_arena;
+		struct spa_pod_builder *fb, *rb;
+		struct spa_pod_object *props, *filter;
+		struct spa_pod_frame f[2];
+		int i;
+
+		b = spa_pod_arena_begin(&arena);
+		build_props(b, N_PROPS);
+		spa_pod_arena_end(&arena);
+		props = b->data;
+
+		spa_pod_arena_init(&filter_arena, 0);
+		fb = spa_pod_arena_begin(&filter_arena);
+		spa_pod_builder_push_object(fb, &f[0], 0, 0);
+		for (i = 0; i < N_PROPS; i++) {
+			spa_pod_builder_push_prop(fb, &f[1], i,
+						  SPA_POD_PROP_RANGE_ENUM |
+						  SPA_POD_PROP_FLAG_UNSET);
+			spa_pod_builder_int(fb, i + 1);
+			spa_pod_builder_int(fb, i + 1);
+			spa_pod_builder_int(fb, i + 2);
+			spa_pod_builder_pop(fb, &f[1]);
+		}
+		spa_pod_builder_pop(fb, &f[0]);
+		spa_pod_arena_end(&filter_arena);
+		filter = fb->data;
+
+		rb = spa_pod_arena_begin(spa_pod_arena_get_thread());
+		spa_pod_builder_push_object(rb, &f[0], 0, 0);
+		if (spa_props_filter(rb,
+				     SPA_POD_CONTENTS(struct spa_pod_object, props),
+				     SPA_POD_CONTENTS_SIZE(struct spa_pod_object, props),
+				     SPA_POD_CONTENTS(struct spa_pod_object, filter),
+				     SPA_POD_CONTENTS_SIZE(struct spa_pod_object, filter)) < 0) {
+			printf("filter failed\n");
+			failures++;
+		}
+		spa_pod_builder_pop(rb, &f[0]);
+		if (spa_pod_arena_end(spa_pod_arena_get_thread()) < 0 ||
+		    check_props(rb->data, rb->offset, N_PROPS, 3)) {
+			printf("filtered props are wrong\n");
+			failures++;
+		}
+		for (i = 0; i < N_PROPS; i++) {
+			struct spa_pod_prop *p = spa_pod_object_find_prop(rb->data, i);
+			if (p == NULL || !(p->body.flags & SPA_POD_PROP_RANGE_ENUM) ||
+			    SPA_POD_VALUE(struct spa_pod_int, &p->body.value) != i + 1) {
+				printf("filtered prop %d is wrong\n", i);
+				failures++;
+				break;
+			}
+		}
+		spa_pod_arena_clear(&filter_arena);
+	}
+
+	spa_pod_arena_clear(&arena);
+
+	printf("%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+
+	return failures ? -1 : 0;
+}
@@ -0,0 +1,143 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <spa/pod-builder.h>
+
+#include <lib/props.h>
+
+/* Checks the intersection of int enums in spa_props_filter(), for each
+ * of the ways it is done: nested loops, merging sorted enums and looking
+ * up the values of the first enum in the sorted second one. The result has
+ * the values of the first enum that are in the second, in the order of the
+ * first. Enums with more values than can be sorted on the stack are
+ * included. */
+
+#define KEY		1
+#define MAX_VALUES	1024
+
+static int failures;
+
+static struct spa_pod_prop *
+build_enum(struct spa_pod_builder *b, const int32_t *values, int n_values)
+{
+	struct spa_pod_frame f;
+	int i;
+
+	spa_pod_builder_push_prop(b, &f, KEY, SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+	spa_pod_builder_int(b, values[0]);
+	for (i = 0; i < n_values; i++)
+		spa_pod_builder_int(b, values[i]);
+	spa_pod_builder_pop(b, &f);
+
+	return SPA_POD_BUILDER_DEREF(b, f.ref, struct spa_pod_prop);
+}
+
+static void check(const char *name,
+		  const int32_t *alt1, int nalt1,
+		  const int32_t *alt2, int nalt2,
+		  const int32_t *expected, int n_expected)
+{
+	static uint8_t buffer[3][(MAX_VALUES + 8) * 8];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod_prop *p1, *p2, *res;
+	int32_t *values;
+	int i, n, r;
+
+	spa_pod_builder_init(&b, buffer[0], sizeof(buffer[0]));
+	p1 = build_enum(&b, alt1, nalt1);
+	spa_pod_builder_init(&b, buffer[1], sizeof(buffer[1]));
+	p2 = build_enum(&b, alt2, nalt2);
+
+	spa_pod_builder_init(&b, buffer[2], sizeof(buffer[2]));
+	r = spa_props_filter(&b, &p1->pod, SPA_POD_SIZE(p1), &p2->pod, SPA_POD_SIZE(p2));
+	if (n_expected == 0) {
+		if (r != SPA_RESULT_INCOMPATIBLE_PROPS) {
+			printf("%s: filter returned %d, expected no common values\n", name, r);
+			failures++;
+		}
+		return;
+	}
+	if (r != SPA_RESULT_OK) {
+		printf("%s: filter failed %d\n", name, r);
+		failures++;
+		return;
+	}
+
+	res = (struct spa_pod_prop *) buffer[2];
+	n = SPA_POD_PROP_N_VALUES(res) - 1;
+	values = SPA_MEMBER(res, sizeof(struct spa_pod_prop) + sizeof(int32_t), int32_t);
+
+	if (n != n_expected || memcmp(values, expected, n * sizeof(int32_t)) != 0) {
+		printf("%s: %d values:", name, n);
+		for (i = 0; i < n && i < 16; i++)
+			printf(" %d", values[i]);
+		printf(", expected %d:", n_expected);
+		for (i = 0; i < n_expected && i < 16; i++)
+			printf(" %d", expected[i]);
+		printf("\n");
+		failures++;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static int32_t seq[MAX_VALUES], rev[MAX_VALUES], mixed[MAX_VALUES];
+	static const int32_t unsorted[] = { 5, 3, 1, 2 };
+	static const int32_t sorted[] = { 1, 2, 3, 5 };
+	int i;
+
+	for (i = 0; i < MAX_VALUES; i++) {
+		seq[i] = i;
+		rev[i] = MAX_VALUES - 1 - i;
+		mixed[i] = (i * 7) % MAX_VALUES;
+	}
+
+	/* few comparisons, nested loops */
+	check("small", unsorted, 4, sorted, 4, unsorted, 4);
+
+	/* both sorted, merged */
+	check("merge", sorted, 4, seq, 300, sorted, 4);
+	check("merge large", seq, 600, seq + 300, 600, seq + 300, 300);
+
+	/* the second enum is sorted in place on the stack */
+	check("lookup", unsorted, 4, rev + MAX_VALUES - 200, 200, unsorted, 4);
+
+	/* the second enum is sorted but too large for the stack and the
+	 * first is not sorted */
+	check("sorted large", unsorted, 4, seq, 300, unsorted, 4);
+
+	/* neither enum is sorted, the second is too large for the stack */
+	check("unsorted large", mixed, 300, rev, MAX_VALUES, mixed, 300);
+
+	/* duplicates in the second enum are copied once for each */
+	check("duplicates", (int32_t[]) { 7, 3 }, 2,
+	      (int32_t[]) { 3, 3, 1, 2, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+			    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35 },
+	      35, (int32_t[]) { 3, 3 }, 2);
+
+	check("no common values", unsorted, 4, seq + 10, 300, NULL, 0);
+
+	printf("%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+
+	return failures ? -1 : 0;
+}
@@ -0,0 +1,256 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <spa/loop.h>
+#include <spa/log-impl.h>
+#include <spa/type-map-impl.h>
+
+/* test of the loop timers. Many one-shot timers with random timeouts are
+ * started, some are updated or removed again, and every timer must fire
+ * once, not before its deadline. An interval timer checks that it keeps
+ * firing at the interval. Some timers are armed from another thread while
+ * the loop runs. */
+
+#define N_TIMERS	2000
+#define N_THREAD_TIMERS	200
+#define MAX_TIMEOUT_MS	300
+#define MAX_LATE_NS	(20 * SPA_NSEC_PER_MSEC)
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+struct data;
+
+struct timer {
+	struct data *data;
+	struct spa_source *source;
+	int64_t deadline;
+	int fired;
+	bool removed;
+};
+
+struct data {
+	struct spa_loop *loop;
+	struct spa_loop_control *control;
+	struct spa_loop_utils *utils;
+
+	struct timer timers[N_TIMERS];
+	struct timer thread_timers[N_THREAD_TIMERS];
+	int pending;
+	int64_t max_late;
+	int failures;
+
+	struct spa_source *interval;
+	int64_t interval_start;
+	uint64_t n_intervals;
+};
+
+static int64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static void on_timer(void *user_data, uint64_t expirations)
+{
+	struct timer *t = user_data;
+	struct data *d = t->data;
+	int64_t now = get_time();
+
+	if (t->removed || t->fired++ > 0) {
+		printf("timer %d: unexpected timeout\n", (int)(t - d->timers));
+		d->failures++;
+		return;
+	}
+	if (now < t->deadline) {
+		printf("timer %d: %" PRIi64 " ns early\n", (int)(t - d->timers), t->deadline - now);
+		d->failures++;
+	}
+	d->max_late = SPA_MAX(d->max_late, now - t->deadline);
+	d->pending--;
+}
+
+static void on_interval(void *user_data, uint64_t expirations)
+{
+	struct data *d = user_data;
+	d->n_intervals += expirations;
+}
+
+static void set_timeout(struct data *d, struct timer *t, int64_t timeout)
+{
+	struct timespec value;
+
+	t->deadline = get_time() + timeout;
+	value.tv_sec = t->deadline / SPA_NSEC_PER_SEC;
+	value.tv_nsec = t->deadline % SPA_NSEC_PER_SEC;
+	spa_loop_utils_update_timer(d->utils, t->source, &value, NULL, true);
+}
+
+static void *thread_func(void *user_data)
+{
+	struct data *d = user_data;
+	int i;
+
+	for (i = 0; i < N_THREAD_TIMERS; i++) {
+		set_timeout(d, &d->thread_timers[i], (i % 50) * SPA_NSEC_PER_MSEC);
+		usleep(1000);
+	}
+	return NULL;
+}
+
+static int make_loop(struct data *d, const char *lib)
+{
+	struct spa_support support[2];
+	const struct spa_handle_factory *factory;
+	spa_handle_factory_enum_func_t enum_func;
+	struct spa_handle *handle;
+	void *hnd, *iface;
+	uint32_t i;
+	int res;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return SPA_RESULT_ERROR;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return SPA_RESULT_ERROR;
+	}
+
+	support[0].type = SPA_TYPE__TypeMap;
+	support[0].data = &default_map.map;
+	support[1].type = SPA_TYPE__Log;
+	support[1].data = &default_log.log;
+
+	for (i = 0;; i++) {
+		if ((res = enum_func(&factory, i)) < 0)
+			return res;
+		if (strcmp(factory->name, "loop") == 0)
+			break;
+	}
+
+	handle = calloc(1, factory->size);
+	if ((res = spa_handle_factory_init(factory, handle, NULL, support, 2)) < 0)
+		return res;
+
+	if ((res = spa_handle_get_interface(handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__Loop), &iface)) < 0)
+		return res;
+	d->loop = iface;
+
+	if ((res = spa_handle_get_interface(handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__LoopControl), &iface)) < 0)
+		return res;
+	d->control = iface;
+
+	if ((res = spa_handle_get_interface(handle,
+			spa_type_map_get_id(&default_map.map, SPA_TYPE__LoopUtils), &iface)) < 0)
+		return res;
+	d->utils = iface;
+
+	return SPA_RESULT_OK;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { NULL };
+	struct timespec value, interval;
+	int64_t start, elapsed, expected;
+	pthread_t thread;
+	int i;
+
+	if (make_loop(&data, argc > 1 ? argv[1] :
+		      "build/spa/plugins/support/libspa-support.so") < 0) {
+		printf("can't make loop\n");
+		return -1;
+	}
+
+	srand(0);
+	for (i = 0; i < N_TIMERS; i++) {
+		struct timer *t = &data.timers[i];
+
+		t->data = &data;
+		t->source = spa_loop_utils_add_timer(data.utils, on_timer, t);
+		set_timeout(&data, t, (rand() % (MAX_TIMEOUT_MS * 1000)) * SPA_NSEC_PER_USEC);
+	}
+	data.pending = N_TIMERS;
+
+	for (i = 0; i < N_THREAD_TIMERS; i++) {
+		struct timer *t = &data.thread_timers[i];
+
+		t->data = &data;
+		t->source = spa_loop_utils_add_timer(data.utils, on_timer, t);
+	}
+	data.pending += N_THREAD_TIMERS;
+
+	/* move some timers around and remove some others */
+	for (i = 0; i < N_TIMERS; i += 7)
+		set_timeout(&data, &data.timers[i], (rand() % (MAX_TIMEOUT_MS * 1000)) * SPA_NSEC_PER_USEC);
+	for (i = 3; i < N_TIMERS; i += 11) {
+		data.timers[i].removed = true;
+		data.pending--;
+		if (i & 1)
+			spa_loop_utils_destroy_source(data.utils, data.timers[i].source);
+		else
+			spa_loop_utils_update_timer(data.utils, data.timers[i].source, NULL, NULL, false);
+	}
+
+	value.tv_sec = 0;
+	value.tv_nsec = 10 * SPA_NSEC_PER_MSEC;
+	interval = value;
+	data.interval = spa_loop_utils_add_timer(data.utils, on_interval, &data);
+	spa_loop_utils_update_timer(data.utils, data.interval, &value, &interval, false);
+
+	start = get_time();
+	spa_loop_control_enter(data.control);
+	pthread_create(&thread, NULL, thread_func, &data);
+	while (data.pending > 0 && get_time() - start < 2 * SPA_NSEC_PER_SEC)
+		spa_loop_control_iterate(data.control, -1);
+	spa_loop_control_leave(data.control);
+	pthread_join(thread, NULL);
+	elapsed = get_time() - start;
+
+	if (data.pending > 0) {
+		printf("%d timers did not fire\n", data.pending);
+		data.failures++;
+	}
+	if (data.max_late > MAX_LATE_NS) {
+		printf("timers fired %" PRIi64 " ns late\n", data.max_late);
+		data.failures++;
+	}
+	expected = elapsed / (10 * SPA_NSEC_PER_MSEC);
+	if (data.n_intervals + 1 < expected || data.n_intervals > expected + 1) {
+		printf("%" PRIu64 " intervals, expected %" PRIi64 "\n", data.n_intervals, expected);
+		data.failures++;
+	}
+	printf("%s: %d timers, max latency %" PRIi64 " ns, %" PRIu64 " intervals, %d failures\n",
+	       data.failures ? "FAIL" : "OK", N_TIMERS + N_THREAD_TIMERS, data.max_late, data.n_intervals,
+	       data.failures);
+
+	return data.failures ? -1 : 0;
+}
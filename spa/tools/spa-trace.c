@@ -0,0 +1,436 @@
+/* Spa
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <spa/log-trace.h>
+
+/* decodes the binary trace of the logger, see spa/log-trace.h
+ *
+ *   SPA_LOG_TRACE_SHM=/pw-trace PIPEWIRE_DEBUG=5 pipewire &
+ *   spa-trace -f /pw-trace          stream the trace live
+ *   spa-trace /pw-trace             print what is in the rings and exit
+ *   cp /dev/shm/pw-trace trace.bin
+ *   spa-trace -i trace.bin          decode a copy later
+ */
+
+#define FOLLOW_INTERVAL	(10 * SPA_NSEC_PER_MSEC)
+
+struct entry {
+	uint32_t ring;
+	uint32_t tid;
+	struct spa_log_trace_record *rec;
+};
+
+struct data {
+	struct spa_log_trace_header *h;
+	size_t size;
+
+	uint8_t *records;
+	struct entry *entries;
+	uint32_t n_entries;
+
+	uint32_t lost;
+	uint32_t *ring_lost;
+	uint32_t *ring_tid;
+};
+
+static const char *levels[] = { "-", "E", "W", "I", "D", "T" };
+
+static const struct spa_log_trace_point *
+get_point(struct data *d, uint32_t offset, const char **file, const char **func, const char **fmt)
+{
+	const struct spa_log_trace_point *point;
+	uint32_t used = __atomic_load_n(&d->h->catalog_used, __ATOMIC_ACQUIRE);
+	const char *str, *end;
+
+	if (offset % 8 || offset >= used ||
+	    used - offset < sizeof(struct spa_log_trace_point))
+		return NULL;
+
+	point = spa_log_trace_get_point(d->h, offset);
+	if (point->size > used - offset || point->size < sizeof(struct spa_log_trace_point) ||
+	    (point->n_args > SPA_LOG_TRACE_MAX_ARGS && point->n_args != SPA_LOG_TRACE_TEXT))
+		return NULL;
+
+	str = SPA_MEMBER(point, sizeof(struct spa_log_trace_point), const char);
+	end = SPA_MEMBER(point, point->size, const char);
+	*file = str;
+	if ((str = memchr(str, 0, end - str)) == NULL)
+		return NULL;
+	*func = ++str;
+	if ((str = memchr(str, 0, end - str)) == NULL)
+		return NULL;
+	*fmt = ++str;
+	if (memchr(str, 0, end - str) == NULL)
+		return NULL;
+
+	return point;
+}
+
+/* get the next argument of a record, returns -1 when the record is too short */
+static int
+get_arg(const uint8_t **p, const uint8_t *end, uint32_t type, uint64_t *val,
+	char *str, size_t max)
+{
+	uint64_t len;
+
+	if (end - *p < sizeof(uint64_t))
+		return -1;
+	memcpy(val, *p, sizeof(uint64_t));
+	*p += sizeof(uint64_t);
+
+	if (type == SPA_LOG_TRACE_ARG_STRING) {
+		len = *val;
+		if (len >= max || end - *p < SPA_ROUND_UP_N(len, 8))
+			return -1;
+		memcpy(str, *p, len);
+		str[len] = '\0';
+		*p += SPA_ROUND_UP_N(len, 8);
+	}
+	return 0;
+}
+
+/* format the arguments of a record with the format of its point, one
+ * conversion at a time */
+static int
+format_record(const struct spa_log_trace_point *point, const char *fmt,
+	      const struct spa_log_trace_record *rec, char *out, size_t max)
+{
+	const uint8_t *p = (const uint8_t *) (rec + 1);
+	const uint8_t *end = SPA_MEMBER(rec, rec->size, const uint8_t);
+	char spec[64], str[SPA_LOG_TRACE_MAX_TEXT];
+	uint8_t args[SPA_LOG_TRACE_MAX_ARGS];
+	uint32_t n_args = 0, arg = 0;
+	size_t len = 0;
+
+#define APPEND(...)								\
+	len += snprintf(out + len, len < max ? max - len : 0, __VA_ARGS__)
+
+	if (point->n_args == SPA_LOG_TRACE_TEXT) {
+		uint64_t val;
+		if (get_arg(&p, end, SPA_LOG_TRACE_ARG_STRING, &val, str, sizeof(str)) < 0)
+			return -1;
+		APPEND("%s", str);
+		return 0;
+	}
+
+	while (*fmt) {
+		const char *start = fmt, *next;
+		int star[2], n_star = 0;
+		uint64_t val = 0;
+
+		if (*fmt != '%') {
+			if ((next = strchr(fmt, '%')) == NULL)
+				next = fmt + strlen(fmt);
+			APPEND("%.*s", (int) (next - fmt), fmt);
+			fmt = next;
+			continue;
+		}
+		if (fmt[1] == '%') {
+			APPEND("%%");
+			fmt += 2;
+			continue;
+		}
+		if ((next = spa_log_trace_parse_spec(fmt + 1, args, &n_args,
+						     SPA_LOG_TRACE_MAX_ARGS)) == NULL ||
+		    n_args > point->n_args || next - start >= sizeof(spec))
+			return -1;
+
+		snprintf(spec, next - start + 1, "%s", start);
+		for (; arg < n_args; arg++) {
+			if (args[arg] != point->args[arg] ||
+			    get_arg(&p, end, args[arg], &val, str, sizeof(str)) < 0)
+				return -1;
+			if (arg + 1 < n_args)
+				star[n_star++] = (int) val;
+		}
+
+#define APPEND_SPEC(type, v)							\
+		if (n_star == 2) APPEND(spec, star[0], star[1], (type) v);	\
+		else if (n_star == 1) APPEND(spec, star[0], (type) v);		\
+		else APPEND(spec, (type) v);
+
+		switch (args[n_args - 1]) {
+		case SPA_LOG_TRACE_ARG_INT:
+			APPEND_SPEC(int, val);
+			break;
+		case SPA_LOG_TRACE_ARG_LONG:
+			APPEND_SPEC(long, val);
+			break;
+		case SPA_LOG_TRACE_ARG_LONG_LONG:
+			APPEND_SPEC(long long, val);
+			break;
+		case SPA_LOG_TRACE_ARG_SIZE:
+			APPEND_SPEC(size_t, val);
+			break;
+		case SPA_LOG_TRACE_ARG_INTMAX:
+			APPEND_SPEC(intmax_t, val);
+			break;
+		case SPA_LOG_TRACE_ARG_PTRDIFF:
+			APPEND_SPEC(ptrdiff_t, val);
+			break;
+		case SPA_LOG_TRACE_ARG_DOUBLE:
+		{
+			double d;
+			memcpy(&d, &val, sizeof(double));
+			APPEND_SPEC(double, d);
+			break;
+		}
+		case SPA_LOG_TRACE_ARG_POINTER:
+			APPEND_SPEC(void *, (uintptr_t) val);
+			break;
+		case SPA_LOG_TRACE_ARG_STRING:
+			APPEND_SPEC(const char *, str);
+			break;
+		default:
+			return -1;
+		}
+#undef APPEND_SPEC
+		fmt = next;
+	}
+#undef APPEND
+	return 0;
+}
+
+static void print_record(struct data *d, const struct entry *e)
+{
+	const struct spa_log_trace_point *point;
+	const char *file, *func, *fmt, *base;
+	char text[4096];
+	uint64_t sec = e->rec->time / SPA_NSEC_PER_SEC;
+	uint64_t nsec = e->rec->time % SPA_NSEC_PER_SEC;
+
+	if ((point = get_point(d, e->rec->point, &file, &func, &fmt)) == NULL) {
+		printf("[%" PRIu64 ".%09" PRIu64 "][%u] invalid point %u\n",
+		       sec, nsec, e->tid, e->rec->point);
+		return;
+	}
+	if (format_record(point, fmt, e->rec, text, sizeof(text)) < 0)
+		snprintf(text, sizeof(text), "<invalid record for \"%s\">", fmt);
+
+	base = strrchr(file, '/');
+	printf("[%" PRIu64 ".%09" PRIu64 "][%u][%s][%s:%i %s()] %s\n",
+	       sec, nsec, e->tid, levels[SPA_MIN(point->level, SPA_N_ELEMENTS(levels) - 1)],
+	       base ? base + 1 : file, point->line, func, text);
+}
+
+static int compare_entry(const void *a, const void *b)
+{
+	const struct entry *ea = a, *eb = b;
+
+	if (ea->rec->time != eb->rec->time)
+		return ea->rec->time < eb->rec->time ? -1 : 1;
+	return ea->ring < eb->ring ? -1 : ea->ring > eb->ring;
+}
+
+/* copy the records of a ring and free the space for the writer */
+static uint8_t *read_ring(struct data *d, uint32_t i, uint8_t *dst)
+{
+	struct spa_log_trace_ring *ring = spa_log_trace_get_ring(d->h, i);
+	void *data = spa_log_trace_get_ring_data(d->h, i);
+	uint32_t index;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&ring->rb, &index);
+	if (avail < 0 || avail > d->h->ring_size) {
+		fprintf(stderr, "ring %u: invalid indexes, skipping\n", i);
+		goto skip;
+	}
+	while (avail >= sizeof(struct spa_log_trace_record)) {
+		struct spa_log_trace_record *rec = (struct spa_log_trace_record *) dst;
+
+		spa_ringbuffer_read_data(&ring->rb, data, index & ring->rb.mask,
+					 rec, sizeof(struct spa_log_trace_record));
+		if (rec->size < sizeof(struct spa_log_trace_record) || rec->size % 8 ||
+		    rec->size > avail || rec->size > SPA_LOG_TRACE_MAX_RECORD) {
+			fprintf(stderr, "ring %u: invalid record size %u, skipping\n",
+				i, rec->size);
+			goto skip;
+		}
+		spa_ringbuffer_read_data(&ring->rb, data, index & ring->rb.mask,
+					 rec, rec->size);
+		index += rec->size;
+		avail -= rec->size;
+
+		if (rec->point == SPA_LOG_TRACE_POINT_THREAD) {
+			uint64_t tid;
+			if (rec->size >= sizeof(struct spa_log_trace_record) + sizeof(uint64_t)) {
+				memcpy(&tid, rec + 1, sizeof(uint64_t));
+				d->ring_tid[i] = tid;
+			}
+			continue;
+		}
+
+		d->entries[d->n_entries].ring = i;
+		d->entries[d->n_entries].tid = d->ring_tid[i];
+		d->entries[d->n_entries].rec = rec;
+		d->n_entries++;
+		dst += rec->size;
+	}
+	spa_ringbuffer_read_update(&ring->rb, index);
+	return dst;
+
+      skip:
+	spa_ringbuffer_read_update(&ring->rb,
+				   __atomic_load_n(&ring->rb.writeindex, __ATOMIC_ACQUIRE));
+	return dst;
+}
+
+static void report_lost(struct data *d)
+{
+	uint32_t i, lost;
+
+	if ((lost = __atomic_load_n(&d->h->lost, __ATOMIC_RELAXED)) != d->lost) {
+		fprintf(stderr, "lost %u records without ring or catalog space\n",
+			lost - d->lost);
+		d->lost = lost;
+	}
+	for (i = 0; i < d->h->n_rings; i++) {
+		struct spa_log_trace_ring *ring = spa_log_trace_get_ring(d->h, i);
+
+		if ((lost = __atomic_load_n(&ring->lost, __ATOMIC_RELAXED)) != d->ring_lost[i]) {
+			fprintf(stderr, "ring %u: lost %u records, the ring was full\n",
+				i, lost - d->ring_lost[i]);
+			d->ring_lost[i] = lost;
+		}
+	}
+}
+
+/* read all the rings and print their records in time order */
+static void process(struct data *d)
+{
+	uint8_t *dst = d->records;
+	uint32_t i;
+
+	d->n_entries = 0;
+	for (i = 0; i < d->h->n_rings; i++)
+		dst = read_ring(d, i, dst);
+
+	qsort(d->entries, d->n_entries, sizeof(struct entry), compare_entry);
+	for (i = 0; i < d->n_entries; i++)
+		print_record(d, &d->entries[i]);
+
+	report_lost(d);
+	fflush(stdout);
+}
+
+static int open_trace(struct data *d, const char *name, bool is_file)
+{
+	struct stat st;
+	int fd;
+
+	if (is_file)
+		fd = open(name, O_RDONLY | O_CLOEXEC);
+	else
+		fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "can't open %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+	d->size = st.st_size;
+
+	/* a file is mapped privately so that reading it does not modify it */
+	d->h = mmap(NULL, d->size, PROT_READ | PROT_WRITE,
+		    is_file ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+	close(fd);
+	if (d->h == MAP_FAILED) {
+		fprintf(stderr, "can't map %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	if (d->size < sizeof(struct spa_log_trace_header) ||
+	    d->h->magic != SPA_LOG_TRACE_MAGIC || d->h->version != SPA_LOG_TRACE_VERSION ||
+	    d->h->ring_size == 0 || (d->h->ring_size & (d->h->ring_size - 1)) ||
+	    d->h->catalog_size % 8 || d->h->catalog_used > d->h->catalog_size ||
+	    spa_log_trace_size(d->h->n_rings, d->h->ring_size, d->h->catalog_size) > d->size) {
+		fprintf(stderr, "%s is not a trace of version %d\n", name, SPA_LOG_TRACE_VERSION);
+		return -1;
+	}
+
+	d->records = malloc((size_t) d->h->n_rings * d->h->ring_size);
+	d->entries = malloc((size_t) d->h->n_rings * d->h->ring_size /
+			    sizeof(struct spa_log_trace_record) * sizeof(struct entry));
+	d->ring_lost = calloc(d->h->n_rings, sizeof(uint32_t));
+	d->ring_tid = calloc(d->h->n_rings, sizeof(uint32_t));
+	if (d->records == NULL || d->entries == NULL ||
+	    d->ring_lost == NULL || d->ring_tid == NULL) {
+		fprintf(stderr, "can't allocate memory\n");
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { NULL, };
+	bool follow = false, is_file = false;
+	int c;
+
+	while ((c = getopt(argc, argv, "fi")) != -1) {
+		switch (c) {
+		case 'f':
+			follow = true;
+			break;
+		case 'i':
+			is_file = true;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind + 1 != argc || (follow && is_file))
+		goto usage;
+
+	if (open_trace(&data, argv[optind], is_file) < 0)
+		return -1;
+
+	process(&data);
+	while (follow) {
+		struct timespec ts = { 0, FOLLOW_INTERVAL };
+		nanosleep(&ts, NULL);
+		process(&data);
+	}
+
+	free(data.records);
+	free(data.entries);
+	free(data.ring_lost);
+	free(data.ring_tid);
+	munmap(data.h, data.size);
+
+	return 0;
+
+      usage:
+	printf("usage: %s [-f] <shm name>\n"
+	       "       %s -i <file>\n"
+	       "  -f  keep on reading the trace\n"
+	       "  -i  decode a copy of the trace in a file\n", argv[0], argv[0]);
+	return -1;
+}
@@ -53,6 +53,26 @@ parse_line(struct pw_daemon_config *config,
 	if (*line == '\0')	/* empty line */
 		return true;
 
+	/* properties are needed before the core is made, keep them apart
+	 * from the commands */
+	if (strncmp(line, "set-prop", 8) == 0 && (line[8] == ' ' || line[8] == '\t')) {
+		char **args;
+		int n_args;
+
+		p = line + 8;
+		p += strspn(p, " \t");
+		args = pw_split_strv(p, " \t", 2, &n_args);
+		if (n_args != 2) {
+			asprintf(err, "%s:%u: set-prop requires a key and a value", filename, lineno);
+			ret = false;
+		} else {
+			pw_strip(args[1], " \t");
+			pw_properties_set(config->properties, args[0], args[1]);
+		}
+		pw_free_strv(args);
+		return ret;
+	}
+
 	if ((command = pw_command_parse(line, &local_err)) == NULL) {
 		asprintf(err, "%s:%u: %s", filename, lineno, local_err);
 		free(local_err);
@@ -75,6 +95,7 @@ struct pw_daemon_config *pw_daemon_config_new(void)
 
 	config = calloc(1, sizeof(struct pw_daemon_config));
 	spa_list_init(&config->commands);
+	config->properties = pw_properties_new(NULL, NULL);
 
 	return config;
 }
@@ -92,6 +113,7 @@ void pw_daemon_config_free(struct pw_daemon_config *config)
 	spa_list_for_each_safe(cmd, tmp, &config->commands, link)
 	    pw_command_free(cmd);
 
+	pw_properties_free(config->properties);
 	free(config);
 }
 
@@ -170,6 +192,26 @@ bool pw_daemon_config_load(struct pw_daemon_config *config, char **err)
 	return pw_daemon_config_load_file(config, filename, err);
 }
 
+/**
+ * pw_daemon_config_apply_properties:
+ * @config: A #struct pw_daemon_config
+ * @properties: A #struct pw_properties
+ *
+ * Copy all properties set with set-prop into @properties. Call this
+ * before making the core so that the loops and the core see them.
+ */
+void pw_daemon_config_apply_properties(struct pw_daemon_config *config, struct pw_properties *properties)
+{
+	const char *key;
+	void *state = NULL;
+
+	while ((key = pw_properties_iterate(config->properties, &state))) {
+		const char *value = pw_properties_get(config->properties, key);
+		pw_log_info("config: %s = %s", key, value);
+		pw_properties_set(properties, key, value);
+	}
+}
+
 /**
  * pw_daemon_config_run_commands:
  * @config: A #struct pw_daemon_config
@@ -29,6 +29,7 @@ extern "C" {
 
 struct pw_daemon_config {
 	struct spa_list commands;
+	struct pw_properties *properties;	/**< properties from set-prop lines */
 };
 
 struct pw_daemon_config *
@@ -43,6 +44,9 @@ pw_daemon_config_load_file(struct pw_daemon_config *config, const char *filename
 bool
 pw_daemon_config_load(struct pw_daemon_config *config, char **err);
 
+void
+pw_daemon_config_apply_properties(struct pw_daemon_config *config, struct pw_properties *properties);
+
 bool
 pw_daemon_config_run_commands(struct pw_daemon_config *config, struct pw_core *core);
 
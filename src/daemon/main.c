@@ -51,6 +51,7 @@ int main(int argc, char *argv[])
 
 	props = pw_properties_new("pipewire.core.name", "pipewire-0",
 				  "pipewire.daemon", "1", NULL);
+	pw_daemon_config_apply_properties(config, props);
 
 	loop = pw_main_loop_new(props);
 	pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGINT, do_quit, loop);
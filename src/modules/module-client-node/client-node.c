@@ -884,12 +884,18 @@ client_node_port_update(void *data,
 	if (remove) {
 		do_uninit_port(this, direction, port_id);
 	} else {
+		struct pw_port *port;
+
 		do_update_port(this,
 			       direction,
 			       port_id,
 			       change_mask,
 			       n_possible_formats,
 			       possible_formats, format, n_params, params, info);
+
+		if ((change_mask & PW_CLIENT_NODE_PORT_UPDATE_POSSIBLE_FORMATS) &&
+		    (port = pw_node_find_port(impl->this.node, direction, port_id)))
+			pw_port_invalidate_formats(port);
 	}
 }
 
@@ -934,7 +940,10 @@ static void proxy_on_data_fd_events(struct spa_source *source)
 					this, strerror(errno));
 
 		while (pw_client_node_transport_next_message(impl->transport, &message) == SPA_RESULT_OK) {
-			struct pw_client_node_message *msg = alloca(SPA_POD_SIZE(&message));
+			/* scoped to the iteration, alloca would grow the stack
+			 * with every message */
+			uint64_t buffer[(SPA_POD_SIZE(&message) + 7) / 8];
+			struct pw_client_node_message *msg = (struct pw_client_node_message *) buffer;
 			pw_client_node_transport_parse_message(impl->transport, msg);
 			handle_node_message(this, msg);
 		}
@@ -1139,6 +1148,7 @@ struct pw_client_node *pw_client_node_new(struct pw_resource *resource,
 	struct pw_core *core = pw_client_get_core(client);
 	const struct spa_support *support;
 	uint32_t n_support;
+	const char *str;
 
 
 	impl = calloc(1, sizeof(struct impl));
@@ -1152,7 +1162,15 @@ struct pw_client_node *pw_client_node_new(struct pw_resource *resource,
 	impl->fds[0] = impl->fds[1] = -1;
 	pw_log_debug("client-node %p: new", impl);
 
-	support = pw_core_get_support(impl->core, &n_support);
+	/* every new data loop is a realtime thread, clients can only use the
+	 * loops that the daemon has or that are in its config */
+	if (properties && (str = pw_properties_get(properties, "node.data-loop")) &&
+	    !pw_core_has_data_loop(core, str)) {
+		pw_log_warn("client-node %p: unknown data loop %s, using the default", impl, str);
+		pw_properties_set(properties, "node.data-loop", NULL);
+	}
+
+	support = pw_core_get_node_support(impl->core, properties, &n_support);
 
 	proxy_init(&impl->proxy, NULL, support, n_support);
 	impl->proxy.impl = impl;
@@ -19,7 +19,7 @@
 
 #include <errno.h>
 
-#include "spa/pod-iter.h"
+#include "spa/pod-schema.h"
 
 #include "pipewire/pipewire.h"
 #include "pipewire/interfaces.h"
@@ -31,18 +31,227 @@
 
 #include "transport.h"
 
+/* layouts of the messages, the same schema is used to marshal and
+ * demarshal a message */
+struct msg_done {
+	int32_t seq;
+	int32_t res;
+};
+SPA_POD_SCHEMA_DEFINE(msg_done_schema,
+	SPA_POD_SCHEMA_INT(struct msg_done, seq),
+	SPA_POD_SCHEMA_INT(struct msg_done, res));
+
+struct msg_update {
+	uint32_t change_mask;
+	uint32_t max_input_ports;
+	uint32_t max_output_ports;
+	const struct spa_props *props;
+};
+SPA_POD_SCHEMA_DEFINE(msg_update_schema,
+	SPA_POD_SCHEMA_INT(struct msg_update, change_mask),
+	SPA_POD_SCHEMA_INT(struct msg_update, max_input_ports),
+	SPA_POD_SCHEMA_INT(struct msg_update, max_output_ports),
+	SPA_POD_SCHEMA_POD(-SPA_POD_TYPE_OBJECT, struct msg_update, props));
+
+struct msg_port_update {
+	uint32_t direction;
+	uint32_t port_id;
+	uint32_t change_mask;
+	uint32_t n_possible_formats;
+};
+SPA_POD_SCHEMA_DEFINE(msg_port_update_schema,
+	SPA_POD_SCHEMA_INT(struct msg_port_update, direction),
+	SPA_POD_SCHEMA_INT(struct msg_port_update, port_id),
+	SPA_POD_SCHEMA_INT(struct msg_port_update, change_mask),
+	SPA_POD_SCHEMA_INT(struct msg_port_update, n_possible_formats));
+
+struct msg_port_update_params {
+	const struct spa_format *format;
+	uint32_t n_params;
+};
+SPA_POD_SCHEMA_DEFINE(msg_port_update_params_schema,
+	SPA_POD_SCHEMA_POD(-SPA_POD_TYPE_OBJECT, struct msg_port_update_params, format),
+	SPA_POD_SCHEMA_INT(struct msg_port_update_params, n_params));
+
+/* the port info is an optional struct */
+struct msg_port_info {
+	const struct spa_pod *info;
+};
+SPA_POD_SCHEMA_DEFINE(msg_port_info_schema,
+	SPA_POD_SCHEMA_POD(-SPA_POD_TYPE_STRUCT, struct msg_port_info, info));
+
+SPA_POD_SCHEMA_DEFINE(port_info_schema,
+	SPA_POD_SCHEMA_INT(struct spa_port_info, flags),
+	SPA_POD_SCHEMA_INT(struct spa_port_info, rate));
+
+struct msg_event {
+	const struct spa_event *event;
+};
+SPA_POD_SCHEMA_DEFINE(msg_event_schema,
+	SPA_POD_SCHEMA_POD(SPA_POD_TYPE_OBJECT, struct msg_event, event));
+
+struct msg_set_props {
+	uint32_t seq;
+	const struct spa_props *props;
+};
+SPA_POD_SCHEMA_DEFINE(msg_set_props_schema,
+	SPA_POD_SCHEMA_INT(struct msg_set_props, seq),
+	SPA_POD_SCHEMA_POD(-SPA_POD_TYPE_OBJECT, struct msg_set_props, props));
+
+struct msg_port {
+	uint32_t seq;
+	uint32_t direction;
+	uint32_t port_id;
+};
+SPA_POD_SCHEMA_DEFINE(msg_port_schema,
+	SPA_POD_SCHEMA_INT(struct msg_port, seq),
+	SPA_POD_SCHEMA_INT(struct msg_port, direction),
+	SPA_POD_SCHEMA_INT(struct msg_port, port_id));
+
+struct msg_set_format {
+	uint32_t seq;
+	uint32_t direction;
+	uint32_t port_id;
+	uint32_t flags;
+	const struct spa_format *format;
+};
+SPA_POD_SCHEMA_DEFINE(msg_set_format_schema,
+	SPA_POD_SCHEMA_INT(struct msg_set_format, seq),
+	SPA_POD_SCHEMA_INT(struct msg_set_format, direction),
+	SPA_POD_SCHEMA_INT(struct msg_set_format, port_id),
+	SPA_POD_SCHEMA_INT(struct msg_set_format, flags),
+	SPA_POD_SCHEMA_POD(-SPA_POD_TYPE_OBJECT, struct msg_set_format, format));
+
+struct msg_set_param {
+	uint32_t seq;
+	uint32_t direction;
+	uint32_t port_id;
+	const struct spa_param *param;
+};
+SPA_POD_SCHEMA_DEFINE(msg_set_param_schema,
+	SPA_POD_SCHEMA_INT(struct msg_set_param, seq),
+	SPA_POD_SCHEMA_INT(struct msg_set_param, direction),
+	SPA_POD_SCHEMA_INT(struct msg_set_param, port_id),
+	SPA_POD_SCHEMA_POD(-SPA_POD_TYPE_OBJECT, struct msg_set_param, param));
+
+struct msg_add_mem {
+	uint32_t direction;
+	uint32_t port_id;
+	uint32_t mem_id;
+	uint32_t type;
+	uint32_t memfd_idx;
+	uint32_t flags;
+	uint32_t offset;
+	uint32_t size;
+};
+SPA_POD_SCHEMA_DEFINE(msg_add_mem_schema,
+	SPA_POD_SCHEMA_INT(struct msg_add_mem, direction),
+	SPA_POD_SCHEMA_INT(struct msg_add_mem, port_id),
+	SPA_POD_SCHEMA_INT(struct msg_add_mem, mem_id),
+	SPA_POD_SCHEMA_ID(struct msg_add_mem, type),
+	SPA_POD_SCHEMA_INT(struct msg_add_mem, memfd_idx),
+	SPA_POD_SCHEMA_INT(struct msg_add_mem, flags),
+	SPA_POD_SCHEMA_INT(struct msg_add_mem, offset),
+	SPA_POD_SCHEMA_INT(struct msg_add_mem, size));
+
+struct msg_use_buffers {
+	uint32_t seq;
+	uint32_t direction;
+	uint32_t port_id;
+	uint32_t n_buffers;
+};
+SPA_POD_SCHEMA_DEFINE(msg_use_buffers_schema,
+	SPA_POD_SCHEMA_INT(struct msg_use_buffers, seq),
+	SPA_POD_SCHEMA_INT(struct msg_use_buffers, direction),
+	SPA_POD_SCHEMA_INT(struct msg_use_buffers, port_id),
+	SPA_POD_SCHEMA_INT(struct msg_use_buffers, n_buffers));
+
+SPA_POD_SCHEMA_DEFINE(client_node_buffer_schema,
+	SPA_POD_SCHEMA_INT(struct pw_client_node_buffer, mem_id),
+	SPA_POD_SCHEMA_INT(struct pw_client_node_buffer, offset),
+	SPA_POD_SCHEMA_INT(struct pw_client_node_buffer, size));
+
+SPA_POD_SCHEMA_DEFINE(buffer_metas_schema,
+	SPA_POD_SCHEMA_INT(struct spa_buffer, id),
+	SPA_POD_SCHEMA_INT(struct spa_buffer, n_metas));
+
+SPA_POD_SCHEMA_DEFINE(buffer_datas_schema,
+	SPA_POD_SCHEMA_INT(struct spa_buffer, n_datas));
+
+SPA_POD_SCHEMA_DEFINE(meta_schema,
+	SPA_POD_SCHEMA_ID(struct spa_meta, type),
+	SPA_POD_SCHEMA_INT(struct spa_meta, size));
+
+/* the data pointer is sent as the id of the memory */
+struct msg_data {
+	uint32_t type;
+	uint32_t data_id;
+	uint32_t flags;
+	uint32_t mapoffset;
+	uint32_t maxsize;
+};
+SPA_POD_SCHEMA_DEFINE(msg_data_schema,
+	SPA_POD_SCHEMA_ID(struct msg_data, type),
+	SPA_POD_SCHEMA_INT(struct msg_data, data_id),
+	SPA_POD_SCHEMA_INT(struct msg_data, flags),
+	SPA_POD_SCHEMA_INT(struct msg_data, mapoffset),
+	SPA_POD_SCHEMA_INT(struct msg_data, maxsize));
+
+struct msg_node_command {
+	uint32_t seq;
+	const struct spa_command *command;
+};
+SPA_POD_SCHEMA_DEFINE(msg_node_command_schema,
+	SPA_POD_SCHEMA_INT(struct msg_node_command, seq),
+	SPA_POD_SCHEMA_POD(SPA_POD_TYPE_OBJECT, struct msg_node_command, command));
+
+struct msg_port_command {
+	uint32_t direction;
+	uint32_t port_id;
+	const struct spa_command *command;
+};
+SPA_POD_SCHEMA_DEFINE(msg_port_command_schema,
+	SPA_POD_SCHEMA_INT(struct msg_port_command, direction),
+	SPA_POD_SCHEMA_INT(struct msg_port_command, port_id),
+	SPA_POD_SCHEMA_POD(SPA_POD_TYPE_OBJECT, struct msg_port_command, command));
+
+struct msg_transport {
+	uint32_t node_id;
+	uint32_t ridx;
+	uint32_t widx;
+	uint32_t memfd_idx;
+	uint32_t offset;
+	uint32_t size;
+};
+SPA_POD_SCHEMA_DEFINE(msg_transport_schema,
+	SPA_POD_SCHEMA_INT(struct msg_transport, node_id),
+	SPA_POD_SCHEMA_INT(struct msg_transport, ridx),
+	SPA_POD_SCHEMA_INT(struct msg_transport, widx),
+	SPA_POD_SCHEMA_INT(struct msg_transport, memfd_idx),
+	SPA_POD_SCHEMA_INT(struct msg_transport, offset),
+	SPA_POD_SCHEMA_INT(struct msg_transport, size));
+
+SPA_POD_SCHEMA_DEFINE(object_schema, { SPA_POD_TYPE_OBJECT, 0 });
+
+/* the size of the smallest pod with a value. Used to check that the
+ * number of elements of an array in a message fits in the message */
+#define MIN_POD_SIZE	(sizeof(struct spa_pod) + 8)
+
+static bool check_n_elems(struct spa_pod_iter *it, uint32_t n_elems, uint32_t elem_size)
+{
+	return it->offset <= it->size && n_elems <= (it->size - it->offset) / elem_size;
+}
+
 static void
 client_node_marshal_done(void *object, int seq, int res)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_done msg = { seq, res };
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CLIENT_NODE_PROXY_METHOD_DONE);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, seq,
-			       SPA_POD_TYPE_INT, res);
+	spa_pod_schema_build(b, &msg_done_schema, &msg);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -56,14 +265,11 @@ client_node_marshal_update(void *object,
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_update msg = { change_mask, max_input_ports, max_output_ports, props };
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CLIENT_NODE_PROXY_METHOD_UPDATE);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, change_mask,
-			       SPA_POD_TYPE_INT, max_input_ports,
-			       SPA_POD_TYPE_INT, max_output_ports, SPA_POD_TYPE_POD, props);
+	spa_pod_schema_build(b, &msg_update_schema, &msg);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -81,36 +287,32 @@ client_node_marshal_port_update(void *object,
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f[2];
+	struct spa_pod_frame f;
+	struct msg_port_update msg = { direction, port_id, change_mask, n_possible_formats };
+	struct msg_port_update_params msg_params = { format, n_params };
 	int i;
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CLIENT_NODE_PROXY_METHOD_PORT_UPDATE);
 
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f[0],
-			    SPA_POD_TYPE_INT, direction,
-			    SPA_POD_TYPE_INT, port_id,
-			    SPA_POD_TYPE_INT, change_mask, SPA_POD_TYPE_INT, n_possible_formats, 0);
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &msg_port_update_schema, &msg);
 
 	for (i = 0; i < n_possible_formats; i++)
-		spa_pod_builder_add(b, SPA_POD_TYPE_POD, possible_formats[i], 0);
+		spa_pod_schema_add(b, &object_schema, &possible_formats[i]);
 
-	spa_pod_builder_add(b, SPA_POD_TYPE_POD, format, SPA_POD_TYPE_INT, n_params, 0);
+	spa_pod_schema_add(b, &msg_port_update_params_schema, &msg_params);
 
-	for (i = 0; i < n_params; i++) {
-		const struct spa_param *p = params[i];
-		spa_pod_builder_add(b, SPA_POD_TYPE_POD, p, 0);
-	}
+	for (i = 0; i < n_params; i++)
+		spa_pod_schema_add(b, &object_schema, &params[i]);
 
 	if (info) {
-		spa_pod_builder_add(b,
-				    SPA_POD_TYPE_STRUCT, &f[1],
-				    SPA_POD_TYPE_INT, info->flags, SPA_POD_TYPE_INT, info->rate, 0);
-		spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f[1], 0);
+		spa_pod_schema_build(b, &port_info_schema, info);
 	} else {
-		spa_pod_builder_add(b, SPA_POD_TYPE_POD, NULL, 0);
+		struct msg_port_info msg_info = { NULL };
+		spa_pod_schema_add(b, &msg_port_info_schema, &msg_info);
 	}
-	spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f[0], 0);
+
+	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -119,11 +321,11 @@ static void client_node_marshal_event_method(void *object, struct spa_event *eve
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_event msg = { event };
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CLIENT_NODE_PROXY_METHOD_EVENT);
 
-	spa_pod_builder_struct(b, &f, SPA_POD_TYPE_POD, event);
+	spa_pod_schema_build(b, &msg_event_schema, &msg);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -144,131 +346,98 @@ static void client_node_marshal_destroy(void *object)
 static bool client_node_demarshal_set_props(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t seq;
-	const struct spa_props *props = NULL;
+	struct msg_set_props msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      -SPA_POD_TYPE_OBJECT, &props, 0))
+	if (!spa_pod_schema_parse(&msg_set_props_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, set_props, seq, props);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, set_props, msg.seq, msg.props);
 	return true;
 }
 
 static bool client_node_demarshal_event_event(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	const struct spa_event *event;
+	struct msg_event msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &event, 0))
+	if (!spa_pod_schema_parse(&msg_event_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, event, event);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, event, msg.event);
 	return true;
 }
 
 static bool client_node_demarshal_add_port(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	int32_t seq, direction, port_id;
+	struct msg_port msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction, SPA_POD_TYPE_INT, &port_id, 0))
+	if (!spa_pod_schema_parse(&msg_port_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, add_port, seq, direction, port_id);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, add_port, msg.seq,
+			msg.direction, msg.port_id);
 	return true;
 }
 
 static bool client_node_demarshal_remove_port(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	int32_t seq, direction, port_id;
+	struct msg_port msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction, SPA_POD_TYPE_INT, &port_id, 0))
+	if (!spa_pod_schema_parse(&msg_port_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, remove_port, seq, direction, port_id);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, remove_port, msg.seq,
+			msg.direction, msg.port_id);
 	return true;
 }
 
 static bool client_node_demarshal_set_format(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t seq, direction, port_id, flags;
-	const struct spa_format *format = NULL;
+	struct msg_set_format msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      SPA_POD_TYPE_INT, &flags,
-			      -SPA_POD_TYPE_OBJECT, &format, 0))
+	if (!spa_pod_schema_parse(&msg_set_format_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, set_format, seq, direction, port_id,
-			flags, format);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, set_format, msg.seq,
+			msg.direction, msg.port_id, msg.flags, msg.format);
 	return true;
 }
 
 static bool client_node_demarshal_set_param(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t seq, direction, port_id;
-	const struct spa_param *param = NULL;
+	struct msg_set_param msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      -SPA_POD_TYPE_OBJECT, &param, 0))
+	if (!spa_pod_schema_parse(&msg_set_param_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, set_param, seq, direction, port_id, param);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, set_param, msg.seq,
+			msg.direction, msg.port_id, msg.param);
 	return true;
 }
 
 static bool client_node_demarshal_add_mem(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t direction, port_id, mem_id, type, memfd_idx, flags, offset, sz;
+	struct msg_add_mem msg = { 0, };
 	int memfd;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      SPA_POD_TYPE_INT, &mem_id,
-			      SPA_POD_TYPE_ID, &type,
-			      SPA_POD_TYPE_INT, &memfd_idx,
-			      SPA_POD_TYPE_INT, &flags,
-			      SPA_POD_TYPE_INT, &offset, SPA_POD_TYPE_INT, &sz, 0))
+	if (!spa_pod_schema_parse(&msg_add_mem_schema, data, size, &msg))
 		return false;
 
-	memfd = pw_protocol_native_get_proxy_fd(proxy, memfd_idx);
+	memfd = pw_protocol_native_get_proxy_fd(proxy, msg.memfd_idx);
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, add_mem, direction,
-								      port_id,
-								      mem_id,
-								      type,
-								      memfd, flags, offset, sz);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, add_mem, msg.direction,
+								      msg.port_id,
+								      msg.mem_id,
+								      msg.type,
+								      memfd,
+								      msg.flags,
+								      msg.offset,
+								      msg.size);
 	return true;
 }
 
@@ -276,127 +445,105 @@ static bool client_node_demarshal_use_buffers(void *object, void *data, size_t s
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_iter it;
-	uint32_t seq, direction, port_id, n_buffers, data_id;
+	struct msg_use_buffers msg = { 0, };
+	struct msg_data d = { 0, };
 	struct pw_client_node_buffer *buffers;
 	int i, j;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id, SPA_POD_TYPE_INT, &n_buffers, 0))
+	    !spa_pod_schema_parse_iter(&it, &msg_use_buffers_schema, &msg) ||
+	    !check_n_elems(&it, msg.n_buffers, 6 * MIN_POD_SIZE))
 		return false;
 
-	buffers = alloca(sizeof(struct pw_client_node_buffer) * n_buffers);
-	for (i = 0; i < n_buffers; i++) {
+	buffers = alloca(sizeof(struct pw_client_node_buffer) * msg.n_buffers);
+	for (i = 0; i < msg.n_buffers; i++) {
 		struct spa_buffer *buf = buffers[i].buffer = alloca(sizeof(struct spa_buffer));
 
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_INT, &buffers[i].mem_id,
-				      SPA_POD_TYPE_INT, &buffers[i].offset,
-				      SPA_POD_TYPE_INT, &buffers[i].size,
-				      SPA_POD_TYPE_INT, &buf->id,
-				      SPA_POD_TYPE_INT, &buf->n_metas, 0))
+		if (!spa_pod_schema_parse_iter(&it, &client_node_buffer_schema, &buffers[i]) ||
+		    !spa_pod_schema_parse_iter(&it, &buffer_metas_schema, buf) ||
+		    !check_n_elems(&it, buf->n_metas, 2 * MIN_POD_SIZE))
 			return false;
 
 		buf->metas = alloca(sizeof(struct spa_meta) * buf->n_metas);
 		for (j = 0; j < buf->n_metas; j++) {
-			struct spa_meta *m = &buf->metas[j];
-
-			if (!spa_pod_iter_get(&it,
-					      SPA_POD_TYPE_ID, &m->type,
-					      SPA_POD_TYPE_INT, &m->size, 0))
+			if (!spa_pod_schema_parse_iter(&it, &meta_schema, &buf->metas[j]))
 				return false;
 		}
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &buf->n_datas, 0))
+		if (!spa_pod_schema_parse_iter(&it, &buffer_datas_schema, buf) ||
+		    !check_n_elems(&it, buf->n_datas, 5 * MIN_POD_SIZE))
 			return false;
 
 		buf->datas = alloca(sizeof(struct spa_data) * buf->n_datas);
 		for (j = 0; j < buf->n_datas; j++) {
-			struct spa_data *d = &buf->datas[j];
+			struct spa_data *bd = &buf->datas[j];
 
-			if (!spa_pod_iter_get(&it,
-					      SPA_POD_TYPE_ID, &d->type,
-					      SPA_POD_TYPE_INT, &data_id,
-					      SPA_POD_TYPE_INT, &d->flags,
-					      SPA_POD_TYPE_INT, &d->mapoffset,
-					      SPA_POD_TYPE_INT, &d->maxsize, 0))
+			if (!spa_pod_schema_parse_iter(&it, &msg_data_schema, &d))
 				return false;
 
-			d->data = SPA_UINT32_TO_PTR(data_id);
+			bd->type = d.type;
+			bd->data = SPA_UINT32_TO_PTR(d.data_id);
+			bd->flags = d.flags;
+			bd->mapoffset = d.mapoffset;
+			bd->maxsize = d.maxsize;
 		}
 	}
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, use_buffers, seq,
-									  direction,
-									  port_id,
-									  n_buffers, buffers);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, use_buffers, msg.seq,
+									  msg.direction,
+									  msg.port_id,
+									  msg.n_buffers, buffers);
 	return true;
 }
 
 static bool client_node_demarshal_node_command(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	const struct spa_command *command;
-	uint32_t seq;
+	struct msg_node_command msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &seq, SPA_POD_TYPE_OBJECT, &command, 0))
+	if (!spa_pod_schema_parse(&msg_node_command_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, node_command, seq, command);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, node_command, msg.seq,
+			msg.command);
 	return true;
 }
 
 static bool client_node_demarshal_port_command(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	const struct spa_command *command;
-	uint32_t direction, port_id;
+	struct msg_port_command msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      SPA_POD_TYPE_OBJECT, &command, 0))
+	if (!spa_pod_schema_parse(&msg_port_command_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, port_command, direction,
-									   port_id,
-									   command);
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, port_command, msg.direction,
+									   msg.port_id,
+									   msg.command);
 	return true;
 }
 
 static bool client_node_demarshal_transport(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t node_id, ridx, widx, memfd_idx;
+	struct msg_transport msg = { 0, };
 	int readfd, writefd;
 	struct pw_client_node_transport_info info;
 	struct pw_client_node_transport *transport;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &node_id,
-			      SPA_POD_TYPE_INT, &ridx,
-			      SPA_POD_TYPE_INT, &widx,
-			      SPA_POD_TYPE_INT, &memfd_idx,
-			      SPA_POD_TYPE_INT, &info.offset,
-			      SPA_POD_TYPE_INT, &info.size, 0))
+	if (!spa_pod_schema_parse(&msg_transport_schema, data, size, &msg))
 		return false;
 
-	readfd = pw_protocol_native_get_proxy_fd(proxy, ridx);
-	writefd = pw_protocol_native_get_proxy_fd(proxy, widx);
-	info.memfd = pw_protocol_native_get_proxy_fd(proxy, memfd_idx);
+	readfd = pw_protocol_native_get_proxy_fd(proxy, msg.ridx);
+	writefd = pw_protocol_native_get_proxy_fd(proxy, msg.widx);
+	info.memfd = pw_protocol_native_get_proxy_fd(proxy, msg.memfd_idx);
+	info.offset = msg.offset;
+	info.size = msg.size;
 
 	if (readfd == -1 || writefd == -1 || info.memfd == -1)
 		return false;
 
 	transport = pw_client_node_transport_new_from_info(&info);
 
-	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, transport, node_id,
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, transport, msg.node_id,
 								   readfd, writefd, transport);
 	return true;
 }
@@ -406,13 +553,11 @@ client_node_marshal_set_props(void *object, uint32_t seq, const struct spa_props
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_set_props msg = { seq, props };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_SET_PROPS);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, seq,
-			       SPA_POD_TYPE_POD, props);
+	spa_pod_schema_build(b, &msg_set_props_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -421,11 +566,11 @@ static void client_node_marshal_event_event(void *object, const struct spa_event
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_event msg = { event };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_EVENT);
 
-	spa_pod_builder_struct(b, &f, SPA_POD_TYPE_POD, event);
+	spa_pod_schema_build(b, &msg_event_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -436,13 +581,11 @@ client_node_marshal_add_port(void *object,
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_port msg = { seq, direction, port_id };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_ADD_PORT);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, seq,
-			       SPA_POD_TYPE_INT, direction, SPA_POD_TYPE_INT, port_id);
+	spa_pod_schema_build(b, &msg_port_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -453,13 +596,11 @@ client_node_marshal_remove_port(void *object,
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_port msg = { seq, direction, port_id };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_REMOVE_PORT);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, seq,
-			       SPA_POD_TYPE_INT, direction, SPA_POD_TYPE_INT, port_id);
+	spa_pod_schema_build(b, &msg_port_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -474,16 +615,11 @@ client_node_marshal_set_format(void *object,
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_set_format msg = { seq, direction, port_id, flags, format };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_SET_FORMAT);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, seq,
-			       SPA_POD_TYPE_INT, direction,
-			       SPA_POD_TYPE_INT, port_id,
-			       SPA_POD_TYPE_INT, flags,
-			       SPA_POD_TYPE_POD, format);
+	spa_pod_schema_build(b, &msg_set_format_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -497,15 +633,11 @@ client_node_marshal_set_param(void *object,
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_set_param msg = { seq, direction, port_id, param };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_SET_PARAM);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, seq,
-			       SPA_POD_TYPE_INT, direction,
-			       SPA_POD_TYPE_INT, port_id,
-			       SPA_POD_TYPE_POD, param);
+	spa_pod_schema_build(b, &msg_set_param_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -520,18 +652,13 @@ client_node_marshal_add_mem(void *object,
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_add_mem msg = { direction, port_id, mem_id, type,
+				   pw_protocol_native_add_resource_fd(resource, memfd),
+				   flags, offset, size };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_ADD_MEM);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, direction,
-			       SPA_POD_TYPE_INT, port_id,
-			       SPA_POD_TYPE_INT, mem_id,
-			       SPA_POD_TYPE_ID, type,
-			       SPA_POD_TYPE_INT, pw_protocol_native_add_resource_fd(resource, memfd),
-			       SPA_POD_TYPE_INT, flags,
-			       SPA_POD_TYPE_INT, offset, SPA_POD_TYPE_INT, size);
+	spa_pod_schema_build(b, &msg_add_mem_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -546,42 +673,34 @@ client_node_marshal_use_buffers(void *object,
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
+	struct msg_use_buffers msg = { seq, direction, port_id, n_buffers };
 	uint32_t i, j;
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_USE_BUFFERS);
 
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f,
-			    SPA_POD_TYPE_INT, seq,
-			    SPA_POD_TYPE_INT, direction,
-			    SPA_POD_TYPE_INT, port_id, SPA_POD_TYPE_INT, n_buffers, 0);
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &msg_use_buffers_schema, &msg);
 
 	for (i = 0; i < n_buffers; i++) {
 		struct spa_buffer *buf = buffers[i].buffer;
 
-		spa_pod_builder_add(b,
-				    SPA_POD_TYPE_INT, buffers[i].mem_id,
-				    SPA_POD_TYPE_INT, buffers[i].offset,
-				    SPA_POD_TYPE_INT, buffers[i].size,
-				    SPA_POD_TYPE_INT, buf->id, SPA_POD_TYPE_INT, buf->n_metas, 0);
+		spa_pod_schema_add(b, &client_node_buffer_schema, &buffers[i]);
+		spa_pod_schema_add(b, &buffer_metas_schema, buf);
+
+		for (j = 0; j < buf->n_metas; j++)
+			spa_pod_schema_add(b, &meta_schema, &buf->metas[j]);
+
+		spa_pod_schema_add(b, &buffer_datas_schema, buf);
 
-		for (j = 0; j < buf->n_metas; j++) {
-			struct spa_meta *m = &buf->metas[j];
-			spa_pod_builder_add(b,
-					    SPA_POD_TYPE_ID, m->type, SPA_POD_TYPE_INT, m->size, 0);
-		}
-		spa_pod_builder_add(b, SPA_POD_TYPE_INT, buf->n_datas, 0);
 		for (j = 0; j < buf->n_datas; j++) {
 			struct spa_data *d = &buf->datas[j];
-			spa_pod_builder_add(b,
-					    SPA_POD_TYPE_ID, d->type,
-					    SPA_POD_TYPE_INT, SPA_PTR_TO_UINT32(d->data),
-					    SPA_POD_TYPE_INT, d->flags,
-					    SPA_POD_TYPE_INT, d->mapoffset,
-					    SPA_POD_TYPE_INT, d->maxsize, 0);
+			struct msg_data md = { d->type, SPA_PTR_TO_UINT32(d->data), d->flags,
+					       d->mapoffset, d->maxsize };
+
+			spa_pod_schema_add(b, &msg_data_schema, &md);
 		}
 	}
-	spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f, 0);
+	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -591,11 +710,11 @@ client_node_marshal_node_command(void *object, uint32_t seq, const struct spa_co
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_node_command msg = { seq, command };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_NODE_COMMAND);
 
-	spa_pod_builder_struct(b, &f, SPA_POD_TYPE_INT, seq, SPA_POD_TYPE_POD, command);
+	spa_pod_schema_build(b, &msg_node_command_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -608,14 +727,11 @@ client_node_marshal_port_command(void *object,
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_port_command msg = { direction, port_id, command };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_PORT_COMMAND);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, direction,
-			       SPA_POD_TYPE_INT, port_id,
-			       SPA_POD_TYPE_POD, command);
+	spa_pod_schema_build(b, &msg_port_command_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -625,20 +741,21 @@ static void client_node_marshal_transport(void *object, uint32_t node_id, int re
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
 	struct pw_client_node_transport_info info;
+	struct msg_transport msg;
 
 	pw_client_node_transport_get_info(transport, &info);
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_TRANSPORT);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, node_id,
-			       SPA_POD_TYPE_INT, pw_protocol_native_add_resource_fd(resource, readfd),
-			       SPA_POD_TYPE_INT, pw_protocol_native_add_resource_fd(resource, writefd),
-			       SPA_POD_TYPE_INT, pw_protocol_native_add_resource_fd(resource, info.memfd),
-			       SPA_POD_TYPE_INT, info.offset,
-			       SPA_POD_TYPE_INT, info.size);
+	msg.node_id = node_id;
+	msg.ridx = pw_protocol_native_add_resource_fd(resource, readfd);
+	msg.widx = pw_protocol_native_add_resource_fd(resource, writefd);
+	msg.memfd_idx = pw_protocol_native_add_resource_fd(resource, info.memfd);
+	msg.offset = info.offset;
+	msg.size = info.size;
+
+	spa_pod_schema_build(b, &msg_transport_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -647,37 +764,27 @@ static void client_node_marshal_transport(void *object, uint32_t node_id, int re
 static bool client_node_demarshal_done(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
-	uint32_t seq, res;
+	struct msg_done msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &seq,
-			      SPA_POD_TYPE_INT, &res, 0))
+	if (!spa_pod_schema_parse(&msg_done_schema, data, size, &msg))
 		return false;
 
-	pw_resource_do(resource, struct pw_client_node_proxy_methods, done, seq, res);
+	pw_resource_do(resource, struct pw_client_node_proxy_methods, done, msg.seq, msg.res);
 	return true;
 }
 
 static bool client_node_demarshal_update(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
-	uint32_t change_mask, max_input_ports, max_output_ports;
-	const struct spa_props *props;
+	struct msg_update msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &change_mask,
-			      SPA_POD_TYPE_INT, &max_input_ports,
-			      SPA_POD_TYPE_INT, &max_output_ports, -SPA_POD_TYPE_OBJECT, &props, 0))
+	if (!spa_pod_schema_parse(&msg_update_schema, data, size, &msg))
 		return false;
 
-	pw_resource_do(resource, struct pw_client_node_proxy_methods, update, change_mask,
-									max_input_ports,
-									max_output_ports,
-									props);
+	pw_resource_do(resource, struct pw_client_node_proxy_methods, update, msg.change_mask,
+									msg.max_input_ports,
+									msg.max_output_ports,
+									msg.props);
 	return true;
 }
 
@@ -685,54 +792,52 @@ static bool client_node_demarshal_port_update(void *object, void *data, size_t s
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_iter it;
-	uint32_t i, direction, port_id, change_mask, n_possible_formats, n_params;
+	struct msg_port_update msg = { 0, };
+	struct msg_port_update_params msg_params = { 0, };
 	const struct spa_param **params = NULL;
-	const struct spa_format **possible_formats = NULL, *format = NULL;
-	struct spa_port_info info, *infop = NULL;
-	struct spa_pod *ipod;
+	const struct spa_format **possible_formats = NULL;
+	struct msg_port_info msg_info = { 0, };
+	struct spa_port_info info = { 0, }, *infop = NULL;
+	uint32_t i;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &direction,
-			      SPA_POD_TYPE_INT, &port_id,
-			      SPA_POD_TYPE_INT, &change_mask,
-			      SPA_POD_TYPE_INT, &n_possible_formats, 0))
+	    !spa_pod_schema_parse_iter(&it, &msg_port_update_schema, &msg) ||
+	    !check_n_elems(&it, msg.n_possible_formats, MIN_POD_SIZE))
 		return false;
 
-	possible_formats = alloca(n_possible_formats * sizeof(struct spa_format *));
-	for (i = 0; i < n_possible_formats; i++)
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &possible_formats[i], 0))
+	possible_formats = alloca(msg.n_possible_formats * sizeof(struct spa_format *));
+	for (i = 0; i < msg.n_possible_formats; i++)
+		if (!spa_pod_schema_parse_iter(&it, &object_schema, &possible_formats[i]))
 			return false;
 
-	if (!spa_pod_iter_get(&it, -SPA_POD_TYPE_OBJECT, &format, SPA_POD_TYPE_INT, &n_params, 0))
+	if (!spa_pod_schema_parse_iter(&it, &msg_port_update_params_schema, &msg_params) ||
+	    !check_n_elems(&it, msg_params.n_params, MIN_POD_SIZE))
 		return false;
 
-	params = alloca(n_params * sizeof(struct spa_param *));
-	for (i = 0; i < n_params; i++)
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &params[i], 0))
+	params = alloca(msg_params.n_params * sizeof(struct spa_param *));
+	for (i = 0; i < msg_params.n_params; i++)
+		if (!spa_pod_schema_parse_iter(&it, &object_schema, &params[i]))
 			return false;
 
-	if (!spa_pod_iter_get(&it, -SPA_POD_TYPE_STRUCT, &ipod, 0))
+	if (!spa_pod_schema_parse_iter(&it, &msg_port_info_schema, &msg_info))
 		return false;
 
-	if (ipod) {
+	if (msg_info.info) {
 		struct spa_pod_iter it2;
 		infop = &info;
 
-		if (!spa_pod_iter_pod(&it2, ipod) ||
-		    !spa_pod_iter_get(&it2,
-				      SPA_POD_TYPE_INT, &info.flags,
-				      SPA_POD_TYPE_INT, &info.rate, 0))
+		if (!spa_pod_iter_pod(&it2, (struct spa_pod *) msg_info.info) ||
+		    !spa_pod_schema_parse_iter(&it2, &port_info_schema, &info))
 			return false;
 	}
 
-	pw_resource_do(resource, struct pw_client_node_proxy_methods, port_update, direction,
-									     port_id,
-									     change_mask,
-									     n_possible_formats,
+	pw_resource_do(resource, struct pw_client_node_proxy_methods, port_update, msg.direction,
+									     msg.port_id,
+									     msg.change_mask,
+									     msg.n_possible_formats,
 									     possible_formats,
-									     format,
-									     n_params,
+									     msg_params.format,
+									     msg_params.n_params,
 									     params, infop);
 	return true;
 }
@@ -740,14 +845,13 @@ static bool client_node_demarshal_port_update(void *object, void *data, size_t s
 static bool client_node_demarshal_event_method(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
-	struct spa_event *event;
+	struct msg_event msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &event, 0))
+	if (!spa_pod_schema_parse(&msg_event_schema, data, size, &msg))
 		return false;
 
-	pw_resource_do(resource, struct pw_client_node_proxy_methods, event, event);
+	pw_resource_do(resource, struct pw_client_node_proxy_methods, event,
+		       (struct spa_event *) msg.event);
 	return true;
 }
 
@@ -1124,7 +1124,7 @@ static void jack_node_pull(void *data)
 	spa_list_for_each(p, &n->ports[SPA_DIRECTION_INPUT], link) {
 		if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
 			continue;
-		pn->state = spa_node_process_input(pn->implementation);
+		pn->state = spa_graph_node_process_input(pn);
 	}
 }
 
@@ -1154,7 +1154,7 @@ static void jack_node_push(void *data)
 	spa_list_for_each(p, &n->ports[SPA_DIRECTION_INPUT], link) {
 		if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
 			continue;
-		pn->state = spa_node_process_output(pn->implementation);
+		pn->state = spa_graph_node_process_output(pn);
 	}
 
 	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
@@ -1163,25 +1163,25 @@ static void jack_node_push(void *data)
 		spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
 			if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
 				continue;
-			pn->state = spa_node_process_output(pn->implementation);
+			pn->state = spa_graph_node_process_output(pn);
 		}
-		n->state = spa_node_process_output(n->implementation);
+		n->state = spa_graph_node_process_output(n);
 
 		/* mix inputs */
 		spa_list_for_each(p, &n->ports[SPA_DIRECTION_INPUT], link) {
 			if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
 				continue;
-			pn->state = spa_node_process_output(pn->implementation);
-			pn->state = spa_node_process_input(pn->implementation);
+			pn->state = spa_graph_node_process_output(pn);
+			pn->state = spa_graph_node_process_input(pn);
 		}
 
-		n->state = spa_node_process_input(n->implementation);
+		n->state = spa_graph_node_process_input(n);
 
 		/* tee outputs */
 		spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
 			if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
 				continue;
-			pn->state = spa_node_process_input(pn->implementation);
+			pn->state = spa_graph_node_process_input(pn);
 		}
 	}
 
@@ -57,7 +57,9 @@ struct type {
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
-        type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	bool ids = spa_type_map_has_ids(map);
+
+        type->format = SPA_TYPE_MAP_ID(map, ids, SPA_TYPE__Format);
         spa_type_data_map(map, &type->data);
         spa_type_media_type_map(map, &type->media_type);
         spa_type_media_subtype_map(map, &type->media_subtype);
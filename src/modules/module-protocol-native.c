@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/stat.h>
@@ -53,6 +54,10 @@
 #define LOCK_SUFFIX     ".lock"
 #define LOCK_SUFFIXLEN  5
 
+#define ARENA_SIZE	(1024 * 1024)	/* default size of the side channel for large messages */
+#define ARENA_PROP	"pipewire.protocol.arena"	/* set when a peer can receive
+							 * arena references */
+
 void pw_protocol_native_init(struct pw_protocol *protocol);
 
 struct protocol_data {
@@ -72,7 +77,12 @@ struct client {
 
         bool disconnecting;
 	bool flush_signaled;
+	bool flushing;			/* waiting for the socket to be writable */
         struct spa_source *flush_event;
+	struct spa_hook remote_listener;
+
+	uint64_t n_remapped;		/* messages that needed type remapping */
+	uint64_t n_unmapped;		/* messages where remapping was skipped */
 };
 
 struct server {
@@ -93,8 +103,30 @@ struct client_data {
 	struct spa_source *source;
 	struct pw_protocol_native_connection *connection;
 	bool busy;
+	bool flushing;			/* waiting for the socket to be writable */
+
+	uint64_t n_remapped;		/* messages that needed type remapping */
+	uint64_t n_unmapped;		/* messages where remapping was skipped */
 };
 
+/* set up the side channel for large messages when the peer announced
+ * ARENA_PROP in its properties. The size can be changed with
+ * PIPEWIRE_PROTOCOL_ARENA, 0 disables it. */
+static void enable_arena(struct pw_protocol_native_connection *conn, const struct spa_dict *props)
+{
+	const char *str;
+	uint32_t size = ARENA_SIZE;
+
+	if (props == NULL || (str = spa_dict_lookup(props, ARENA_PROP)) == NULL || atoi(str) < 1)
+		return;
+
+	if ((str = getenv("PIPEWIRE_PROTOCOL_ARENA")) != NULL)
+		size = strtoul(str, NULL, 0);
+
+	if (size > 0 && !pw_protocol_native_connection_enable_arena(conn, size))
+		pw_log_warn("connection %p: can't enable arena of %u bytes", conn, size);
+}
+
 static void
 process_messages(struct client_data *data)
 {
@@ -147,9 +179,15 @@ process_messages(struct client_data *data)
 			continue;
 		}
 
-		if (demarshal[opcode].flags & PW_PROTOCOL_NATIVE_REMAP)
-			if (!pw_pod_remap_data(SPA_POD_TYPE_STRUCT, message, size, &client->types))
-				goto invalid_message;
+		if (demarshal[opcode].flags & PW_PROTOCOL_NATIVE_REMAP) {
+			if (!client->remap_types) {
+				data->n_unmapped++;
+			} else {
+				if (!pw_pod_remap_data(SPA_POD_TYPE_STRUCT, message, size, &client->types))
+					goto invalid_message;
+				data->n_remapped++;
+			}
+		}
 
 		if (!demarshal[opcode].func (resource, message, size))
 			goto invalid_message;
@@ -168,20 +206,44 @@ process_messages(struct client_data *data)
 	return;
 }
 
+static void client_update_io(struct client_data *c)
+{
+	enum spa_io mask = SPA_IO_ERR | SPA_IO_HUP;
+
+	if (!c->busy)
+		mask |= SPA_IO_IN;
+	if (c->flushing)
+		mask |= SPA_IO_OUT;
+
+	pw_loop_update_io(c->client->core->main_loop, c->source, mask);
+}
+
+/* flush the connection, when the socket is full wait until it can be
+ * written again */
+static void client_flush(struct client_data *c)
+{
+	bool flushing;
+
+	if (!pw_protocol_native_connection_flush(c->connection))
+		return;
+
+	flushing = pw_protocol_native_connection_is_pending(c->connection);
+	if (flushing != c->flushing) {
+		c->flushing = flushing;
+		client_update_io(c);
+	}
+}
+
 static void
 client_busy_changed(void *data, bool busy)
 {
 	struct client_data *c = data;
 	struct pw_client *client = c->client;
-	enum spa_io mask = SPA_IO_ERR | SPA_IO_HUP;
 
 	c->busy = busy;
 
-	if (!busy)
-		mask |= SPA_IO_IN;
-
 	pw_log_debug("protocol-native %p: busy changed %d", client->protocol, busy);
-	pw_loop_update_io(client->core->main_loop, c->source, mask);
+	client_update_io(c);
 
 	if (!busy)
 		process_messages(c);
@@ -200,6 +262,9 @@ connection_data(void *data, int fd, enum spa_io mask)
 		return;
 	}
 
+	if (mask & SPA_IO_OUT)
+		client_flush(this);
+
 	if (mask & SPA_IO_IN)
 		process_messages(this);
 }
@@ -209,15 +274,26 @@ static void client_free(void *data)
 	struct client_data *this = data;
 	struct pw_client *client = this->client;
 
+	pw_log_debug("protocol-native %p: client %p remapped %" PRIu64 " messages, skipped %"
+		     PRIu64, client->protocol, client, this->n_remapped, this->n_unmapped);
+
 	pw_loop_destroy_source(client->protocol->core->main_loop, this->source);
 	spa_list_remove(&client->protocol_link);
 
 	pw_protocol_native_connection_destroy(this->connection);
 }
 
+static void client_info_changed(void *data, struct pw_client_info *info)
+{
+	struct client_data *this = data;
+
+	enable_arena(this->connection, info->props);
+}
+
 static const struct pw_client_events client_events = {
 	PW_VERSION_CLIENT_EVENTS,
 	.free = client_free,
+	.info_changed = client_info_changed,
 	.busy_changed = client_busy_changed,
 };
 
@@ -453,6 +529,26 @@ static int impl_connect(struct pw_protocol_client *client)
 }
 
 
+static void remote_flush(struct client *impl)
+{
+	struct pw_remote *remote = impl->this.remote;
+	bool flushing;
+
+	if (!pw_protocol_native_connection_flush(impl->connection)) {
+		impl->this.disconnect(&impl->this);
+		return;
+	}
+
+	/* when the socket is full, wait until it can be written again */
+	flushing = pw_protocol_native_connection_is_pending(impl->connection);
+	if (flushing != impl->flushing && impl->source) {
+		impl->flushing = flushing;
+		pw_loop_update_io(remote->core->main_loop, impl->source,
+				  SPA_IO_IN | SPA_IO_HUP | SPA_IO_ERR |
+				  (flushing ? SPA_IO_OUT : 0));
+	}
+}
+
 static void
 on_remote_data(void *data, int fd, enum spa_io mask)
 {
@@ -469,6 +565,12 @@ on_remote_data(void *data, int fd, enum spa_io mask)
 		return;
         }
 
+	if (mask & SPA_IO_OUT) {
+		remote_flush(impl);
+		if (impl->disconnecting)
+			return;
+	}
+
         if (mask & SPA_IO_IN) {
                 uint8_t opcode;
                 uint32_t id;
@@ -505,11 +607,16 @@ on_remote_data(void *data, int fd, enum spa_io mask)
 			}
 
 			if (demarshal[opcode].flags & PW_PROTOCOL_NATIVE_REMAP) {
-				if (!pw_pod_remap_data(SPA_POD_TYPE_STRUCT, message, size, &this->types)) {
-                                        pw_log_error
-                                            ("protocol-native %p: invalid message received %u for %u", this,
-                                             opcode, id);
-					continue;
+				if (!this->remap_types) {
+					impl->n_unmapped++;
+				} else {
+					if (!pw_pod_remap_data(SPA_POD_TYPE_STRUCT, message, size, &this->types)) {
+						pw_log_error
+						    ("protocol-native %p: invalid message received %u for %u", this,
+						     opcode, id);
+						continue;
+					}
+					impl->n_remapped++;
 				}
 			}
 			if (!demarshal[opcode].func(proxy, message, size)) {
@@ -527,8 +634,7 @@ static void do_flush_event(void *data, uint64_t count)
         struct client *impl = data;
 	impl->flush_signaled = false;
         if (impl->connection)
-                if (!pw_protocol_native_connection_flush(impl->connection))
-                        impl->this.disconnect(&impl->this);
+		remote_flush(impl);
 }
 
 static void on_need_flush(void *data)
@@ -556,6 +662,9 @@ static int impl_connect_fd(struct pw_protocol_client *client, int fd)
 	if (impl->connection == NULL)
                 goto error_close;
 
+	/* tell the daemon we understand arena references */
+	pw_properties_set(remote->properties, ARENA_PROP, "1");
+
 	pw_protocol_native_connection_add_listener(impl->connection,
 						   &impl->conn_listener,
 						   &conn_events,
@@ -573,6 +682,19 @@ static int impl_connect_fd(struct pw_protocol_client *client, int fd)
         return -1;
 }
 
+static void on_remote_info_changed(void *data, const struct pw_core_info *info)
+{
+	struct client *impl = data;
+
+	if (impl->connection)
+		enable_arena(impl->connection, info->props);
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.info_changed = on_remote_info_changed,
+};
+
 static void impl_disconnect(struct pw_protocol_client *client)
 {
 	struct client *impl = SPA_CONTAINER_OF(client, struct client, this);
@@ -580,9 +702,14 @@ static void impl_disconnect(struct pw_protocol_client *client)
 
 	impl->disconnecting = true;
 
+	pw_log_debug("protocol-native %p: remapped %" PRIu64 " messages, skipped %" PRIu64,
+		     impl, impl->n_remapped, impl->n_unmapped);
+	impl->n_remapped = impl->n_unmapped = 0;
+
 	if (impl->source)
                 pw_loop_destroy_source(remote->core->main_loop, impl->source);
 	impl->source = NULL;
+	impl->flushing = false;
 
 	if (impl->connection)
                 pw_protocol_native_connection_destroy(impl->connection);
@@ -597,6 +724,7 @@ static void impl_destroy(struct pw_protocol_client *client)
 	impl_disconnect(client);
 
 	pw_loop_destroy_source(remote->core->main_loop, impl->flush_event);
+	spa_hook_remove(&impl->remote_listener);
 
 	spa_list_remove(&client->link);
 	free(impl);
@@ -623,6 +751,7 @@ impl_new_client(struct pw_protocol *protocol,
 	this->destroy = impl_destroy;
 
 	impl->flush_event = pw_loop_add_event(remote->core->main_loop, do_flush_event, impl);
+	pw_remote_add_listener(remote, &impl->remote_listener, &remote_events, impl);
 
 	spa_list_append(&protocol->client_list, &this->link);
 
@@ -659,7 +788,7 @@ static void on_before_hook(void *_data)
 
 	spa_list_for_each_safe(client, tmp, &this->client_list, protocol_link) {
 		data = client->user_data;
-		pw_protocol_native_connection_flush(data->connection);
+		client_flush(data);
 	}
 }
 
@@ -824,8 +953,14 @@ static bool module_init(struct pw_module *module, struct pw_properties *properti
 	d->properties = properties;
 
 	if ((val = pw_properties_get(pw_core_get_properties(core), "pipewire.daemon"))) {
-		if (atoi(val) == 1)
+		if (atoi(val) == 1) {
+			/* clients see this in the core info and then send
+			 * large payloads through their arena */
+			struct spa_dict_item item = { ARENA_PROP, "1" };
+			struct spa_dict dict = SPA_DICT_INIT(1, &item);
+			pw_core_update_properties(core, &dict);
 			impl_add_server(this, core, properties);
+		}
 	}
 
 	pw_module_add_listener(module, &d->module_listener, &module_events, d);
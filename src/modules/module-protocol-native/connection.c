@@ -23,7 +23,14 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <inttypes.h>
+
+#include <spa/ringbuffer.h>
 
 #include <spa/lib/debug.h>
 
@@ -32,29 +39,114 @@
 
 #include "connection.h"
 
-#define MAX_BUFFER_SIZE (1024 * 32)
+/** \cond */
+
+#define SEGMENT_SIZE	(1024 * 32)	/* size of an output segment */
+#define MIN_SEGMENTS	2		/* preallocated output segments */
+#define MAX_FREE_SEGMENTS 8		/* recycled output segments to keep */
+#define MAX_IOV		64		/* max segments per sendmsg */
+#define RING_SIZE	(1024 * 64)	/* initial size of the input ring, power of 2 */
 #define MAX_FDS 28
 
+#define ARENA_THRESHOLD	(1024 * 8)	/* min payload size to pass through the arena */
+#define ARENA_HEADER_SIZE 4096		/* arena header, the ring data follows */
+#define ARENA_MESSAGE_SIZE 16		/* body size of an arena reference */
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC       0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (F_LINUX_SPECIFIC_BASE + 9)
+#define F_GET_SEALS (F_LINUX_SPECIFIC_BASE + 10)
+#define F_SEAL_SEAL     0x0001
+#define F_SEAL_SHRINK   0x0002
+#define F_SEAL_GROW     0x0004
+#endif
+
 static bool debug_messages = 0;
 
-struct buffer {
-	uint8_t *buffer_data;
-	size_t buffer_size;
-	size_t buffer_maxsize;
+/* a fixed size chunk of output data */
+struct segment {
+	struct spa_list link;
+	uint32_t offset;	/* offset of first unsent byte */
+	uint32_t size;		/* number of bytes written */
+	uint32_t maxsize;
+	uint8_t data[0];
+};
+
+struct output {
+	struct spa_list segments;	/* queued segments, oldest first */
+	struct spa_list free;		/* free segments for reuse */
+	uint32_t n_free;
+	uint32_t n_messages;		/* number of queued messages */
+	int fds[MAX_FDS];
+	uint32_t n_fds;
+
+	struct segment *start;		/* segment of the message being built */
+	uint32_t start_offset;		/* offset of the message in start */
+	uint32_t msg_size;		/* size of the message being built, with header */
+
+	struct pw_memblock arena;	/* side channel for large payloads */
+	struct spa_ringbuffer *arena_ring;
+	uint8_t *arena_data;
+	uint32_t arena_read;		/* last valid read index of the peer */
+	bool arena_sent;		/* the peer has the arena fd */
+};
+
+/* the arena is a ring of payloads in a sealed memfd. The sender owns the
+ * write index and the receiver advances the read index in the header when
+ * it has copied a payload out. References to payloads are sent as messages
+ * to SPA_ID_INVALID with the real destination, opcode and size, the index
+ * of the payload in the ring and the index of the arena fd or -1.
+ *
+ * Both sides can write the whole arena, so neither side trusts what the
+ * other wrote there: the receiver copies the payload out before it looks
+ * at it and the sender ignores read indexes that are not between the
+ * last valid one and its write index. */
+struct arena_header {
+	struct spa_ringbuffer ring;
+};
+
+struct input {
+	struct spa_ringbuffer ring;	/* indexes in data */
+	uint8_t *data;
 	int fds[MAX_FDS];
 	uint32_t n_fds;
 
-	off_t offset;
-	void *data;
-	size_t size;
+	uint32_t size;			/* size of the current message with header */
+	uint8_t *scratch;		/* copy of messages that wrap around the ring
+					 * or that are in the arena */
+	uint32_t scratch_size;
+
+	void *arena_map;		/* mapped arena of the peer */
+	size_t arena_map_size;
+	struct spa_ringbuffer *arena_ring;
+	uint8_t *arena_data;
+	uint32_t arena_size;
 
 	bool update;
 };
 
+struct stats {
+	uint64_t n_flush;
+	uint64_t n_sendmsg;
+	uint64_t bytes_sent;
+	uint64_t messages_sent;
+	uint64_t n_recvmsg;
+	uint64_t bytes_received;
+	uint64_t arena_sent;
+	uint64_t arena_received;
+};
+
 struct impl {
 	struct pw_protocol_native_connection this;
 
-	struct buffer in, out;
+	struct input in;
+	struct output out;
+	struct stats stats;
 
 	uint32_t dest_id;
 	uint8_t opcode;
@@ -111,58 +203,374 @@ uint32_t pw_protocol_native_connection_add_fd(struct pw_protocol_native_connecti
 	return index;
 }
 
-static void *connection_ensure_size(struct pw_protocol_native_connection *conn, struct buffer *buf, size_t size)
+static struct segment *segment_get(struct output *out)
 {
-	if (buf->buffer_size + size > buf->buffer_maxsize) {
-		buf->buffer_maxsize = SPA_ROUND_UP_N(buf->buffer_size + size, MAX_BUFFER_SIZE);
-		buf->buffer_data = realloc(buf->buffer_data, buf->buffer_maxsize);
+	struct segment *seg;
 
-		pw_log_warn("connection %p: resize buffer to %zd %zd %zd",
-			    conn, buf->buffer_size, size, buf->buffer_maxsize);
+	if (spa_list_is_empty(&out->free)) {
+		seg = malloc(sizeof(struct segment) + SEGMENT_SIZE);
+		if (seg == NULL)
+			return NULL;
+		seg->maxsize = SEGMENT_SIZE;
+	} else {
+		seg = spa_list_first(&out->free, struct segment, link);
+		spa_list_remove(&seg->link);
+		out->n_free--;
 	}
-	return (uint8_t *) buf->buffer_data + buf->buffer_size;
+	seg->offset = seg->size = 0;
+	spa_list_insert(out->segments.prev, &seg->link);
+
+	return seg;
 }
 
-static bool refill_buffer(struct pw_protocol_native_connection *conn, struct buffer *buf)
+static void segment_release(struct output *out, struct segment *seg)
 {
+	spa_list_remove(&seg->link);
+	if (out->n_free >= MAX_FREE_SEGMENTS) {
+		free(seg);
+	} else {
+		spa_list_insert(&out->free, &seg->link);
+		out->n_free++;
+	}
+}
+
+/* append data to the queued segments, allocating a new segment when the
+ * last one is full */
+static bool output_append(struct output *out, const void *data, uint32_t size)
+{
+	struct segment *seg;
+
+	seg = spa_list_is_empty(&out->segments) ? NULL :
+		SPA_CONTAINER_OF(out->segments.prev, struct segment, link);
+
+	while (size > 0) {
+		uint32_t avail, len;
+
+		if (seg == NULL || seg->size == seg->maxsize) {
+			if ((seg = segment_get(out)) == NULL)
+				return false;
+		}
+		avail = seg->maxsize - seg->size;
+		len = SPA_MIN(avail, size);
+		if (data) {
+			memcpy(seg->data + seg->size, data, len);
+			data = SPA_MEMBER(data, len, void);
+		}
+		seg->size += len;
+		size -= len;
+	}
+	return true;
+}
+
+/* overwrite data at offset in the message that is being built */
+static void output_write_at(struct output *out, uint32_t offset, const void *data, uint32_t size)
+{
+	struct segment *seg = out->start;
+
+	offset += out->start_offset;
+
+	while (offset >= seg->size) {
+		offset -= seg->size;
+		seg = SPA_CONTAINER_OF(seg->link.next, struct segment, link);
+	}
+	while (size > 0) {
+		uint32_t len = SPA_MIN(seg->size - offset, size);
+
+		memcpy(seg->data + offset, data, len);
+		data = SPA_MEMBER(data, len, void);
+		size -= len;
+		offset = 0;
+		seg = SPA_CONTAINER_OF(seg->link.next, struct segment, link);
+	}
+}
+
+/* copy the message that is being built to data, starting at offset */
+static void output_read_message(struct output *out, uint32_t offset, void *data, uint32_t size)
+{
+	struct segment *seg = out->start;
+	uint32_t done = 0;
+
+	offset += out->start_offset;
+
+	while (offset >= seg->size) {
+		offset -= seg->size;
+		seg = SPA_CONTAINER_OF(seg->link.next, struct segment, link);
+	}
+	while (done < size) {
+		uint32_t len = SPA_MIN(seg->size - offset, size - done);
+		memcpy(SPA_MEMBER(data, done, void), seg->data + offset, len);
+		done += len;
+		offset = 0;
+		seg = SPA_CONTAINER_OF(seg->link.next, struct segment, link);
+	}
+}
+
+/* make a copy of the message that is being built, for debugging */
+static void *output_copy_message(struct output *out)
+{
+	uint8_t *data;
+
+	if ((data = malloc(out->msg_size)) != NULL)
+		output_read_message(out, 0, data, out->msg_size);
+
+	return data;
+}
+
+/* remove the message that is being built from the segments */
+static void output_drop_message(struct output *out)
+{
+	struct segment *seg, *t;
+
+	spa_list_for_each_safe_next(seg, t, &out->segments, &out->start->link, link)
+		segment_release(out, seg);
+
+	out->start->size = out->start_offset;
+	out->msg_size = 0;
+}
+
+/* move the payload of the message that is being built to the arena and
+ * replace it with a reference. Returns false when the payload should be
+ * sent inline */
+static bool output_move_to_arena(struct pw_protocol_native_connection *conn,
+				 struct impl *impl, uint32_t dest_id, uint8_t opcode)
+{
+	struct output *out = &impl->out;
+	uint32_t index, read, offset, size, pad, filled, ring_size, p[2 + ARENA_MESSAGE_SIZE / 4];
+	uint32_t fd_index = -1;
+
+	if (out->arena_ring == NULL)
+		return false;
+
+	size = out->msg_size - 8;
+	if (size < ARENA_THRESHOLD)
+		return false;
+
+	/* the peer writes the read index, it can only move forward and not
+	 * past what we wrote */
+	ring_size = out->arena_ring->size;
+	index = out->arena_ring->writeindex;
+	read = __atomic_load_n(&out->arena_ring->readindex, __ATOMIC_ACQUIRE);
+	if ((int32_t) (read - out->arena_read) >= 0 && (int32_t) (index - read) >= 0)
+		out->arena_read = read;
+	filled = index - out->arena_read;
+	offset = index & out->arena_ring->mask;
+
+	/* payloads are contiguous, skip the end of the ring when needed */
+	pad = offset + size > ring_size ? ring_size - offset : 0;
+	if (filled + pad + size > ring_size)
+		return false;
+
+	if (!out->arena_sent) {
+		fd_index = pw_protocol_native_connection_add_fd(conn, out->arena.fd);
+		if (fd_index == -1)
+			return false;
+		out->arena_sent = true;
+	}
+	index += pad;
+	output_read_message(out, 8, out->arena_data + (index & out->arena_ring->mask), size);
+	spa_ringbuffer_write_update(out->arena_ring, index + size);
+
+	output_drop_message(out);
+
+	p[0] = SPA_ID_INVALID;
+	p[1] = ARENA_MESSAGE_SIZE;
+	p[2] = dest_id;
+	p[3] = (opcode << 24) | (size & 0xffffff);
+	p[4] = index;
+	p[5] = fd_index;
+	if (!output_append(out, p, sizeof(p)))
+		return false;
+
+	impl->stats.arena_sent++;
+
+	return true;
+}
+
+/* map the arena of the peer */
+static bool input_map_arena(struct pw_protocol_native_connection *conn, struct input *in, int fd)
+{
+	struct stat st;
+	uint32_t size;
+	int seals;
+	void *ptr;
+
+	if (fstat(fd, &st) < 0 || st.st_size <= ARENA_HEADER_SIZE)
+		goto invalid;
+
+	size = st.st_size - ARENA_HEADER_SIZE;
+	if ((size & (size - 1)) != 0)
+		goto invalid;
+
+	/* we can't allow the peer to shrink the file while we access it */
+	if ((seals = fcntl(fd, F_GET_SEALS)) < 0 || (seals & F_SEAL_SHRINK) == 0)
+		goto invalid;
+
+	ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+		goto invalid;
+
+	if (in->arena_map)
+		munmap(in->arena_map, in->arena_map_size);
+
+	in->arena_map = ptr;
+	in->arena_map_size = st.st_size;
+	in->arena_ring = ptr;
+	in->arena_data = SPA_MEMBER(ptr, ARENA_HEADER_SIZE, uint8_t);
+	in->arena_size = size;
+	close(fd);
+
+	pw_log_debug("connection %p: mapped arena of %u bytes", conn, size);
+	return true;
+
+      invalid:
+	pw_log_error("connection %p: invalid arena fd %d", conn, fd);
+	close(fd);
+	return false;
+}
+
+/* make the scratch buffer at least size bytes */
+static bool input_ensure_scratch(struct input *in, uint32_t size)
+{
+	if (size <= in->scratch_size)
+		return true;
+
+	free(in->scratch);
+	in->scratch_size = SPA_ROUND_UP_N(size, 4096);
+	if ((in->scratch = malloc(in->scratch_size)) == NULL) {
+		in->scratch_size = 0;
+		return false;
+	}
+	return true;
+}
+
+/* resolve an arena reference to a copy of the payload. The peer can still
+ * write to the arena, so the payload is copied out before it is parsed and
+ * the space is released right away */
+static bool input_arena_message(struct pw_protocol_native_connection *conn, struct input *in,
+				const uint32_t *p, uint8_t *opcode, uint32_t *dest_id,
+				void **data, uint32_t *size)
+{
+	uint32_t len, index, offset, id, op, fd_index;
+
+	/* p can point to the scratch buffer */
+	id = p[0];
+	op = p[1] >> 24;
+	len = p[1] & 0xffffff;
+	index = p[2];
+	fd_index = p[3];
+
+	if (fd_index != -1) {
+		if (fd_index >= in->n_fds || !input_map_arena(conn, in, in->fds[fd_index]))
+			return false;
+		in->fds[fd_index] = -1;
+	}
+	if (in->arena_map == NULL)
+		return false;
+
+	offset = index & (in->arena_size - 1);
+	if (len > in->arena_size - offset)
+		return false;
+
+	if (!input_ensure_scratch(in, len))
+		return false;
+	memcpy(in->scratch, in->arena_data + offset, len);
+	spa_ringbuffer_read_update(in->arena_ring, index + len);
+
+	*dest_id = id;
+	*opcode = op;
+	*data = in->scratch;
+	*size = len;
+
+	return true;
+}
+
+/* grow the input ring so that it can hold at least size bytes, the pending
+ * data is moved to the start of the new ring */
+static bool input_ensure_size(struct pw_protocol_native_connection *conn, struct input *in, uint32_t size)
+{
+	uint32_t index, new_size;
+	int32_t avail;
+	uint8_t *data;
+
+	if (size <= in->ring.size)
+		return true;
+
+	new_size = in->ring.size;
+	while (new_size < size)
+		new_size <<= 1;
+
+	if ((data = malloc(new_size)) == NULL)
+		return false;
+
+	avail = spa_ringbuffer_get_read_index(&in->ring, &index);
+	spa_ringbuffer_read_data(&in->ring, in->data, index & in->ring.mask, data, avail);
+
+	pw_log_debug("connection %p: grow input ring from %u to %u", conn, in->ring.size, new_size);
+
+	free(in->data);
+	in->data = data;
+	spa_ringbuffer_init(&in->ring, new_size);
+	spa_ringbuffer_write_update(&in->ring, avail);
+
+	return true;
+}
+
+static bool refill_buffer(struct pw_protocol_native_connection *conn, struct input *in)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 	ssize_t len;
 	struct cmsghdr *cmsg;
 	struct msghdr msg = { 0 };
-	struct iovec iov[1];
+	struct iovec iov[2];
 	char cmsgbuf[CMSG_SPACE(MAX_FDS * sizeof(int))];
-
-	iov[0].iov_base = buf->buffer_data + buf->buffer_size;
-	iov[0].iov_len = buf->buffer_maxsize - buf->buffer_size;
+	uint32_t index, offset, avail;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&in->ring, &index);
+	avail = in->ring.size - filled;
+	offset = index & in->ring.mask;
+
+	/* read into the free space of the ring, in two parts when it wraps around */
+	iov[0].iov_base = in->data + offset;
+	iov[0].iov_len = SPA_MIN(avail, in->ring.size - offset);
+	iov[1].iov_base = in->data;
+	iov[1].iov_len = avail - iov[0].iov_len;
 	msg.msg_iov = iov;
-	msg.msg_iovlen = 1;
+	msg.msg_iovlen = iov[1].iov_len > 0 ? 2 : 1;
 	msg.msg_control = cmsgbuf;
 	msg.msg_controllen = sizeof(cmsgbuf);
 	msg.msg_flags = MSG_CMSG_CLOEXEC;
 
 	while (true) {
 		len = recvmsg(conn->fd, &msg, msg.msg_flags);
+		impl->stats.n_recvmsg++;
 		if (len < 0) {
 			if (errno == EINTR)
 				continue;
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return false;
 			else
 				goto recv_error;
 		}
 		break;
 	}
+	if (len == 0)
+		return false;
 
-	buf->buffer_size += len;
+	spa_ringbuffer_write_update(&in->ring, index + len);
+	impl->stats.bytes_received += len;
 
 	/* handle control messages */
 	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
 		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
 			continue;
 
-		buf->n_fds =
+		in->n_fds =
 		    (cmsg->cmsg_len - ((char *) CMSG_DATA(cmsg) - (char *) cmsg)) / sizeof(int);
-		memcpy(buf->fds, CMSG_DATA(cmsg), buf->n_fds * sizeof(int));
+		memcpy(in->fds, CMSG_DATA(cmsg), in->n_fds * sizeof(int));
 	}
 	pw_log_trace("connection %p: %d read %zd bytes and %d fds", conn, conn->fd, len,
-		     buf->n_fds);
+		     in->n_fds);
 
 	return true;
 
@@ -172,12 +580,21 @@ static bool refill_buffer(struct pw_protocol_native_connection *conn, struct buf
 	return false;
 }
 
-static void clear_buffer(struct buffer *buf)
+static void clear_input(struct input *in)
 {
-	buf->n_fds = 0;
-	buf->offset = 0;
-	buf->size = 0;
-	buf->buffer_size = 0;
+	in->n_fds = 0;
+	in->size = 0;
+	spa_ringbuffer_clear(&in->ring);
+}
+
+static void clear_output(struct output *out)
+{
+	struct segment *seg, *t;
+
+	spa_list_for_each_safe(seg, t, &out->segments, link)
+		segment_release(out, seg);
+	out->n_fds = 0;
+	out->n_messages = 0;
 }
 
 /** Make a new connection object for the given socket
@@ -191,6 +608,8 @@ struct pw_protocol_native_connection *pw_protocol_native_connection_new(int fd)
 {
 	struct impl *impl;
 	struct pw_protocol_native_connection *this;
+	struct segment *seg, *t;
+	int i;
 
 	impl = calloc(1, sizeof(struct impl));
 	if (impl == NULL)
@@ -205,24 +624,109 @@ struct pw_protocol_native_connection *pw_protocol_native_connection_new(int fd)
 	this->fd = fd;
 	spa_hook_list_init(&this->listener_list);
 
-	impl->out.buffer_data = malloc(MAX_BUFFER_SIZE);
-	impl->out.buffer_maxsize = MAX_BUFFER_SIZE;
-	impl->in.buffer_data = malloc(MAX_BUFFER_SIZE);
-	impl->in.buffer_maxsize = MAX_BUFFER_SIZE;
-	impl->in.update = true;
+	spa_list_init(&impl->out.segments);
+	spa_list_init(&impl->out.free);
+	for (i = 0; i < MIN_SEGMENTS; i++) {
+		if ((seg = segment_get(&impl->out)) == NULL)
+			goto no_mem;
+	}
+	clear_output(&impl->out);
 
-	if (impl->out.buffer_data == NULL || impl->in.buffer_data == NULL)
+	impl->in.data = malloc(RING_SIZE);
+	if (impl->in.data == NULL)
 		goto no_mem;
+	spa_ringbuffer_init(&impl->in.ring, RING_SIZE);
+	impl->in.update = true;
 
 	return this;
 
       no_mem:
-	free(impl->out.buffer_data);
-	free(impl->in.buffer_data);
+	spa_list_for_each_safe(seg, t, &impl->out.segments, link)
+		free(seg);
+	spa_list_for_each_safe(seg, t, &impl->out.free, link)
+		free(seg);
 	free(impl);
 	return NULL;
 }
 
+/* the peer only accepts an arena that can't shrink, so we always need
+ * a sealed memfd, also when memblocks don't use one */
+static bool alloc_arena(struct pw_memblock *mem, size_t size)
+{
+#ifdef SYS_memfd_create
+	unsigned int seals = F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL;
+
+	mem->fd = syscall(SYS_memfd_create, "pipewire-arena", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (mem->fd == -1)
+		return false;
+
+	if (ftruncate(mem->fd, size) < 0 ||
+	    fcntl(mem->fd, F_ADD_SEALS, seals) < 0)
+		goto error;
+
+	mem->ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mem->fd, 0);
+	if (mem->ptr == MAP_FAILED)
+		goto error;
+
+	mem->flags = PW_MEMBLOCK_FLAG_WITH_FD | PW_MEMBLOCK_FLAG_MAP_READWRITE |
+		     PW_MEMBLOCK_FLAG_SEAL;
+	mem->offset = 0;
+	mem->size = size;
+	return true;
+
+      error:
+	close(mem->fd);
+	mem->fd = -1;
+	return false;
+#else
+	errno = ENOTSUP;
+	return false;
+#endif
+}
+
+/** Enable the shared memory side channel for large payloads
+ *
+ * \param conn the connection
+ * \param size the size of the arena, a power of 2
+ * \return true when the arena is enabled
+ *
+ * Payloads of messages that are larger than a threshold are placed in a
+ * sealed memfd that is shared with the peer. Only a small reference is
+ * sent over the socket. The peer maps the arena when it receives the
+ * first reference.
+ *
+ * Only enable the arena when the peer announced that it understands
+ * arena references, older peers can't parse them.
+ *
+ * \memberof pw_protocol_native_connection
+ */
+bool pw_protocol_native_connection_enable_arena(struct pw_protocol_native_connection *conn,
+						uint32_t size)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct output *out = &impl->out;
+
+	if (out->arena_ring != NULL)
+		return true;
+
+	if (size < ARENA_THRESHOLD || (size & (size - 1)) != 0)
+		return false;
+
+	if (!alloc_arena(&out->arena, ARENA_HEADER_SIZE + size)) {
+		pw_log_debug("connection %p: can't allocate arena: %s", conn, strerror(errno));
+		return false;
+	}
+	out->arena_ring = out->arena.ptr;
+	out->arena_data = SPA_MEMBER(out->arena.ptr, ARENA_HEADER_SIZE, uint8_t);
+	spa_ringbuffer_init(out->arena_ring, size);
+	out->arena_read = 0;
+	out->arena_sent = false;
+
+	pw_log_debug("connection %p: enabled arena of %u bytes", conn, size);
+
+	return true;
+}
+
 /** Destroy a connection
  *
  * \param conn the connection to destroy
@@ -232,13 +736,26 @@ struct pw_protocol_native_connection *pw_protocol_native_connection_new(int fd)
 void pw_protocol_native_connection_destroy(struct pw_protocol_native_connection *conn)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct segment *seg, *t;
 
-	pw_log_debug("connection %p: destroy", conn);
+	pw_log_debug("connection %p: destroy, sent %" PRIu64 " messages, %" PRIu64 " bytes in %"
+		     PRIu64 " flushes and %" PRIu64 " sendmsg, received %" PRIu64 " bytes in %"
+		     PRIu64 " recvmsg, %" PRIu64 "/%" PRIu64 " payloads in arena", conn,
+		     impl->stats.messages_sent, impl->stats.bytes_sent,
+		     impl->stats.n_flush, impl->stats.n_sendmsg, impl->stats.bytes_received,
+		     impl->stats.n_recvmsg, impl->stats.arena_sent, impl->stats.arena_received);
 
 	spa_hook_list_call(&conn->listener_list, struct pw_protocol_native_connection_events, destroy);
 
-	free(impl->out.buffer_data);
-	free(impl->in.buffer_data);
+	clear_output(&impl->out);
+	spa_list_for_each_safe(seg, t, &impl->out.free, link)
+		free(seg);
+	if (impl->out.arena_ring)
+		pw_memblock_free(&impl->out.arena);
+	if (impl->in.arena_map)
+		munmap(impl->in.arena_map, impl->in.arena_map_size);
+	free(impl->in.data);
+	free(impl->in.scratch);
 	free(impl);
 }
 
@@ -264,61 +781,75 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 		       uint32_t *sz)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	size_t len, size;
+	uint32_t index, offset, len, p[2];
+	int32_t avail;
 	uint8_t *data;
-	struct buffer *buf;
-	uint32_t *p;
+	struct input *in;
 
-	buf = &impl->in;
+	in = &impl->in;
 
 	/* move to next packet */
-	buf->offset += buf->size;
+	spa_ringbuffer_get_read_index(&in->ring, &index);
+	spa_ringbuffer_read_update(&in->ring, index + in->size);
+	in->size = 0;
 
       again:
-	if (buf->update) {
-		if (!refill_buffer(conn, buf))
+	if (in->update) {
+		if (!refill_buffer(conn, in))
 			return false;
-		buf->update = false;
+		in->update = false;
 	}
 
 	/* now read packet */
-	data = buf->buffer_data;
-	size = buf->buffer_size;
+	avail = spa_ringbuffer_get_read_index(&in->ring, &index);
 
-	if (buf->offset >= size) {
-		clear_buffer(buf);
-		buf->update = true;
+	if (avail <= 0) {
+		clear_input(in);
+		in->update = true;
 		return false;
 	}
 
-	data += buf->offset;
-	size -= buf->offset;
-
-	if (size < 8) {
-		connection_ensure_size(conn, buf, 8);
-		buf->update = true;
+	if (avail < 8) {
+		in->update = true;
 		goto again;
 	}
-	p = (uint32_t *) data;
-	data += 8;
-	size -= 8;
+	spa_ringbuffer_read_data(&in->ring, in->data, index & in->ring.mask, p, 8);
 
 	*dest_id = p[0];
 	*opcode = p[1] >> 24;
 	len = p[1] & 0xffffff;
 
-	if (len > size) {
-		connection_ensure_size(conn, buf, len);
-		buf->update = true;
+	if (len > avail - 8) {
+		if (!input_ensure_size(conn, in, 8 + len))
+			return false;
+		in->update = true;
 		goto again;
 	}
-	buf->size = len;
-	buf->data = data;
-	buf->offset += 8;
 
-	*dt = buf->data;
-	*sz = buf->size;
+	offset = (index + 8) & in->ring.mask;
+	if (offset + len <= in->ring.size) {
+		data = in->data + offset;
+	} else {
+		/* message wraps around the end of the ring, make it contiguous */
+		if (!input_ensure_scratch(in, len))
+			return false;
+		spa_ringbuffer_read_data(&in->ring, in->data, offset, in->scratch, len);
+		data = in->scratch;
+	}
+	in->size = 8 + len;
 
+	if (*dest_id == SPA_ID_INVALID) {
+		if (len != ARENA_MESSAGE_SIZE ||
+		    !input_arena_message(conn, in, (uint32_t *) data, opcode, dest_id, dt, sz)) {
+			pw_log_error("connection %p: invalid arena message", conn);
+			return false;
+		}
+		impl->stats.arena_received++;
+		data = *dt;
+	} else {
+		*dt = data;
+		*sz = len;
+	}
 
 	if (debug_messages) {
 		printf("<<<<<<<<< in:\n");
@@ -328,30 +859,49 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 	return true;
 }
 
-static inline void *begin_write(struct pw_protocol_native_connection *conn, uint32_t size)
+static uint32_t write_pod(struct spa_pod_builder *b, uint32_t ref, const void *data, uint32_t size)
 {
-	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	uint32_t *p;
-	struct buffer *buf = &impl->out;
-	/* 4 for dest_id, 1 for opcode, 3 for size and size for payload */
-	p = connection_ensure_size(conn, buf, 8 + size);
-	return p + 2;
+	struct impl *impl = SPA_CONTAINER_OF(b, struct impl, builder);
+	struct output *out = &impl->out;
+
+	if (ref == -1) {
+		ref = b->offset;
+		if (!output_append(out, data, size)) {
+			pw_log_error("connection %p: out of memory", impl);
+			return -1;
+		}
+		out->msg_size += size;
+	} else {
+		/* 8 bytes of header before the pod */
+		output_write_at(out, 8 + ref, data, size);
+	}
+	return ref;
 }
 
-static uint32_t write_pod(struct spa_pod_builder *b, uint32_t ref, const void *data, uint32_t size)
+static struct spa_pod_builder *begin_write(struct impl *impl, uint32_t dest_id, uint8_t opcode)
 {
-	struct impl *impl = SPA_CONTAINER_OF(b, struct impl, builder);
+	struct output *out = &impl->out;
+	struct segment *seg;
+
+	/* start the message in the last segment when the header fits,
+	 * else in a new one */
+	seg = spa_list_is_empty(&out->segments) ? NULL :
+		SPA_CONTAINER_OF(out->segments.prev, struct segment, link);
+	if (seg == NULL || seg->maxsize - seg->size < 8)
+		seg = segment_get(out);
+	if (seg == NULL)
+		return NULL;
 
-        if (ref == -1)
-                ref = b->offset;
+	out->start = seg;
+	out->start_offset = seg->size;
+	out->msg_size = 8;
+	seg->size += 8;
 
-        if (b->size <= b->offset) {
-                b->size = SPA_ROUND_UP_N(b->offset + size, 4096);
-                b->data = begin_write(&impl->this, b->size);
-        }
-        memcpy(b->data + ref, data, size);
+	impl->dest_id = dest_id;
+	impl->opcode = opcode;
+	impl->builder = (struct spa_pod_builder) { NULL, 0, 0, NULL, write_pod };
 
-        return ref;
+	return &impl->builder;
 }
 
 struct spa_pod_builder *
@@ -366,6 +916,12 @@ pw_protocol_native_connection_begin_resource(struct pw_protocol_native_connectio
         const char **types;
 
         base = client->n_types;
+	if (base == 0 && spa_type_map_has_ids(core->type.map)) {
+		/* send only the marker of the reserved types, the other side
+		 * has the same ids when it knows the marker and refuses the
+		 * connection when it doesn't */
+		base = client->n_types = SPA_TYPE__TypeIds_ID;
+	}
         diff = spa_type_map_get_size(core->type.map) - base;
         if (diff > 0) {
 		types = alloca(diff * sizeof(char *));
@@ -376,11 +932,7 @@ pw_protocol_native_connection_begin_resource(struct pw_protocol_native_connectio
 		pw_core_resource_update_types(client->core_resource, base, diff, types);
 	}
 
-	impl->dest_id = resource->id;
-	impl->opcode = opcode;
-	impl->builder = (struct spa_pod_builder) { NULL, 0, 0, NULL, write_pod };
-
-	return &impl->builder;
+	return begin_write(impl, resource->id, opcode);
 }
 
 struct spa_pod_builder *
@@ -395,6 +947,12 @@ pw_protocol_native_connection_begin_proxy(struct pw_protocol_native_connection *
         struct pw_core *core = remote->core;
 
         base = remote->n_types;
+	if (base == 0 && spa_type_map_has_ids(core->type.map)) {
+		/* send only the marker of the reserved types, the other side
+		 * has the same ids when it knows the marker and refuses the
+		 * connection when it doesn't */
+		base = remote->n_types = SPA_TYPE__TypeIds_ID;
+	}
         diff = spa_type_map_get_size(core->type.map) - base;
         if (diff > 0) {
 		types = alloca(diff * sizeof(char *));
@@ -405,11 +963,7 @@ pw_protocol_native_connection_begin_proxy(struct pw_protocol_native_connection *
 	        pw_core_proxy_update_types(remote->core_proxy, base, diff, types);
 	}
 
-	impl->dest_id = proxy->id;
-	impl->opcode = opcode;
-	impl->builder = (struct spa_pod_builder) { NULL, 0, 0, NULL, write_pod };
-
-	return &impl->builder;
+	return begin_write(impl, proxy->id, opcode);
 }
 
 void
@@ -417,19 +971,23 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 				  struct spa_pod_builder *builder)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	uint32_t *p, size = builder->offset;
-	struct buffer *buf = &impl->out;
-
-	p = connection_ensure_size(conn, buf, 8 + size);
-	*p++ = impl->dest_id;
-	*p++ = (impl->opcode << 24) | (size & 0xffffff);
+	struct output *out = &impl->out;
+	uint32_t p[2], size = builder->offset;
 
-	buf->buffer_size += 8 + size;
+	p[0] = impl->dest_id;
+	p[1] = (impl->opcode << 24) | (size & 0xffffff);
+	output_write_at(out, 0, p, 8);
+	out->n_messages++;
 
 	if (debug_messages) {
+		uint8_t *data = output_copy_message(out);
 		printf(">>>>>>>>> out:\n");
-	        spa_debug_pod((struct spa_pod *)p);
+		if (data)
+		        spa_debug_pod((struct spa_pod *)(data + 8));
+		free(data);
 	}
+
+	output_move_to_arena(conn, impl, impl->dest_id, impl->opcode);
 	spa_hook_list_call(&conn->listener_list, struct pw_protocol_native_connection_events, need_flush);
 }
 
@@ -438,64 +996,104 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
  * \param conn the connection object
  * \return true on success
  *
- * Write the queued messages on the connection to the socket
+ * Write the queued messages on the connection to the socket. All queued
+ * segments are written with one sendmsg call when possible. When the
+ * socket is full, the rest stays queued, see
+ * pw_protocol_native_connection_is_pending().
  *
  * \memberof pw_protocol_native_connection
  */
 bool pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	ssize_t len;
+	ssize_t len, total = 0;
 	struct msghdr msg = { 0 };
-	struct iovec iov[1];
+	struct iovec iov[MAX_IOV];
 	struct cmsghdr *cmsg;
 	char cmsgbuf[CMSG_SPACE(MAX_FDS * sizeof(int))];
-	int *cm, i, fds_len;
-	struct buffer *buf;
+	int *cm, i, fds_len, n_iov, n_syscalls = 0;
+	struct output *out;
+	struct segment *seg, *t;
 
-	buf = &impl->out;
+	out = &impl->out;
 
-	if (buf->buffer_size == 0)
+	if (spa_list_is_empty(&out->segments))
 		return true;
 
-	fds_len = buf->n_fds * sizeof(int);
+	while (!spa_list_is_empty(&out->segments)) {
+		n_iov = 0;
+		spa_list_for_each(seg, &out->segments, link) {
+			if (n_iov == MAX_IOV)
+				break;
+			if (seg->size == seg->offset)
+				continue;
+			iov[n_iov].iov_base = seg->data + seg->offset;
+			iov[n_iov].iov_len = seg->size - seg->offset;
+			n_iov++;
+		}
+		if (n_iov == 0)
+			break;
+
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n_iov;
+
+		if (out->n_fds > 0) {
+			fds_len = out->n_fds * sizeof(int);
+			msg.msg_control = cmsgbuf;
+			msg.msg_controllen = CMSG_SPACE(fds_len);
+			cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN(fds_len);
+			cm = (int *) CMSG_DATA(cmsg);
+			for (i = 0; i < out->n_fds; i++)
+				cm[i] = out->fds[i] > 0 ? out->fds[i] : -out->fds[i];
+			msg.msg_controllen = cmsg->cmsg_len;
+		} else {
+			msg.msg_control = NULL;
+			msg.msg_controllen = 0;
+		}
 
-	iov[0].iov_base = buf->buffer_data;
-	iov[0].iov_len = buf->buffer_size;
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 1;
-
-	if (buf->n_fds > 0) {
-		msg.msg_control = cmsgbuf;
-		msg.msg_controllen = CMSG_SPACE(fds_len);
-		cmsg = CMSG_FIRSTHDR(&msg);
-		cmsg->cmsg_level = SOL_SOCKET;
-		cmsg->cmsg_type = SCM_RIGHTS;
-		cmsg->cmsg_len = CMSG_LEN(fds_len);
-		cm = (int *) CMSG_DATA(cmsg);
-		for (i = 0; i < buf->n_fds; i++)
-			cm[i] = buf->fds[i] > 0 ? buf->fds[i] : -buf->fds[i];
-		msg.msg_controllen = cmsg->cmsg_len;
-	} else {
-		msg.msg_control = NULL;
-		msg.msg_controllen = 0;
-	}
+		while (true) {
+			len = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+			n_syscalls++;
+			if (len < 0) {
+				if (errno == EINTR)
+					continue;
+				else if (errno == EAGAIN || errno == EWOULDBLOCK)
+					goto done;
+				else
+					goto send_error;
+			}
+			break;
+		}
+		pw_log_trace("connection %p: %d written %zd bytes and %u fds", conn, conn->fd, len,
+			     out->n_fds);
 
-	while (true) {
-		len = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
-		if (len < 0) {
-			if (errno == EINTR)
-				continue;
-			else
-				goto send_error;
+		out->n_fds = 0;
+		total += len;
+
+		/* release the segments that are completely written */
+		spa_list_for_each_safe(seg, t, &out->segments, link) {
+			uint32_t l = SPA_MIN(seg->size - seg->offset, len);
+
+			seg->offset += l;
+			len -= l;
+			if (seg->offset < seg->size)
+				break;
+			segment_release(out, seg);
 		}
-		break;
 	}
-	pw_log_trace("connection %p: %d written %zd bytes and %u fds", conn, conn->fd, len,
-		     buf->n_fds);
 
-	buf->buffer_size -= len;
-	buf->n_fds = 0;
+      done:
+	impl->stats.n_flush++;
+	impl->stats.n_sendmsg += n_syscalls;
+	impl->stats.bytes_sent += total;
+	if (spa_list_is_empty(&out->segments)) {
+		impl->stats.messages_sent += out->n_messages;
+		out->n_messages = 0;
+	}
+	pw_log_debug("connection %p: flush %zd bytes in %d syscalls", conn, total, n_syscalls);
 
 	return true;
 
@@ -505,6 +1103,26 @@ bool pw_protocol_native_connection_flush(struct pw_protocol_native_connection *c
 	return false;
 }
 
+/** Check if there is data that could not be sent yet
+ *
+ * \param conn the connection
+ * \return true when the socket was full during the last flush, the
+ *	caller should wait until the socket is writable and flush again
+ *
+ * \memberof pw_protocol_native_connection
+ */
+bool pw_protocol_native_connection_is_pending(struct pw_protocol_native_connection *conn)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct segment *seg;
+
+	spa_list_for_each(seg, &impl->out.segments, link) {
+		if (seg->offset < seg->size)
+			return true;
+	}
+	return false;
+}
+
 /** Clear the connection object
  *
  * \param conn the connection object
@@ -518,8 +1136,8 @@ bool pw_protocol_native_connection_clear(struct pw_protocol_native_connection *c
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 
-	clear_buffer(&impl->out);
-	clear_buffer(&impl->in);
+	clear_output(&impl->out);
+	clear_input(&impl->in);
 	impl->in.update = true;
 
 	return true;
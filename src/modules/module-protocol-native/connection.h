@@ -62,6 +62,10 @@ pw_protocol_native_connection_new(int fd);
 void
 pw_protocol_native_connection_destroy(struct pw_protocol_native_connection *conn);
 
+bool
+pw_protocol_native_connection_enable_arena(struct pw_protocol_native_connection *conn,
+					   uint32_t size);
+
 bool
 pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *conn,
 				       uint8_t *opcode,
@@ -88,6 +92,9 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 bool
 pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn);
 
+bool
+pw_protocol_native_connection_is_pending(struct pw_protocol_native_connection *conn);
+
 bool
 pw_protocol_native_connection_clear(struct pw_protocol_native_connection *conn);
 
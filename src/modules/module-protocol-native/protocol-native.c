@@ -20,7 +20,7 @@
 #include <stdio.h>
 #include <errno.h>
 
-#include "spa/pod-iter.h"
+#include "spa/pod-schema.h"
 
 #include "pipewire/pipewire.h"
 #include "pipewire/protocol.h"
@@ -30,25 +30,200 @@
 
 #include "connection.h"
 
+/* layouts of the messages, the same schema is used to marshal and
+ * demarshal a message */
+struct msg_seq {
+	uint32_t seq;
+};
+SPA_POD_SCHEMA_DEFINE(msg_seq_schema,
+	SPA_POD_SCHEMA_INT(struct msg_seq, seq));
+
+struct msg_id {
+	uint32_t id;
+};
+SPA_POD_SCHEMA_DEFINE(msg_id_schema,
+	SPA_POD_SCHEMA_INT(struct msg_id, id));
+
+struct msg_get_registry {
+	uint32_t version;
+	uint32_t new_id;
+};
+SPA_POD_SCHEMA_DEFINE(msg_get_registry_schema,
+	SPA_POD_SCHEMA_INT(struct msg_get_registry, version),
+	SPA_POD_SCHEMA_INT(struct msg_get_registry, new_id));
+
+struct msg_error {
+	uint32_t id;
+	int32_t res;
+	const char *error;
+};
+SPA_POD_SCHEMA_DEFINE(msg_error_schema,
+	SPA_POD_SCHEMA_INT(struct msg_error, id),
+	SPA_POD_SCHEMA_INT(struct msg_error, res),
+	SPA_POD_SCHEMA_STRING(struct msg_error, error));
+
+struct msg_types {
+	uint32_t first_id;
+	uint32_t n_types;
+};
+SPA_POD_SCHEMA_DEFINE(msg_types_schema,
+	SPA_POD_SCHEMA_INT(struct msg_types, first_id),
+	SPA_POD_SCHEMA_INT(struct msg_types, n_types));
+
+struct msg_create_node {
+	const char *factory_name;
+	const char *name;
+	uint32_t type;
+	uint32_t version;
+};
+SPA_POD_SCHEMA_DEFINE(msg_create_node_schema,
+	SPA_POD_SCHEMA_STRING(struct msg_create_node, factory_name),
+	SPA_POD_SCHEMA_STRING(struct msg_create_node, name),
+	SPA_POD_SCHEMA_ID(struct msg_create_node, type),
+	SPA_POD_SCHEMA_INT(struct msg_create_node, version));
+
+struct msg_create_link {
+	uint32_t output_node_id;
+	uint32_t output_port_id;
+	uint32_t input_node_id;
+	uint32_t input_port_id;
+	const struct spa_format *filter;
+};
+SPA_POD_SCHEMA_DEFINE(msg_create_link_schema,
+	SPA_POD_SCHEMA_INT(struct msg_create_link, output_node_id),
+	SPA_POD_SCHEMA_INT(struct msg_create_link, output_port_id),
+	SPA_POD_SCHEMA_INT(struct msg_create_link, input_node_id),
+	SPA_POD_SCHEMA_INT(struct msg_create_link, input_port_id),
+	SPA_POD_SCHEMA_POD(-SPA_POD_TYPE_OBJECT, struct msg_create_link, filter));
+
+struct msg_bind {
+	uint32_t id;
+	uint32_t type;
+	uint32_t version;
+	uint32_t new_id;
+};
+SPA_POD_SCHEMA_DEFINE(msg_bind_schema,
+	SPA_POD_SCHEMA_INT(struct msg_bind, id),
+	SPA_POD_SCHEMA_ID(struct msg_bind, type),
+	SPA_POD_SCHEMA_INT(struct msg_bind, version),
+	SPA_POD_SCHEMA_INT(struct msg_bind, new_id));
+
+struct msg_snapshot {
+	uint32_t generation;
+	uint32_t flags;
+	uint32_t n_globals;
+};
+SPA_POD_SCHEMA_DEFINE(msg_snapshot_schema,
+	SPA_POD_SCHEMA_INT(struct msg_snapshot, generation),
+	SPA_POD_SCHEMA_INT(struct msg_snapshot, flags),
+	SPA_POD_SCHEMA_INT(struct msg_snapshot, n_globals));
+
+SPA_POD_SCHEMA_DEFINE(registry_global_schema,
+	SPA_POD_SCHEMA_INT(struct pw_registry_global, id),
+	SPA_POD_SCHEMA_INT(struct pw_registry_global, parent_id),
+	SPA_POD_SCHEMA_INT(struct pw_registry_global, permissions),
+	SPA_POD_SCHEMA_ID(struct pw_registry_global, type),
+	SPA_POD_SCHEMA_INT(struct pw_registry_global, version));
+
+SPA_POD_SCHEMA_DEFINE(core_info_schema,
+	SPA_POD_SCHEMA_LONG(struct pw_core_info, change_mask),
+	SPA_POD_SCHEMA_STRING(struct pw_core_info, user_name),
+	SPA_POD_SCHEMA_STRING(struct pw_core_info, host_name),
+	SPA_POD_SCHEMA_STRING(struct pw_core_info, version),
+	SPA_POD_SCHEMA_STRING(struct pw_core_info, name),
+	SPA_POD_SCHEMA_INT(struct pw_core_info, cookie));
+
+SPA_POD_SCHEMA_DEFINE(module_info_schema,
+	SPA_POD_SCHEMA_LONG(struct pw_module_info, change_mask),
+	SPA_POD_SCHEMA_STRING(struct pw_module_info, name),
+	SPA_POD_SCHEMA_STRING(struct pw_module_info, filename),
+	SPA_POD_SCHEMA_STRING(struct pw_module_info, args));
+
+/* the node info has the formats and the properties in between */
+SPA_POD_SCHEMA_DEFINE(node_info_input_schema,
+	SPA_POD_SCHEMA_LONG(struct pw_node_info, change_mask),
+	SPA_POD_SCHEMA_STRING(struct pw_node_info, name),
+	SPA_POD_SCHEMA_INT(struct pw_node_info, max_input_ports),
+	SPA_POD_SCHEMA_INT(struct pw_node_info, n_input_ports),
+	SPA_POD_SCHEMA_INT(struct pw_node_info, n_input_formats));
+SPA_POD_SCHEMA_DEFINE(node_info_output_schema,
+	SPA_POD_SCHEMA_INT(struct pw_node_info, max_output_ports),
+	SPA_POD_SCHEMA_INT(struct pw_node_info, n_output_ports),
+	SPA_POD_SCHEMA_INT(struct pw_node_info, n_output_formats));
+SPA_POD_SCHEMA_DEFINE(node_info_state_schema,
+	SPA_POD_SCHEMA_INT(struct pw_node_info, state),
+	SPA_POD_SCHEMA_STRING(struct pw_node_info, error));
+
+SPA_POD_SCHEMA_DEFINE(client_info_schema,
+	SPA_POD_SCHEMA_LONG(struct pw_client_info, change_mask));
+
+SPA_POD_SCHEMA_DEFINE(link_info_schema,
+	SPA_POD_SCHEMA_LONG(struct pw_link_info, change_mask),
+	SPA_POD_SCHEMA_INT(struct pw_link_info, output_node_id),
+	SPA_POD_SCHEMA_INT(struct pw_link_info, output_port_id),
+	SPA_POD_SCHEMA_INT(struct pw_link_info, input_node_id),
+	SPA_POD_SCHEMA_INT(struct pw_link_info, input_port_id),
+	SPA_POD_SCHEMA_POD(-SPA_POD_TYPE_OBJECT, struct pw_link_info, format));
+
+/* elements of the variable parts */
+SPA_POD_SCHEMA_DEFINE(dict_schema,
+	SPA_POD_SCHEMA_INT(struct spa_dict, n_items));
+
+SPA_POD_SCHEMA_DEFINE(dict_item_schema,
+	SPA_POD_SCHEMA_STRING(struct spa_dict_item, key),
+	SPA_POD_SCHEMA_STRING(struct spa_dict_item, value));
+
+SPA_POD_SCHEMA_DEFINE(int_schema, { SPA_POD_TYPE_INT, 0 });
+SPA_POD_SCHEMA_DEFINE(string_schema, { SPA_POD_TYPE_STRING, 0 });
+SPA_POD_SCHEMA_DEFINE(object_schema, { SPA_POD_TYPE_OBJECT, 0 });
+
+/* the size of the smallest pod with a value. Used to check that the
+ * number of elements of an array in a message fits in the message */
+#define MIN_POD_SIZE	(sizeof(struct spa_pod) + 8)
+
+static bool check_n_elems(struct spa_pod_iter *it, uint32_t n_elems, uint32_t elem_size)
+{
+	return it->offset <= it->size && n_elems <= (it->size - it->offset) / elem_size;
+}
+
+static void add_dict(struct spa_pod_builder *b, const struct spa_dict *dict)
+{
+	uint32_t i, n_items = dict ? dict->n_items : 0;
+
+	spa_pod_builder_int(b, n_items);
+	for (i = 0; i < n_items; i++)
+		spa_pod_schema_add(b, &dict_item_schema, &dict->items[i]);
+}
+
+/* parse the number of items of a dict, the caller allocates the items */
+static bool parse_dict_n_items(struct spa_pod_iter *it, struct spa_dict *dict)
+{
+	return spa_pod_schema_parse_iter(it, &dict_schema, dict) &&
+	       check_n_elems(it, dict->n_items, 2 * MIN_POD_SIZE);
+}
+
+static bool parse_dict_items(struct spa_pod_iter *it, struct spa_dict *dict)
+{
+	uint32_t i;
+
+	for (i = 0; i < dict->n_items; i++) {
+		if (!spa_pod_schema_parse_iter(it, &dict_item_schema, &dict->items[i]))
+			return false;
+	}
+	return true;
+}
+
 static void core_marshal_client_update(void *object, const struct spa_dict *props)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
-	int i, n_items;
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_CLIENT_UPDATE);
 
-	n_items = props ? props->n_items : 0;
-
-	spa_pod_builder_add(b, SPA_POD_TYPE_STRUCT, &f, SPA_POD_TYPE_INT, n_items, 0);
-
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    SPA_POD_TYPE_STRING, props->items[i].key,
-				    SPA_POD_TYPE_STRING, props->items[i].value, 0);
-	}
-	spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f, 0);
+	spa_pod_builder_push_struct(b, &f);
+	add_dict(b, props);
+	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -57,11 +232,11 @@ static void core_marshal_sync(void *object, uint32_t seq)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_seq msg = { seq };
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_SYNC);
 
-	spa_pod_builder_struct(b, &f, SPA_POD_TYPE_INT, seq);
+	spa_pod_schema_build(b, &msg_seq_schema, &msg);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -70,13 +245,24 @@ static void core_marshal_get_registry(void *object, uint32_t version, uint32_t n
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_get_registry msg = { version, new_id };
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_GET_REGISTRY);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, version,
-			       SPA_POD_TYPE_INT, new_id);
+	spa_pod_schema_build(b, &msg_get_registry_schema, &msg);
+
+	pw_protocol_native_end_proxy(proxy, b);
+}
+
+static void core_marshal_get_registry_snapshot(void *object, uint32_t version, uint32_t new_id)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_builder *b;
+	struct msg_get_registry msg = { version, new_id };
+
+	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_GET_REGISTRY_SNAPSHOT);
+
+	spa_pod_schema_build(b, &msg_get_registry_schema, &msg);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -90,28 +276,15 @@ core_marshal_create_node(void *object,
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
-	uint32_t i, n_items;
+	struct msg_create_node msg = { factory_name, name, type, version };
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_CREATE_NODE);
 
-	n_items = props ? props->n_items : 0;
-
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f,
-			    SPA_POD_TYPE_STRING, factory_name,
-			    SPA_POD_TYPE_STRING, name,
-			    SPA_POD_TYPE_ID, type,
-			    SPA_POD_TYPE_INT, version,
-			    SPA_POD_TYPE_INT, n_items, 0);
-
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    SPA_POD_TYPE_STRING, props->items[i].key,
-				    SPA_POD_TYPE_STRING, props->items[i].value, 0);
-	}
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_INT, new_id,
-			    -SPA_POD_TYPE_STRUCT, &f, 0);
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &msg_create_node_schema, &msg);
+	add_dict(b, props);
+	spa_pod_builder_int(b, new_id);
+	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -129,51 +302,54 @@ core_marshal_create_link(void *object,
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
-	uint32_t i, n_items;
+	struct msg_create_link msg = { output_node_id, output_port_id,
+				       input_node_id, input_port_id, filter };
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_CREATE_LINK);
 
-	n_items = props ? props->n_items : 0;
-
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f,
-			    SPA_POD_TYPE_INT, output_node_id,
-			    SPA_POD_TYPE_INT, output_port_id,
-			    SPA_POD_TYPE_INT, input_node_id,
-			    SPA_POD_TYPE_INT, input_port_id,
-			    SPA_POD_TYPE_POD, filter,
-			    SPA_POD_TYPE_INT, n_items, 0);
-
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    SPA_POD_TYPE_STRING, props->items[i].key,
-				    SPA_POD_TYPE_STRING, props->items[i].value, 0);
-	}
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_INT, new_id,
-			    -SPA_POD_TYPE_STRUCT, &f, 0);
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &msg_create_link_schema, &msg);
+	add_dict(b, props);
+	spa_pod_builder_int(b, new_id);
+	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
 
 static void
-core_marshal_update_types_client(void *object, uint32_t first_id, uint32_t n_types, const char **types)
+add_types(struct spa_pod_builder *b, uint32_t first_id, uint32_t n_types, const char **types)
 {
-	struct pw_proxy *proxy = object;
-	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
+	struct msg_types msg = { first_id, n_types };
 	uint32_t i;
 
-	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_UPDATE_TYPES);
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &msg_types_schema, &msg);
+	for (i = 0; i < n_types; i++)
+		spa_pod_builder_string(b, types[i]);
+	spa_pod_builder_pop(b, &f);
+}
 
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f,
-			    SPA_POD_TYPE_INT, first_id, SPA_POD_TYPE_INT, n_types, 0);
+static bool parse_strings(struct spa_pod_iter *it, uint32_t n_strings, const char **strings)
+{
+	uint32_t i;
 
-	for (i = 0; i < n_types; i++) {
-		spa_pod_builder_add(b, SPA_POD_TYPE_STRING, types[i], 0);
+	for (i = 0; i < n_strings; i++) {
+		if (!spa_pod_schema_parse_iter(it, &string_schema, &strings[i]))
+			return false;
 	}
-	spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f, 0);
+	return true;
+}
+
+static void
+core_marshal_update_types_client(void *object, uint32_t first_id, uint32_t n_types, const char **types)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_UPDATE_TYPES);
+
+	add_types(b, first_id, n_types, types);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -184,26 +360,17 @@ static bool core_demarshal_info(void *object, void *data, size_t size)
 	struct spa_dict props;
 	struct pw_core_info info;
 	struct spa_pod_iter it;
-	int i;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_STRING, &info.user_name,
-			      SPA_POD_TYPE_STRING, &info.host_name,
-			      SPA_POD_TYPE_STRING, &info.version,
-			      SPA_POD_TYPE_STRING, &info.name,
-			      SPA_POD_TYPE_INT, &info.cookie, SPA_POD_TYPE_INT, &props.n_items, 0))
+	    !spa_pod_schema_parse_iter(&it, &core_info_schema, &info) ||
+	    !parse_dict_n_items(&it, &props))
 		return false;
 
 	info.props = &props;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
-			return false;
-	}
+	if (!parse_dict_items(&it, &props))
+		return false;
+
 	pw_proxy_notify(proxy, struct pw_core_proxy_events, info, &info);
 	return true;
 }
@@ -211,45 +378,36 @@ static bool core_demarshal_info(void *object, void *data, size_t size)
 static bool core_demarshal_done(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t seq;
+	struct msg_seq msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &seq, 0))
+	if (!spa_pod_schema_parse(&msg_seq_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_core_proxy_events, done, seq);
+	pw_proxy_notify(proxy, struct pw_core_proxy_events, done, msg.seq);
 	return true;
 }
 
 static bool core_demarshal_error(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t id, res;
-	const char *error;
+	struct msg_error msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &id,
-			      SPA_POD_TYPE_INT, &res, SPA_POD_TYPE_STRING, &error, 0))
+	if (!spa_pod_schema_parse(&msg_error_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_core_proxy_events, error, id, res, error);
+	pw_proxy_notify(proxy, struct pw_core_proxy_events, error, msg.id, msg.res, msg.error);
 	return true;
 }
 
 static bool core_demarshal_remove_id(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t id;
+	struct msg_id msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &id, 0))
+	if (!spa_pod_schema_parse(&msg_id_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_core_proxy_events, remove_id, id);
+	pw_proxy_notify(proxy, struct pw_core_proxy_events, remove_id, msg.id);
 	return true;
 }
 
@@ -257,20 +415,20 @@ static bool core_demarshal_update_types_client(void *object, void *data, size_t
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_iter it;
-	uint32_t first_id, n_types;
+	struct msg_types msg = { 0, };
 	const char **types;
-	int i;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &first_id, SPA_POD_TYPE_INT, &n_types, 0))
+	    !spa_pod_schema_parse_iter(&it, &msg_types_schema, &msg) ||
+	    !check_n_elems(&it, msg.n_types, MIN_POD_SIZE))
 		return false;
 
-	types = alloca(n_types * sizeof(char *));
-	for (i = 0; i < n_types; i++) {
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_STRING, &types[i], 0))
-			return false;
-	}
-	pw_proxy_notify(proxy, struct pw_core_proxy_events, update_types, first_id, n_types, types);
+	types = alloca(msg.n_types * sizeof(char *));
+	if (!parse_strings(&it, msg.n_types, types))
+		return false;
+
+	pw_proxy_notify(proxy, struct pw_core_proxy_events, update_types, msg.first_id,
+			msg.n_types, types);
 	return true;
 }
 
@@ -279,27 +437,13 @@ static void core_marshal_info(void *object, struct pw_core_info *info)
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
-	uint32_t i, n_items;
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
-
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f,
-			    SPA_POD_TYPE_LONG, info->change_mask,
-			    SPA_POD_TYPE_STRING, info->user_name,
-			    SPA_POD_TYPE_STRING, info->host_name,
-			    SPA_POD_TYPE_STRING, info->version,
-			    SPA_POD_TYPE_STRING, info->name,
-			    SPA_POD_TYPE_INT, info->cookie, SPA_POD_TYPE_INT, n_items, 0);
-
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    SPA_POD_TYPE_STRING, info->props->items[i].key,
-				    SPA_POD_TYPE_STRING, info->props->items[i].value, 0);
-	}
-	spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f, 0);
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &core_info_schema, info);
+	add_dict(b, info->props);
+	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -308,11 +452,11 @@ static void core_marshal_done(void *object, uint32_t seq)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_seq msg = { seq };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_DONE);
 
-	spa_pod_builder_struct(b, &f, SPA_POD_TYPE_INT, seq);
+	spa_pod_schema_build(b, &msg_seq_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -322,7 +466,7 @@ static void core_marshal_error(void *object, uint32_t id, int res, const char *e
 	struct pw_resource *resource = object;
 	char buffer[128];
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_error msg = { id, res, buffer };
 	va_list ap;
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_ERROR);
@@ -331,10 +475,7 @@ static void core_marshal_error(void *object, uint32_t id, int res, const char *e
 	vsnprintf(buffer, sizeof(buffer), error, ap);
 	va_end(ap);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, id,
-			       SPA_POD_TYPE_INT, res,
-			       SPA_POD_TYPE_STRING, buffer);
+	spa_pod_schema_build(b, &msg_error_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -343,11 +484,11 @@ static void core_marshal_remove_id(void *object, uint32_t id)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_id msg = { id };
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_REMOVE_ID);
 
-	spa_pod_builder_struct(b, &f, SPA_POD_TYPE_INT, id);
+	spa_pod_schema_build(b, &msg_id_schema, &msg);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -357,19 +498,10 @@ core_marshal_update_types_server(void *object, uint32_t first_id, uint32_t n_typ
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
-	uint32_t i;
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_UPDATE_TYPES);
 
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f,
-			    SPA_POD_TYPE_INT, first_id, SPA_POD_TYPE_INT, n_types, 0);
-
-	for (i = 0; i < n_types; i++) {
-		spa_pod_builder_add(b, SPA_POD_TYPE_STRING, types[i], 0);
-	}
-	spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f, 0);
+	add_types(b, first_id, n_types, types);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -379,19 +511,15 @@ static bool core_demarshal_client_update(void *object, void *data, size_t size)
 	struct pw_resource *resource = object;
 	struct spa_dict props;
 	struct spa_pod_iter it;
-	uint32_t i;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &props.n_items, 0))
+	    !parse_dict_n_items(&it, &props))
 		return false;
 
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
-			return false;
-	}
+	if (!parse_dict_items(&it, &props))
+		return false;
+
 	pw_resource_do(resource, struct pw_core_proxy_methods, client_update, &props);
 	return true;
 }
@@ -399,31 +527,37 @@ static bool core_demarshal_client_update(void *object, void *data, size_t size)
 static bool core_demarshal_sync(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
-	uint32_t seq;
+	struct msg_seq msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &seq, 0))
+	if (!spa_pod_schema_parse(&msg_seq_schema, data, size, &msg))
 		return false;
 
-	pw_resource_do(resource, struct pw_core_proxy_methods, sync, seq);
+	pw_resource_do(resource, struct pw_core_proxy_methods, sync, msg.seq);
 	return true;
 }
 
 static bool core_demarshal_get_registry(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
-	int32_t version, new_id;
+	struct msg_get_registry msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &version,
-			      SPA_POD_TYPE_INT, &new_id, 0))
+	if (!spa_pod_schema_parse(&msg_get_registry_schema, data, size, &msg))
+		return false;
+
+	pw_resource_do(resource, struct pw_core_proxy_methods, get_registry, msg.version, msg.new_id);
+	return true;
+}
+
+static bool core_demarshal_get_registry_snapshot(void *object, void *data, size_t size)
+{
+	struct pw_resource *resource = object;
+	struct msg_get_registry msg = { 0, };
 
+	if (!spa_pod_schema_parse(&msg_get_registry_schema, data, size, &msg))
 		return false;
 
-	pw_resource_do(resource, struct pw_core_proxy_methods, get_registry, version, new_id);
+	pw_resource_do(resource, struct pw_core_proxy_methods, get_registry_snapshot,
+		       msg.version, msg.new_id);
 	return true;
 }
 
@@ -431,32 +565,24 @@ static bool core_demarshal_create_node(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_iter it;
-	uint32_t version, type, new_id, i;
-	const char *factory_name, *name;
+	struct msg_create_node msg = { 0, };
 	struct spa_dict props;
+	uint32_t new_id;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_STRING, &factory_name,
-			      SPA_POD_TYPE_STRING, &name,
-			      SPA_POD_TYPE_ID, &type,
-			      SPA_POD_TYPE_INT, &version,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	    !spa_pod_schema_parse_iter(&it, &msg_create_node_schema, &msg) ||
+	    !parse_dict_n_items(&it, &props))
 		return false;
 
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
-			return false;
-	}
-	if (!spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &new_id, 0))
+	if (!parse_dict_items(&it, &props) ||
+	    !spa_pod_schema_parse_iter(&it, &int_schema, &new_id))
 		return false;
 
-	pw_resource_do(resource, struct pw_core_proxy_methods, create_node, factory_name, name,
-								      type, version,
+	pw_resource_do(resource, struct pw_core_proxy_methods, create_node, msg.factory_name,
+								      msg.name,
+								      msg.type,
+								      msg.version,
 								      &props, new_id);
 	return true;
 }
@@ -465,36 +591,25 @@ static bool core_demarshal_create_link(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_iter it;
-	uint32_t new_id, i;
-	uint32_t output_node_id, output_port_id, input_node_id, input_port_id;
-	struct spa_format *filter = NULL;
+	struct msg_create_link msg = { 0, };
 	struct spa_dict props;
+	uint32_t new_id;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &output_node_id,
-			      SPA_POD_TYPE_INT, &output_port_id,
-			      SPA_POD_TYPE_INT, &input_node_id,
-			      SPA_POD_TYPE_INT, &input_port_id,
-			      -SPA_POD_TYPE_OBJECT, &filter,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	    !spa_pod_schema_parse_iter(&it, &msg_create_link_schema, &msg) ||
+	    !parse_dict_n_items(&it, &props))
 		return false;
 
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
-			return false;
-	}
-	if (!spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &new_id, 0))
+	if (!parse_dict_items(&it, &props) ||
+	    !spa_pod_schema_parse_iter(&it, &int_schema, &new_id))
 		return false;
 
-	pw_resource_do(resource, struct pw_core_proxy_methods, create_link, output_node_id,
-								      output_port_id,
-								      input_node_id,
-								      input_port_id,
-								      filter,
+	pw_resource_do(resource, struct pw_core_proxy_methods, create_link, msg.output_node_id,
+								      msg.output_port_id,
+								      msg.input_node_id,
+								      msg.input_port_id,
+								      msg.filter,
 								      &props,
 								      new_id);
 	return true;
@@ -504,20 +619,20 @@ static bool core_demarshal_update_types_server(void *object, void *data, size_t
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_iter it;
-	uint32_t first_id, n_types;
+	struct msg_types msg = { 0, };
 	const char **types;
-	int i;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &first_id, SPA_POD_TYPE_INT, &n_types, 0))
+	    !spa_pod_schema_parse_iter(&it, &msg_types_schema, &msg) ||
+	    !check_n_elems(&it, msg.n_types, MIN_POD_SIZE))
 		return false;
 
-	types = alloca(n_types * sizeof(char *));
-	for (i = 0; i < n_types; i++) {
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_STRING, &types[i], 0))
-			return false;
-	}
-	pw_resource_do(resource, struct pw_core_proxy_methods, update_types, first_id, n_types, types);
+	types = alloca(msg.n_types * sizeof(char *));
+	if (!parse_strings(&it, msg.n_types, types))
+		return false;
+
+	pw_resource_do(resource, struct pw_core_proxy_methods, update_types, msg.first_id,
+		       msg.n_types, types);
 	return true;
 }
 
@@ -526,16 +641,11 @@ static void registry_marshal_global(void *object, uint32_t id, uint32_t parent_i
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct pw_registry_global g = { id, parent_id, permissions, type, version, NULL };
 
 	b = pw_protocol_native_begin_resource(resource, PW_REGISTRY_PROXY_EVENT_GLOBAL);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, id,
-			       SPA_POD_TYPE_INT, parent_id,
-			       SPA_POD_TYPE_INT, permissions,
-			       SPA_POD_TYPE_ID, type,
-			       SPA_POD_TYPE_INT, version);
+	spa_pod_schema_build(b, &registry_global_schema, &g);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -544,11 +654,40 @@ static void registry_marshal_global_remove(void *object, uint32_t id)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_id msg = { id };
 
 	b = pw_protocol_native_begin_resource(resource, PW_REGISTRY_PROXY_EVENT_GLOBAL_REMOVE);
 
-	spa_pod_builder_struct(b, &f, SPA_POD_TYPE_INT, id);
+	spa_pod_schema_build(b, &msg_id_schema, &msg);
+
+	pw_protocol_native_end_resource(resource, b);
+}
+
+static void registry_marshal_snapshot(void *object, uint32_t generation, uint32_t flags,
+				      uint32_t n_globals, const struct pw_registry_global *globals,
+				      uint32_t n_removed, const uint32_t *removed)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_builder *b;
+	struct spa_pod_frame f;
+	struct msg_snapshot msg = { generation, flags, n_globals };
+	uint32_t i;
+
+	b = pw_protocol_native_begin_resource(resource, PW_REGISTRY_PROXY_EVENT_SNAPSHOT);
+
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &msg_snapshot_schema, &msg);
+
+	for (i = 0; i < n_globals; i++) {
+		spa_pod_schema_add(b, &registry_global_schema, &globals[i]);
+		add_dict(b, globals[i].props);
+	}
+
+	spa_pod_builder_int(b, n_removed);
+	for (i = 0; i < n_removed; i++)
+		spa_pod_builder_int(b, removed[i]);
+
+	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -556,18 +695,13 @@ static void registry_marshal_global_remove(void *object, uint32_t id)
 static bool registry_demarshal_bind(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
-	struct spa_pod_iter it;
-	uint32_t id, version, type, new_id;
+	struct msg_bind msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &id,
-			      SPA_POD_TYPE_ID, &type,
-			      SPA_POD_TYPE_INT, &version,
-			      SPA_POD_TYPE_INT, &new_id, 0))
+	if (!spa_pod_schema_parse(&msg_bind_schema, data, size, &msg))
 		return false;
 
-	pw_resource_do(resource, struct pw_registry_proxy_methods, bind, id, type, version, new_id);
+	pw_resource_do(resource, struct pw_registry_proxy_methods, bind, msg.id, msg.type,
+		       msg.version, msg.new_id);
 	return true;
 }
 
@@ -576,25 +710,13 @@ static void module_marshal_info(void *object, struct pw_module_info *info)
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
-	uint32_t i, n_items;
 
 	b = pw_protocol_native_begin_resource(resource, PW_MODULE_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
-
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f,
-			    SPA_POD_TYPE_LONG, info->change_mask,
-			    SPA_POD_TYPE_STRING, info->name,
-			    SPA_POD_TYPE_STRING, info->filename,
-			    SPA_POD_TYPE_STRING, info->args, SPA_POD_TYPE_INT, n_items, 0);
-
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    SPA_POD_TYPE_STRING, info->props->items[i].key,
-				    SPA_POD_TYPE_STRING, info->props->items[i].value, 0);
-	}
-	spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f, 0);
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &module_info_schema, info);
+	add_dict(b, info->props);
+	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -605,24 +727,17 @@ static bool module_demarshal_info(void *object, void *data, size_t size)
 	struct spa_pod_iter it;
 	struct spa_dict props;
 	struct pw_module_info info;
-	int i;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_STRING, &info.name,
-			      SPA_POD_TYPE_STRING, &info.filename,
-			      SPA_POD_TYPE_STRING, &info.args, SPA_POD_TYPE_INT, &props.n_items, 0))
+	    !spa_pod_schema_parse_iter(&it, &module_info_schema, &info) ||
+	    !parse_dict_n_items(&it, &props))
 		return false;
 
 	info.props = &props;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
-			return false;
-	}
+	if (!parse_dict_items(&it, &props))
+		return false;
+
 	pw_proxy_notify(proxy, struct pw_module_proxy_events, info, &info);
 	return true;
 }
@@ -632,43 +747,35 @@ static void node_marshal_info(void *object, struct pw_node_info *info)
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
-	uint32_t i, n_items;
+	uint32_t i;
 
 	b = pw_protocol_native_begin_resource(resource, PW_NODE_PROXY_EVENT_INFO);
 
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f,
-			    SPA_POD_TYPE_LONG, info->change_mask,
-			    SPA_POD_TYPE_STRING, info->name,
-			    SPA_POD_TYPE_INT, info->max_input_ports,
-			    SPA_POD_TYPE_INT, info->n_input_ports,
-			    SPA_POD_TYPE_INT, info->n_input_formats, 0);
-
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &node_info_input_schema, info);
 	for (i = 0; i < info->n_input_formats; i++)
-		spa_pod_builder_add(b, SPA_POD_TYPE_POD, info->input_formats[i], 0);
-
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_INT, info->max_output_ports,
-			    SPA_POD_TYPE_INT, info->n_output_ports,
-			    SPA_POD_TYPE_INT, info->n_output_formats, 0);
+		spa_pod_schema_add(b, &object_schema, &info->input_formats[i]);
 
+	spa_pod_schema_add(b, &node_info_output_schema, info);
 	for (i = 0; i < info->n_output_formats; i++)
-		spa_pod_builder_add(b, SPA_POD_TYPE_POD, info->output_formats[i], 0);
+		spa_pod_schema_add(b, &object_schema, &info->output_formats[i]);
 
-	n_items = info->props ? info->props->n_items : 0;
+	spa_pod_schema_add(b, &node_info_state_schema, info);
+	add_dict(b, info->props);
+	spa_pod_builder_pop(b, &f);
 
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_INT, info->state,
-			    SPA_POD_TYPE_STRING, info->error, SPA_POD_TYPE_INT, n_items, 0);
+	pw_protocol_native_end_resource(resource, b);
+}
 
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    SPA_POD_TYPE_STRING, info->props->items[i].key,
-				    SPA_POD_TYPE_STRING, info->props->items[i].value, 0);
-	}
-	spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f, 0);
+static bool parse_formats(struct spa_pod_iter *it, uint32_t n_formats, struct spa_format **formats)
+{
+	uint32_t i;
 
-	pw_protocol_native_end_resource(resource, b);
+	for (i = 0; i < n_formats; i++) {
+		if (!spa_pod_schema_parse_iter(it, &object_schema, &formats[i]))
+			return false;
+	}
+	return true;
 }
 
 static bool node_demarshal_info(void *object, void *data, size_t size)
@@ -677,47 +784,29 @@ static bool node_demarshal_info(void *object, void *data, size_t size)
 	struct spa_pod_iter it;
 	struct spa_dict props;
 	struct pw_node_info info;
-	int i;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_STRING, &info.name,
-			      SPA_POD_TYPE_INT, &info.max_input_ports,
-			      SPA_POD_TYPE_INT, &info.n_input_ports,
-			      SPA_POD_TYPE_INT, &info.n_input_formats, 0))
+	    !spa_pod_schema_parse_iter(&it, &node_info_input_schema, &info) ||
+	    !check_n_elems(&it, info.n_input_formats, MIN_POD_SIZE))
 		return false;
 
 	info.input_formats = alloca(info.n_input_formats * sizeof(struct spa_format *));
-	for (i = 0; i < info.n_input_formats; i++)
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &info.input_formats[i], 0))
-			return false;
-
-	if (!spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.max_output_ports,
-			      SPA_POD_TYPE_INT, &info.n_output_ports,
-			      SPA_POD_TYPE_INT, &info.n_output_formats, 0))
+	if (!parse_formats(&it, info.n_input_formats, info.input_formats) ||
+	    !spa_pod_schema_parse_iter(&it, &node_info_output_schema, &info) ||
+	    !check_n_elems(&it, info.n_output_formats, MIN_POD_SIZE))
 		return false;
 
 	info.output_formats = alloca(info.n_output_formats * sizeof(struct spa_format *));
-	for (i = 0; i < info.n_output_formats; i++)
-		if (!spa_pod_iter_get(&it, SPA_POD_TYPE_OBJECT, &info.output_formats[i], 0))
-			return false;
-
-	if (!spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &info.state,
-			      SPA_POD_TYPE_STRING, &info.error,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	if (!parse_formats(&it, info.n_output_formats, info.output_formats) ||
+	    !spa_pod_schema_parse_iter(&it, &node_info_state_schema, &info) ||
+	    !parse_dict_n_items(&it, &props))
 		return false;
 
 	info.props = &props;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
-			return false;
-	}
+	if (!parse_dict_items(&it, &props))
+		return false;
+
 	pw_proxy_notify(proxy, struct pw_node_proxy_events, info, &info);
 	return true;
 }
@@ -727,23 +816,13 @@ static void client_marshal_info(void *object, struct pw_client_info *info)
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
-	uint32_t i, n_items;
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
-
-	spa_pod_builder_add(b,
-			    SPA_POD_TYPE_STRUCT, &f,
-			    SPA_POD_TYPE_LONG, info->change_mask,
-			    SPA_POD_TYPE_INT, n_items, 0);
-
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    SPA_POD_TYPE_STRING, info->props->items[i].key,
-				    SPA_POD_TYPE_STRING, info->props->items[i].value, 0);
-	}
-	spa_pod_builder_add(b, -SPA_POD_TYPE_STRUCT, &f, 0);
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_schema_add(b, &client_info_schema, info);
+	add_dict(b, info->props);
+	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -754,22 +833,17 @@ static bool client_demarshal_info(void *object, void *data, size_t size)
 	struct spa_pod_iter it;
 	struct spa_dict props;
 	struct pw_client_info info;
-	uint32_t i;
 
 	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_INT, &props.n_items, 0))
+	    !spa_pod_schema_parse_iter(&it, &client_info_schema, &info) ||
+	    !parse_dict_n_items(&it, &props))
 		return false;
 
 	info.props = &props;
 	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (!spa_pod_iter_get(&it,
-				      SPA_POD_TYPE_STRING, &props.items[i].key,
-				      SPA_POD_TYPE_STRING, &props.items[i].value, 0))
-			return false;
-	}
+	if (!parse_dict_items(&it, &props))
+		return false;
+
 	pw_proxy_notify(proxy, struct pw_client_proxy_events, info, &info);
 	return true;
 }
@@ -778,17 +852,10 @@ static void link_marshal_info(void *object, struct pw_link_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
 
 	b = pw_protocol_native_begin_resource(resource, PW_LINK_PROXY_EVENT_INFO);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_LONG, info->change_mask,
-			       SPA_POD_TYPE_INT, info->output_node_id,
-			       SPA_POD_TYPE_INT, info->output_port_id,
-			       SPA_POD_TYPE_INT, info->input_node_id,
-			       SPA_POD_TYPE_INT, info->input_port_id,
-			       SPA_POD_TYPE_POD, info->format);
+	spa_pod_schema_build(b, &link_info_schema, info);
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -796,17 +863,9 @@ static void link_marshal_info(void *object, struct pw_link_info *info)
 static bool link_demarshal_info(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
 	struct pw_link_info info = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_LONG, &info.change_mask,
-			      SPA_POD_TYPE_INT, &info.output_node_id,
-			      SPA_POD_TYPE_INT, &info.output_port_id,
-			      SPA_POD_TYPE_INT, &info.input_node_id,
-			      SPA_POD_TYPE_INT, &info.input_port_id,
-			      -SPA_POD_TYPE_OBJECT, &info.format, 0))
+	if (!spa_pod_schema_parse(&link_info_schema, data, size, &info))
 		return false;
 
 	pw_proxy_notify(proxy, struct pw_link_proxy_events, info, &info);
@@ -816,50 +875,126 @@ static bool link_demarshal_info(void *object, void *data, size_t size)
 static bool registry_demarshal_global(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t id, parent_id, permissions, type, version;
+	struct pw_registry_global g;
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it,
-			      SPA_POD_TYPE_INT, &id,
-			      SPA_POD_TYPE_INT, &parent_id,
-			      SPA_POD_TYPE_INT, &permissions,
-			      SPA_POD_TYPE_ID, &type,
-			      SPA_POD_TYPE_INT, &version, 0))
+	if (!spa_pod_schema_parse(&registry_global_schema, data, size, &g))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_registry_proxy_events, global, id, parent_id, permissions, type, version);
+	pw_proxy_notify(proxy, struct pw_registry_proxy_events, global, g.id, g.parent_id,
+			g.permissions, g.type, g.version);
 	return true;
 }
 
 static bool registry_demarshal_global_remove(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
-	struct spa_pod_iter it;
-	uint32_t id;
+	struct msg_id msg = { 0, };
 
-	if (!spa_pod_iter_struct(&it, data, size) ||
-	    !spa_pod_iter_get(&it, SPA_POD_TYPE_INT, &id, 0))
+	if (!spa_pod_schema_parse(&msg_id_schema, data, size, &msg))
 		return false;
 
-	pw_proxy_notify(proxy, struct pw_registry_proxy_events, global_remove, id);
+	pw_proxy_notify(proxy, struct pw_registry_proxy_events, global_remove, msg.id);
 	return true;
 }
 
+/* parse the globals of a snapshot. When globals is NULL, only count the
+ * number of property items */
+static bool parse_snapshot_globals(struct spa_pod_iter *it, uint32_t n_globals,
+				   struct pw_registry_global *globals, struct spa_dict *dicts,
+				   struct spa_dict_item *items, uint32_t *n_items)
+{
+	struct pw_registry_global g;
+	struct spa_dict props;
+	struct spa_dict_item item;
+	uint32_t i, j;
+
+	*n_items = 0;
+	for (i = 0; i < n_globals; i++) {
+		if (!spa_pod_schema_parse_iter(it, &registry_global_schema, &g) ||
+		    !parse_dict_n_items(it, &props))
+			return false;
+
+		g.props = NULL;
+		if (globals && props.n_items > 0) {
+			dicts[i].n_items = props.n_items;
+			dicts[i].items = &items[*n_items];
+			g.props = &dicts[i];
+		}
+		for (j = 0; j < props.n_items; j++) {
+			if (!spa_pod_schema_parse_iter(it, &dict_item_schema,
+						       globals ? &items[*n_items] : &item))
+				return false;
+			(*n_items)++;
+		}
+		if (globals)
+			globals[i] = g;
+	}
+	return true;
+}
+
+static bool registry_demarshal_snapshot(void *object, void *data, size_t size)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_iter it, start;
+	struct msg_snapshot msg = { 0, };
+	uint32_t i, n_items, n_removed, *removed;
+	struct pw_registry_global *globals;
+	struct spa_dict *dicts;
+	struct spa_dict_item *items;
+	void *mem;
+	bool res = false;
+
+	if (!spa_pod_iter_struct(&it, data, size) ||
+	    !spa_pod_schema_parse_iter(&it, &msg_snapshot_schema, &msg) ||
+	    !check_n_elems(&it, msg.n_globals, 6 * MIN_POD_SIZE))
+		return false;
+
+	/* count first so that we can do one allocation for all globals */
+	start = it;
+	if (!parse_snapshot_globals(&it, msg.n_globals, NULL, NULL, NULL, &n_items) ||
+	    !spa_pod_schema_parse_iter(&it, &int_schema, &n_removed) ||
+	    !check_n_elems(&it, n_removed, MIN_POD_SIZE))
+		return false;
+
+	mem = malloc(msg.n_globals * (sizeof(struct pw_registry_global) + sizeof(struct spa_dict)) +
+		     n_items * sizeof(struct spa_dict_item) +
+		     n_removed * sizeof(uint32_t));
+	if (mem == NULL)
+		return false;
+
+	globals = mem;
+	dicts = SPA_MEMBER(globals, msg.n_globals * sizeof(struct pw_registry_global), struct spa_dict);
+	items = SPA_MEMBER(dicts, msg.n_globals * sizeof(struct spa_dict), struct spa_dict_item);
+	removed = SPA_MEMBER(items, n_items * sizeof(struct spa_dict_item), uint32_t);
+
+	it = start;
+	if (!parse_snapshot_globals(&it, msg.n_globals, globals, dicts, items, &n_items) ||
+	    !spa_pod_schema_parse_iter(&it, &int_schema, &n_removed))
+		goto exit;
+
+	for (i = 0; i < n_removed; i++)
+		if (!spa_pod_schema_parse_iter(&it, &int_schema, &removed[i]))
+			goto exit;
+
+	pw_proxy_notify(proxy, struct pw_registry_proxy_events, snapshot, msg.generation,
+			msg.flags, msg.n_globals, globals, n_removed, removed);
+	res = true;
+
+      exit:
+	free(mem);
+	return res;
+}
+
 static void registry_marshal_bind(void *object, uint32_t id,
 				  uint32_t type, uint32_t version, uint32_t new_id)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_builder *b;
-	struct spa_pod_frame f;
+	struct msg_bind msg = { id, type, version, new_id };
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_REGISTRY_PROXY_METHOD_BIND);
 
-	spa_pod_builder_struct(b, &f,
-			       SPA_POD_TYPE_INT, id,
-			       SPA_POD_TYPE_ID, type,
-			       SPA_POD_TYPE_INT, version,
-			       SPA_POD_TYPE_INT, new_id);
+	spa_pod_schema_build(b, &msg_bind_schema, &msg);
 
 	pw_protocol_native_end_proxy(proxy, b);
 }
@@ -871,7 +1006,8 @@ static const struct pw_core_proxy_methods pw_protocol_native_core_method_marshal
 	&core_marshal_get_registry,
 	&core_marshal_client_update,
 	&core_marshal_create_node,
-	&core_marshal_create_link
+	&core_marshal_create_link,
+	&core_marshal_get_registry_snapshot,
 };
 
 static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_demarshal[PW_CORE_PROXY_METHOD_NUM] = {
@@ -880,7 +1016,8 @@ static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_
 	{ &core_demarshal_get_registry, 0, },
 	{ &core_demarshal_client_update, 0, },
 	{ &core_demarshal_create_node, PW_PROTOCOL_NATIVE_REMAP, },
-	{ &core_demarshal_create_link, PW_PROTOCOL_NATIVE_REMAP, }
+	{ &core_demarshal_create_link, PW_PROTOCOL_NATIVE_REMAP, },
+	{ &core_demarshal_get_registry_snapshot, 0, },
 };
 
 static const struct pw_core_proxy_events pw_protocol_native_core_event_marshal = {
@@ -924,11 +1061,13 @@ static const struct pw_registry_proxy_events pw_protocol_native_registry_event_m
 	PW_VERSION_REGISTRY_PROXY_EVENTS,
 	&registry_marshal_global,
 	&registry_marshal_global_remove,
+	&registry_marshal_snapshot,
 };
 
 static const struct pw_protocol_native_demarshal pw_protocol_native_registry_event_demarshal[] = {
 	{ &registry_demarshal_global, PW_PROTOCOL_NATIVE_REMAP, },
-	{ &registry_demarshal_global_remove, 0, }
+	{ &registry_demarshal_global_remove, 0, },
+	{ &registry_demarshal_snapshot, PW_PROTOCOL_NATIVE_REMAP, },
 };
 
 const struct pw_protocol_marshal pw_protocol_native_registry_marshal = {
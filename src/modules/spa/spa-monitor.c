@@ -43,6 +43,7 @@ struct monitor_item {
 	struct spa_list link;
 	struct pw_node *node;
 	struct spa_handle *handle;
+	struct pw_data_loop *data_loop;	/* the handle uses this loop */
 };
 
 struct impl {
@@ -57,6 +58,27 @@ struct impl {
 	struct spa_list item_list;
 };
 
+/* with data-loop.assign=device every device gets its own data loop, named
+ * after the monitor and the card or device path, like alsa.0 */
+static void assign_data_loop(struct impl *impl, struct pw_properties *props, const char *id)
+{
+	const struct pw_properties *core_props = pw_core_get_properties(impl->core);
+	const char *str, *device;
+
+	if (pw_properties_get(props, "node.data-loop"))
+		return;
+
+	if ((str = pw_properties_get(core_props, "data-loop.assign")) == NULL ||
+	    strcmp(str, "device") != 0)
+		return;
+
+	if ((device = pw_properties_get(props, "alsa.card")) == NULL &&
+	    (device = pw_properties_get(props, "device.path")) == NULL)
+		device = id;
+
+	pw_properties_setf(props, "node.data-loop", "%s.%s", impl->this.system_name, device);
+}
+
 static void add_item(struct pw_spa_monitor *this, struct spa_monitor_item *item)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
@@ -72,6 +94,7 @@ static void add_item(struct pw_spa_monitor *this, struct spa_monitor_item *item)
 	struct pw_type *t = pw_core_get_type(impl->core);
 	const struct spa_support *support;
 	uint32_t n_support;
+	struct pw_data_loop *data_loop;
 
 	spa_pod_object_query(&item->object,
 			     t->monitor.name, SPA_POD_TYPE_STRING, &name,
@@ -98,7 +121,10 @@ static void add_item(struct pw_spa_monitor *this, struct spa_monitor_item *item)
 	}
 	pw_properties_set(props, "media.class", klass);
 
-	support = pw_core_get_support(impl->core, &n_support);
+	assign_data_loop(impl, props, id);
+
+	data_loop = pw_core_get_data_loop(impl->core, pw_properties_get(props, "node.data-loop"));
+	support = pw_core_get_node_support(impl->core, props, &n_support);
 
 	handle = calloc(1, factory->size);
 	if ((res = spa_handle_factory_init(factory,
@@ -107,11 +133,11 @@ static void add_item(struct pw_spa_monitor *this, struct spa_monitor_item *item)
 					   support,
 					   n_support)) < 0) {
 		pw_log_error("can't make factory instance: %d", res);
-		return;
+		goto error;
 	}
 	if ((res = spa_handle_get_interface(handle, t->spa_node, &node_iface)) < 0) {
 		pw_log_error("can't get NODE interface: %d", res);
-		return;
+		goto error;
 	}
 	if ((res = spa_handle_get_interface(handle, t->spa_clock, &clock_iface)) < 0) {
 		pw_log_info("no CLOCK interface: %d", res);
@@ -122,10 +148,16 @@ static void add_item(struct pw_spa_monitor *this, struct spa_monitor_item *item)
 	mitem = calloc(1, sizeof(struct monitor_item));
 	mitem->id = strdup(id);
 	mitem->handle = handle;
+	mitem->data_loop = data_loop;
 	mitem->node = pw_spa_node_new(impl->core, NULL, impl->parent, name,
 				      false, node_iface, clock_iface, props, 0);
 
 	spa_list_append(&impl->item_list, &mitem->link);
+	return;
+
+      error:
+	if (data_loop)
+		pw_core_release_data_loop(impl->core, data_loop);
 }
 
 static struct monitor_item *find_item(struct pw_spa_monitor *this, const char *id)
@@ -143,10 +175,14 @@ static struct monitor_item *find_item(struct pw_spa_monitor *this, const char *i
 
 void destroy_item(struct monitor_item *mitem)
 {
+	struct pw_core *core = pw_node_get_core(mitem->node);
+
 	pw_node_destroy(mitem->node);
 	spa_list_remove(&mitem->link);
 	spa_handle_clear(mitem->handle);
 	free(mitem->handle);
+	if (mitem->data_loop)
+		pw_core_release_data_loop(core, mitem->data_loop);
 	free(mitem->id);
 	free(mitem);
 }
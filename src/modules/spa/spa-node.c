@@ -170,6 +170,7 @@ pw_spa_node_new(struct pw_core *core,
 		return NULL;
 
 	this->clock = clock;
+	this->own_clock = clock;
 
 	impl = this->user_data;
 	impl->this = this;
@@ -299,7 +300,7 @@ struct pw_node *pw_spa_node_load(struct pw_core *core,
 			break;
 	}
 
-	support = pw_core_get_support(core, &n_support);
+	support = pw_core_get_node_support(core, properties, &n_support);
 
 	handle = calloc(1, factory->size);
 	if ((res = spa_handle_factory_init(factory,
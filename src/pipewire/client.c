@@ -194,6 +194,8 @@ void pw_client_destroy(struct pw_client *client)
 
 	pw_map_for_each(&client->objects, destroy_resource, client);
 
+	pw_link_forget_client_buffers(client->core, client);
+
 	spa_hook_list_call(&client->listener_list, struct pw_client_events, free);
 	pw_log_debug("client %p: free", impl);
 
@@ -73,7 +73,10 @@ struct pw_client;
  *
  * The client and server maintain a mapping between the client and server
  * types. All type ids that are in messages exchanged between the client
- * and server will automatically be remapped. See also \ref page_types.
+ * and server will automatically be remapped. When both sides registered
+ * their types with the same ids, which is the common case because they
+ * register the core types in the same order, the remapping is skipped.
+ * See also \ref page_types.
  *
  * \section sec_page_client_resources Resources
  *
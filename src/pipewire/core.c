@@ -18,11 +18,18 @@
  */
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <inttypes.h>
 #include <stdio.h>
 
 #include <spa/lib/debug.h>
+#include <spa/lib/format.h>
+#include <spa/lib/pod-arena.h>
 #include <spa/format-utils.h>
-#include <spa/graph-scheduler3.h>
 
 #include <pipewire/pipewire.h>
 #include <pipewire/private.h>
@@ -34,6 +41,7 @@
 /** \cond */
 struct resource_data {
 	struct spa_hook resource_listener;
+	uint32_t generation;		/**< last snapshot sent on a snapshot registry */
 };
 
 /** \endcond */
@@ -109,12 +117,12 @@ static void core_sync(void *object, uint32_t seq)
 	pw_core_resource_done(resource, seq);
 }
 
-static void core_get_registry(void *object, uint32_t version, uint32_t new_id)
+static struct pw_resource *
+new_registry_resource(struct pw_resource *resource, uint32_t version, uint32_t new_id,
+		      struct spa_list *list)
 {
-	struct pw_resource *resource = object;
 	struct pw_client *client = resource->client;
 	struct pw_core *this = resource->core;
-	struct pw_global *global;
 	struct pw_resource *registry_resource;
 	struct resource_data *data;
 
@@ -137,7 +145,29 @@ static void core_get_registry(void *object, uint32_t version, uint32_t new_id)
 				       &registry_methods,
 				       registry_resource);
 
-	spa_list_insert(this->registry_resource_list.prev, &registry_resource->link);
+	spa_list_insert(list->prev, &registry_resource->link);
+
+	return registry_resource;
+
+      no_mem:
+	pw_log_error("can't create registry resource");
+	pw_core_resource_error(client->core_resource,
+			       resource->id, SPA_RESULT_NO_MEMORY, "no memory");
+	return NULL;
+}
+
+static void core_get_registry(void *object, uint32_t version, uint32_t new_id)
+{
+	struct pw_resource *resource = object;
+	struct pw_client *client = resource->client;
+	struct pw_core *this = resource->core;
+	struct pw_global *global;
+	struct pw_resource *registry_resource;
+
+	registry_resource = new_registry_resource(resource, version, new_id,
+						  &this->registry_resource_list);
+	if (registry_resource == NULL)
+		return;
 
 	spa_list_for_each(global, &this->global_list, link) {
 		uint32_t permissions = pw_global_get_permissions(global, client);
@@ -150,13 +180,72 @@ static void core_get_registry(void *object, uint32_t version, uint32_t new_id)
 						    global->version);
 		}
 	}
+}
+
+static void core_get_registry_snapshot(void *object, uint32_t version, uint32_t new_id)
+{
+	struct pw_resource *resource = object;
+	struct pw_client *client = resource->client;
+	struct pw_core *this = resource->core;
+	struct pw_global *global;
+	struct pw_resource *registry_resource;
+	struct pw_registry_global *globals;
+	uint32_t n_globals = 0, max_globals = 0;
+
+	if (version < 1)
+		goto wrong_version;
+
+	registry_resource = new_registry_resource(resource, version, new_id,
+						  &this->registry_snapshot_list);
+	if (registry_resource == NULL)
+		return;
+
+	spa_list_for_each(global, &this->global_list, link)
+		max_globals++;
+
+	globals = malloc(max_globals * sizeof(struct pw_registry_global));
+	if (globals == NULL)
+		goto no_mem;
+
+	spa_list_for_each(global, &this->global_list, link) {
+		uint32_t permissions = pw_global_get_permissions(global, client);
+		if (PW_PERM_IS_R(permissions))
+			pw_global_get_registry_info(global, permissions, &globals[n_globals++]);
+	}
+
+	pw_core_registry_snapshot(registry_resource, PW_REGISTRY_SNAPSHOT_FLAG_FULL,
+				  n_globals, globals, 0, NULL);
+	free(globals);
 
 	return;
 
+      wrong_version:
+	pw_log_error("registry snapshots need registry version 1, not %u", version);
+	pw_core_resource_error(client->core_resource,
+			       resource->id, SPA_RESULT_INVALID_ARGUMENTS, "wrong version");
+	return;
       no_mem:
-	pw_log_error("can't create registry resource");
+	pw_log_error("can't create registry snapshot");
 	pw_core_resource_error(client->core_resource,
 			       resource->id, SPA_RESULT_NO_MEMORY, "no memory");
+	pw_resource_destroy(registry_resource);
+}
+
+/** Send a snapshot on a snapshot registry
+ *
+ * Each registry numbers the snapshots it sends, so that the client sees
+ * a gap in the generations only when it missed a snapshot.
+ *
+ * \memberof pw_core
+ */
+void pw_core_registry_snapshot(struct pw_resource *registry, uint32_t flags,
+			       uint32_t n_globals, const struct pw_registry_global *globals,
+			       uint32_t n_removed, const uint32_t *removed)
+{
+	struct resource_data *data = pw_resource_get_user_data(registry);
+
+	pw_registry_resource_snapshot(registry, ++data->generation, flags,
+				      n_globals, globals, n_removed, removed);
 }
 
 static void
@@ -240,10 +329,37 @@ static void core_update_types(void *object, uint32_t first_id, uint32_t n_types,
 	struct pw_client *client = resource->client;
 	int i;
 
+	/* the client skipped the reserved types and starts with the marker.
+	 * Clients built with other reserved types have their marker at
+	 * another id, they are refused as well */
+	if (pw_map_get_size(&client->types) == 0 &&
+	    (first_id == SPA_TYPE__TypeIds_ID ||
+	     (n_types > 0 && spa_type_is_ids_marker(types[0])))) {
+		if (first_id != SPA_TYPE__TypeIds_ID || n_types == 0 ||
+		    !spa_type_map_has_ids(this->type.map) ||
+		    strcmp(types[0], SPA_TYPE__TypeIds) != 0) {
+			/* we don't know the reserved types of the client, stop
+			 * reading its messages until it disconnects */
+			pw_log_error("client %p: reserved type ids differ from ours", client);
+			pw_core_resource_error(client->core_resource, resource->id,
+					       SPA_RESULT_INCOMPATIBLE_VERSION,
+					       "reserved type ids differ from the server");
+			pw_client_set_busy(client, true);
+			return;
+		}
+		for (i = 0; i < first_id; i++)
+			pw_map_insert_at(&client->types, i, PW_MAP_ID_TO_PTR(i));
+	}
+
 	for (i = 0; i < n_types; i++, first_id++) {
 		uint32_t this_id = spa_type_map_get_id(this->type.map, types[i]);
 		if (!pw_map_insert_at(&client->types, first_id, PW_MAP_ID_TO_PTR(this_id)))
 			pw_log_error("can't add type for client");
+		if (this_id != first_id && !client->remap_types) {
+			pw_log_debug("client %p: type %s has id %u, we have %u, enable remapping",
+				     client, types[i], first_id, this_id);
+			client->remap_types = true;
+		}
 	}
 }
 
@@ -254,7 +370,8 @@ static const struct pw_core_proxy_methods core_methods = {
 	.get_registry = core_get_registry,
 	.client_update = core_client_update,
 	.create_node = core_create_node,
-	.create_link = core_create_link
+	.create_link = core_create_link,
+	.get_registry_snapshot = core_get_registry_snapshot,
 };
 
 static void core_unbind_func(void *data)
@@ -269,6 +386,54 @@ static const struct pw_resource_events core_resource_events = {
 	.destroy = core_unbind_func,
 };
 
+static void add_histogram(struct pw_properties *props, const char *key,
+			  const struct spa_histogram *hist)
+{
+	struct spa_histogram h;
+	char buffer[1024], hkey[128];
+	int i, len = 0;
+
+	spa_histogram_read(hist, &h);
+
+	pw_properties_setf(props, key,
+			   "count=%" PRIu64 " avg=%.1fus p50=%.1fus p99=%.1fus max=%.1fus",
+			   h.count, h.count ? h.total / (h.count * 1000.0) : 0.0,
+			   spa_histogram_percentile(&h, 50) / 1000.0,
+			   spa_histogram_percentile(&h, 99) / 1000.0,
+			   h.max / 1000.0);
+
+	/* non-empty buckets as upper bound in nsec:count */
+	buffer[0] = '\0';
+	for (i = 0; i < SPA_HISTOGRAM_BUCKETS && len < sizeof(buffer); i++) {
+		if (h.buckets[i] == 0)
+			continue;
+		len += snprintf(buffer + len, sizeof(buffer) - len, "%s%" PRIu64 ":%" PRIu64,
+				len ? " " : "", (uint64_t) ((2ULL << i) - 1), h.buckets[i]);
+	}
+	snprintf(hkey, sizeof(hkey), "%s.histogram", key);
+	pw_properties_set(props, hkey, buffer);
+}
+
+/* snapshot of the loop statistics, as properties */
+static void add_loop_stats(struct pw_properties *props, const char *name, struct pw_loop *loop)
+{
+	const struct spa_loop_stats *stats;
+	char key[64];
+
+	if (loop->control->version < 1)
+		return;
+
+	stats = pw_loop_get_stats(loop);
+
+	snprintf(key, sizeof(key), "loop.%s.iterations", name);
+	pw_properties_setf(props, key, "%" PRIu64,
+			   __atomic_load_n(&stats->iterations, __ATOMIC_RELAXED));
+	snprintf(key, sizeof(key), "loop.%s.wakeup-latency", name);
+	add_histogram(props, key, &stats->wakeup_latency);
+	snprintf(key, sizeof(key), "loop.%s.dispatch-time", name);
+	add_histogram(props, key, &stats->dispatch_time);
+}
+
 static int
 core_bind_func(struct pw_global *global,
 	       struct pw_client *client,
@@ -279,6 +444,8 @@ core_bind_func(struct pw_global *global,
 	struct pw_core *this = global->object;
 	struct pw_resource *resource;
 	struct resource_data *data;
+	struct pw_core_info info;
+	struct pw_properties *props;
 
 	resource = pw_resource_new(client, id, permissions, global->type, version, sizeof(*data));
 	if (resource == NULL)
@@ -294,8 +461,27 @@ core_bind_func(struct pw_global *global,
 
 	pw_log_debug("core %p: bound to %d", this, resource->id);
 
-	this->info.change_mask = PW_CORE_CHANGE_MASK_ALL;
-	pw_core_resource_info(resource, &this->info);
+	/* the info of a new binding has the current loop statistics */
+	info = this->info;
+	info.change_mask = PW_CORE_CHANGE_MASK_ALL;
+	if ((props = pw_properties_copy(this->properties)) != NULL) {
+		struct pw_data_loop *l;
+
+		add_loop_stats(props, "main", this->main_loop);
+		spa_list_for_each(l, &this->data_loop_list, link) {
+			char name[64];
+			if (l == this->data_loop_impl)
+				snprintf(name, sizeof(name), "data");
+			else
+				snprintf(name, sizeof(name), "data.%s", l->name);
+			add_loop_stats(props, name, l->loop);
+		}
+		info.props = &props->dict;
+	}
+	pw_core_resource_info(resource, &info);
+
+	if (props)
+		pw_properties_free(props);
 
 	return SPA_RESULT_OK;
 
@@ -304,6 +490,157 @@ core_bind_func(struct pw_global *global,
 	return SPA_RESULT_NO_MEMORY;
 }
 
+static void add_data_loop(struct pw_core *core, struct pw_data_loop *data_loop)
+{
+	uint32_t i;
+
+	/* the nodes on the loop get it as their data loop */
+	for (i = 0; i < core->n_support; i++) {
+		if (strcmp(core->support[i].type, SPA_TYPE_LOOP__DataLoop) == 0)
+			data_loop->support[i] = SPA_SUPPORT_INIT(SPA_TYPE_LOOP__DataLoop,
+								 data_loop->loop->loop);
+		else
+			data_loop->support[i] = core->support[i];
+	}
+	data_loop->n_support = core->n_support;
+
+	spa_list_append(&core->data_loop_list, &data_loop->link);
+	pw_data_loop_start(data_loop);
+}
+
+/* open a new stats file, a file that another daemon doesn't hold the
+ * lock of was left behind by a daemon that didn't exit cleanly */
+static int open_stats_file(const char *path)
+{
+	int fd, retry;
+
+	for (retry = 0; retry < 2; retry++) {
+		fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+			  S_IRUSR | S_IWUSR);
+		if (fd >= 0) {
+			if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+				int res = -errno;
+				close(fd);
+				return res;
+			}
+			return fd;
+		}
+		if (errno != EEXIST || retry > 0)
+			return -errno;
+
+		if ((fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) >= 0) {
+			if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+				pw_log_error("stats %s in use, maybe another daemon is running", path);
+				close(fd);
+				return -EBUSY;
+			}
+			close(fd);
+		}
+		unlink(path);
+	}
+	return -EEXIST;
+}
+
+/* the node stats in a file in XDG_RUNTIME_DIR, only the user of the daemon
+ * can read it. The slots are given to the nodes when they are registered */
+static int create_stats(struct pw_core *core, const char *name)
+{
+	struct pw_stats_header *h;
+	size_t size = pw_stats_size(PW_STATS_MAX_NODES);
+	const char *runtime_dir;
+	char *path;
+	uint32_t i;
+	int fd, res;
+
+	if ((runtime_dir = getenv("XDG_RUNTIME_DIR")) == NULL) {
+		pw_log_error("XDG_RUNTIME_DIR not set in the environment");
+		return -ENOENT;
+	}
+	if (strchr(name, '/') != NULL)
+		return -EINVAL;
+
+	if (asprintf(&path, "%s/%s", runtime_dir, name) < 0)
+		return -ENOMEM;
+
+	if ((fd = open_stats_file(path)) < 0) {
+		free(path);
+		return fd;
+	}
+
+	if (ftruncate(fd, size) < 0 ||
+	    (h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		res = -errno;
+		unlink(path);
+		close(fd);
+		free(path);
+		return res;
+	}
+
+	h->version = PW_STATS_VERSION;
+	h->n_nodes = PW_STATS_MAX_NODES;
+	for (i = 0; i < PW_STATS_MAX_NODES; i++)
+		pw_stats_get_node(h, i)->id = SPA_ID_INVALID;
+	__atomic_store_n(&h->magic, PW_STATS_MAGIC, __ATOMIC_RELEASE);
+
+	core->stats = h;
+	core->stats_n_nodes = PW_STATS_MAX_NODES;
+	core->stats_path = path;
+	core->stats_fd = fd;
+
+	return SPA_RESULT_OK;
+}
+
+static void destroy_stats(struct pw_core *core)
+{
+	if (core->stats == NULL)
+		return;
+
+	unlink(core->stats_path);
+	munmap(core->stats, pw_stats_size(core->stats_n_nodes));
+	close(core->stats_fd);
+	free(core->stats_path);
+	core->stats = NULL;
+}
+
+static void set_node_stats_info(struct pw_node_stats *stats, uint32_t id, const char *name)
+{
+	__atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	stats->id = id;
+	snprintf(stats->name, sizeof(stats->name), "%s", name);
+
+	__atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELEASE);
+}
+
+struct pw_node_stats *pw_core_alloc_node_stats(struct pw_core *core, uint32_t id, const char *name)
+{
+	struct pw_node_stats *stats;
+	uint32_t i;
+
+	if (core->stats == NULL)
+		return NULL;
+
+	for (i = 0; i < core->stats_n_nodes; i++) {
+		stats = pw_stats_get_node(core->stats, i);
+		if (stats->id != SPA_ID_INVALID)
+			continue;
+
+		/* readers skip free slots, the counters can be cleared */
+		memset(&stats->cycle_start, 0,
+		       sizeof(*stats) - offsetof(struct pw_node_stats, cycle_start));
+		set_node_stats_info(stats, id, name);
+		return stats;
+	}
+	pw_log_warn("core %p: no free stats for node %s", core, name);
+	return NULL;
+}
+
+void pw_core_free_node_stats(struct pw_core *core, struct pw_node_stats *stats)
+{
+	set_node_stats_info(stats, SPA_ID_INVALID, "");
+}
+
 /** Create a new core object
  *
  * \param main_loop the main loop to use
@@ -315,7 +652,8 @@ core_bind_func(struct pw_global *global,
 struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *properties)
 {
 	struct pw_core *this;
-	const char *name;
+	const char *name, *str;
+	int res;
 
 	this = calloc(1, sizeof(struct pw_core));
 	if (this == NULL)
@@ -338,9 +676,6 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 	pw_type_init(&this->type);
 	pw_map_init(&this->globals, 128, 32);
 
-	spa_graph_init(&this->rt.graph);
-	spa_graph_set_callbacks(&this->rt.graph, &spa_graph_impl_default, NULL);
-
 	spa_debug_set_type_map(this->type.map);
 
 	this->support[0] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, this->type.map);
@@ -349,18 +684,21 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 	this->support[3] = SPA_SUPPORT_INIT(SPA_TYPE__Log, pw_log_get());
 	this->n_support = 4;
 
-	pw_data_loop_start(this->data_loop_impl);
+	spa_list_init(&this->data_loop_list);
+	add_data_loop(this, this->data_loop_impl);
 
 	spa_list_init(&this->protocol_list);
 	spa_list_init(&this->remote_list);
 	spa_list_init(&this->resource_list);
 	spa_list_init(&this->registry_resource_list);
+	spa_list_init(&this->registry_snapshot_list);
 	spa_list_init(&this->global_list);
 	spa_list_init(&this->module_list);
 	spa_list_init(&this->client_list);
 	spa_list_init(&this->node_list);
 	spa_list_init(&this->node_factory_list);
 	spa_list_init(&this->link_list);
+	spa_list_init(&this->buffer_pool);
 	spa_hook_list_init(&this->listener_list);
 
 	if ((name = pw_properties_get(properties, "pipewire.core.name")) == NULL) {
@@ -379,6 +717,10 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 	this->info.props = &properties->dict;
 	this->info.name = name;
 
+	if ((str = pw_properties_get(properties, "stats.shm")) != NULL &&
+	    (res = create_stats(this, str)) < 0)
+		pw_log_warn("core %p: can't create stats %s: %s", this, str, strerror(-res));
+
 	this->global = pw_core_add_global(this,
 					  NULL,
 					  NULL,
@@ -404,6 +746,8 @@ void pw_core_destroy(struct pw_core *core)
 {
 	struct pw_global *global, *t;
 	struct pw_module *module, *tm;
+	struct pw_data_loop *data_loop, *tdl;
+	int i;
 
 	pw_log_debug("core %p: destroy", core);
 	spa_hook_list_call(&core->listener_list, struct pw_core_events, destroy);
@@ -416,12 +760,22 @@ void pw_core_destroy(struct pw_core *core)
 
 	spa_hook_list_call(&core->listener_list, struct pw_core_events, free);
 
-	pw_data_loop_destroy(core->data_loop_impl);
+	pw_link_trim_buffers(core);
+	if (core->buffer_pool_timer)
+		pw_loop_destroy_source(core->main_loop, core->buffer_pool_timer);
+
+	spa_list_for_each_safe(data_loop, tdl, &core->data_loop_list, link)
+		pw_data_loop_destroy(data_loop);
 
 	pw_properties_free(core->properties);
 
 	pw_map_clear(&core->globals);
 
+	for (i = 0; i < PW_FORMAT_MEMO_SIZE; i++)
+		free(core->format_memo[i].format);
+
+	destroy_stats(core);
+
 	pw_log_debug("core %p: free", core);
 	free(core);
 }
@@ -463,6 +817,144 @@ const struct spa_support *pw_core_get_support(struct pw_core *core, uint32_t *n_
 	return core->support;
 }
 
+static struct pw_data_loop *find_data_loop(struct pw_core *core, const char *name)
+{
+	struct pw_data_loop *data_loop;
+
+	spa_list_for_each(data_loop, &core->data_loop_list, link) {
+		if (strcmp(data_loop->name, name) == 0)
+			return data_loop;
+	}
+	return NULL;
+}
+
+/* find the data loop with name or make and start a new one */
+static struct pw_data_loop *ensure_data_loop(struct pw_core *core, const char *name)
+{
+	struct pw_data_loop *data_loop;
+	struct pw_properties *props;
+
+	if (name == NULL)
+		return core->data_loop_impl;
+
+	if ((data_loop = find_data_loop(core, name)) != NULL)
+		return data_loop;
+
+	if ((props = pw_properties_copy(core->properties)) == NULL)
+		return NULL;
+	pw_properties_set(props, "data-loop.name", name);
+	data_loop = pw_data_loop_new(props);
+	pw_properties_free(props);
+
+	if (data_loop == NULL)
+		return NULL;
+
+	pw_log_debug("core %p: new data loop %s %p", core, name, data_loop);
+	add_data_loop(core, data_loop);
+
+	return data_loop;
+}
+
+/** Get a data loop
+ * \param core a core
+ * \param name the name of the data loop or NULL for the default loop
+ * \return the data loop with \a name or NULL on error
+ *
+ * When there is no data loop with \a name yet, a new one is made and
+ * started. Its settings are the data-loop.<name>.<key> properties of the
+ * core, with the data-loop.<key> properties as the fallback, see
+ * \ref pw_data_loop_new.
+ *
+ * The caller gets a reference on the loop, release it with
+ * \ref pw_core_release_data_loop.
+ *
+ * \memberof pw_core
+ */
+struct pw_data_loop *pw_core_get_data_loop(struct pw_core *core, const char *name)
+{
+	struct pw_data_loop *data_loop;
+
+	if ((data_loop = ensure_data_loop(core, name)) != NULL)
+		data_loop->refcount++;
+
+	return data_loop;
+}
+
+/** Release a data loop
+ * \param core a core
+ * \param data_loop a data loop from \ref pw_core_get_data_loop
+ *
+ * A data loop other than the default one is stopped and destroyed when
+ * its last reference is released.
+ *
+ * \memberof pw_core
+ */
+void pw_core_release_data_loop(struct pw_core *core, struct pw_data_loop *data_loop)
+{
+	if (--data_loop->refcount > 0 || data_loop == core->data_loop_impl)
+		return;
+
+	pw_log_debug("core %p: destroy unused data loop %s %p", core, data_loop->name, data_loop);
+	spa_list_remove(&data_loop->link);
+	pw_data_loop_destroy(data_loop);
+}
+
+/** Check if a data loop can be used by name
+ * \param core a core
+ * \param name the name of a data loop
+ * \return true when the loop exists or has data-loop.<name>.<key>
+ *	properties in the core
+ *
+ * \memberof pw_core
+ */
+bool pw_core_has_data_loop(struct pw_core *core, const char *name)
+{
+	const struct spa_dict *dict = &core->properties->dict;
+	char prefix[256];
+	size_t len;
+	uint32_t i;
+
+	if (find_data_loop(core, name) != NULL)
+		return true;
+
+	len = snprintf(prefix, sizeof(prefix), "data-loop.%s.", name);
+	if (len >= sizeof(prefix))
+		return false;
+
+	for (i = 0; i < dict->n_items; i++) {
+		if (strncmp(dict->items[i].key, prefix, len) == 0)
+			return true;
+	}
+	return false;
+}
+
+/** Get the support for a node
+ * \param core a core
+ * \param properties the node properties or NULL
+ * \param[out] n_support the number of support items
+ * \return the support items for a node with \a properties
+ *
+ * This is like \ref pw_core_get_support but the data loop is the one
+ * named with the node.data-loop property. The node made with these
+ * properties keeps the loop alive.
+ *
+ * \memberof pw_core
+ */
+const struct spa_support *
+pw_core_get_node_support(struct pw_core *core, const struct pw_properties *properties,
+			 uint32_t *n_support)
+{
+	struct pw_data_loop *data_loop;
+
+	data_loop = ensure_data_loop(core,
+			properties ? pw_properties_get(properties, "node.data-loop") : NULL);
+	if (data_loop == NULL)
+		data_loop = core->data_loop_impl;
+
+	*n_support = data_loop->n_support;
+	return data_loop->support;
+}
+
 struct pw_loop *pw_core_get_main_loop(struct pw_core *core)
 {
 	return core->main_loop;
@@ -600,6 +1092,103 @@ struct pw_port *pw_core_find_port(struct pw_core *core,
 	return best;
 }
 
+static inline struct pw_format_memo *
+find_format_memo(struct pw_core *core, uint32_t output_generation, uint32_t input_generation)
+{
+	uint32_t hash = output_generation * 0x9e3779b1u ^ input_generation;
+	return &core->format_memo[(hash ^ (hash >> 16)) & (PW_FORMAT_MEMO_SIZE - 1)];
+}
+
+/* intersect the cached formats of the ports, the first output format that
+ * matches an input format, in the order of the input formats, is used */
+static struct spa_format *
+find_common_format(struct pw_core *core,
+		   struct pw_port *output,
+		   struct pw_port *input,
+		   char **error)
+{
+	struct pw_format_memo *memo;
+	struct spa_pod_arena *arena;
+	struct spa_pod_builder *b;
+	struct spa_format *format = NULL, *iformat, *oformat;
+	int i, o, n_input, n_output, res;
+
+	if ((n_input = pw_port_cache_formats(input)) < 0) {
+		asprintf(error, "error input enum formats: %d", n_input);
+		return NULL;
+	}
+	if ((n_output = pw_port_cache_formats(output)) < 0) {
+		asprintf(error, "error output enum formats: %d", n_output);
+		return NULL;
+	}
+
+	memo = find_format_memo(core, output->format_cache.generation,
+				input->format_cache.generation);
+	if (memo->output_generation == output->format_cache.generation &&
+	    memo->input_generation == input->format_cache.generation) {
+		pw_log_debug("core %p: negotiated format %p from memo", core, memo->format);
+		if (memo->format == NULL)
+			asprintf(error, "no common format");
+		return memo->format;
+	}
+
+	if ((arena = spa_pod_arena_get_thread()) == NULL ||
+	    (b = spa_pod_arena_begin(arena)) == NULL) {
+		asprintf(error, "error filter formats: no arena");
+		return NULL;
+	}
+
+	iformat = input->format_cache.data.data;
+	for (i = 0; i < n_input && format == NULL; i++) {
+		pw_log_debug("core %p: input format %d", core, i);
+		if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
+			spa_debug_format(iformat);
+
+		oformat = output->format_cache.data.data;
+		for (o = 0; o < n_output; o++) {
+			b->offset = 0;
+			b->stack = NULL;
+			if (spa_format_filter(oformat, iformat, b) == SPA_RESULT_OK &&
+			    !spa_pod_builder_overflow(b)) {
+				format = b->data;
+				break;
+			}
+			oformat = SPA_MEMBER(oformat, SPA_ROUND_UP_N(SPA_POD_SIZE(oformat), 8),
+					     struct spa_format);
+		}
+		iformat = SPA_MEMBER(iformat, SPA_ROUND_UP_N(SPA_POD_SIZE(iformat), 8),
+				     struct spa_format);
+	}
+	/* without input formats, the first output format is used */
+	if (n_input == 0 && n_output > 0)
+		format = output->format_cache.data.data;
+
+	if (format)
+		format = spa_format_copy(format);
+
+	if ((res = spa_pod_arena_end(arena)) < 0) {
+		asprintf(error, "error filter formats: %d", res);
+		free(format);
+		return NULL;
+	}
+
+	if (format) {
+		pw_log_debug("Got filtered:");
+		if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
+			spa_debug_format(format);
+		spa_format_fixate(format);
+	} else {
+		asprintf(error, "no common format");
+	}
+
+	free(memo->format);
+	memo->output_generation = output->format_cache.generation;
+	memo->input_generation = input->format_cache.generation;
+	memo->format = format;
+
+	return format;
+}
+
 /** Find a common format between two ports
  *
  * \param core a core object
@@ -614,6 +1203,11 @@ struct pw_port *pw_core_find_port(struct pw_core *core,
  * Find a common format between the given ports. The format will
  * be restricted to a subset given with the format filters.
  *
+ * When both ports need a format, the cached formats of the ports are
+ * intersected and the result is remembered for the pair of ports until
+ * the formats of one of them change. The returned format is then owned
+ * by the core and should be copied.
+ *
  * \memberof pw_core
  */
 struct spa_format *pw_core_find_format(struct pw_core *core,
@@ -626,8 +1220,7 @@ struct spa_format *pw_core_find_format(struct pw_core *core,
 {
 	uint32_t out_state, in_state;
 	int res;
-	struct spa_format *filter = NULL, *format;
-	uint32_t iidx = 0, oidx = 0;
+	struct spa_format *format;
 
 	out_state = output->state;
 	in_state = input->state;
@@ -655,35 +1248,9 @@ struct spa_format *pw_core_find_format(struct pw_core *core,
 			goto error;
 		}
 	} else if (in_state == PW_PORT_STATE_CONFIGURE && out_state == PW_PORT_STATE_CONFIGURE) {
-	      again:
 		/* both ports need a format */
-		pw_log_debug("core %p: do enum input %d", core, iidx);
-		if ((res = spa_node_port_enum_formats(input->node->node, input->direction, input->port_id,
-						      &filter, NULL, iidx)) < 0) {
-			if (res == SPA_RESULT_ENUM_END && iidx != 0) {
-				asprintf(error, "error input enum formats: %d", res);
-				goto error;
-			}
-		}
-		pw_log_debug("enum output %d with filter: %p", oidx, filter);
-		if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
-			spa_debug_format(filter);
-
-		if ((res = spa_node_port_enum_formats(output->node->node, output->direction, output->port_id,
-						      &format, filter, oidx)) < 0) {
-			if (res == SPA_RESULT_ENUM_END) {
-				oidx = 0;
-				iidx++;
-				goto again;
-			}
-			asprintf(error, "error output enum formats: %d", res);
+		if ((format = find_common_format(core, output, input, error)) == NULL)
 			goto error;
-		}
-		pw_log_debug("Got filtered:");
-		if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
-			spa_debug_format(format);
-
-		spa_format_fixate(format);
 	} else {
 		asprintf(error, "error node state");
 		goto error;
@@ -39,6 +39,7 @@ extern "C" {
 struct pw_core;
 
 #include <pipewire/client.h>
+#include <pipewire/data-loop.h>
 #include <pipewire/global.h>
 #include <pipewire/introspect.h>
 #include <pipewire/loop.h>
@@ -152,6 +153,16 @@ const struct pw_properties *pw_core_get_properties(struct pw_core *core);
 
 const struct spa_support *pw_core_get_support(struct pw_core *core, uint32_t *n_support);
 
+struct pw_data_loop *pw_core_get_data_loop(struct pw_core *core, const char *name);
+
+void pw_core_release_data_loop(struct pw_core *core, struct pw_data_loop *data_loop);
+
+bool pw_core_has_data_loop(struct pw_core *core, const char *name);
+
+const struct spa_support *
+pw_core_get_node_support(struct pw_core *core, const struct pw_properties *properties,
+			 uint32_t *n_support);
+
 struct pw_loop *pw_core_get_main_loop(struct pw_core *core);
 
 void pw_core_update_properties(struct pw_core *core, const struct spa_dict *dict);
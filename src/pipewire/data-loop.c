@@ -19,56 +19,454 @@
 
 #include <pthread.h>
 #include <errno.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <dirent.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <sched.h>
+#include <unistd.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <spa/graph-scheduler3.h>
 
 #include "pipewire/log.h"
 #include "pipewire/rtkit.h"
 #include "pipewire/data-loop.h"
 #include "pipewire/private.h"
+#include "pipewire/rt-check.h"
+
+/* only set when libpipewire-rt-check is loaded */
+#pragma weak pw_rt_check_enter
+#pragma weak pw_rt_check_leave
+
+/** \cond */
+#define DEFAULT_POLICY		SCHED_FIFO
+#define DEFAULT_PRIORITY	20
+#define DEFAULT_RTTIME		20000
+
+#define MAX_WATCHDOG		16
+
+/* The RLIMIT_RTTIME soft limit raises SIGXCPU for the whole process, we
+ * can't tell which thread overran so all registered data loop threads are
+ * demoted to SCHED_OTHER. The loops report this when they run again. */
+static struct {
+	pid_t tid;
+	int fired;
+} watchdogs[MAX_WATCHDOG];
+static pthread_mutex_t watchdog_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sigaction watchdog_old_action;
+static int watchdog_users;
+/** \endcond */
+
+static pid_t get_tid(void)
+{
+	return syscall(SYS_gettid);
+}
 
-static void make_realtime(struct pw_data_loop *this)
+static void watchdog_handler(int sig)
 {
-	struct sched_param sp;
-	struct pw_rtkit_bus *system_bus;
-	struct rlimit rl;
-	int r, rtprio;
-	long long rttime;
+	struct sched_param sp = { 0 };
+	int i;
+
+	for (i = 0; i < MAX_WATCHDOG; i++) {
+		pid_t tid = __atomic_load_n(&watchdogs[i].tid, __ATOMIC_ACQUIRE);
+		if (tid == 0)
+			continue;
+		if (sched_setscheduler(tid, SCHED_OTHER, &sp) == 0)
+			__atomic_store_n(&watchdogs[i].fired, 1, __ATOMIC_RELEASE);
+	}
+}
 
-	rtprio = 20;
-	rttime = 20000;
+static int watchdog_register(pid_t tid)
+{
+	int i, slot = -1;
+
+	pthread_mutex_lock(&watchdog_lock);
+	for (i = 0; i < MAX_WATCHDOG; i++) {
+		if (watchdogs[i].tid == 0) {
+			watchdogs[i].fired = 0;
+			__atomic_store_n(&watchdogs[i].tid, tid, __ATOMIC_RELEASE);
+			slot = i;
+			break;
+		}
+	}
+	if (slot >= 0 && watchdog_users++ == 0) {
+		struct sigaction sa;
+
+		spa_zero(sa);
+		sa.sa_handler = watchdog_handler;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGXCPU, &sa, &watchdog_old_action);
+	}
+	pthread_mutex_unlock(&watchdog_lock);
 
-	spa_zero(sp);
-	sp.sched_priority = rtprio;
+	return slot;
+}
 
-	if (pthread_setschedparam(pthread_self(), SCHED_OTHER | SCHED_RESET_ON_FORK, &sp) == 0) {
-		pw_log_debug("SCHED_OTHER|SCHED_RESET_ON_FORK worked.");
+static void watchdog_unregister(int slot)
+{
+	if (slot < 0)
 		return;
+
+	pthread_mutex_lock(&watchdog_lock);
+	__atomic_store_n(&watchdogs[slot].tid, 0, __ATOMIC_RELEASE);
+	if (--watchdog_users == 0)
+		sigaction(SIGXCPU, &watchdog_old_action, NULL);
+	pthread_mutex_unlock(&watchdog_lock);
+}
+
+static bool watchdog_fired(int slot)
+{
+	if (slot < 0)
+		return false;
+	return __atomic_exchange_n(&watchdogs[slot].fired, 0, __ATOMIC_ACQ_REL) != 0;
+}
+
+static bool is_watchdog_tid(pid_t tid)
+{
+	int i;
+	for (i = 0; i < MAX_WATCHDOG; i++)
+		if (__atomic_load_n(&watchdogs[i].tid, __ATOMIC_ACQUIRE) == tid)
+			return true;
+	return false;
+}
+
+/* parse a cpu list like "1,3-5" */
+static int parse_cpus(const char *str, cpu_set_t *set)
+{
+	const char *p = str;
+	char *end;
+	long a, b;
+	int count = 0;
+
+	CPU_ZERO(set);
+
+	while (*p) {
+		a = strtol(p, &end, 10);
+		if (end == p || a < 0)
+			return -1;
+		b = a;
+		p = end;
+		if (*p == '-') {
+			p++;
+			b = strtol(p, &end, 10);
+			if (end == p || b < a)
+				return -1;
+			p = end;
+		}
+		if (b >= CPU_SETSIZE)
+			return -1;
+		for (; a <= b; a++, count++)
+			CPU_SET(a, set);
+		if (*p == ',')
+			p++;
+		else if (*p != '\0')
+			return -1;
+	}
+	return count;
+}
+
+/* parse a size in bytes with an optional k or M suffix */
+static size_t parse_size(const char *str)
+{
+	char *end;
+	unsigned long long val = strtoull(str, &end, 0);
+
+	if (*end == 'k' || *end == 'K')
+		val <<= 10;
+	else if (*end == 'm' || *end == 'M')
+		val <<= 20;
+	return val;
+}
+
+static bool parse_bool(const char *str)
+{
+	return strcmp(str, "true") == 0 || atoi(str) == 1;
+}
+
+/* a setting for this loop, data-loop.<name>.<key> overrides data-loop.<key> */
+static const char *get_setting(struct pw_data_loop *this, struct pw_properties *properties,
+			       const char *key)
+{
+	char name[256];
+	const char *str;
+
+	snprintf(name, sizeof(name), "data-loop.%s.%s", this->name, key);
+	if ((str = pw_properties_get(properties, name)))
+		return str;
+
+	snprintf(name, sizeof(name), "data-loop.%s", key);
+	return pw_properties_get(properties, name);
+}
+
+static void parse_rt_properties(struct pw_data_loop *this, struct pw_properties *properties)
+{
+	const char *str;
+
+	this->rt.policy = DEFAULT_POLICY;
+	this->rt.priority = DEFAULT_PRIORITY;
+	this->rt.rttime = DEFAULT_RTTIME;
+	this->rt.watchdog = -1;
+
+	if (properties == NULL)
+		return;
+
+	if ((str = get_setting(this, properties, "rt.policy"))) {
+		if (strcmp(str, "rr") == 0)
+			this->rt.policy = SCHED_RR;
+		else if (strcmp(str, "fifo") == 0)
+			this->rt.policy = SCHED_FIFO;
+		else
+			pw_log_warn("data-loop %p: unknown policy %s, using fifo", this, str);
+	}
+	if ((str = get_setting(this, properties, "rt.priority")))
+		this->rt.priority = atoi(str);
+	if ((str = get_setting(this, properties, "rt.rttime")))
+		this->rt.rttime = strtoll(str, NULL, 0);
+	if ((str = get_setting(this, properties, "cpus")))
+		this->rt.cpus = strdup(str);
+	if ((str = get_setting(this, properties, "isolate")))
+		this->rt.isolate = parse_bool(str);
+	if ((str = get_setting(this, properties, "mlock")))
+		this->rt.mlock = parse_bool(str);
+	if ((str = get_setting(this, properties, "prefault.stack")))
+		this->rt.prefault_stack = parse_size(str);
+	if ((str = get_setting(this, properties, "prefault.heap")))
+		this->rt.prefault_heap = parse_size(str);
+}
+
+/* move all other threads of the process off the data loop cpus and
+ * check that the kernel keeps the scheduler and timers away as well.
+ * Returns the number of threads moved or a negative errno, failures
+ * are logged here. */
+static int isolate_cpus(struct pw_data_loop *this, const cpu_set_t *cpus)
+{
+	cpu_set_t others;
+	DIR *dir;
+	struct dirent *e;
+	pid_t self = get_tid();
+	char buf[1024];
+	FILE *f;
+	int i, n_cpus, moved = 0;
+
+	n_cpus = SPA_MIN(sysconf(_SC_NPROCESSORS_CONF), CPU_SETSIZE);
+	CPU_ZERO(&others);
+	for (i = 0; i < n_cpus; i++)
+		if (!CPU_ISSET(i, cpus))
+			CPU_SET(i, &others);
+
+	if (CPU_COUNT(&others) == 0) {
+		pw_log_warn("data-loop %p: no cpus left for the other threads", this);
+		return -EINVAL;
+	}
+
+	if ((dir = opendir("/proc/self/task")) == NULL) {
+		int res = -errno;
+		pw_log_warn("data-loop %p: can't list threads: %s", this, strerror(-res));
+		return res;
+	}
+
+	while ((e = readdir(dir))) {
+		pid_t tid = atoi(e->d_name);
+		if (tid <= 0 || tid == self || is_watchdog_tid(tid))
+			continue;
+		if (sched_setaffinity(tid, sizeof(others), &others) < 0) {
+			pw_log_warn("data-loop %p: can't move thread %d: %s", this, tid,
+				    strerror(errno));
+		} else
+			moved++;
+	}
+	closedir(dir);
+
+	if ((f = fopen("/sys/devices/system/cpu/isolated", "r"))) {
+		cpu_set_t isolated;
+
+		if (fgets(buf, sizeof(buf), f) == NULL)
+			buf[0] = '\0';
+		pw_strip(buf, "\n\r \t");
+		if (parse_cpus(buf, &isolated) >= 0) {
+			for (i = 0; i < CPU_SETSIZE; i++) {
+				if (CPU_ISSET(i, cpus) && !CPU_ISSET(i, &isolated))
+					pw_log_warn("data-loop %p: cpu %d is not isolated by the kernel "
+						    "(isolcpus=)", this, i);
+			}
+		}
+		fclose(f);
+	}
+	return moved;
+}
+
+static size_t __attribute__((noinline)) prefault_stack(size_t size)
+{
+	pthread_attr_t attr;
+	size_t stacksize, page = sysconf(_SC_PAGESIZE), i;
+	volatile char *p;
+
+	/* leave half of the stack for the frames above and below us */
+	if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+		if (pthread_attr_getstacksize(&attr, &stacksize) == 0)
+			size = SPA_MIN(size, stacksize / 2);
+		pthread_attr_destroy(&attr);
 	}
-	system_bus = pw_rtkit_bus_get_system();
+	p = alloca(size);
+	for (i = 0; i < size; i += page)
+		p[i] = 0;
+
+	return size;
+}
+
+static size_t prefault_heap(size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE), i;
+	volatile char *p;
+
+	/* keep freed memory in the arena, don't return it to the kernel
+	 * and don't serve large blocks with separate mmaps */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	if ((p = malloc(size)) == NULL)
+		return 0;
+	for (i = 0; i < size; i += page)
+		p[i] = 0;
+	free((void *) p);
+
+	return size;
+}
+
+static int set_rttime(struct pw_data_loop *this)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_RTTIME, &rl) < 0)
+		return -errno;
+
+	/* the soft limit raises SIGXCPU for the watchdog, the hard limit
+	 * kills the process if the watchdog could not demote the thread */
+	rl.rlim_cur = this->rt.rttime;
+	if (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > (rlim_t) this->rt.rttime * 2)
+		rl.rlim_max = this->rt.rttime * 2;
+	if (rl.rlim_cur > rl.rlim_max)
+		rl.rlim_cur = rl.rlim_max;
+
+	if (setrlimit(RLIMIT_RTTIME, &rl) < 0)
+		return -errno;
 
-	rl.rlim_cur = rl.rlim_max = rttime;
-	if ((r = setrlimit(RLIMIT_RTTIME, &rl)) < 0)
-		pw_log_debug("setrlimit() failed: %s", strerror(errno));
+	return rl.rlim_cur;
+}
 
-	if (rttime >= 0) {
-		r = getrlimit(RLIMIT_RTTIME, &rl);
-		if (r >= 0 && (long long) rl.rlim_max > rttime) {
-			pw_log_debug("Clamping rlimit-rttime to %lld for RealtimeKit", rttime);
-			rl.rlim_cur = rl.rlim_max = rttime;
+static const char *policy_name(int policy)
+{
+	switch (policy & ~SCHED_RESET_ON_FORK) {
+	case SCHED_FIFO:
+		return "SCHED_FIFO";
+	case SCHED_RR:
+		return "SCHED_RR";
+	case SCHED_OTHER:
+		return "SCHED_OTHER";
+	default:
+		return "unknown";
+	}
+}
 
-			if ((r = setrlimit(RLIMIT_RTTIME, &rl)) < 0)
-				pw_log_debug("setrlimit() failed: %s", strerror(errno));
+static void make_realtime(struct pw_data_loop *this)
+{
+	struct sched_param sp;
+	struct pw_rtkit_bus *system_bus;
+	cpu_set_t cpus;
+	char report[512];
+	size_t len = 0;
+	int r, policy;
+
+#define REPORT(...)	len += snprintf(report + len, len < sizeof(report) ? sizeof(report) - len : 0, __VA_ARGS__)
+	report[0] = '\0';
+
+	if (this->rt.cpus) {
+		if (parse_cpus(this->rt.cpus, &cpus) <= 0) {
+			pw_log_warn("data-loop %p: invalid cpu list '%s'", this, this->rt.cpus);
+		} else if ((r = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) != 0) {
+			pw_log_warn("data-loop %p: can't set affinity to %s: %s", this,
+				    this->rt.cpus, strerror(r));
+		} else {
+			REPORT(" cpus=%s", this->rt.cpus);
+			if (this->rt.isolate) {
+				if ((r = isolate_cpus(this, &cpus)) >= 0)
+					REPORT(" isolated(%d threads moved)", r);
+			}
 		}
 	}
 
-	if ((r = pw_rtkit_make_realtime(system_bus, 0, rtprio)) < 0) {
-		pw_log_debug("could not make thread realtime: %s", strerror(r));
+	if (this->rt.rttime > 0) {
+		if ((r = set_rttime(this)) < 0) {
+			pw_log_warn("data-loop %p: can't set RLIMIT_RTTIME: %s", this,
+				    strerror(-r));
+		} else if ((this->rt.watchdog = watchdog_register(get_tid())) < 0) {
+			pw_log_warn("data-loop %p: no free watchdog slot", this);
+		} else {
+			REPORT(" watchdog=%dus", r);
+		}
+	}
+
+	spa_zero(sp);
+	sp.sched_priority = this->rt.priority;
+
+	if ((r = pthread_setschedparam(pthread_self(),
+				       this->rt.policy | SCHED_RESET_ON_FORK, &sp)) == 0) {
+		REPORT(" %s:%d", policy_name(this->rt.policy), this->rt.priority);
 	} else {
-		pw_log_debug("thread made realtime");
+		pw_log_debug("data-loop %p: %s failed: %s, trying RTKit", this,
+			     policy_name(this->rt.policy), strerror(r));
+
+		if ((system_bus = pw_rtkit_bus_get_system()) == NULL) {
+			r = -ENOTCONN;
+		} else {
+			r = pw_rtkit_make_realtime(system_bus, 0, this->rt.priority);
+			pw_rtkit_bus_free(system_bus);
+		}
+		if (r < 0) {
+			pw_log_warn("data-loop %p: could not make thread realtime: %s", this,
+				    strerror(-r));
+		} else if (pthread_getschedparam(pthread_self(), &policy, &sp) == 0)
+			REPORT(" %s:%d(rtkit)", policy_name(policy), sp.sched_priority);
 	}
-	pw_rtkit_bus_free(system_bus);
+
+	if (this->rt.mlock) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+			pw_log_warn("data-loop %p: mlockall failed: %s", this, strerror(errno));
+		} else
+			REPORT(" mlock");
+	}
+	if (this->rt.prefault_stack > 0)
+		REPORT(" stack=%zu", prefault_stack(this->rt.prefault_stack));
+	if (this->rt.prefault_heap > 0)
+		REPORT(" heap=%zu", prefault_heap(this->rt.prefault_heap));
+#undef REPORT
+
+	pw_log_info("data-loop %p: %s realtime:%s", this, this->name, len ? report : " none");
+}
+
+/* the thread is realtime while it dispatches, not while it waits */
+static void check_before(void *data)
+{
+	pw_rt_check_leave();
+}
+
+static void check_after(void *data)
+{
+	pw_rt_check_enter();
 }
 
+static const struct spa_loop_control_hooks check_hooks = {
+	SPA_VERSION_LOOP_CONTROL_HOOKS,
+	.before = check_before,
+	.after = check_after,
+};
+
 static void *do_loop(void *user_data)
 {
 	struct pw_data_loop *this = user_data;
@@ -76,20 +474,59 @@ static void *do_loop(void *user_data)
 
 	make_realtime(this);
 
+	if (pw_rt_check_enter != NULL) {
+		pw_log_info("data-loop %p: checking realtime violations", this);
+		pw_loop_add_hook(this->loop, &this->rt.check_hook, &check_hooks, this);
+	}
+
 	pw_log_debug("data-loop %p: enter thread", this);
 	pw_loop_enter(this->loop);
 
 	while (this->running) {
 		if ((res = pw_loop_iterate(this->loop, -1)) < 0)
 			pw_log_warn("data-loop %p: iterate error %d", this, res);
+		if (watchdog_fired(this->rt.watchdog))
+			pw_log_error("data-loop %p: realtime time limit of %" PRIi64 "us exceeded, "
+				     "thread demoted to SCHED_OTHER", this, this->rt.rttime);
 	}
 	pw_log_debug("data-loop %p: leave thread", this);
 	pw_loop_leave(this->loop);
 
+	if (pw_rt_check_enter != NULL) {
+		spa_hook_remove(&this->rt.check_hook);
+		pw_rt_check_leave();
+	}
+
+	watchdog_unregister(this->rt.watchdog);
+	this->rt.watchdog = -1;
+
 	return NULL;
 }
 
 
+static int
+do_port_ready(struct spa_loop *loop,
+	      bool async, uint32_t seq, size_t size, const void *data, void *user_data)
+{
+	return spa_graph_impl_port_ready(NULL, user_data);
+}
+
+/* a node on another loop made one of our ports ready. Hand the port over
+ * with the lock-free invoke queue of this loop so it is processed here. */
+static int graph_port_ready(void *data, struct spa_graph_port *port)
+{
+	struct pw_data_loop *this = data;
+
+	return pw_loop_invoke(this->loop, do_port_ready, SPA_ID_INVALID, 0, NULL, false, port);
+}
+
+static const struct spa_graph_callbacks graph_callbacks = {
+	SPA_VERSION_GRAPH_CALLBACKS,
+	.need_input = spa_graph_impl_need_input,
+	.have_output = spa_graph_impl_have_output,
+	.port_ready = graph_port_ready,
+};
+
 static void do_stop(void *data, uint64_t count)
 {
 	struct pw_data_loop *this = data;
@@ -97,19 +534,47 @@ static void do_stop(void *data, uint64_t count)
 }
 
 /** Create a new \ref pw_data_loop.
+ * \param properties extra properties or NULL
  * \return a newly allocated data loop
  *
+ * The loop is named with the data-loop.name property, "default" when
+ * not set. The realtime behaviour of the thread is configured with the
+ * properties below. A data-loop.<name>.<key> property overrides the
+ * data-loop.<key> property for the loop with that name.
+ *
+ * - data-loop.rt.policy: "fifo" (default) or "rr"
+ * - data-loop.rt.priority: realtime priority, default 20
+ * - data-loop.rt.rttime: RLIMIT_RTTIME watchdog in usec, default 20000,
+ *   0 disables. A thread that runs longer without blocking is demoted
+ *   to SCHED_OTHER.
+ * - data-loop.cpus: cpu list for the thread, like "2,3" or "2-3"
+ * - data-loop.isolate: move all other threads off data-loop.cpus
+ * - data-loop.mlock: lock all current and future memory with mlockall
+ * - data-loop.prefault.stack: bytes of thread stack to prefault, k and M
+ *   suffixes are allowed
+ * - data-loop.prefault.heap: bytes of heap to prefault and keep
+ *
+ * When the policy can't be set directly, RTKit is used. The settings that
+ * were applied are logged when the thread starts.
+ *
  * \memberof pw_data_loop
  */
 struct pw_data_loop *pw_data_loop_new(struct pw_properties *properties)
 {
 	struct pw_data_loop *this;
+	const char *name;
 
 	this = calloc(1, sizeof(struct pw_data_loop));
 	if (this == NULL)
 		return NULL;
 
-	pw_log_debug("data-loop %p: new", this);
+	if (properties == NULL || (name = pw_properties_get(properties, "data-loop.name")) == NULL)
+		name = "default";
+	this->name = strdup(name);
+
+	pw_log_debug("data-loop %p: new %s", this, this->name);
+
+	parse_rt_properties(this, properties);
 
 	this->loop = pw_loop_new(properties);
 	if (this->loop == NULL)
@@ -117,11 +582,16 @@ struct pw_data_loop *pw_data_loop_new(struct pw_properties *properties)
 
 	spa_hook_list_init(&this->listener_list);
 
+	spa_graph_init(&this->graph);
+	spa_graph_set_callbacks(&this->graph, &graph_callbacks, this);
+
 	this->event = pw_loop_add_event(this->loop, do_stop, this);
 
 	return this;
 
       no_loop:
+	free(this->rt.cpus);
+	free(this->name);
 	free(this);
 	return NULL;
 }
@@ -140,6 +610,8 @@ void pw_data_loop_destroy(struct pw_data_loop *loop)
 
 	pw_loop_destroy_source(loop->loop, loop->event);
 	pw_loop_destroy(loop->loop);
+	free(loop->rt.cpus);
+	free(loop->name);
 	free(loop);
 }
 
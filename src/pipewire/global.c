@@ -33,6 +33,30 @@ struct global_impl {
 
 /** \endcond */
 
+static const struct spa_dict *global_get_props(struct pw_global *global)
+{
+	struct pw_core *core = global->core;
+	const struct pw_properties *props = NULL;
+
+	if (global->type == core->type.node)
+		props = pw_node_get_properties(global->object);
+	else if (global->type == core->type.client)
+		props = pw_client_get_properties(global->object);
+
+	return props ? &props->dict : NULL;
+}
+
+void pw_global_get_registry_info(struct pw_global *global, uint32_t permissions,
+				 struct pw_registry_global *info)
+{
+	info->id = global->id;
+	info->parent_id = global->parent->id;
+	info->permissions = permissions;
+	info->type = global->type;
+	info->version = global->version;
+	info->props = global_get_props(global);
+}
+
 uint32_t pw_global_get_permissions(struct pw_global *global, struct pw_client *client)
 {
 	struct pw_core *core = client->core;
@@ -110,6 +134,16 @@ pw_core_add_global(struct pw_core *core,
 						    this->type,
 						    this->version);
 	}
+	spa_list_for_each(registry, &core->registry_snapshot_list, link) {
+		uint32_t permissions = pw_global_get_permissions(this, registry->client);
+		struct pw_registry_global info;
+
+		if (!PW_PERM_IS_R(permissions))
+			continue;
+
+		pw_global_get_registry_info(this, permissions, &info);
+		pw_core_registry_snapshot(registry, 0, 1, &info, 0, NULL);
+	}
 	return this;
 }
 
@@ -211,6 +245,11 @@ void pw_global_destroy(struct pw_global *global)
 		if (PW_PERM_IS_R(permissions))
 			pw_registry_resource_global_remove(registry, global->id);
 	}
+	spa_list_for_each(registry, &core->registry_snapshot_list, link) {
+		uint32_t permissions = pw_global_get_permissions(global, registry->client);
+		if (PW_PERM_IS_R(permissions))
+			pw_core_registry_snapshot(registry, 0, 0, NULL, 1, &global->id);
+	}
 
 	pw_map_remove(&core->globals, global->id);
 
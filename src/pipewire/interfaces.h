@@ -65,7 +65,7 @@ struct pw_link_proxy;
 #define PW_TYPE_INTERFACE__Client	PW_TYPE_INTERFACE_BASE "Client"
 #define PW_TYPE_INTERFACE__Link		PW_TYPE_INTERFACE_BASE "Link"
 
-#define PW_VERSION_CORE				0
+#define PW_VERSION_CORE				1
 
 #define PW_CORE_PROXY_METHOD_UPDATE_TYPES	0
 #define PW_CORE_PROXY_METHOD_SYNC		1
@@ -73,7 +73,8 @@ struct pw_link_proxy;
 #define PW_CORE_PROXY_METHOD_CLIENT_UPDATE	3
 #define PW_CORE_PROXY_METHOD_CREATE_NODE	4
 #define PW_CORE_PROXY_METHOD_CREATE_LINK	5
-#define PW_CORE_PROXY_METHOD_NUM		6
+#define PW_CORE_PROXY_METHOD_GET_REGISTRY_SNAPSHOT	6
+#define PW_CORE_PROXY_METHOD_NUM		7
 
 /**
  * \struct pw_core_proxy_methods
@@ -84,7 +85,7 @@ struct pw_link_proxy;
  * for internal features.
  */
 struct pw_core_proxy_methods {
-#define PW_VERSION_CORE_PROXY_METHODS	0
+#define PW_VERSION_CORE_PROXY_METHODS	1
 	uint32_t version;
 	/**
 	 * Update the type map
@@ -161,6 +162,20 @@ struct pw_core_proxy_methods {
 			     const struct spa_format *filter,
 			     const struct spa_dict *props,
 			     uint32_t new_id);
+	/**
+	 * Get the registry object as a snapshot
+	 *
+	 * Like get_registry but the registry sends all globals in one
+	 * snapshot event instead of a global event per object. Later
+	 * changes are sent as snapshot events with the added and removed
+	 * globals.
+	 *
+	 * Since core version 1, the registry version must be at least 1.
+	 *
+	 * \param version the registry version
+	 * \param new_id the client proxy id
+	 */
+	void (*get_registry_snapshot) (void *object, uint32_t version, uint32_t new_id);
 };
 
 static inline void
@@ -183,6 +198,16 @@ pw_core_proxy_get_registry(struct pw_core_proxy *core, uint32_t type, uint32_t v
 	return (struct pw_registry_proxy *) p;
 }
 
+static inline struct pw_registry_proxy *
+pw_core_proxy_get_registry_snapshot(struct pw_core_proxy *core, uint32_t type, uint32_t version,
+				    size_t user_data_size)
+{
+	struct pw_proxy *p = pw_proxy_new((struct pw_proxy*)core, type, user_data_size);
+	pw_proxy_do((struct pw_proxy*)core, struct pw_core_proxy_methods, get_registry_snapshot,
+		    version, pw_proxy_get_id(p));
+	return (struct pw_registry_proxy *) p;
+}
+
 static inline void
 pw_core_proxy_client_update(struct pw_core_proxy *core, const struct spa_dict *props)
 {
@@ -306,7 +331,7 @@ pw_core_proxy_add_listener(struct pw_core_proxy *core,
 #define pw_core_resource_info(r,...)         pw_resource_notify(r,struct pw_core_proxy_events,info,__VA_ARGS__)
 
 
-#define PW_VERSION_REGISTRY			0
+#define PW_VERSION_REGISTRY			1
 
 #define PW_REGISTRY_PROXY_METHOD_BIND		0
 #define PW_REGISTRY_PROXY_METHOD_NUM		1
@@ -344,11 +369,25 @@ pw_registry_proxy_bind(struct pw_registry_proxy *registry,
 
 #define PW_REGISTRY_PROXY_EVENT_GLOBAL             0
 #define PW_REGISTRY_PROXY_EVENT_GLOBAL_REMOVE      1
-#define PW_REGISTRY_PROXY_EVENT_NUM                2
+#define PW_REGISTRY_PROXY_EVENT_SNAPSHOT           2
+#define PW_REGISTRY_PROXY_EVENT_NUM                3
+
+/** A global in a registry snapshot */
+struct pw_registry_global {
+	uint32_t id;			/**< the global object id */
+	uint32_t parent_id;		/**< the parent global id */
+	uint32_t permissions;		/**< the permissions of the object */
+	uint32_t type;			/**< the type of the interface */
+	uint32_t version;		/**< the version of the interface */
+	const struct spa_dict *props;	/**< properties of the object or NULL */
+};
+
+/** the snapshot contains all globals, forget the previous ones */
+#define PW_REGISTRY_SNAPSHOT_FLAG_FULL	(1 << 0)
 
 /** Registry events */
 struct pw_registry_proxy_events {
-#define PW_VERSION_REGISTRY_PROXY_EVENTS	0
+#define PW_VERSION_REGISTRY_PROXY_EVENTS	1
 	uint32_t version;
 	/**
 	 * Notify of a new global object
@@ -374,6 +413,26 @@ struct pw_registry_proxy_events {
 	 * \param id the id of the global that was removed
 	 */
 	void (*global_remove) (void *object, uint32_t id);
+	/**
+	 * Notify of a snapshot of the global objects
+	 *
+	 * Emited on registries made with get_registry_snapshot, since
+	 * registry version 1. The first snapshot has
+	 * PW_REGISTRY_SNAPSHOT_FLAG_FULL set and contains all globals. The
+	 * following snapshots contain the changes. The registry increments
+	 * the generation for each snapshot it sends, so a gap in the
+	 * generation means that snapshots were missed.
+	 *
+	 * \param generation the generation of the registry
+	 * \param flags snapshot flags
+	 * \param n_globals the number of added globals
+	 * \param globals the added globals
+	 * \param n_removed the number of removed globals
+	 * \param removed the ids of the removed globals
+	 */
+	void (*snapshot) (void *object, uint32_t generation, uint32_t flags,
+			  uint32_t n_globals, const struct pw_registry_global *globals,
+			  uint32_t n_removed, const uint32_t *removed);
 };
 
 static inline void
@@ -387,6 +446,7 @@ pw_registry_proxy_add_listener(struct pw_registry_proxy *registry,
 
 #define pw_registry_resource_global(r,...)        pw_resource_notify(r,struct pw_registry_proxy_events,global,__VA_ARGS__)
 #define pw_registry_resource_global_remove(r,...) pw_resource_notify(r,struct pw_registry_proxy_events,global_remove,__VA_ARGS__)
+#define pw_registry_resource_snapshot(r,...)      pw_resource_notify(r,struct pw_registry_proxy_events,snapshot,__VA_ARGS__)
 
 
 #define PW_VERSION_MODULE			0
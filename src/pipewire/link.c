@@ -26,6 +26,7 @@
 
 #include <spa/lib/format.h>
 #include <spa/lib/props.h>
+#include <spa/lib/pod-arena.h>
 
 #include "pipewire.h"
 #include "private.h"
@@ -35,6 +36,9 @@
 
 #define MAX_BUFFERS     16
 
+#define MAX_BUFFER_POOL_IDLE	8
+#define BUFFER_POOL_TIMEOUT	5
+
 /** \cond */
 struct impl {
 	struct pw_link this;
@@ -248,47 +252,341 @@ static struct spa_param *find_meta_enable(struct pw_core *core, struct spa_param
 	return NULL;
 }
 
+/** \cond */
+struct pool_buffers {
+	struct spa_list link;		/**< link in core buffer_pool */
+	bool in_use;			/**< if the buffers are used by a link */
+	bool no_reuse;			/**< free the buffers when they are released */
+	struct pw_client *clients[2];	/**< clients that received the memory, they
+					  *  keep it mapped after the link is gone */
+	enum pw_memblock_flags flags;	/**< flags used to allocate the memory */
+	struct pw_memblock mem;		/**< memory for metadata and data */
+	uint32_t n_buffers;
+	uint32_t n_metas;
+	struct spa_meta *metas;		/**< type and size of the metadata */
+	uint32_t n_datas;
+	size_t *data_sizes;
+	ssize_t *data_strides;
+	size_t skel_size;		/**< size of one buffer skeleton */
+	size_t data_size;		/**< size of the memory of one buffer */
+	struct spa_buffer **buffers;
+};
+/** \endcond */
+
+static void pool_buffers_free(struct pool_buffers *pb)
+{
+	spa_list_remove(&pb->link);
+	pw_memblock_free(&pb->mem);
+	free(pb);
+}
+
+static void on_buffer_pool_timeout(void *data, uint64_t expirations)
+{
+	struct pw_core *core = data;
+	pw_log_debug("core %p: trim idle buffer pool", core);
+	pw_link_trim_buffers(core);
+}
+
+/** Free all buffers in the buffer pool that are not used by a link
+ * \param core a core
+ * \memberof pw_link
+ */
+void pw_link_trim_buffers(struct pw_core *core)
+{
+	struct pool_buffers *pb, *t;
+
+	spa_list_for_each_safe(pb, t, &core->buffer_pool, link) {
+		if (!pb->in_use)
+			pool_buffers_free(pb);
+	}
+	core->n_buffer_pool_idle = 0;
+}
+
+/** Release buffers allocated for a link
+ * \param core a core
+ * \param buffers buffers allocated for a link
+ *
+ * The buffers and their memory are kept in the buffer pool of the core
+ * so that they can be reused when a link with the same or smaller
+ * requirements is negotiated. Unused buffers are freed when the pool
+ * was idle for some time.
+ * \memberof pw_link
+ */
+void pw_link_release_buffers(struct pw_core *core, struct spa_buffer **buffers)
+{
+	struct pool_buffers *pb;
+	struct timespec timeout = { BUFFER_POOL_TIMEOUT, 0 };
+
+	if (buffers == NULL)
+		return;
+
+	spa_list_for_each(pb, &core->buffer_pool, link) {
+		if (pb->buffers == buffers && pb->in_use)
+			goto found;
+	}
+	pw_log_warn("core %p: buffers %p not in the buffer pool", core, buffers);
+	return;
+
+      found:
+	if (pb->no_reuse) {
+		pw_log_debug("core %p: free buffers %p", core, buffers);
+		pool_buffers_free(pb);
+		return;
+	}
+	pw_log_debug("core %p: release buffers %p to pool", core, buffers);
+	pb->in_use = false;
+	spa_list_remove(&pb->link);
+	spa_list_insert(core->buffer_pool.prev, &pb->link);
+
+	if (++core->n_buffer_pool_idle > MAX_BUFFER_POOL_IDLE) {
+		spa_list_for_each(pb, &core->buffer_pool, link) {
+			if (!pb->in_use) {
+				pool_buffers_free(pb);
+				core->n_buffer_pool_idle--;
+				break;
+			}
+		}
+	}
+
+	if (core->buffer_pool_timer == NULL)
+		core->buffer_pool_timer = pw_loop_add_timer(core->main_loop,
+							    on_buffer_pool_timeout, core);
+	if (core->buffer_pool_timer)
+		pw_loop_update_timer(core->main_loop, core->buffer_pool_timer,
+				     &timeout, NULL, false);
+}
+
+/** Remove the buffers that were shared with a client from the pool
+ * \param core a core
+ * \param client a client that is destroyed
+ *
+ * The pool can't tell a new client at the same address from \a client,
+ * the buffers it received are freed instead of reused.
+ * \memberof pw_link
+ */
+void pw_link_forget_client_buffers(struct pw_core *core, struct pw_client *client)
+{
+	struct pool_buffers *pb, *t;
+
+	spa_list_for_each_safe(pb, t, &core->buffer_pool, link) {
+		if (pb->clients[0] != client && pb->clients[1] != client)
+			continue;
+		if (pb->in_use) {
+			pb->no_reuse = true;
+		} else {
+			pool_buffers_free(pb);
+			core->n_buffer_pool_idle--;
+		}
+	}
+}
+
+static bool pool_buffers_has_client(struct pool_buffers *pb, struct pw_client *client)
+{
+	return pb->clients[0] == client || pb->clients[1] == client;
+}
+
+/* remember that \a client received the memory, returns false when there
+ * is no room and the memory can't be reused */
+static bool pool_buffers_add_client(struct pool_buffers *pb, struct pw_client *client)
+{
+	if (client == NULL || pool_buffers_has_client(pb, client))
+		return true;
+	if (pb->clients[0] == NULL)
+		pb->clients[0] = client;
+	else if (pb->clients[1] == NULL)
+		pb->clients[1] = client;
+	else
+		return false;
+	return true;
+}
+
+static bool pool_buffers_shared_with(struct pool_buffers *pb, struct pw_client **clients)
+{
+	uint32_t i;
+
+	/* memory that went to a client is only reused for links of exactly
+	 * the same clients. Memory of other clients or of the nodes of the
+	 * daemon would let a client see their data, the memory is not
+	 * cleared when it is reused */
+	for (i = 0; i < 2; i++) {
+		if (pb->clients[i] != NULL &&
+		    pb->clients[i] != clients[0] && pb->clients[i] != clients[1])
+			return false;
+		if (clients[i] != NULL && !pool_buffers_has_client(pb, clients[i]))
+			return false;
+	}
+	return true;
+}
+
+/* the buffers of a port are given to the client of another node, it can't
+ * be reused for other clients */
+static void share_pool_buffers(struct pw_core *core, struct spa_buffer **buffers,
+			       struct pw_node *node)
+{
+	struct pool_buffers *pb;
+	struct pw_client *client = node->owner ? node->owner->client : NULL;
+
+	if (client == NULL)
+		return;
+
+	spa_list_for_each(pb, &core->buffer_pool, link) {
+		if (pb->buffers != buffers)
+			continue;
+		if (!pool_buffers_add_client(pb, client))
+			pb->no_reuse = true;
+		return;
+	}
+}
+
+static struct pool_buffers *find_pool_buffers(struct pw_core *core,
+					      struct pw_client **clients,
+					      enum pw_memblock_flags flags,
+					      uint32_t n_buffers,
+					      uint32_t n_metas,
+					      struct spa_meta *metas,
+					      uint32_t n_datas,
+					      size_t *data_sizes,
+					      ssize_t *data_strides)
+{
+	struct pool_buffers *pb;
+	uint32_t i;
+
+	spa_list_for_each(pb, &core->buffer_pool, link) {
+		if (pb->in_use ||
+		    !pool_buffers_shared_with(pb, clients) ||
+		    pb->flags != flags ||
+		    pb->n_buffers < n_buffers ||
+		    pb->n_metas != n_metas ||
+		    pb->n_datas != n_datas)
+			continue;
+
+		for (i = 0; i < n_metas; i++) {
+			if (pb->metas[i].type != metas[i].type ||
+			    pb->metas[i].size != metas[i].size)
+				break;
+		}
+		if (i < n_metas)
+			continue;
+
+		for (i = 0; i < n_datas; i++) {
+			if (pb->data_sizes[i] < data_sizes[i] ||
+			    pb->data_strides[i] != data_strides[i])
+				break;
+		}
+		if (i < n_datas)
+			continue;
+
+		return pb;
+	}
+	return NULL;
+}
+
+static struct pool_buffers *new_pool_buffers(struct pw_core *core,
+					     struct pw_client **clients,
+					     enum pw_memblock_flags flags,
+					     uint32_t n_buffers,
+					     uint32_t n_metas,
+					     struct spa_meta *metas,
+					     uint32_t n_datas,
+					     size_t *data_sizes,
+					     ssize_t *data_strides)
+{
+	struct pool_buffers *pb;
+	uint32_t i;
+	size_t skel_size, data_size;
+
+	/* each buffer */
+	skel_size = sizeof(struct spa_buffer);
+	skel_size += n_metas * sizeof(struct spa_meta);
+	skel_size += n_datas * sizeof(struct spa_data);
+
+	data_size = 0;
+	for (i = 0; i < n_metas; i++)
+		data_size += metas[i].size;
+	for (i = 0; i < n_datas; i++) {
+		data_size += sizeof(struct spa_chunk);
+		data_size += data_sizes[i];
+	}
+
+	pb = calloc(1, sizeof(struct pool_buffers) +
+		    n_metas * sizeof(struct spa_meta) +
+		    n_datas * (sizeof(size_t) + sizeof(ssize_t)) +
+		    n_buffers * (skel_size + sizeof(struct spa_buffer *)));
+	if (pb == NULL)
+		return NULL;
+
+	if (pw_memblock_alloc(flags, n_buffers * data_size, &pb->mem) < 0) {
+		free(pb);
+		return NULL;
+	}
+
+	pb->clients[0] = clients[0];
+	pb->clients[1] = clients[1];
+	pb->flags = flags;
+	pb->n_buffers = n_buffers;
+	pb->n_metas = n_metas;
+	pb->metas = SPA_MEMBER(pb, sizeof(struct pool_buffers), struct spa_meta);
+	memcpy(pb->metas, metas, n_metas * sizeof(struct spa_meta));
+	pb->n_datas = n_datas;
+	pb->data_sizes = SPA_MEMBER(pb->metas, n_metas * sizeof(struct spa_meta), size_t);
+	memcpy(pb->data_sizes, data_sizes, n_datas * sizeof(size_t));
+	pb->data_strides = SPA_MEMBER(pb->data_sizes, n_datas * sizeof(size_t), ssize_t);
+	memcpy(pb->data_strides, data_strides, n_datas * sizeof(ssize_t));
+	pb->skel_size = skel_size;
+	pb->data_size = data_size;
+	/* pointer to buffer structures */
+	pb->buffers = SPA_MEMBER(pb->data_strides, n_datas * sizeof(ssize_t), struct spa_buffer *);
+
+	spa_list_insert(core->buffer_pool.prev, &pb->link);
+
+	return pb;
+}
+
 static struct spa_buffer **alloc_buffers(struct pw_link *this,
+					 enum pw_memblock_flags flags,
 					 uint32_t n_buffers,
 					 uint32_t n_params,
 					 struct spa_param **params,
 					 uint32_t n_datas,
 					 size_t *data_sizes,
-					 ssize_t *data_strides,
-					 struct pw_memblock *mem)
+					 ssize_t *data_strides)
 {
-	struct spa_buffer **buffers, *bp;
+	struct pw_core *core = this->core;
+	struct pool_buffers *pb;
+	struct spa_buffer *bp;
 	uint32_t i;
-	size_t skel_size, data_size, meta_size;
 	struct spa_chunk *cdp;
 	void *ddp;
 	uint32_t n_metas;
 	struct spa_meta *metas;
+	struct pw_memblock *mem;
+	struct pw_client *clients[2] = { NULL, NULL };
 
-	n_metas = data_size = meta_size = 0;
+	/* the clients of the nodes get the memory */
+	if (this->output->node->owner)
+		clients[0] = this->output->node->owner->client;
+	if (this->input->node->owner)
+		clients[1] = this->input->node->owner->client;
 
-	/* each buffer */
-	skel_size = sizeof(struct spa_buffer);
+	n_metas = 0;
 
 	metas = alloca(sizeof(struct spa_meta) * (n_params + 1));
 
 	/* add shared metadata */
-	metas[n_metas].type = this->core->type.meta.Shared;
+	metas[n_metas].type = core->type.meta.Shared;
 	metas[n_metas].size = sizeof(struct spa_meta_shared);
-	meta_size += metas[n_metas].size;
 	n_metas++;
-	skel_size += sizeof(struct spa_meta);
 
 	/* collect metadata */
 	for (i = 0; i < n_params; i++) {
 		if (spa_pod_is_object_type
-		    (&params[i]->object.pod, this->core->type.param_alloc_meta_enable.MetaEnable)) {
+		    (&params[i]->object.pod, core->type.param_alloc_meta_enable.MetaEnable)) {
 			uint32_t type, size;
 
 			if (spa_param_query(params[i],
-					    this->core->type.param_alloc_meta_enable.type,
+					    core->type.param_alloc_meta_enable.type,
 					    SPA_POD_TYPE_ID, &type,
-					    this->core->type.param_alloc_meta_enable.size,
+					    core->type.param_alloc_meta_enable.size,
 					    SPA_POD_TYPE_INT, &size, 0) != 2)
 				continue;
 
@@ -296,36 +594,41 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 
 			metas[n_metas].type = type;
 			metas[n_metas].size = size;
-			meta_size += metas[n_metas].size;
 			n_metas++;
-			skel_size += sizeof(struct spa_meta);
 		}
 	}
-	data_size += meta_size;
 
-	/* data */
-	for (i = 0; i < n_datas; i++) {
-		data_size += sizeof(struct spa_chunk);
-		data_size += data_sizes[i];
-		skel_size += sizeof(struct spa_data);
+	pb = find_pool_buffers(core, clients, flags, n_buffers, n_metas, metas,
+			       n_datas, data_sizes, data_strides);
+	if (pb != NULL) {
+		pw_log_debug("link %p: reuse %d pooled buffers %p for %d buffers", this,
+			     pb->n_buffers, pb->buffers, n_buffers);
+		core->n_buffer_pool_idle--;
+		for (i = 0; i < 2; i++) {
+			if (!pool_buffers_add_client(pb, clients[i]))
+				pb->no_reuse = true;
+		}
+	} else {
+		pb = new_pool_buffers(core, clients, flags, n_buffers, n_metas, metas,
+				      n_datas, data_sizes, data_strides);
+		if (pb == NULL)
+			return NULL;
 	}
+	pb->in_use = true;
 
-	buffers = calloc(n_buffers, skel_size + sizeof(struct spa_buffer *));
-	/* pointer to buffer structures */
-	bp = SPA_MEMBER(buffers, n_buffers * sizeof(struct spa_buffer *), struct spa_buffer);
-
-	pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
-			  PW_MEMBLOCK_FLAG_MAP_READWRITE |
-			  PW_MEMBLOCK_FLAG_SEAL, n_buffers * data_size, mem);
+	/* use the geometry of the pooled buffers, it can be larger than requested */
+	data_sizes = pb->data_sizes;
+	mem = &pb->mem;
+	bp = SPA_MEMBER(pb->buffers, pb->n_buffers * sizeof(struct spa_buffer *), struct spa_buffer);
 
-	for (i = 0; i < n_buffers; i++) {
+	for (i = 0; i < pb->n_buffers; i++) {
 		int j;
 		struct spa_buffer *b;
 		void *p;
 
-		buffers[i] = b = SPA_MEMBER(bp, skel_size * i, struct spa_buffer);
+		pb->buffers[i] = b = SPA_MEMBER(bp, pb->skel_size * i, struct spa_buffer);
 
-		p = SPA_MEMBER(mem->ptr, data_size * i, void);
+		p = SPA_MEMBER(mem->ptr, pb->data_size * i, void);
 
 		b->id = i;
 		b->n_metas = n_metas;
@@ -337,16 +640,18 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 			m->data = p;
 			m->size = metas[j].size;
 
-			if (m->type == this->core->type.meta.Shared) {
+			if (m->type == core->type.meta.Shared) {
 				struct spa_meta_shared *msh = p;
 
 				msh->flags = 0;
 				msh->fd = mem->fd;
-				msh->offset = data_size * i;
-				msh->size = data_size;
-			} else if (m->type == this->core->type.meta.Ringbuffer) {
+				msh->offset = pb->data_size * i;
+				msh->size = pb->data_size;
+			} else if (m->type == core->type.meta.Ringbuffer) {
 				struct spa_meta_ringbuffer *rb = p;
 				spa_ringbuffer_init(&rb->ringbuffer, data_sizes[0]);
+			} else {
+				memset(p, 0, m->size);
 			}
 			p += m->size;
 		}
@@ -362,7 +667,7 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 
 			d->chunk = &cdp[j];
 			if (data_sizes[j] > 0) {
-				d->type = this->core->type.data.MemFd;
+				d->type = core->type.data.MemFd;
 				d->flags = 0;
 				d->fd = mem->fd;
 				d->mapoffset = SPA_PTRDIFF(ddp, mem->ptr);
@@ -378,7 +683,7 @@ static struct spa_buffer **alloc_buffers(struct pw_link *this,
 			}
 		}
 	}
-	return buffers;
+	return pb->buffers;
 }
 
 static int
@@ -510,17 +815,34 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 
 	if (this->buffers == NULL) {
 		struct spa_param **params, *param;
-		uint8_t buffer[4096];
-		struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+		struct spa_pod_arena *arena;
+		struct spa_pod_builder *b;
 		int i, offset, n_params;
 		uint32_t max_buffers;
 		size_t minsize = 1024, stride = 0;
+		int32_t hugepages = 0;
+		enum pw_memblock_flags flags = PW_MEMBLOCK_FLAG_WITH_FD |
+					       PW_MEMBLOCK_FLAG_MAP_READWRITE |
+					       PW_MEMBLOCK_FLAG_SEAL;
+
+		/* the params stay in the arena of this thread until it is used
+		 * again, nothing below builds pods with it */
+		if ((arena = spa_pod_arena_get_thread()) == NULL ||
+		    (b = spa_pod_arena_begin(arena)) == NULL) {
+			asprintf(&error, "error filter params: no arena");
+			res = SPA_RESULT_NO_MEMORY;
+			goto error;
+		}
+		n_params = param_filter(this, input, output, b);
 
-		n_params = param_filter(this, input, output, &b);
+		if ((res = spa_pod_arena_end(arena)) < 0) {
+			asprintf(&error, "error filter params: %d", res);
+			goto error;
+		}
 
 		params = alloca(n_params * sizeof(struct spa_param *));
 		for (i = 0, offset = 0; i < n_params; i++) {
-			params[i] = SPA_MEMBER(buffer, offset, struct spa_param);
+			params[i] = SPA_MEMBER(b->data, offset, struct spa_param);
 			spa_param_fixate(params[i]);
 			if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
 				spa_debug_param(params[i]);
@@ -563,6 +885,13 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 									      max_buffers);
 				minsize = SPA_MAX(minsize, qminsize);
 				stride = SPA_MAX(stride, qstride);
+
+				spa_param_query(param,
+						this->core->type.param_alloc_buffers.hugepages,
+						SPA_POD_TYPE_BOOL, &hugepages, 0);
+				if (hugepages)
+					flags |= PW_MEMBLOCK_FLAG_HUGEPAGES |
+						 PW_MEMBLOCK_FLAG_PREFAULT;
 			} else {
 				minsize = 4096;
 			}
@@ -578,6 +907,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			this->n_buffers = output->n_buffers;
 			this->buffers = output->buffers;
 			this->buffer_owner = output;
+			share_pool_buffers(this->core, this->buffers, input->node);
 			pw_log_debug("link %p: reusing %d output buffers %p", this, this->n_buffers,
 				     this->buffers);
 		} else if (input->n_buffers && input->mix == NULL) {
@@ -586,6 +916,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			this->n_buffers = input->n_buffers;
 			this->buffers = input->buffers;
 			this->buffer_owner = input;
+			share_pool_buffers(this->core, this->buffers, output->node);
 			pw_log_debug("link %p: reusing %d input buffers %p", this, this->n_buffers,
 				     this->buffers);
 		} else {
@@ -598,12 +929,17 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			this->buffer_owner = this;
 			this->n_buffers = max_buffers;
 			this->buffers = alloc_buffers(this,
+						      flags,
 						      this->n_buffers,
 						      n_params,
 						      params,
 						      1,
-						      data_sizes, data_strides,
-						      &this->buffer_mem);
+						      data_sizes, data_strides);
+			if (this->buffers == NULL) {
+				asprintf(&error, "error alloc buffers: no memory");
+				res = SPA_RESULT_NO_MEMORY;
+				goto error;
+			}
 
 			pw_log_debug("link %p: allocating %d input buffers %p %zd %zd", this,
 				     this->n_buffers, this->buffers, minsize, stride);
@@ -618,7 +954,6 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			}
 			if (SPA_RESULT_IS_ASYNC(res))
 				pw_work_queue_add(impl->work, output->node, res, complete_paused, output);
-			output->buffer_mem = this->buffer_mem;
 			this->buffer_owner = output;
 			pw_log_debug("link %p: allocated %d buffers %p from output port", this,
 				     this->n_buffers, this->buffers);
@@ -631,7 +966,6 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			}
 			if (SPA_RESULT_IS_ASYNC(res))
 				pw_work_queue_add(impl->work, input->node, res, complete_paused, input);
-			input->buffer_mem = this->buffer_mem;
 			this->buffer_owner = input;
 			pw_log_debug("link %p: allocated %d buffers %p from input port", this,
 				     this->n_buffers, this->buffers);
@@ -723,7 +1057,15 @@ do_activate_link(struct spa_loop *loop,
 		 bool async, uint32_t seq, size_t size, const void *data, void *user_data)
 {
         struct pw_link *this = user_data;
-	spa_graph_port_link(&this->rt.out_port, &this->rt.in_port);
+	enum pw_direction direction = *(enum pw_direction *) data;
+
+	/* each side is linked from the loop of its node, the nodes can
+	 * be on different data loops */
+	if (direction == PW_DIRECTION_OUTPUT)
+		this->rt.out_port.peer = &this->rt.in_port;
+	else
+		this->rt.in_port.peer = &this->rt.out_port;
+
 	return SPA_RESULT_OK;
 }
 
@@ -757,8 +1099,14 @@ static int check_states(struct pw_link *this, void *user_data, int res)
 	}
 
 	if (in_state == PW_PORT_STATE_STREAMING && out_state == PW_PORT_STATE_STREAMING) {
-		pw_loop_invoke(output->node->data_loop,
-			       do_activate_link, SPA_ID_INVALID, 0, NULL, false, this);
+		enum pw_direction direction;
+
+		direction = PW_DIRECTION_INPUT;
+		pw_loop_invoke(input->node->data_loop, do_activate_link, SPA_ID_INVALID,
+			       sizeof(direction), &direction, false, this);
+		direction = PW_DIRECTION_OUTPUT;
+		pw_loop_invoke(output->node->data_loop, do_activate_link, SPA_ID_INVALID,
+			       sizeof(direction), &direction, false, this);
 		pw_link_update_state(this, PW_LINK_STATE_RUNNING, NULL);
 		return SPA_RESULT_OK;
 	}
@@ -919,7 +1267,20 @@ do_deactivate_link(struct spa_loop *loop,
 		   bool async, uint32_t seq, size_t size, const void *data, void *user_data)
 {
         struct pw_link *this = user_data;
-	spa_graph_port_unlink(&this->rt.out_port);
+	enum pw_direction direction = *(enum pw_direction *) data;
+
+	if (direction == PW_DIRECTION_OUTPUT)
+		this->rt.out_port.peer = NULL;
+	else
+		this->rt.in_port.peer = NULL;
+
+	return SPA_RESULT_OK;
+}
+
+static int
+do_flush(struct spa_loop *loop,
+	 bool async, uint32_t seq, size_t size, const void *data, void *user_data)
+{
 	return SPA_RESULT_OK;
 }
 
@@ -927,14 +1288,26 @@ bool pw_link_deactivate(struct pw_link *this)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
 	struct pw_node *input_node, *output_node;
+	enum pw_direction direction;
 
 	if (!impl->active)
 		return true;
 
 	impl->active = false;
 	pw_log_debug("link %p: deactivate", this);
-	pw_loop_invoke(this->output->node->data_loop,
-		       do_deactivate_link, SPA_ID_INVALID, 0, NULL, true, this);
+	/* first stop the output from handing buffers to the input, then
+	 * unlink the input after the handed over buffers are processed */
+	direction = PW_DIRECTION_OUTPUT;
+	pw_loop_invoke(this->output->node->data_loop, do_deactivate_link, SPA_ID_INVALID,
+		       sizeof(direction), &direction, true, this);
+	direction = PW_DIRECTION_INPUT;
+	pw_loop_invoke(this->input->node->data_loop, do_deactivate_link, SPA_ID_INVALID,
+		       sizeof(direction), &direction, true, this);
+	/* until it was unlinked, the input could queue a port_ready of the
+	 * output port on the output loop, run it before the link is freed */
+	if (this->output->node->data_loop != this->input->node->data_loop)
+		pw_loop_invoke(this->output->node->data_loop, do_flush, SPA_ID_INVALID,
+			       0, NULL, true, this);
 
 	input_node = this->input->node;
 	output_node = this->output->node;
@@ -1196,10 +1569,8 @@ void pw_link_destroy(struct pw_link *link)
 	if (link->info.format)
 		free(link->info.format);
 
-	if (link->buffer_owner == link) {
-		free(link->buffers);
-		pw_memblock_free(&link->buffer_mem);
-	}
+	if (link->buffer_owner == link)
+		pw_link_release_buffers(link->core, link->buffers);
 	free(impl);
 }
 
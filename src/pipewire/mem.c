@@ -30,6 +30,10 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/syscall.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include <spa/list.h>
 
 #include <pipewire/log.h>
 #include <pipewire/mem.h>
@@ -57,6 +61,10 @@ static inline int memfd_create(const char *name, unsigned int flags)
 #define MFD_ALLOW_SEALING 0x0002U
 #endif
 
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB       0x0004U
+#endif
+
 /* fcntl() seals-related flags */
 
 #ifndef F_LINUX_SPECIFIC_BASE
@@ -87,7 +95,10 @@ int pw_memblock_map(struct pw_memblock *mem)
 		return SPA_RESULT_OK;
 
 	if (mem->flags & PW_MEMBLOCK_FLAG_MAP_READWRITE) {
-		int prot = 0;
+		int prot = 0, flags = MAP_SHARED;
+
+		if (mem->flags & PW_MEMBLOCK_FLAG_PREFAULT)
+			flags |= MAP_POPULATE;
 
 		if (mem->flags & PW_MEMBLOCK_FLAG_MAP_READ)
 			prot |= PROT_READ;
@@ -104,7 +115,7 @@ int pw_memblock_map(struct pw_memblock *mem)
 				return SPA_RESULT_NO_MEMORY;
 
 			ptr =
-			    mmap(mem->ptr, mem->size, prot, MAP_FIXED | MAP_SHARED, mem->fd,
+			    mmap(mem->ptr, mem->size, prot, MAP_FIXED | flags, mem->fd,
 				 mem->offset);
 			if (ptr != mem->ptr) {
 				munmap(mem->ptr, mem->size << 1);
@@ -112,16 +123,22 @@ int pw_memblock_map(struct pw_memblock *mem)
 			}
 
 			ptr =
-			    mmap(mem->ptr + mem->size, mem->size, prot, MAP_FIXED | MAP_SHARED,
+			    mmap(mem->ptr + mem->size, mem->size, prot, MAP_FIXED | flags,
 				 mem->fd, mem->offset);
 			if (ptr != mem->ptr + mem->size) {
 				munmap(mem->ptr, mem->size << 1);
 				return SPA_RESULT_NO_MEMORY;
 			}
 		} else {
-			mem->ptr = mmap(NULL, mem->size, prot, MAP_SHARED, mem->fd, 0);
-			if (mem->ptr == MAP_FAILED)
+			mem->ptr = mmap(NULL, mem->size, prot, flags, mem->fd, 0);
+			if (mem->ptr == MAP_FAILED) {
+				mem->ptr = NULL;
 				return SPA_RESULT_NO_MEMORY;
+			}
+			/* no-op for hugetlb memory, asks for transparent huge pages
+			 * on regular shared memory */
+			if (mem->flags & PW_MEMBLOCK_FLAG_HUGEPAGES)
+				madvise(mem->ptr, mem->size, MADV_HUGEPAGE);
 		}
 	} else {
 		mem->ptr = NULL;
@@ -129,6 +146,65 @@ int pw_memblock_map(struct pw_memblock *mem)
 	return SPA_RESULT_OK;
 }
 
+static size_t get_hugepage_size(void)
+{
+	static size_t hugepage_size = 0;
+	char line[128];
+	FILE *f;
+
+	if (hugepage_size != 0)
+		return hugepage_size;
+
+	hugepage_size = 2 * 1024 * 1024;
+
+	if ((f = fopen("/proc/meminfo", "r")) == NULL)
+		return hugepage_size;
+
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long kb;
+		if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+			hugepage_size = kb * 1024;
+			break;
+		}
+	}
+	fclose(f);
+
+	return hugepage_size;
+}
+
+static int alloc_hugetlb(struct pw_memblock *mem)
+{
+	size_t size = SPA_ROUND_UP_N(mem->size, get_hugepage_size());
+
+	mem->fd = memfd_create("pipewire-memfd", MFD_CLOEXEC | MFD_HUGETLB | MFD_ALLOW_SEALING);
+	if (mem->fd == -1)
+		goto failed;
+
+	if (ftruncate(mem->fd, size) < 0)
+		goto failed_close;
+
+	/* without the seals a client could shrink the memory, use regular
+	 * memory when hugetlb memory can't be sealed */
+	if (mem->flags & PW_MEMBLOCK_FLAG_SEAL) {
+		unsigned int seals = F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL;
+		if (fcntl(mem->fd, F_ADD_SEALS, seals) == -1)
+			goto failed_close;
+	}
+
+	mem->size = size;
+	if (pw_memblock_map(mem) != SPA_RESULT_OK)
+		goto failed_close;
+
+	return SPA_RESULT_OK;
+
+      failed_close:
+	close(mem->fd);
+	mem->fd = -1;
+      failed:
+	pw_log_debug("mem %p: no hugetlb memory for %zd bytes: %s", mem, size, strerror(errno));
+	return SPA_RESULT_ERRNO;
+}
+
 /** Create a new memblock
  * \param flags memblock flags
  * \param size size to allocate
@@ -150,6 +226,15 @@ int pw_memblock_alloc(enum pw_memblock_flags flags, size_t size, struct pw_membl
 
 	use_fd = ! !(flags & (PW_MEMBLOCK_FLAG_MAP_TWICE | PW_MEMBLOCK_FLAG_WITH_FD));
 
+	if ((flags & PW_MEMBLOCK_FLAG_HUGEPAGES) && !(flags & PW_MEMBLOCK_FLAG_MAP_TWICE)) {
+		if (alloc_hugetlb(mem) == SPA_RESULT_OK)
+			goto done;
+
+		/* use regular memory, with transparent huge pages if possible */
+		mem->size = size = SPA_ROUND_UP_N(size, get_hugepage_size());
+		use_fd = true;
+	}
+
 	if (use_fd) {
 #ifdef USE_MEMFD
 		mem->fd = memfd_create("pipewire-memfd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
@@ -188,6 +273,7 @@ int pw_memblock_alloc(enum pw_memblock_flags flags, size_t size, struct pw_membl
 			return SPA_RESULT_NO_MEMORY;
 		mem->fd = -1;
 	}
+      done:
 	if (!(flags & PW_MEMBLOCK_FLAG_WITH_FD) && mem->fd != -1) {
 		close(mem->fd);
 		mem->fd = -1;
@@ -208,7 +294,7 @@ void pw_memblock_free(struct pw_memblock *mem)
 	if (mem == NULL)
 		return;
 
-	if (mem->flags & PW_MEMBLOCK_FLAG_WITH_FD) {
+	if (mem->flags & (PW_MEMBLOCK_FLAG_WITH_FD | PW_MEMBLOCK_FLAG_HUGEPAGES)) {
 		if (mem->ptr)
 			munmap(mem->ptr, mem->size);
 		if (mem->fd != -1)
@@ -219,3 +305,160 @@ void pw_memblock_free(struct pw_memblock *mem)
 	mem->ptr = NULL;
 	mem->fd = -1;
 }
+
+/** \cond */
+#define MAX_IDLE_MAPS	16
+
+struct memmap {
+	struct spa_list link;
+	bool shared;		/* dev and ino identify the memory */
+	dev_t dev;		/* identity of the mapped file */
+	ino_t ino;
+	int prot;
+	off_t offset;		/* page aligned offset of the mapping in the file */
+	size_t size;		/* size of the mapping */
+	void *ptr;
+	int ref;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct spa_list maps;	/* most recently used at the end */
+	uint32_t n_idle;
+} memmap_cache = { PTHREAD_MUTEX_INITIALIZER, { &memmap_cache.maps, &memmap_cache.maps }, 0 };
+/** \endcond */
+
+static void memmap_free(struct memmap *m)
+{
+	pw_log_debug("mem %p: unmap %zd bytes at offset %jd", m->ptr, m->size, (intmax_t) m->offset);
+	munmap(m->ptr, m->size);
+	spa_list_remove(&m->link);
+	free(m);
+}
+
+/** Map a region of a file descriptor through the mapping cache
+ * \param fd the file descriptor to map
+ * \param flags PW_MEMBLOCK_FLAG_MAP_READ and/or PW_MEMBLOCK_FLAG_MAP_WRITE
+ * \param offset offset of the region in \a fd
+ * \param size size of the region
+ * \return a pointer to the region or NULL on error
+ *
+ * Mappings of regular files, like memfds, are identified by the file
+ * behind \a fd, not by the fd number, so regions of the same memfd
+ * received several times (once per buffer, port or renegotiation) share
+ * one mapping. When possible, the complete file is mapped so that all
+ * later regions of it are found in the cache. Other fds, like DmaBuf and
+ * anonymous inodes, can share one inode number and are mapped each time.
+ *
+ * Unused mappings are kept around for a while so that they can be reused
+ * when the same memory is sent again.
+ *
+ * Release the region with pw_memmap_release().
+ * \memberof pw_memblock
+ */
+void *pw_memmap_acquire(int fd, enum pw_memblock_flags flags, off_t offset, size_t size)
+{
+	struct memmap *m;
+	struct stat st;
+	int prot = 0;
+	off_t start, end, page_size = sysconf(_SC_PAGESIZE);
+	void *ptr = NULL;
+
+	if (flags & PW_MEMBLOCK_FLAG_MAP_READ)
+		prot |= PROT_READ;
+	if (flags & PW_MEMBLOCK_FLAG_MAP_WRITE)
+		prot |= PROT_WRITE;
+
+	if (fstat(fd, &st) < 0) {
+		pw_log_error("Failed to stat fd %d: %s", fd, strerror(errno));
+		return NULL;
+	}
+
+	pthread_mutex_lock(&memmap_cache.lock);
+	spa_list_for_each(m, &memmap_cache.maps, link) {
+		if (S_ISREG(st.st_mode) && m->shared &&
+		    m->dev == st.st_dev && m->ino == st.st_ino &&
+		    (m->prot & prot) == prot &&
+		    m->offset <= offset && offset + size <= m->offset + m->size) {
+			if (m->ref++ == 0)
+				memmap_cache.n_idle--;
+			spa_list_remove(&m->link);
+			spa_list_insert(memmap_cache.maps.prev, &m->link);
+			ptr = SPA_MEMBER(m->ptr, offset - m->offset, void);
+			goto done;
+		}
+	}
+
+	if (S_ISREG(st.st_mode) && offset + size <= st.st_size) {
+		start = 0;
+		end = st.st_size;
+	} else {
+		start = offset & ~(page_size - 1);
+		end = offset + size;
+	}
+
+	if ((m = calloc(1, sizeof(struct memmap))) == NULL)
+		goto done;
+
+	m->ptr = mmap(NULL, end - start, prot, MAP_SHARED, fd, start);
+	if (m->ptr == MAP_FAILED) {
+		pw_log_error("Failed to mmap fd %d: %s", fd, strerror(errno));
+		free(m);
+		goto done;
+	}
+	m->shared = S_ISREG(st.st_mode);
+	m->dev = st.st_dev;
+	m->ino = st.st_ino;
+	m->prot = prot;
+	m->offset = start;
+	m->size = end - start;
+	m->ref = 1;
+	spa_list_insert(memmap_cache.maps.prev, &m->link);
+
+	pw_log_debug("mem %p: mapped fd %d, %zd bytes at offset %jd", m->ptr, fd,
+		     m->size, (intmax_t) m->offset);
+
+	ptr = SPA_MEMBER(m->ptr, offset - m->offset, void);
+
+      done:
+	pthread_mutex_unlock(&memmap_cache.lock);
+	return ptr;
+}
+
+/** Release a region mapped with pw_memmap_acquire()
+ * \param ptr a pointer returned by pw_memmap_acquire()
+ * \memberof pw_memblock
+ */
+void pw_memmap_release(void *ptr)
+{
+	struct memmap *m;
+
+	if (ptr == NULL)
+		return;
+
+	pthread_mutex_lock(&memmap_cache.lock);
+	spa_list_for_each(m, &memmap_cache.maps, link) {
+		if (m->ref > 0 && ptr >= m->ptr && ptr < SPA_MEMBER(m->ptr, m->size, void))
+			goto found;
+	}
+	pw_log_warn("mem %p: not a mapped region", ptr);
+	goto done;
+
+      found:
+	if (--m->ref == 0 && !m->shared) {
+		/* can't be found again, don't keep it */
+		memmap_free(m);
+	}
+	else if (m->ref == 0 && ++memmap_cache.n_idle > MAX_IDLE_MAPS) {
+		/* evict the least recently used idle mapping */
+		spa_list_for_each(m, &memmap_cache.maps, link) {
+			if (m->ref == 0) {
+				memmap_free(m);
+				memmap_cache.n_idle--;
+				break;
+			}
+		}
+	}
+      done:
+	pthread_mutex_unlock(&memmap_cache.lock);
+}
@@ -34,6 +34,10 @@ enum pw_memblock_flags {
 	PW_MEMBLOCK_FLAG_MAP_READ = (1 << 2),
 	PW_MEMBLOCK_FLAG_MAP_WRITE = (1 << 3),
 	PW_MEMBLOCK_FLAG_MAP_TWICE = (1 << 4),
+	PW_MEMBLOCK_FLAG_HUGEPAGES = (1 << 5),	/**< back the memory with huge pages when
+						  *  possible, size is rounded up to the
+						  *  huge page size */
+	PW_MEMBLOCK_FLAG_PREFAULT = (1 << 6),	/**< fault in the memory when mapping */
 };
 
 #define PW_MEMBLOCK_FLAG_MAP_READWRITE (PW_MEMBLOCK_FLAG_MAP_READ | PW_MEMBLOCK_FLAG_MAP_WRITE)
@@ -57,6 +61,12 @@ pw_memblock_map(struct pw_memblock *mem);
 void
 pw_memblock_free(struct pw_memblock *mem);
 
+void *
+pw_memmap_acquire(int fd, enum pw_memblock_flags flags, off_t offset, size_t size);
+
+void
+pw_memmap_release(void *ptr);
+
 #ifdef __cplusplus
 }
 #endif
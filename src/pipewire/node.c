@@ -23,6 +23,7 @@
 #include <errno.h>
 
 #include <spa/clock.h>
+#include <spa/probe.h>
 
 #include "pipewire/pipewire.h"
 #include "pipewire/interfaces.h"
@@ -40,6 +41,7 @@ struct impl {
 	struct pw_global *parent;
 
 	struct pw_work_queue *work;
+	struct pw_data_loop *data_loop;
 
 	bool registered;
 };
@@ -249,6 +251,17 @@ do_node_add(struct spa_loop *loop,
 	return SPA_RESULT_OK;
 }
 
+static int
+do_node_set_stats(struct spa_loop *loop,
+		  bool async, uint32_t seq, size_t size, const void *data, void *user_data)
+{
+	struct pw_node *this = user_data;
+
+	this->rt.stats = this->stats;
+	this->rt.node.stats = &this->stats->graph;
+
+	return SPA_RESULT_OK;
+}
 
 void pw_node_register(struct pw_node *this)
 {
@@ -267,6 +280,10 @@ void pw_node_register(struct pw_node *this)
 					  core->type.node, PW_VERSION_NODE,
 					  node_bind_func, this);
 
+	this->stats = pw_core_alloc_node_stats(core, this->global->id, this->info.name);
+	if (this->stats)
+		pw_loop_invoke(this->data_loop, do_node_set_stats, 1, 0, NULL, false, this);
+
 	impl->registered = true;
 	spa_hook_list_call(&this->listener_list, struct pw_node_events, initialized);
 
@@ -282,6 +299,7 @@ struct pw_node *pw_node_new(struct pw_core *core,
 {
 	struct impl *impl;
 	struct pw_node *this;
+	struct pw_data_loop *data_loop;
 
 	impl = calloc(1, sizeof(struct impl) + user_data_size);
 	if (impl == NULL)
@@ -306,9 +324,16 @@ struct pw_node *pw_node_new(struct pw_core *core,
 	impl->work = pw_work_queue_new(this->core->main_loop);
 	this->info.name = strdup(name);
 
-	this->data_loop = core->data_loop;
+	/* the node runs on the data loop named in its properties */
+	data_loop = pw_core_get_data_loop(core, pw_properties_get(properties, "node.data-loop"));
+	if (data_loop == NULL) {
+		pw_log_warn("node %p: can't get data loop, using the default", this);
+		data_loop = pw_core_get_data_loop(core, NULL);
+	}
+	impl->data_loop = data_loop;
+	this->data_loop = data_loop->loop;
 
-	this->rt.graph = &core->rt.graph;
+	this->rt.graph = &data_loop->graph;
 
 	spa_list_init(&this->resource_list);
 
@@ -322,6 +347,7 @@ struct pw_node *pw_node_new(struct pw_core *core,
 	pw_map_init(&this->output_port_map, 64, 64);
 
 	spa_graph_node_init(&this->rt.node);
+	this->rt.node.name = this->info.name;
 
 	return this;
 
@@ -400,18 +426,77 @@ static void node_event(void *data, struct spa_event *event)
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, event, event);
 }
 
+static inline uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static inline void copy_clock_stats(struct spa_clock_stats *dst, const struct spa_clock_stats *src)
+{
+#define COPY(f)	__atomic_store_n(&dst->f, __atomic_load_n(&src->f, __ATOMIC_RELAXED), __ATOMIC_RELAXED)
+	COPY(rate);
+	COPY(quantum);
+	COPY(fill);
+	COPY(size);
+	COPY(xruns);
+#undef COPY
+}
+
+static uint64_t stats_cycle_start(struct pw_node *node)
+{
+	struct pw_node_stats *stats = node->rt.stats;
+	uint64_t now;
+
+	if (stats == NULL)
+		return 0;
+
+	now = get_time();
+	if (stats->cycle_start != 0)
+		__atomic_store_n(&stats->period, now - stats->cycle_start, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats->cycle_start, now, __ATOMIC_RELAXED);
+
+	if (node->own_clock && node->own_clock->version >= 1 && node->own_clock->stats)
+		copy_clock_stats(&stats->clock, node->own_clock->stats);
+
+	return now;
+}
+
+static void stats_cycle_end(struct pw_node *node, uint64_t start)
+{
+	if (node->rt.stats)
+		spa_histogram_add(&node->rt.stats->cycle_time, get_time() - start);
+}
+
+/* a cycle is everything the graph does for one need_input or have_output
+ * of a node, the pipewire:cycle_start and pipewire:cycle_end probes have
+ * the graph node, its name and the direction as arguments. The time of
+ * the cycle goes in the stats of the node when the core has stats. */
 static void node_need_input(void *data)
 {
 	struct pw_node *node = data;
+	uint64_t start;
+
+	spa_probe3(pipewire, cycle_start, &node->rt.node, node->info.name, SPA_DIRECTION_INPUT);
+	start = stats_cycle_start(node);
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, need_input);
 	spa_graph_need_input(node->rt.graph, &node->rt.node);
+	stats_cycle_end(node, start);
+	spa_probe2(pipewire, cycle_end, &node->rt.node, SPA_DIRECTION_INPUT);
 }
 
 static void node_have_output(void *data)
 {
 	struct pw_node *node = data;
+	uint64_t start;
+
+	spa_probe3(pipewire, cycle_start, &node->rt.node, node->info.name, SPA_DIRECTION_OUTPUT);
+	start = stats_cycle_start(node);
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, have_output);
 	spa_graph_have_output(node->rt.graph, &node->rt.node);
+	stats_cycle_end(node, start);
+	spa_probe2(pipewire, cycle_end, &node->rt.node, SPA_DIRECTION_OUTPUT);
 }
 
 static void node_reuse_buffer(void *data, uint32_t port_id, uint32_t buffer_id)
@@ -423,8 +508,10 @@ static void node_reuse_buffer(void *data, uint32_t port_id, uint32_t buffer_id)
 		if (p->port_id != port_id)
 			continue;
 
-		if ((pp = p->peer) != NULL)
+		if ((pp = p->peer) != NULL) {
+			spa_probe3(pipewire, reuse_buffer, pp->node, pp->port_id, buffer_id);
 			spa_node_port_reuse_buffer(pp->node->implementation, pp->port_id, buffer_id);
+		}
 		break;
 	}
 }
@@ -475,6 +562,9 @@ do_node_remove(struct spa_loop *loop,
 
 	spa_graph_node_remove(&this->rt.node);
 
+	this->rt.stats = NULL;
+	this->rt.node.stats = NULL;
+
 	return SPA_RESULT_OK;
 }
 
@@ -497,6 +587,9 @@ void pw_node_destroy(struct pw_node *node)
 
 	pw_loop_invoke(node->data_loop, do_node_remove, 1, 0, NULL, true, node);
 
+	if (node->stats)
+		pw_core_free_node_stats(node->core, node->stats);
+
 	if (impl->registered) {
 		spa_list_remove(&node->link);
 		pw_global_destroy(node->global);
@@ -530,6 +623,8 @@ void pw_node_destroy(struct pw_node *node)
 
 	clear_info(node);
 
+	pw_core_release_data_loop(node->core, impl->data_loop);
+
 	free(impl);
 }
 
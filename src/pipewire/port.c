@@ -31,8 +31,18 @@ struct impl {
 
 	struct spa_node mix_node;
 };
+
+/* generations are unique over all ports so that a pair of them identifies
+ * a negotiation, 0 is never used */
+static uint32_t format_generation;
 /** \endcond */
 
+static uint32_t next_format_generation(void)
+{
+	if (++format_generation == 0)
+		++format_generation;
+	return format_generation;
+}
 
 static void port_update_state(struct pw_port *port, enum pw_port_state state)
 {
@@ -168,6 +178,8 @@ struct pw_port *pw_port_new(enum pw_direction direction,
 	this->state = PW_PORT_STATE_INIT;
 	this->io.status = SPA_RESULT_OK;
 	this->io.buffer_id = SPA_ID_INVALID;
+	this->format_cache.generation = next_format_generation();
+	pw_array_init(&this->format_cache.data, 1024);
 
         if (user_data_size > 0)
 		this->user_data = SPA_MEMBER(impl, sizeof(struct impl), void);
@@ -182,6 +194,7 @@ struct pw_port *pw_port_new(enum pw_direction direction,
 			    0,
 			    &this->io);
 	spa_graph_node_init(&this->rt.mix_node);
+	this->rt.mix_node.name = this->direction == PW_DIRECTION_INPUT ? "port-mix" : "port-tee";
 
 	impl->mix_node = this->direction == PW_DIRECTION_INPUT ?  schedule_mix_node : schedule_tee_node;
 	spa_graph_node_set_implementation(&this->rt.mix_node, &impl->mix_node);
@@ -226,6 +239,64 @@ void pw_port_update_properties(struct pw_port *port, const struct spa_dict *dict
 			   properties_changed, port->properties);
 }
 
+/** Invalidate the cached formats of a port
+ *
+ * \param port a port
+ *
+ * Must be called when the possible formats of the port changed. The port
+ * gets a new format generation so that earlier negotiation results with
+ * the port are not used anymore.
+ *
+ * \memberof pw_port
+ */
+void pw_port_invalidate_formats(struct pw_port *port)
+{
+	pw_log_debug("port %p: invalidate formats", port);
+	port->format_cache.valid = false;
+	port->format_cache.generation = next_format_generation();
+}
+
+/** Get the possible formats of a port
+ *
+ * \param port a port
+ * \return the number of formats in the cache of \a port
+ *
+ * The formats of the port are enumerated and copied into the cache of the
+ * port when the cache is not valid.
+ *
+ * \memberof pw_port
+ */
+int pw_port_cache_formats(struct pw_port *port)
+{
+	struct pw_array *data = &port->format_cache.data;
+	struct spa_format *format;
+	uint32_t index;
+	void *p;
+
+	if (port->format_cache.valid)
+		return port->format_cache.n_formats;
+
+	data->size = 0;
+	for (index = 0;; index++) {
+		uint32_t size;
+
+		if (spa_node_port_enum_formats(port->node->node, port->direction, port->port_id,
+					       &format, NULL, index) < 0)
+			break;
+
+		size = SPA_POD_SIZE(format);
+		if ((p = pw_array_add(data, SPA_ROUND_UP_N(size, 8))) == NULL)
+			return SPA_RESULT_NO_MEMORY;
+		memcpy(p, format, size);
+	}
+	pw_log_debug("port %p: cached %d formats", port, index);
+
+	port->format_cache.n_formats = index;
+	port->format_cache.valid = true;
+
+	return index;
+}
+
 struct pw_node *pw_port_get_node(struct pw_port *port)
 {
 	return port->node;
@@ -333,14 +404,14 @@ void pw_port_destroy(struct pw_port *port)
 	pw_log_debug("port %p: free", port);
 	spa_hook_list_call(&port->listener_list, struct pw_port_events, free);
 
-	if (port->allocated) {
-		free(port->buffers);
-		pw_memblock_free(&port->buffer_mem);
-	}
+	if (port->allocated && node)
+		pw_link_release_buffers(node->core, port->buffers);
 
 	if (port->properties)
 		pw_properties_free(port->properties);
 
+	pw_array_clear(&port->format_cache.data);
+
 	free(port);
 }
 
@@ -356,17 +427,24 @@ do_port_pause(struct spa_loop *loop,
 
 int pw_port_set_format(struct pw_port *port, uint32_t flags, const struct spa_format *format)
 {
+	struct pw_node *node = port->node;
+	struct pw_port *p;
 	int res;
 
-	res = spa_node_port_set_format(port->node->node, port->direction, port->port_id, flags, format);
+	res = spa_node_port_set_format(node->node, port->direction, port->port_id, flags, format);
 	pw_log_debug("port %p: set format %d", port, res);
 
+	/* the format of one port can restrict the formats of the other ports
+	 * of the node */
+	spa_list_for_each(p, &node->input_ports, link)
+		pw_port_invalidate_formats(p);
+	spa_list_for_each(p, &node->output_ports, link)
+		pw_port_invalidate_formats(p);
+
 	if (!SPA_RESULT_IS_ASYNC(res)) {
 		if (format == NULL) {
-			if (port->allocated) {
-				free(port->buffers);
-				pw_memblock_free(&port->buffer_mem);
-			}
+			if (port->allocated)
+				pw_link_release_buffers(port->node->core, port->buffers);
 			port->buffers = NULL;
 			port->n_buffers = 0;
 			port->allocated = false;
@@ -398,10 +476,8 @@ int pw_port_use_buffers(struct pw_port *port, struct spa_buffer **buffers, uint3
 	pw_log_debug("port %p: use %d buffers", port, n_buffers);
 	res = spa_node_port_use_buffers(port->node->node, port->direction, port->port_id, buffers, n_buffers);
 
-	if (port->allocated) {
-		free(port->buffers);
-		pw_memblock_free(&port->buffer_mem);
-	}
+	if (port->allocated)
+		pw_link_release_buffers(port->node->core, port->buffers);
 	port->buffers = buffers;
 	port->n_buffers = n_buffers;
 	port->allocated = false;
@@ -434,10 +510,8 @@ int pw_port_alloc_buffers(struct pw_port *port,
 	res = spa_node_port_alloc_buffers(port->node->node, port->direction, port->port_id,
 							  params, n_params,
 							  buffers, n_buffers);
-	if (port->allocated) {
-		free(port->buffers);
-		pw_memblock_free(&port->buffer_mem);
-	}
+	if (port->allocated)
+		pw_link_release_buffers(port->node->core, port->buffers);
 	port->buffers = buffers;
 	port->n_buffers = *n_buffers;
 	port->allocated = true;
@@ -89,6 +89,10 @@ const struct pw_properties *pw_port_get_properties(struct pw_port *port);
 
 void pw_port_update_properties(struct pw_port *port, const struct spa_dict *dict);
 
+/** Signal that the possible formats of the port changed, the cached formats
+ * and negotiation results of the port are not used anymore */
+void pw_port_invalidate_formats(struct pw_port *port);
+
 /** Get the port id */
 uint32_t pw_port_get_id(struct pw_port *port);
 
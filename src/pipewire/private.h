@@ -31,6 +31,7 @@ extern "C" {
 #include "pipewire/mem.h"
 #include "pipewire/pipewire.h"
 #include "pipewire/introspect.h"
+#include "pipewire/stats.h"
 
 struct pw_command {
 	struct spa_list link;	/**< link in list of commands */
@@ -71,6 +72,7 @@ struct pw_client {
 	struct pw_map objects;		/**< list of resource objects */
 	uint32_t n_types;		/**< number of client types */
 	struct pw_map types;		/**< map of client types */
+	bool remap_types;		/**< client type ids differ from ours */
 
 	struct spa_list resource_list;	/**< The list of resources of this client */
 
@@ -100,6 +102,15 @@ struct pw_global {
 	void *object;			/**< object associated with the interface */
 };
 
+#define PW_FORMAT_MEMO_SIZE	256
+
+/** a negotiated format between two ports */
+struct pw_format_memo {
+	uint32_t output_generation;	/**< format generation of the output port */
+	uint32_t input_generation;	/**< format generation of the input port */
+	struct spa_format *format;	/**< the common format or NULL when there is none */
+};
+
 struct pw_core {
 	struct pw_global *global;	/**< the global of the core */
 
@@ -118,6 +129,7 @@ struct pw_core {
 	struct spa_list remote_list;		/**< list of remote connections */
 	struct spa_list resource_list;		/**< list of core resources */
 	struct spa_list registry_resource_list;	/**< list of registry resources */
+	struct spa_list registry_snapshot_list;	/**< list of snapshot registry resources */
 	struct spa_list module_list;		/**< list of modules */
 	struct spa_list global_list;		/**< list of globals */
 	struct spa_list client_list;		/**< list of clients */
@@ -125,18 +137,26 @@ struct pw_core {
 	struct spa_list node_factory_list;	/**< list of node factories */
 	struct spa_list link_list;		/**< list of links */
 
+	struct spa_list buffer_pool;		/**< list of buffers allocated by links */
+	uint32_t n_buffer_pool_idle;		/**< number of unused buffers in the pool */
+	struct spa_source *buffer_pool_timer;	/**< trims the pool when it is idle */
+
+	struct pw_format_memo format_memo[PW_FORMAT_MEMO_SIZE];	/**< negotiated formats */
+
+	struct pw_stats_header *stats;		/**< node stats in shared memory or NULL */
+	uint32_t stats_n_nodes;			/**< number of node slots in stats */
+	char *stats_path;			/**< path of the stats file */
+	int stats_fd;				/**< fd of the stats file, locked */
+
 	struct spa_hook_list listener_list;
 
 	struct pw_loop *main_loop;	/**< main loop for control */
 	struct pw_loop *data_loop;	/**< data loop for data passing */
         struct pw_data_loop *data_loop_impl;
+	struct spa_list data_loop_list;	/**< list of data loops, the first is the default */
 
 	struct spa_support support[4];	/**< support for spa plugins */
 	uint32_t n_support;		/**< number of support items */
-
-	struct {
-		struct spa_graph graph;
-	} rt;
 };
 
 struct pw_data_loop {
@@ -148,6 +168,28 @@ struct pw_data_loop {
 
         bool running;
         pthread_t thread;
+
+	struct spa_list link;		/**< link in core data_loop_list */
+	char *name;			/**< name used to assign nodes and find settings */
+	int refcount;			/**< users of the loop, see pw_core_get_data_loop */
+
+	struct spa_support support[4];	/**< support for spa plugins on this loop */
+	uint32_t n_support;		/**< number of support items */
+
+	struct spa_graph graph;		/**< graph of the nodes on this loop */
+
+	struct {
+		int policy;		/**< scheduling policy, SCHED_FIFO or SCHED_RR */
+		int priority;		/**< realtime priority */
+		char *cpus;		/**< cpu list for the thread or NULL */
+		bool isolate;		/**< move other threads off \a cpus */
+		bool mlock;		/**< lock all memory with mlockall */
+		size_t prefault_stack;	/**< bytes of stack to prefault */
+		size_t prefault_heap;	/**< bytes of heap to prefault */
+		int64_t rttime;		/**< RLIMIT_RTTIME watchdog in usec, 0 disables */
+		int watchdog;		/**< watchdog slot or -1 */
+		struct spa_hook check_hook;	/**< marks dispatch for pw_rt_check */
+	} rt;
 };
 
 struct pw_main_loop {
@@ -181,7 +223,6 @@ struct pw_link {
 	struct spa_hook_list listener_list;
 
 	void *buffer_owner;
-	struct pw_memblock buffer_mem;
 	struct spa_buffer **buffers;
 	uint32_t n_buffers;
 
@@ -219,6 +260,9 @@ struct pw_node {
 
 	bool live;			/**< if the node is live */
 	struct spa_clock *clock;	/**< handle to SPA clock if any */
+	struct spa_clock *own_clock;	/**< clock of the node itself, clock is
+					  *  replaced by the clock of the upstream
+					  *  node when it is linked */
 	struct spa_node *node;		/**< SPA node implementation */
 
 	struct spa_list resource_list;	/**< list of resources for this node */
@@ -237,9 +281,13 @@ struct pw_node {
 
 	struct pw_loop *data_loop;		/**< the data loop for this node */
 
+	struct pw_node_stats *stats;		/**< slot in the core stats or NULL */
+
 	struct {
 		struct spa_graph *graph;
 		struct spa_graph_node node;
+		struct pw_node_stats *stats;	/**< stats, set when the node is added
+						  *  to the graph */
 	} rt;
 
         void *user_data;                /**< extra user data */
@@ -259,7 +307,6 @@ struct pw_port {
 	struct spa_port_io io;		/**< io area of the port */
 
 	bool allocated;			/**< if buffers are allocated */
-	struct pw_memblock buffer_mem;	/**< allocated buffer memory */
 	struct spa_buffer **buffers;	/**< port buffers */
 	uint32_t n_buffers;		/**< number of port buffers */
 
@@ -269,6 +316,13 @@ struct pw_port {
 
 	struct spa_node *mix;		/**< optional port buffer mix/split */
 
+	struct {
+		uint32_t generation;	/**< unique id of the current possible formats */
+		bool valid;		/**< formats are enumerated */
+		uint32_t n_formats;	/**< number of formats in \a data */
+		struct pw_array data;	/**< the formats, padded to 8 bytes */
+	} format_cache;			/**< enumerated formats of the port */
+
 	struct {
 		struct spa_graph *graph;
 		struct spa_graph_port port;	/**< this graph port, linked to mix_port */
@@ -328,6 +382,7 @@ struct pw_remote {
 
 	uint32_t n_types;			/**< number of client types */
 	struct pw_map types;			/**< client types */
+	bool remap_types;			/**< server type ids differ from ours */
 
 	struct spa_list proxy_list;		/**< list of \ref pw_proxy objects */
 	struct spa_list stream_list;		/**< list of \ref pw_stream objects */
@@ -373,6 +428,10 @@ struct pw_node_factory {
 /** Set a format on a port \memberof pw_port */
 int pw_port_set_format(struct pw_port *port, uint32_t flags, const struct spa_format *format);
 
+/** Get the number of formats of a port, enumerated when the cache is not
+ * valid \memberof pw_port */
+int pw_port_cache_formats(struct pw_port *port);
+
 /** Use buffers on a port \memberof pw_port */
 int pw_port_use_buffers(struct pw_port *port, struct spa_buffer **buffers, uint32_t n_buffers);
 
@@ -381,6 +440,30 @@ int pw_port_alloc_buffers(struct pw_port *port,
 			  struct spa_param **params, uint32_t n_params,
 			  struct spa_buffer **buffers, uint32_t *n_buffers);
 
+/** Return buffers allocated by a link to the buffer pool \memberof pw_link */
+void pw_link_release_buffers(struct pw_core *core, struct spa_buffer **buffers);
+
+/** Free the unused buffers in the buffer pool \memberof pw_link */
+void pw_link_trim_buffers(struct pw_core *core);
+
+/** Don't reuse the buffers that were shared with a client \memberof pw_link */
+void pw_link_forget_client_buffers(struct pw_core *core, struct pw_client *client);
+
+/** Get a free slot in the stats of the core for a node, NULL when the
+ * core has no stats or all slots are used \memberof pw_core */
+struct pw_node_stats *pw_core_alloc_node_stats(struct pw_core *core, uint32_t id, const char *name);
+
+/** Give a slot back after the data thread stopped using it \memberof pw_core */
+void pw_core_free_node_stats(struct pw_core *core, struct pw_node_stats *stats);
+
+/** Fill the registry snapshot info of a global \memberof pw_global */
+void pw_global_get_registry_info(struct pw_global *global, uint32_t permissions,
+				 struct pw_registry_global *info);
+
+void pw_core_registry_snapshot(struct pw_resource *registry, uint32_t flags,
+			       uint32_t n_globals, const struct pw_registry_global *globals,
+			       uint32_t n_removed, const uint32_t *removed);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,49 +18,271 @@
  */
 
 #include <stdio.h>
+#include <pthread.h>
 
 #include "pipewire/pipewire.h"
 #include "pipewire/properties.h"
 
 /** \cond */
+/* use the hash index from this many items, smaller dicts are scanned */
+#define INDEX_MIN_ITEMS	8
+
 struct properties {
 	struct pw_properties this;
 
 	struct pw_array items;
+	struct pw_array hashes;
+
+	/* open addressing hash table with index + 1 of the items, 0 is free */
+	uint32_t *index;
+	uint32_t index_size;
 };
+
+/* keys that are used often. They are interned, items with these keys
+ * point into this string instead of to a copy of the key */
+static const char known_keys[] =
+	"media.class\0"
+	"media.name\0"
+	"media.role\0"
+	"media.category\0"
+	"node.name\0"
+	"node.data-loop\0"
+	"device.path\0"
+	"device.api\0"
+	"alsa.card\0"
+	"data-loop.name\0"
+	"data-loop.assign\0"
+	"application.name\0"
+	"application.prgname\0"
+	"application.language\0"
+	"application.process.id\0"
+	"application.process.user\0"
+	"application.process.userid\0"
+	"application.process.host\0"
+	"pipewire.core.name\0"
+	"pipewire.core.version\0"
+	"pipewire.daemon\0"
+	"pipewire.protocol\0"
+	"pipewire.autoconnect\0"
+	"pipewire.target.node\0"
+	"pipewire.latency.is-live\0"
+	"spa.library.name\0"
+	"spa.factory.name\0";
+
+/* hash table of the known keys */
+#define KNOWN_SIZE	64
+static struct {
+	uint32_t hash;
+	const char *key;
+} known[KNOWN_SIZE];
+static pthread_once_t known_once = PTHREAD_ONCE_INIT;
 /** \endcond */
 
-static void add_func(struct pw_properties *this, char *key, char *value)
+static inline uint32_t hash_key(const char *key)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*key)
+		hash = (hash ^ (uint8_t) *key++) * 16777619u;
+
+	return hash;
+}
+
+static void init_known_keys(void)
+{
+	const char *key;
+	uint32_t hash, pos;
+
+	for (key = known_keys; *key; key += strlen(key) + 1) {
+		hash = hash_key(key);
+		for (pos = hash % KNOWN_SIZE; known[pos].key; pos = (pos + 1) % KNOWN_SIZE);
+		known[pos].hash = hash;
+		known[pos].key = key;
+	}
+}
+
+static inline bool is_known_key(const char *key)
+{
+	return key >= known_keys && key < known_keys + sizeof(known_keys);
+}
+
+static char *intern_key(const char *key, uint32_t hash)
+{
+	uint32_t pos;
+
+	pthread_once(&known_once, init_known_keys);
+
+	for (pos = hash % KNOWN_SIZE; known[pos].key; pos = (pos + 1) % KNOWN_SIZE) {
+		if (known[pos].hash == hash && strcmp(known[pos].key, key) == 0)
+			return (char *) known[pos].key;
+	}
+	return strdup(key);
+}
+
+static void clear_item(struct spa_dict_item *item)
+{
+	if (!is_known_key(item->key))
+		free((char *) item->key);
+	free((char *) item->value);
+}
+
+static inline uint32_t n_items(struct properties *impl)
+{
+	return pw_array_get_len(&impl->items, struct spa_dict_item);
+}
+
+static inline uint32_t *item_hash(struct properties *impl, uint32_t index)
+{
+	return pw_array_get_unchecked(&impl->hashes, index, uint32_t);
+}
+
+static void update_dict(struct properties *impl)
+{
+	impl->this.dict.items = impl->items.data;
+	impl->this.dict.n_items = n_items(impl);
+}
+
+static void index_insert(struct properties *impl, uint32_t hash, uint32_t index)
+{
+	uint32_t pos, mask = impl->index_size - 1;
+
+	for (pos = hash & mask; impl->index[pos] != 0; pos = (pos + 1) & mask);
+	impl->index[pos] = index + 1;
+}
+
+/* make the index again for the current items, it is kept at most half
+ * full and only used for larger dicts */
+static void rebuild_index(struct properties *impl)
+{
+	uint32_t i, n = n_items(impl), size;
+
+	if (n < INDEX_MIN_ITEMS) {
+		free(impl->index);
+		impl->index = NULL;
+		impl->index_size = 0;
+		return;
+	}
+	for (size = 32; size < n * 2; size <<= 1);
+
+	if (size != impl->index_size) {
+		free(impl->index);
+		impl->index = malloc(size * sizeof(uint32_t));
+		impl->index_size = impl->index ? size : 0;
+		if (impl->index == NULL)
+			return;
+	}
+	memset(impl->index, 0, size * sizeof(uint32_t));
+	for (i = 0; i < n; i++)
+		index_insert(impl, *item_hash(impl, i), i);
+}
+
+static int find_index(struct properties *impl, const char *key, uint32_t hash)
+{
+	struct spa_dict_item *items = impl->items.data;
+	uint32_t i, pos, mask, n = n_items(impl);
+
+	if (impl->index == NULL) {
+		for (i = 0; i < n; i++) {
+			if (*item_hash(impl, i) == hash &&
+			    (items[i].key == key || strcmp(items[i].key, key) == 0))
+				return i;
+		}
+		return -1;
+	}
+
+	mask = impl->index_size - 1;
+	for (pos = hash & mask; (i = impl->index[pos]) != 0; pos = (pos + 1) & mask) {
+		i--;
+		if (*item_hash(impl, i) == hash &&
+		    (items[i].key == key || strcmp(items[i].key, key) == 0))
+			return i;
+	}
+	return -1;
+}
+
+static void add_func(struct properties *impl, char *key, uint32_t hash, char *value)
 {
 	struct spa_dict_item *item;
-	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
+	uint32_t *h, index = n_items(impl);
 
 	item = pw_array_add(&impl->items, sizeof(struct spa_dict_item));
+	h = pw_array_add(&impl->hashes, sizeof(uint32_t));
+	if (item == NULL || h == NULL) {
+		impl->items.size = index * sizeof(struct spa_dict_item);
+		impl->hashes.size = index * sizeof(uint32_t);
+		if (!is_known_key(key))
+			free(key);
+		free(value);
+		return;
+	}
 	item->key = key;
 	item->value = value;
+	*h = hash;
+
+	update_dict(impl);
 
-	this->dict.items = impl->items.data;
-	this->dict.n_items = pw_array_get_len(&impl->items, struct spa_dict_item);
+	if (impl->index != NULL && (index + 1) * 2 <= impl->index_size)
+		index_insert(impl, hash, index);
+	else if (index + 1 >= INDEX_MIN_ITEMS)
+		rebuild_index(impl);
 }
 
-static void clear_item(struct spa_dict_item *item)
+static void remove_index(struct properties *impl, int index)
 {
-	free((char *) item->key);
-	free((char *) item->value);
+	struct spa_dict_item *items = impl->items.data;
+	uint32_t *hashes = impl->hashes.data;
+	uint32_t n = n_items(impl) - 1;
+
+	clear_item(&items[index]);
+
+	/* keep the order of the other items */
+	memmove(&items[index], &items[index + 1], (n - index) * sizeof(struct spa_dict_item));
+	memmove(&hashes[index], &hashes[index + 1], (n - index) * sizeof(uint32_t));
+	impl->items.size -= sizeof(struct spa_dict_item);
+	impl->hashes.size -= sizeof(uint32_t);
+
+	update_dict(impl);
+	rebuild_index(impl);
 }
 
-static int find_index(const struct pw_properties *this, const char *key)
+/* set \a key to \a value, which is consumed, or remove it when \a value is NULL */
+static void do_replace(struct properties *impl, const char *key, uint32_t hash, char *value)
 {
-	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
-	int i, len = pw_array_get_len(&impl->items, struct spa_dict_item);
+	int index = find_index(impl, key, hash);
 
-	for (i = 0; i < len; i++) {
+	if (index == -1) {
+		if (value != NULL)
+			add_func(impl, intern_key(key, hash), hash, value);
+	} else if (value == NULL) {
+		remove_index(impl, index);
+	} else {
 		struct spa_dict_item *item =
-		    pw_array_get_unchecked(&impl->items, i, struct spa_dict_item);
-		if (strcmp(item->key, key) == 0)
-			return i;
+		    pw_array_get_unchecked(&impl->items, index, struct spa_dict_item);
+
+		free((char *) item->value);
+		item->value = value;
 	}
-	return -1;
+}
+
+static struct properties *properties_new(uint32_t n_items)
+{
+	struct properties *impl;
+
+	impl = calloc(1, sizeof(struct properties));
+	if (impl == NULL)
+		return NULL;
+
+	n_items = SPA_MAX(n_items, 16u);
+	pw_array_init(&impl->items, n_items * sizeof(struct spa_dict_item));
+	pw_array_init(&impl->hashes, n_items * sizeof(uint32_t));
+
+	return impl;
+}
+
+static void properties_add(struct properties *impl, const char *key, const char *value)
+{
+	uint32_t hash = hash_key(key);
+	add_func(impl, intern_key(key, hash), hash, strdup(value));
 }
 
 /** Make a new properties object
@@ -77,16 +299,14 @@ struct pw_properties *pw_properties_new(const char *key, ...)
 	va_list varargs;
 	const char *value;
 
-	impl = calloc(1, sizeof(struct properties));
+	impl = properties_new(0);
 	if (impl == NULL)
 		return NULL;
 
-	pw_array_init(&impl->items, 16);
-
 	va_start(varargs, key);
 	while (key != NULL) {
 		value = va_arg(varargs, char *);
-		add_func(&impl->this, strdup(key), strdup(value));
+		properties_add(impl, key, value);
 		key = va_arg(varargs, char *);
 	}
 	va_end(varargs);
@@ -106,14 +326,12 @@ struct pw_properties *pw_properties_new_dict(const struct spa_dict *dict)
 	uint32_t i;
 	struct properties *impl;
 
-	impl = calloc(1, sizeof(struct properties));
+	impl = properties_new(dict->n_items);
 	if (impl == NULL)
 		return NULL;
 
-	pw_array_init(&impl->items, 16);
-
 	for (i = 0; i < dict->n_items; i++)
-		add_func(&impl->this, strdup(dict->items[i].key), strdup(dict->items[i].value));
+		properties_add(impl, dict->items[i].key, dict->items[i].value);
 
 	return &impl->this;
 }
@@ -128,17 +346,21 @@ struct pw_properties *pw_properties_new_dict(const struct spa_dict *dict)
 struct pw_properties *pw_properties_copy(const struct pw_properties *properties)
 {
 	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
-	struct pw_properties *copy;
+	struct properties *copy;
 	struct spa_dict_item *item;
+	uint32_t i;
 
-	copy = pw_properties_new(NULL, NULL);
+	copy = properties_new(n_items(impl));
 	if (copy == NULL)
 		return NULL;
 
-	pw_array_for_each(item, &impl->items)
-	    add_func(copy, strdup(item->key), strdup(item->value));
-
-	return copy;
+	/* the hashes don't need to be computed again */
+	for (i = 0; i < n_items(impl); i++) {
+		item = pw_array_get_unchecked(&impl->items, i, struct spa_dict_item);
+		add_func(copy, is_known_key(item->key) ? (char *) item->key : strdup(item->key),
+			 *item_hash(impl, i), strdup(item->value));
+	}
+	return &copy->this;
 }
 
 /** Merge properties into one
@@ -165,15 +387,18 @@ struct pw_properties *pw_properties_merge(const struct pw_properties *oldprops,
 	} else if (newprops == NULL) {
 		res = pw_properties_copy(oldprops);
 	} else {
-		const char *key;
-		void *state = NULL;
+		struct properties *impl = SPA_CONTAINER_OF(newprops, struct properties, this);
+		struct spa_dict_item *item;
+		uint32_t i;
 
 		res = pw_properties_copy(oldprops);
 		if (res == NULL)
 			return NULL;
 
-		while ((key = pw_properties_iterate(newprops, &state))) {
-			pw_properties_set(res, key, pw_properties_get(newprops, key));
+		for (i = 0; i < n_items(impl); i++) {
+			item = pw_array_get_unchecked(&impl->items, i, struct spa_dict_item);
+			do_replace(SPA_CONTAINER_OF(res, struct properties, this),
+				   item->key, *item_hash(impl, i), strdup(item->value));
 		}
 	}
 	return res;
@@ -194,38 +419,11 @@ void pw_properties_free(struct pw_properties *properties)
 	    clear_item(item);
 
 	pw_array_clear(&impl->items);
+	pw_array_clear(&impl->hashes);
+	free(impl->index);
 	free(impl);
 }
 
-static void do_replace(struct pw_properties *properties, char *key, char *value)
-{
-	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
-	int index = find_index(properties, key);
-
-	if (index == -1) {
-		add_func(properties, key, value);
-	} else {
-		struct spa_dict_item *item =
-		    pw_array_get_unchecked(&impl->items, index, struct spa_dict_item);
-
-		clear_item(item);
-		if (value == NULL) {
-			struct spa_dict_item *other = pw_array_get_unchecked(&impl->items,
-									     pw_array_get_len
-									     (&impl->items,
-									      struct spa_dict_item)
-									     - 1,
-									     struct spa_dict_item);
-			item->key = other->key;
-			item->value = other->value;
-			impl->items.size -= sizeof(struct spa_dict_item);
-		} else {
-			item->key = key;
-			item->value = value;
-		}
-	}
-}
-
 /** Set a property value
  *
  * \param properties the properties to change
@@ -240,7 +438,9 @@ static void do_replace(struct pw_properties *properties, char *key, char *value)
  */
 void pw_properties_set(struct pw_properties *properties, const char *key, const char *value)
 {
-	do_replace(properties, strdup(key), value ? strdup(value) : NULL);
+	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
+
+	do_replace(impl, key, hash_key(key), value ? strdup(value) : NULL);
 }
 
 /** Set a property value by format
@@ -257,14 +457,17 @@ void pw_properties_set(struct pw_properties *properties, const char *key, const
  */
 void pw_properties_setf(struct pw_properties *properties, const char *key, const char *format, ...)
 {
+	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
 	va_list varargs;
 	char *value;
 
 	va_start(varargs, format);
-	vasprintf(&value, format, varargs);
+	if (vasprintf(&value, format, varargs) < 0)
+		value = NULL;
 	va_end(varargs);
 
-	do_replace(properties, strdup(key), value);
+	if (value != NULL)
+		do_replace(impl, key, hash_key(key), value);
 }
 
 /** Get a property
@@ -280,7 +483,7 @@ void pw_properties_setf(struct pw_properties *properties, const char *key, const
 const char *pw_properties_get(const struct pw_properties *properties, const char *key)
 {
 	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
-	int index = find_index(properties, key);
+	int index = find_index(impl, key, hash_key(key));
 
 	if (index == -1)
 		return NULL;
@@ -34,6 +34,10 @@
  * Both keys and values are strings which keeps things simple.
  * Encoding of arbitrary values should be done by using a string
  * serialization such as base64 for binary blobs.
+ *
+ * The items of \a dict stay in the order they were added in, also when
+ * other keys are removed. Lookups with pw_properties_get() use a hash
+ * index, lookups on \a dict are a linear scan.
  */
 struct pw_properties {
 	struct spa_dict dict;
@@ -178,10 +178,35 @@ core_event_update_types(void *data, uint32_t first_id, uint32_t n_types, const c
 	struct pw_remote *this = data;
 	int i;
 
+	/* the server skipped the reserved types and starts with the marker,
+	 * a server with other reserved types has it at another id */
+	if (pw_map_get_size(&this->types) == 0 &&
+	    (first_id == SPA_TYPE__TypeIds_ID ||
+	     (n_types > 0 && spa_type_is_ids_marker(types[0])))) {
+		if (first_id != SPA_TYPE__TypeIds_ID || n_types == 0 ||
+		    !spa_type_map_has_ids(this->core->type.map) ||
+		    strcmp(types[0], SPA_TYPE__TypeIds) != 0) {
+			/* the reserved ids stay unmapped, messages that use them
+			 * fail to remap and are dropped */
+			pw_log_error("remote %p: reserved type ids differ from ours", this);
+			this->remap_types = true;
+			pw_remote_update_state(this, PW_REMOTE_STATE_ERROR,
+					       "reserved type ids differ from the server");
+			return;
+		}
+		for (i = 0; i < first_id; i++)
+			pw_map_insert_at(&this->types, i, PW_MAP_ID_TO_PTR(i));
+	}
+
 	for (i = 0; i < n_types; i++, first_id++) {
 		uint32_t this_id = spa_type_map_get_id(this->core->type.map, types[i]);
 		if (!pw_map_insert_at(&this->types, first_id, PW_MAP_ID_TO_PTR(this_id)))
 			pw_log_error("can't add type for client");
+		if (this_id != first_id && !this->remap_types) {
+			pw_log_debug("remote %p: type %s has id %u, we have %u, enable remapping",
+				     this, types[i], first_id, this_id);
+			this->remap_types = true;
+		}
 	}
 }
 
@@ -388,6 +413,7 @@ void pw_remote_disconnect(struct pw_remote *remote)
 	pw_map_clear(&remote->objects);
 	pw_map_clear(&remote->types);
 	remote->n_types = 0;
+	remote->remap_types = false;
 
 	if (remote->info) {
 		pw_core_info_free (remote->info);
@@ -430,7 +456,7 @@ static void handle_rtnode_message(struct pw_proxy *proxy, struct pw_client_node_
 		/* process all input in the mixers */
 		spa_list_for_each(port, &n->ports[SPA_DIRECTION_INPUT], link) {
 			pn = port->peer->node;
-	                pn->state = spa_node_process_input(pn->implementation);
+	                pn->state = spa_graph_node_process_input(pn);
 	                if (pn->state == SPA_RESULT_HAVE_BUFFER)
 	                        spa_graph_have_output(data->node->rt.graph, pn);
 			else {
@@ -444,7 +470,7 @@ static void handle_rtnode_message(struct pw_proxy *proxy, struct pw_client_node_
 		}
         }
 	else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_PROCESS_OUTPUT) {
-		spa_node_process_output(n->implementation);
+		spa_graph_node_process_output(n);
 	}
 	else if (PW_CLIENT_NODE_MESSAGE_TYPE(message) == PW_CLIENT_NODE_MESSAGE_REUSE_BUFFER) {
 	}
@@ -472,7 +498,8 @@ on_rtsocket_condition(void *user_data, int fd, enum spa_io mask)
 		read(fd, &cmd, 8);
 
 		while (pw_client_node_transport_next_message(data->trans, &message) == SPA_RESULT_OK) {
-			struct pw_client_node_message *msg = alloca(SPA_POD_SIZE(&message));
+			uint64_t buffer[(SPA_POD_SIZE(&message) + 7) / 8];
+			struct pw_client_node_message *msg = (struct pw_client_node_message *) buffer;
 			pw_client_node_transport_parse_message(data->trans, msg);
 			handle_rtnode_message(proxy, msg);
 		}
@@ -687,8 +714,7 @@ static struct mem_id *find_mem(struct pw_proxy *proxy, uint32_t id)
 
 static void clear_memid(struct mem_id *mid)
 {
-	if (mid->ptr != NULL)
-		munmap(mid->ptr, mid->size + mid->offset);
+	pw_memmap_release(mid->ptr);
 	mid->ptr = NULL;
 	close(mid->fd);
 }
@@ -781,11 +807,9 @@ client_node_use_buffers(void *object,
 		}
 
 		if (mid->ptr == NULL) {
-			mid->ptr =
-			    mmap(NULL, mid->size + mid->offset, PROT_READ | PROT_WRITE, MAP_SHARED,
-				 mid->fd, 0);
-			if (mid->ptr == MAP_FAILED) {
-				mid->ptr = NULL;
+			mid->ptr = pw_memmap_acquire(mid->fd, PW_MEMBLOCK_FLAG_MAP_READWRITE,
+						     mid->offset, mid->size);
+			if (mid->ptr == NULL) {
 				pw_log_warn("Failed to mmap memory %d %p: %s", mid->size, mid,
 					    strerror(errno));
 				continue;
@@ -796,7 +820,7 @@ client_node_use_buffers(void *object,
 
 		b = buffers[i].buffer;
 
-		bid->buf_ptr = SPA_MEMBER(mid->ptr, mid->offset + buffers[i].offset, void);
+		bid->buf_ptr = SPA_MEMBER(mid->ptr, buffers[i].offset, void);
 		{
 			size_t size;
 
@@ -839,13 +863,27 @@ client_node_use_buffers(void *object,
 
 			if (d->type == proxy->remote->core->type.data.Id) {
 				struct mem_id *bmid = find_mem(proxy, SPA_PTR_TO_UINT32(d->data));
-				void *map;
 
+				if (bmid == NULL) {
+					pw_log_warn("unknown buffer memory id %u",
+						    SPA_PTR_TO_UINT32(d->data));
+					res = SPA_RESULT_INVALID_ARGUMENTS;
+					goto cleanup;
+				}
+				if (bmid->ptr == NULL) {
+					bmid->ptr = pw_memmap_acquire(bmid->fd,
+								      PW_MEMBLOCK_FLAG_MAP_READWRITE,
+								      bmid->offset, bmid->size);
+					if (bmid->ptr == NULL) {
+						pw_log_warn("Failed to mmap memory %d %p: %s",
+							    bmid->size, bmid, strerror(errno));
+						res = SPA_RESULT_NO_MEMORY;
+						goto cleanup;
+					}
+				}
 				d->type = proxy->remote->core->type.data.MemFd;
 				d->fd = bmid->fd;
-				map = mmap(NULL, d->maxsize + d->mapoffset, PROT_READ|PROT_WRITE,
-					   MAP_SHARED, d->fd, 0);
-				d->data = SPA_MEMBER(map, d->mapoffset, uint8_t);
+				d->data = bmid->ptr;
 				pw_log_debug(" data %d %u -> fd %d", j, bmid->id, bmid->fd);
 			} else if (d->type == proxy->remote->core->type.data.MemPtr) {
 				d->data = SPA_MEMBER(bid->buf_ptr, SPA_PTR_TO_INT(d->data), void);
@@ -862,7 +900,10 @@ client_node_use_buffers(void *object,
 
 	if (n_buffers == 0)
 		clear_mems(proxy);
+	goto done;
 
+      cleanup:
+	clear_buffers(proxy);
       done:
 	pw_client_node_proxy_done(data->node_proxy, seq, res);
 
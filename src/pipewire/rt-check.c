@@ -0,0 +1,283 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "pipewire/rt-check.h"
+
+/** \cond */
+#define MAX_FRAMES	32
+
+/* initial-exec so that the first access from a thread doesn't allocate */
+#define RT_TLS	__thread __attribute__((tls_model("initial-exec")))
+
+static RT_TLS int rt_depth;
+static RT_TLS bool in_report;
+
+static uint32_t violations;
+static bool abort_on_violation;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+extern void __libc_free(void *ptr);
+
+static void *(*real_mmap) (void *, size_t, int, int, int, off_t);
+static int (*real_munmap) (void *, size_t);
+static int (*real_open) (const char *, int, ...);
+static int (*real_openat) (int, const char *, int, ...);
+static FILE *(*real_fopen) (const char *, const char *);
+static int (*real_nanosleep) (const struct timespec *, struct timespec *);
+static int (*real_clock_nanosleep) (clockid_t, int, const struct timespec *, struct timespec *);
+static int (*real_usleep) (useconds_t);
+/** \endcond */
+
+#define RESOLVE(name)						\
+	if (real_##name == NULL)				\
+		real_##name = dlsym(RTLD_NEXT, #name)
+
+static void __attribute__((constructor)) rt_check_init(void)
+{
+	void *frames[1];
+	const char *str;
+
+	if ((str = getenv("PIPEWIRE_RT_CHECK_ABORT")) != NULL)
+		abort_on_violation = atoi(str) != 0;
+
+	/* the first backtrace loads the unwinder, which allocates */
+	backtrace(frames, 1);
+
+	RESOLVE(mmap);
+	RESOLVE(munmap);
+	RESOLVE(open);
+	RESOLVE(openat);
+	RESOLVE(fopen);
+	RESOLVE(nanosleep);
+	RESOLVE(clock_nanosleep);
+	RESOLVE(usleep);
+}
+
+void pw_rt_check_enter(void)
+{
+	rt_depth++;
+}
+
+void pw_rt_check_leave(void)
+{
+	if (rt_depth > 0)
+		rt_depth--;
+}
+
+uint32_t pw_rt_check_get_violations(void)
+{
+	return __atomic_load_n(&violations, __ATOMIC_RELAXED);
+}
+
+static inline bool is_violation(void)
+{
+	return rt_depth > 0 && !in_report;
+}
+
+static void __attribute__((format(printf, 1, 2))) report(const char *fmt, ...)
+{
+	void *frames[MAX_FRAMES];
+	char buffer[256];
+	va_list args;
+	int len, n_frames;
+
+	in_report = true;
+
+	__atomic_add_fetch(&violations, 1, __ATOMIC_RELAXED);
+
+	len = snprintf(buffer, sizeof(buffer), "pipewire-rt-check: thread %ld: ",
+		       (long) syscall(SYS_gettid));
+	va_start(args, fmt);
+	len += vsnprintf(buffer + len, sizeof(buffer) - len, fmt, args);
+	va_end(args);
+	if (len > sizeof(buffer) - 1)
+		len = sizeof(buffer) - 1;
+	buffer[len++] = '\n';
+
+	if (write(STDERR_FILENO, buffer, len) == len) {
+		n_frames = backtrace(frames, MAX_FRAMES);
+		/* skip ourselves and the wrapper */
+		if (n_frames > 2)
+			backtrace_symbols_fd(frames + 2, n_frames - 2, STDERR_FILENO);
+	}
+
+	if (abort_on_violation)
+		abort();
+
+	in_report = false;
+}
+
+void *malloc(size_t size)
+{
+	if (is_violation())
+		report("malloc(%zu)", size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (is_violation())
+		report("calloc(%zu, %zu)", nmemb, size);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (is_violation())
+		report("realloc(%p, %zu)", ptr, size);
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	if (ptr != NULL && is_violation())
+		report("free(%p)", ptr);
+	__libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	if (is_violation())
+		report("memalign(%zu, %zu)", alignment, size);
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	if (is_violation())
+		report("aligned_alloc(%zu, %zu)", alignment, size);
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if (is_violation())
+		report("posix_memalign(%zu, %zu)", alignment, size);
+	if ((ptr = __libc_memalign(alignment, size)) == NULL)
+		return ENOMEM;
+	*memptr = ptr;
+	return 0;
+}
+
+void *valloc(size_t size)
+{
+	if (is_violation())
+		report("valloc(%zu)", size);
+	return __libc_valloc(size);
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+	if (is_violation())
+		report("mmap(%zu)", length);
+	RESOLVE(mmap);
+	return real_mmap(addr, length, prot, flags, fd, offset);
+}
+
+int munmap(void *addr, size_t length)
+{
+	if (is_violation())
+		report("munmap(%p, %zu)", addr, length);
+	RESOLVE(munmap);
+	return real_munmap(addr, length);
+}
+
+int open(const char *pathname, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list args;
+
+	if (flags & (O_CREAT | O_TMPFILE)) {
+		va_start(args, flags);
+		mode = va_arg(args, mode_t);
+		va_end(args);
+	}
+	if (is_violation())
+		report("open(%s)", pathname);
+	RESOLVE(open);
+	return real_open(pathname, flags, mode);
+}
+
+int openat(int dirfd, const char *pathname, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list args;
+
+	if (flags & (O_CREAT | O_TMPFILE)) {
+		va_start(args, flags);
+		mode = va_arg(args, mode_t);
+		va_end(args);
+	}
+	if (is_violation())
+		report("openat(%s)", pathname);
+	RESOLVE(openat);
+	return real_openat(dirfd, pathname, flags, mode);
+}
+
+FILE *fopen(const char *pathname, const char *mode)
+{
+	if (is_violation())
+		report("fopen(%s)", pathname);
+	RESOLVE(fopen);
+	return real_fopen(pathname, mode);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+	if (is_violation())
+		report("nanosleep()");
+	RESOLVE(nanosleep);
+	return real_nanosleep(req, rem);
+}
+
+int clock_nanosleep(clockid_t clockid, int flags, const struct timespec *req, struct timespec *rem)
+{
+	if (is_violation())
+		report("clock_nanosleep()");
+	RESOLVE(clock_nanosleep);
+	return real_clock_nanosleep(clockid, flags, req, rem);
+}
+
+int usleep(useconds_t usec)
+{
+	if (is_violation())
+		report("usleep(%u)", usec);
+	RESOLVE(usleep);
+	return real_usleep(usec);
+}
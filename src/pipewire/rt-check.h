@@ -0,0 +1,55 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PIPEWIRE_RT_CHECK_H__
+#define __PIPEWIRE_RT_CHECK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/** \class pw_rt_check
+ *
+ * Debug checker for the realtime path. The functions are implemented in
+ * libpipewire-rt-check, which wraps malloc, free and blocking system
+ * calls. Load it with LD_PRELOAD or link with it.
+ *
+ * The data loops mark their threads as realtime while they dispatch
+ * events. Every wrapped call made by a realtime thread is a violation
+ * and is reported on stderr with a backtrace. With
+ * PIPEWIRE_RT_CHECK_ABORT=1 in the environment the first violation
+ * aborts the process.
+ */
+
+/** mark the current thread as realtime, calls can be nested \memberof pw_rt_check */
+void pw_rt_check_enter(void);
+
+/** leave the realtime section of the current thread \memberof pw_rt_check */
+void pw_rt_check_leave(void);
+
+/** the number of violations so far \memberof pw_rt_check */
+uint32_t pw_rt_check_get_violations(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIPEWIRE_RT_CHECK_H__ */
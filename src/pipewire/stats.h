@@ -0,0 +1,130 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PIPEWIRE_STATS_H__
+#define __PIPEWIRE_STATS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#include <spa/defs.h>
+#include <spa/clock.h>
+#include <spa/graph.h>
+#include <spa/histogram.h>
+
+/** \class pw_stats
+ *
+ * Layout of the node statistics in shared memory
+ *
+ * When the core has the stats.shm property, it creates a file with that
+ * name in XDG_RUNTIME_DIR, readable only by the user of the daemon, that
+ * contains a header and a slot for each node.
+ * The data threads update the slots of their nodes while they run and
+ * tools like pipewire-top map the memory read-only and read them, without
+ * sending messages to the daemon.
+ *
+ * The main thread gives a slot to a node when it is registered and takes
+ * it back when the node is destroyed. It increments the seq of the slot
+ * before and after it changes the id and the name, readers should use
+ * pw_node_stats_read_info() to get a consistent copy and compare the seq
+ * to see if the slot was given to another node.
+ */
+
+#define PW_STATS_MAGIC		0x54535750	/* "PWST" */
+#define PW_STATS_VERSION	1
+
+#define PW_STATS_MAX_NODES	256
+#define PW_STATS_MAX_NAME	64
+
+/** the header of the stats area \memberof pw_stats */
+struct pw_stats_header {
+	uint32_t magic;		/**< PW_STATS_MAGIC, set when the area is ready */
+	uint32_t version;	/**< PW_STATS_VERSION */
+	uint32_t n_nodes;	/**< number of node slots after the header */
+	uint32_t padding[13];
+};
+
+/** the stats of a node \memberof pw_stats */
+struct pw_node_stats {
+	uint32_t seq;				/**< odd while id and name change */
+	uint32_t id;				/**< global id of the node or
+						  *  SPA_ID_INVALID for a free slot */
+	char name[PW_STATS_MAX_NAME];		/**< name of the node */
+
+	uint64_t cycle_start;			/**< CLOCK_MONOTONIC time of the last
+						  *  cycle started by the node */
+	uint64_t period;			/**< time between the last two cycles */
+	struct spa_histogram cycle_time;	/**< time the graph needed for the
+						  *  cycles started by the node */
+	struct spa_graph_node_stats graph;	/**< processing time of the node */
+	struct spa_clock_stats clock;		/**< device stats from the clock of
+						  *  the node, all 0 without clock */
+	uint32_t padding[3];
+};
+
+#define pw_stats_size(n_nodes)							\
+	(sizeof(struct pw_stats_header) + (size_t)(n_nodes) * sizeof(struct pw_node_stats))
+
+#define pw_stats_get_node(h,i)							\
+	SPA_MEMBER(h, pw_stats_size(i), struct pw_node_stats)
+
+#define PW_STATS_READ_RETRIES	1000
+
+/** Read the id and name of a slot
+ * \param stats the slot
+ * \param[out] id the id of the node
+ * \param[out] name at least PW_STATS_MAX_NAME bytes for the name
+ * \return the seq of the slot, it changes when the slot is given to
+ *	another node. When the slot keeps changing, like when the daemon
+ *	died while it changed the slot, \a id is SPA_ID_INVALID after
+ *	PW_STATS_READ_RETRIES tries.
+ * \memberof pw_stats
+ */
+static inline uint32_t
+pw_node_stats_read_info(const struct pw_node_stats *stats, uint32_t *id, char *name)
+{
+	uint32_t seq = 0;
+	int i;
+
+	for (i = 0; i < PW_STATS_READ_RETRIES; i++) {
+		seq = __atomic_load_n(&stats->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		*id = __atomic_load_n(&stats->id, __ATOMIC_RELAXED);
+		memcpy(name, stats->name, PW_STATS_MAX_NAME);
+		name[PW_STATS_MAX_NAME - 1] = '\0';
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&stats->seq, __ATOMIC_RELAXED) == seq)
+			return seq;
+	}
+	*id = SPA_ID_INVALID;
+	name[0] = '\0';
+	return seq;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIPEWIRE_STATS_H__ */
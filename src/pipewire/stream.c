@@ -105,8 +105,7 @@ struct stream {
 
 static void clear_memid(struct mem_id *mid)
 {
-	if (mid->ptr != NULL)
-		munmap(mid->ptr, mid->size + mid->offset);
+	pw_memmap_release(mid->ptr);
 	mid->ptr = NULL;
 	close(mid->fd);
 }
@@ -564,7 +563,8 @@ on_rtsocket_condition(void *data, int fd, enum spa_io mask)
 		read(fd, &cmd, 8);
 
 		while (pw_client_node_transport_next_message(impl->trans, &message) == SPA_RESULT_OK) {
-			struct pw_client_node_message *msg = alloca(SPA_POD_SIZE(&message));
+			uint64_t buffer[(SPA_POD_SIZE(&message) + 7) / 8];
+			struct pw_client_node_message *msg = (struct pw_client_node_message *) buffer;
 			pw_client_node_transport_parse_message(impl->trans, msg);
 			handle_rtnode_message(stream, msg);
 		}
@@ -756,11 +756,9 @@ client_node_use_buffers(void *data,
 		}
 
 		if (mid->ptr == NULL) {
-			mid->ptr =
-			    mmap(NULL, mid->size + mid->offset, PROT_READ | PROT_WRITE, MAP_SHARED,
-				 mid->fd, 0);
-			if (mid->ptr == MAP_FAILED) {
-				mid->ptr = NULL;
+			mid->ptr = pw_memmap_acquire(mid->fd, PW_MEMBLOCK_FLAG_MAP_READWRITE,
+						     mid->offset, mid->size);
+			if (mid->ptr == NULL) {
 				pw_log_warn("Failed to mmap memory %d %p: %s", mid->size, mid,
 					    strerror(errno));
 				continue;
@@ -777,7 +775,7 @@ client_node_use_buffers(void *data,
 
 		b = buffers[i].buffer;
 
-		bid->buf_ptr = SPA_MEMBER(mid->ptr, mid->offset + buffers[i].offset, void);
+		bid->buf_ptr = SPA_MEMBER(mid->ptr, buffers[i].offset, void);
 		{
 			size_t size;
 
@@ -24,6 +24,8 @@
 #include "pipewire/work-queue.h"
 
 /** \cond */
+#define PREALLOC_ITEMS	16
+
 struct work_item {
 	uint32_t id;
 	void *obj;
@@ -87,6 +89,8 @@ static void process_work_queue(void *data, uint64_t count)
 struct pw_work_queue *pw_work_queue_new(struct pw_loop *loop)
 {
 	struct pw_work_queue *this;
+	struct work_item *item;
+	int i;
 
 	this = calloc(1, sizeof(struct pw_work_queue));
 	pw_log_debug("work-queue %p: new", this);
@@ -98,6 +102,14 @@ struct pw_work_queue *pw_work_queue_new(struct pw_loop *loop)
 	spa_list_init(&this->work_list);
 	spa_list_init(&this->free_list);
 
+	/* enough items for the usual state changes so that adding work
+	 * doesn't need to allocate */
+	for (i = 0; i < PREALLOC_ITEMS; i++) {
+		if ((item = malloc(sizeof(struct work_item))) == NULL)
+			break;
+		spa_list_insert(this->free_list.prev, &item->link);
+	}
+
 	return this;
 }
 
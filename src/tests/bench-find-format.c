@@ -0,0 +1,138 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pipewire/core.h>
+#include <pipewire/private.h>
+
+#include "format-node.h"
+
+/* benchmark of pw_core_find_format(), the way autolink probes candidate
+ * nodes for an output port. Each candidate has N_FORMATS formats and only
+ * the last one matches a format of the output.
+ *
+ *  enumerate: the formats of the ports are enumerated for each call, like
+ *             before the formats were cached
+ *  cached:    the formats are cached, the memo is cleared for each call
+ *  memo:      the negotiated formats are remembered
+ */
+
+#define N_CANDIDATES	16
+#define N_FORMATS	16
+#define N_ITERATIONS	1000
+
+static int64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void clear_memo(struct pw_core *core)
+{
+	int i;
+
+	for (i = 0; i < PW_FORMAT_MEMO_SIZE; i++) {
+		free(core->format_memo[i].format);
+		core->format_memo[i].format = NULL;
+		core->format_memo[i].output_generation = 0;
+		core->format_memo[i].input_generation = 0;
+	}
+}
+
+enum mode {
+	MODE_ENUMERATE,
+	MODE_CACHED,
+	MODE_MEMO,
+};
+
+static void run(struct pw_core *core, const char *name, enum mode mode,
+		struct pw_port *output, struct pw_port **inputs)
+{
+	int64_t t1, t2;
+	char *error;
+	int i, j, failed = 0;
+
+	t1 = get_time();
+	for (i = 0; i < N_ITERATIONS; i++) {
+		for (j = 0; j < N_CANDIDATES; j++) {
+			if (mode == MODE_ENUMERATE) {
+				pw_port_invalidate_formats(output);
+				pw_port_invalidate_formats(inputs[j]);
+			} else if (mode == MODE_CACHED)
+				clear_memo(core);
+
+			error = NULL;
+			if (pw_core_find_format(core, output, inputs[j], NULL, 0, NULL, &error) == NULL)
+				failed++;
+			free(error);
+		}
+	}
+	t2 = get_time();
+
+	printf("%-10s: %d negotiations in %.3f ms, %.0f ns/negotiation%s\n", name,
+	       N_ITERATIONS * N_CANDIDATES, (t2 - t1) / 1000000.0,
+	       (double) (t2 - t1) / (N_ITERATIONS * N_CANDIDATES),
+	       failed ? ", FAILED" : "");
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_loop *loop;
+	struct pw_core *core;
+	struct format_node *out, *in[N_CANDIDATES];
+	struct pw_port *output, *inputs[N_CANDIDATES];
+	int i, j;
+
+	pw_init(&argc, &argv);
+
+	loop = pw_loop_new(NULL);
+	core = pw_core_new(loop, NULL);
+
+	out = format_node_new(core, "out", 0, 1);
+	out->n_rates[SPA_DIRECTION_OUTPUT] = N_FORMATS;
+	for (i = 0; i < N_FORMATS; i++)
+		out->rates[SPA_DIRECTION_OUTPUT][i] = 8000 + i * 1000;
+	output = pw_node_find_port(out->this, PW_DIRECTION_OUTPUT, 0);
+
+	for (j = 0; j < N_CANDIDATES; j++) {
+		in[j] = format_node_new(core, "in", 1, 0);
+		in[j]->n_rates[SPA_DIRECTION_INPUT] = N_FORMATS;
+		for (i = 0; i < N_FORMATS; i++)
+			in[j]->rates[SPA_DIRECTION_INPUT][i] = 100000 + i;
+		in[j]->rates[SPA_DIRECTION_INPUT][N_FORMATS - 1] = 8000;
+		inputs[j] = pw_node_find_port(in[j]->this, PW_DIRECTION_INPUT, 0);
+	}
+
+	run(core, "enumerate", MODE_ENUMERATE, output, inputs);
+	run(core, "cached", MODE_CACHED, output, inputs);
+	run(core, "memo", MODE_MEMO, output, inputs);
+
+	for (j = 0; j < N_CANDIDATES; j++)
+		format_node_destroy(in[j]);
+	format_node_destroy(out);
+	pw_core_destroy(core);
+	pw_loop_destroy(loop);
+
+	return 0;
+}
@@ -0,0 +1,92 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include <pipewire/mem.h>
+
+/* size of a 3840x2160 BGRx frame */
+#define FRAME_SIZE	(3840 * 2160 * 4)
+#define N_COPIES	64
+
+static int64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void run(const char *name, enum pw_memblock_flags extra)
+{
+	struct pw_memblock src, dst;
+	enum pw_memblock_flags flags = PW_MEMBLOCK_FLAG_WITH_FD |
+				       PW_MEMBLOCK_FLAG_MAP_READWRITE | extra;
+	int64_t t1, t2, t3, t4;
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct stat st;
+	size_t i;
+	int j;
+
+	t1 = get_time();
+	if (pw_memblock_alloc(flags, FRAME_SIZE, &src) < 0 ||
+	    pw_memblock_alloc(flags, FRAME_SIZE, &dst) < 0) {
+		printf("%-24s: allocation failed\n", name);
+		return;
+	}
+	t2 = get_time();
+
+	/* touch every page once */
+	for (i = 0; i < FRAME_SIZE; i += page_size)
+		((uint8_t *) src.ptr)[i] = i;
+	for (i = 0; i < FRAME_SIZE; i += page_size)
+		((uint8_t *) dst.ptr)[i] = i;
+	t3 = get_time();
+
+	for (j = 0; j < N_COPIES; j++)
+		memcpy(dst.ptr, src.ptr, FRAME_SIZE);
+	t4 = get_time();
+
+	fstat(src.fd, &st);
+
+	printf("%-24s: %-8s alloc %8.3f ms, first touch %8.3f ms, copy %8.1f MB/s\n",
+	       name, st.st_blksize > page_size ? "hugetlb" : "regular",
+	       (t2 - t1) / 1000000.0, (t3 - t2) / 1000000.0,
+	       (double) FRAME_SIZE * N_COPIES / ((t4 - t3) / 1000.0));
+
+	pw_memblock_free(&src);
+	pw_memblock_free(&dst);
+}
+
+int main(int argc, char *argv[])
+{
+	printf("2 frames of %d bytes, %d copies\n", FRAME_SIZE, N_COPIES);
+
+	run("default", 0);
+	run("prefault", PW_MEMBLOCK_FLAG_PREFAULT);
+	run("hugepages", PW_MEMBLOCK_FLAG_HUGEPAGES);
+	run("hugepages+prefault", PW_MEMBLOCK_FLAG_HUGEPAGES | PW_MEMBLOCK_FLAG_PREFAULT);
+
+	return 0;
+}
@@ -0,0 +1,175 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <pipewire/properties.h>
+
+/* microbenchmark of pw_properties with dicts of 50 keys, about what a node
+ * with its device and application properties has. Lookups are compared
+ * with a linear spa_dict_lookup on the same dict. */
+
+#define N_KEYS		50
+#define N_ROUNDS	20000
+
+static char keys[N_KEYS][64];
+static char values[N_KEYS][64];
+static struct spa_dict_item items[N_KEYS];
+static struct spa_dict dict = SPA_DICT_INIT(N_KEYS, items);
+
+static const char *well_known[] = {
+	"media.class", "media.name", "media.role", "node.name", "device.path",
+	"alsa.card", "application.name", "application.process.id",
+	"pipewire.target.node", "pipewire.autoconnect",
+};
+
+static int64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void report(const char *name, int64_t t1, int64_t t2, int n)
+{
+	printf("%-16s: %8.1f ns per op\n", name, (double) (t2 - t1) / n);
+}
+
+static int check_order(struct pw_properties *props)
+{
+	const char *key;
+	void *state = NULL;
+	int i = 0, failures = 0;
+
+	/* every other key was removed, the rest keeps its order */
+	while ((key = pw_properties_iterate(props, &state))) {
+		if (strcmp(key, keys[i]) != 0) {
+			printf("key %d: got %s expected %s\n", i / 2, key, keys[i]);
+			failures++;
+		}
+		if (strcmp(pw_properties_get(props, key), values[i]) != 0)
+			failures++;
+		i += 2;
+	}
+	if (i != N_KEYS) {
+		printf("iterated %d keys, expected %d\n", i / 2, N_KEYS / 2);
+		failures++;
+	}
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_properties *props, *copy, *merged;
+	int64_t t1, t2;
+	const char *v;
+	int i, j, failures = 0;
+	volatile int found = 0;
+
+	for (i = 0; i < N_KEYS; i++) {
+		if (i < SPA_N_ELEMENTS(well_known))
+			snprintf(keys[i], sizeof(keys[i]), "%s", well_known[i]);
+		else
+			snprintf(keys[i], sizeof(keys[i]), "bench.property.key-%d", i);
+		snprintf(values[i], sizeof(values[i]), "value %d", i);
+		items[i].key = keys[i];
+		items[i].value = values[i];
+	}
+
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS / 10; i++) {
+		props = pw_properties_new_dict(&dict);
+		pw_properties_free(props);
+	}
+	t2 = get_time();
+	report("new_dict", t1, t2, N_ROUNDS / 10);
+
+	props = pw_properties_new_dict(&dict);
+
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS; i++)
+		for (j = 0; j < N_KEYS; j++)
+			found += spa_dict_lookup(&props->dict, keys[j]) != NULL;
+	t2 = get_time();
+	report("spa_dict_lookup", t1, t2, N_ROUNDS * N_KEYS);
+
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS; i++)
+		for (j = 0; j < N_KEYS; j++)
+			found += pw_properties_get(props, keys[j]) != NULL;
+	t2 = get_time();
+	report("get", t1, t2, N_ROUNDS * N_KEYS);
+
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS; i++)
+		found += pw_properties_get(props, "bench.missing.key") != NULL;
+	t2 = get_time();
+	report("get missing", t1, t2, N_ROUNDS);
+
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS / 10; i++)
+		for (j = 0; j < N_KEYS; j++)
+			pw_properties_set(props, keys[j], values[j]);
+	t2 = get_time();
+	report("set existing", t1, t2, N_ROUNDS / 10 * N_KEYS);
+
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS / 10; i++) {
+		copy = pw_properties_copy(props);
+		pw_properties_free(copy);
+	}
+	t2 = get_time();
+	report("copy", t1, t2, N_ROUNDS / 10);
+
+	copy = pw_properties_copy(props);
+	t1 = get_time();
+	for (i = 0; i < N_ROUNDS / 10; i++) {
+		merged = pw_properties_merge(props, copy);
+		pw_properties_free(merged);
+	}
+	t2 = get_time();
+	report("merge", t1, t2, N_ROUNDS / 10);
+	pw_properties_free(copy);
+
+	for (j = 0; j < N_KEYS; j++) {
+		v = pw_properties_get(props, keys[j]);
+		if (v == NULL || strcmp(v, values[j]) != 0) {
+			printf("key %s: wrong value %s\n", keys[j], v);
+			failures++;
+		}
+	}
+	if (found != (N_ROUNDS + N_ROUNDS) * N_KEYS) {
+		printf("found %d keys, expected %d\n", found, 2 * N_ROUNDS * N_KEYS);
+		failures++;
+	}
+
+	for (j = 1; j < N_KEYS; j += 2)
+		pw_properties_set(props, keys[j], NULL);
+	failures += check_order(props);
+
+	pw_properties_free(props);
+
+	printf("%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+
+	return failures ? -1 : 0;
+}
@@ -0,0 +1,178 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <spa/node.h>
+#include <spa/format-builder.h>
+#include <spa/audio/format-utils.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/node.h>
+#include <pipewire/port.h>
+
+/* a node for the format negotiation tests. Its ports have raw audio
+ * formats, one for each rate in the list of their direction, and it
+ * counts how often the formats are enumerated. */
+
+#define FORMAT_NODE_MAX_RATES	64
+
+struct format_node_type {
+	uint32_t format;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+};
+
+struct format_node {
+	struct spa_node node;
+	struct format_node_type type;
+	struct pw_node *this;
+
+	uint32_t n_rates[2];
+	uint32_t rates[2][FORMAT_NODE_MAX_RATES];
+	uint32_t n_enum;		/**< number of enumerations */
+
+	uint8_t buffer[1024];
+};
+
+static inline void format_node_type_init(struct format_node_type *type, struct spa_type_map *map)
+{
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+}
+
+#define FORMAT_NODE_PROP(f,key,type,...)					\
+	SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+
+static inline struct spa_format *
+format_node_build(struct format_node *n, uint8_t *buffer, size_t size, uint32_t rate)
+{
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, size);
+	struct spa_pod_frame f[2];
+
+	spa_pod_builder_format(&b, &f[0], n->type.format,
+		n->type.media_type.audio,
+		n->type.media_subtype.raw,
+		FORMAT_NODE_PROP(&f[1], n->type.format_audio.format, SPA_POD_TYPE_ID,
+			n->type.audio_format.S16),
+		FORMAT_NODE_PROP(&f[1], n->type.format_audio.layout, SPA_POD_TYPE_INT,
+			SPA_AUDIO_LAYOUT_INTERLEAVED),
+		FORMAT_NODE_PROP(&f[1], n->type.format_audio.rate, SPA_POD_TYPE_INT, rate),
+		FORMAT_NODE_PROP(&f[1], n->type.format_audio.channels, SPA_POD_TYPE_INT, 2));
+
+	return SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
+}
+
+static inline uint32_t format_node_get_rate(struct format_node *n, const struct spa_format *format)
+{
+	int32_t rate = 0;
+	spa_format_query(format, n->type.format_audio.rate, SPA_POD_TYPE_INT, &rate, 0);
+	return rate;
+}
+
+static int format_node_ok(struct spa_node *node)
+{
+	return SPA_RESULT_OK;
+}
+
+static int format_node_send_command(struct spa_node *node, const struct spa_command *command)
+{
+	return SPA_RESULT_OK;
+}
+
+static int format_node_set_callbacks(struct spa_node *node,
+				     const struct spa_node_callbacks *callbacks, void *data)
+{
+	return SPA_RESULT_OK;
+}
+
+static int format_node_port_enum_formats(struct spa_node *node, enum spa_direction direction,
+					 uint32_t port_id, struct spa_format **format,
+					 const struct spa_format *filter, uint32_t index)
+{
+	struct format_node *n = SPA_CONTAINER_OF(node, struct format_node, node);
+
+	if (index == 0)
+		n->n_enum++;
+	if (index >= n->n_rates[direction])
+		return SPA_RESULT_ENUM_END;
+
+	*format = format_node_build(n, n->buffer, sizeof(n->buffer), n->rates[direction][index]);
+	return SPA_RESULT_OK;
+}
+
+static int format_node_port_set_format(struct spa_node *node, enum spa_direction direction,
+				       uint32_t port_id, uint32_t flags,
+				       const struct spa_format *format)
+{
+	return SPA_RESULT_OK;
+}
+
+static int format_node_port_set_io(struct spa_node *node, enum spa_direction direction,
+				   uint32_t port_id, struct spa_port_io *io)
+{
+	return SPA_RESULT_OK;
+}
+
+static const struct spa_node format_node_impl = {
+	SPA_VERSION_NODE,
+	NULL,
+	.send_command = format_node_send_command,
+	.set_callbacks = format_node_set_callbacks,
+	.port_enum_formats = format_node_port_enum_formats,
+	.port_set_format = format_node_port_set_format,
+	.port_set_io = format_node_port_set_io,
+	.process_input = format_node_ok,
+	.process_output = format_node_ok,
+};
+
+/** make a node with \a n_inputs input and \a n_outputs output ports */
+static inline struct format_node *
+format_node_new(struct pw_core *core, const char *name, uint32_t n_inputs, uint32_t n_outputs)
+{
+	struct format_node *n;
+	uint32_t i;
+
+	n = calloc(1, sizeof(struct format_node));
+	n->node = format_node_impl;
+	format_node_type_init(&n->type, pw_core_get_type(core)->map);
+
+	n->this = pw_node_new(core, NULL, NULL, name, NULL, 0);
+	pw_node_set_implementation(n->this, &n->node);
+
+	for (i = 0; i < n_inputs; i++)
+		pw_port_add(pw_port_new(PW_DIRECTION_INPUT, i, NULL, 0), n->this);
+	for (i = 0; i < n_outputs; i++)
+		pw_port_add(pw_port_new(PW_DIRECTION_OUTPUT, i, NULL, 0), n->this);
+
+	/* registering enumerates the formats for the node info */
+	pw_node_register(n->this);
+	n->n_enum = 0;
+
+	return n;
+}
+
+static inline void format_node_destroy(struct format_node *n)
+{
+	pw_node_destroy(n->this);
+	free(n);
+}
@@ -0,0 +1,123 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pipewire/core.h>
+#include <pipewire/private.h>
+
+#include "format-node.h"
+
+/* Checks the negotiated formats that the core remembers for a pair of
+ * ports. A second negotiation uses the memo and doesn't enumerate the
+ * formats again. When the possible formats of a port change, like in a
+ * port_update of a client-node, or a format is set on another port of the
+ * node, the next negotiation sees the new formats. */
+
+static int failures;
+
+static struct spa_format *
+negotiate(struct pw_core *core, struct pw_port *output, struct pw_port *input)
+{
+	struct spa_format *format;
+	char *error = NULL;
+
+	format = pw_core_find_format(core, output, input, NULL, 0, NULL, &error);
+	if (format == NULL) {
+		printf("no format: %s\n", error);
+		failures++;
+	}
+	free(error);
+	return format;
+}
+
+static void check(struct format_node *out, struct format_node *in, struct spa_format *format,
+		  uint32_t rate, uint32_t n_out_enum, uint32_t n_in_enum, const char *what)
+{
+	if (format == NULL || format_node_get_rate(in, format) != rate) {
+		printf("%s: wrong rate %u, expected %u\n", what,
+		       format ? format_node_get_rate(in, format) : 0, rate);
+		failures++;
+	}
+	if (out->n_enum != n_out_enum || in->n_enum != n_in_enum) {
+		printf("%s: %u output and %u input enumerations, expected %u and %u\n", what,
+		       out->n_enum, in->n_enum, n_out_enum, n_in_enum);
+		failures++;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_loop *loop;
+	struct pw_core *core;
+	struct format_node *out, *in;
+	struct pw_port *oport, *iport0, *iport1;
+	struct spa_format *format;
+	uint8_t buffer[1024];
+
+	pw_init(&argc, &argv);
+
+	loop = pw_loop_new(NULL);
+	core = pw_core_new(loop, NULL);
+
+	out = format_node_new(core, "out", 0, 1);
+	out->n_rates[SPA_DIRECTION_OUTPUT] = 2;
+	out->rates[SPA_DIRECTION_OUTPUT][0] = 48000;
+	out->rates[SPA_DIRECTION_OUTPUT][1] = 44100;
+
+	in = format_node_new(core, "in", 2, 0);
+	in->n_rates[SPA_DIRECTION_INPUT] = 1;
+	in->rates[SPA_DIRECTION_INPUT][0] = 44100;
+
+	oport = pw_node_find_port(out->this, PW_DIRECTION_OUTPUT, 0);
+	iport0 = pw_node_find_port(in->this, PW_DIRECTION_INPUT, 0);
+	iport1 = pw_node_find_port(in->this, PW_DIRECTION_INPUT, 1);
+
+	format = negotiate(core, oport, iport0);
+	check(out, in, format, 44100, 1, 1, "first negotiation");
+
+	format = negotiate(core, oport, iport0);
+	check(out, in, format, 44100, 1, 1, "memo");
+
+	/* what client-node does for a port_update with new possible formats */
+	in->rates[SPA_DIRECTION_INPUT][0] = 48000;
+	pw_port_invalidate_formats(iport0);
+
+	format = negotiate(core, oport, iport0);
+	check(out, in, format, 48000, 1, 2, "after port update");
+
+	/* a format on the other port can restrict the formats of the node,
+	 * the formats of the output port stay cached */
+	in->rates[SPA_DIRECTION_INPUT][0] = 44100;
+	pw_port_set_format(iport1, 0, format_node_build(in, buffer, sizeof(buffer), 44100));
+
+	format = negotiate(core, oport, iport0);
+	check(out, in, format, 44100, 1, 3, "after set format");
+
+	format_node_destroy(in);
+	format_node_destroy(out);
+	pw_core_destroy(core);
+	pw_loop_destroy(loop);
+
+	printf("%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+
+	return failures ? -1 : 0;
+}
@@ -0,0 +1,96 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <pipewire/mem.h>
+
+/* Checks the mapping cache: regions of one memfd share a mapping, also
+ * through another fd of the same memfd, and stay cached after release.
+ * Two opens of /dev/zero have the same device and inode but are different
+ * memory, like DmaBuf and other anonymous fds, they must not share a
+ * mapping. */
+
+int main(int argc, char *argv[])
+{
+	struct pw_memblock mem;
+	char *a, *b, *c, *z1, *z2;
+	int fd, zfd1, zfd2, failures = 0;
+
+	if (pw_memblock_alloc(PW_MEMBLOCK_FLAG_WITH_FD |
+			      PW_MEMBLOCK_FLAG_MAP_READWRITE, 65536, &mem) < 0) {
+		printf("can't allocate memory\n");
+		return -1;
+	}
+	fd = dup(mem.fd);
+
+	a = pw_memmap_acquire(mem.fd, PW_MEMBLOCK_FLAG_MAP_READWRITE, 100, 200);
+	b = pw_memmap_acquire(fd, PW_MEMBLOCK_FLAG_MAP_READWRITE, 3 * 4096 + 5, 300);
+	if (a == NULL || b == NULL || b - a != 3 * 4096 + 5 - 100) {
+		printf("regions of a memfd don't share a mapping\n");
+		failures++;
+	}
+	else {
+		a[0] = 'x';
+		if (((char *) mem.ptr)[100] != 'x') {
+			printf("mapping is not the memfd\n");
+			failures++;
+		}
+	}
+	pw_memmap_release(a);
+	pw_memmap_release(b);
+
+	c = pw_memmap_acquire(fd, PW_MEMBLOCK_FLAG_MAP_READ, 100, 10);
+	if (c != a) {
+		printf("released mapping was not kept\n");
+		failures++;
+	}
+	pw_memmap_release(c);
+
+	zfd1 = open("/dev/zero", O_RDWR);
+	zfd2 = open("/dev/zero", O_RDWR);
+	z1 = pw_memmap_acquire(zfd1, PW_MEMBLOCK_FLAG_MAP_READWRITE, 0, 4096);
+	z2 = pw_memmap_acquire(zfd2, PW_MEMBLOCK_FLAG_MAP_READWRITE, 0, 4096);
+	if (z1 == NULL || z2 == NULL || z1 == z2) {
+		printf("different anonymous memory shares a mapping\n");
+		failures++;
+	}
+	else {
+		z1[0] = 'x';
+		if (z2[0] != 0) {
+			printf("anonymous memory is mixed up\n");
+			failures++;
+		}
+	}
+	pw_memmap_release(z1);
+	pw_memmap_release(z2);
+
+	close(zfd1);
+	close(zfd2);
+	close(fd);
+	pw_memblock_free(&mem);
+
+	printf("%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+
+	return failures ? -1 : 0;
+}
@@ -0,0 +1,159 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/data-loop.h>
+#include <pipewire/rt-check.h>
+
+/* Runs the steady state work of two data loops, a periodic timer on the
+ * first loop that wakes up the second loop, and invokes from the main
+ * thread into both. None of this may allocate or block on the data loop
+ * threads. A deliberate allocation at the end checks that the detector
+ * is active. */
+
+#define N_TICKS		2000
+
+struct data {
+	struct pw_data_loop *loops[2];
+	struct spa_source *timer;
+	struct spa_source *event;
+
+	int ticks;
+	int wakeups;
+	int invokes;
+	void *volatile ptr;
+};
+
+static void on_timer(void *user_data, uint64_t expirations)
+{
+	struct data *d = user_data;
+
+	d->ticks += expirations;
+	pw_loop_signal_event(pw_data_loop_get_loop(d->loops[1]), d->event);
+}
+
+static void on_event(void *user_data, uint64_t count)
+{
+	struct data *d = user_data;
+	d->wakeups += count;
+}
+
+static int
+do_count(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+	 void *user_data)
+{
+	struct data *d = user_data;
+	d->invokes++;
+	return SPA_RESULT_OK;
+}
+
+/* the timer is armed and disarmed on the thread of its loop */
+static int
+do_update_timer(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+		void *user_data)
+{
+	struct data *d = user_data;
+	const struct timespec *ts = data;
+
+	pw_loop_update_timer(pw_data_loop_get_loop(d->loops[0]), d->timer,
+			     (struct timespec *) ts, (struct timespec *) ts, false);
+	return SPA_RESULT_OK;
+}
+
+static int
+do_allocate(struct spa_loop *loop, bool async, uint32_t seq, size_t size, const void *data,
+	    void *user_data)
+{
+	struct data *d = user_data;
+	d->ptr = malloc(64);
+	free(d->ptr);
+	return SPA_RESULT_OK;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { { NULL } };
+	struct pw_loop *loop[2];
+	struct timespec interval;
+	uint32_t violations;
+	int i, res = 0;
+
+	pw_init(&argc, &argv);
+
+	for (i = 0; i < 2; i++) {
+		data.loops[i] = pw_data_loop_new(NULL);
+		loop[i] = pw_data_loop_get_loop(data.loops[i]);
+	}
+
+	data.timer = pw_loop_add_timer(loop[0], on_timer, &data);
+	data.event = pw_loop_add_event(loop[1], on_event, &data);
+
+	for (i = 0; i < 2; i++)
+		pw_data_loop_start(data.loops[i]);
+
+	interval.tv_sec = 0;
+	interval.tv_nsec = 500000;
+	pw_loop_invoke(loop[0], do_update_timer, SPA_ID_INVALID,
+		       sizeof(interval), &interval, true, &data);
+
+	while (data.ticks < N_TICKS) {
+		for (i = 0; i < 2; i++)
+			pw_loop_invoke(loop[i], do_count, SPA_ID_INVALID, 0, NULL, false, &data);
+		usleep(1000);
+	}
+	pw_loop_invoke(loop[0], do_update_timer, SPA_ID_INVALID, 0, NULL, true, &data);
+
+	/* flush both loops */
+	for (i = 0; i < 2; i++)
+		pw_loop_invoke(loop[i], do_count, SPA_ID_INVALID, 0, NULL, true, &data);
+
+	violations = pw_rt_check_get_violations();
+	printf("%d ticks, %d wakeups, %d invokes: %u violations\n",
+	       data.ticks, data.wakeups, data.invokes, violations);
+	if (violations > 0) {
+		printf("FAIL: allocation or blocking call on a data loop\n");
+		res = -1;
+	}
+
+	pw_loop_invoke(loop[0], do_allocate, SPA_ID_INVALID, 0, NULL, true, &data);
+	if (pw_rt_check_get_violations() == violations) {
+		printf("FAIL: allocation on a data loop was not detected\n");
+		res = -1;
+	}
+
+	for (i = 0; i < 2; i++)
+		pw_data_loop_stop(data.loops[i]);
+
+	pw_loop_destroy_source(loop[0], data.timer);
+	pw_loop_destroy_source(loop[1], data.event);
+
+	for (i = 0; i < 2; i++)
+		pw_data_loop_destroy(data.loops[i]);
+
+	if (res == 0)
+		printf("OK\n");
+
+	return res;
+}
@@ -0,0 +1,313 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <spa/format-builder.h>
+#include <spa/audio/format-utils.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/core.h>
+#include <pipewire/module.h>
+#include <pipewire/rt-check.h>
+
+/* Runs a daemon and a client in one process. The daemon has a live
+ * audiotestsrc, standing in for an ALSA source, that drives the graph.
+ * The client captures from it with a stream, so every cycle goes through
+ * the client-node and its transport to the data loop of the client.
+ *
+ * After a warmup, in which the links are activated and the buffers are
+ * allocated, the steady state cycles may not allocate or block on any
+ * data loop thread.
+ *
+ * The modules and plugins are found with PIPEWIRE_MODULE_DIR and
+ * SPA_PLUGIN_DIR, meson sets them for the build tree. */
+
+#define WARMUP_BUFFERS	50
+#define N_BUFFERS	500
+#define TIMEOUT_MSEC	10000
+#define CHECK_MSEC	10
+
+struct type {
+	uint32_t format;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+};
+
+struct data {
+	struct type type;
+
+	struct pw_thread_loop *daemon_loop;
+	struct pw_core *daemon;
+
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_type *t;
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+	struct pw_stream *stream;
+	struct spa_hook stream_listener;
+	struct spa_source *timer;
+
+	uint8_t params_buffer[512];
+
+	int n_buffers;
+	uint32_t warmup_violations;
+	int elapsed;
+	int res;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+}
+
+#define PROP(f,key,type,...)							\
+	SPA_POD_PROP (f,key,0,type,1,__VA_ARGS__)
+#define PROP_U_MM(f,key,type,...)						\
+	SPA_POD_PROP (f,key,SPA_POD_PROP_FLAG_UNSET |				\
+			SPA_POD_PROP_RANGE_MIN_MAX,type,3,__VA_ARGS__)
+
+/* called on the data loop of the client for each cycle */
+static void on_stream_new_buffer(void *_data, uint32_t id)
+{
+	struct data *d = _data;
+	int n = __atomic_add_fetch(&d->n_buffers, 1, __ATOMIC_RELAXED);
+
+	if (n == WARMUP_BUFFERS)
+		__atomic_store_n(&d->warmup_violations, pw_rt_check_get_violations(),
+				 __ATOMIC_RELAXED);
+
+	pw_stream_recycle_buffer(d->stream, id);
+}
+
+static void on_stream_format_changed(void *_data, struct spa_format *format)
+{
+	struct data *d = _data;
+	struct pw_type *t = d->t;
+	struct spa_pod_builder b = { NULL };
+	struct spa_pod_frame f[2];
+	struct spa_param *params[1];
+
+	if (format == NULL) {
+		pw_stream_finish_format(d->stream, SPA_RESULT_OK, NULL, 0);
+		return;
+	}
+
+	spa_pod_builder_init(&b, d->params_buffer, sizeof(d->params_buffer));
+	spa_pod_builder_object(&b, &f[0], 0, t->param_alloc_buffers.Buffers,
+		PROP(&f[1], t->param_alloc_buffers.size, SPA_POD_TYPE_INT, 1024 * 4),
+		PROP(&f[1], t->param_alloc_buffers.stride, SPA_POD_TYPE_INT, 4),
+		PROP_U_MM(&f[1], t->param_alloc_buffers.buffers, SPA_POD_TYPE_INT,
+			8,
+			2, 32),
+		PROP(&f[1], t->param_alloc_buffers.align, SPA_POD_TYPE_INT, 16));
+	params[0] = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_param);
+
+	pw_stream_finish_format(d->stream, SPA_RESULT_OK, params, 1);
+}
+
+static void on_stream_state_changed(void *_data, enum pw_stream_state old,
+				    enum pw_stream_state state, const char *error)
+{
+	struct data *d = _data;
+
+	if (state == PW_STREAM_STATE_ERROR) {
+		printf("FAIL: stream error: %s\n", error);
+		d->res = -1;
+		pw_main_loop_quit(d->loop);
+	}
+}
+
+static const struct pw_stream_events stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_stream_state_changed,
+	.format_changed = on_stream_format_changed,
+	.new_buffer = on_stream_new_buffer,
+};
+
+static void connect_stream(struct data *d)
+{
+	const struct spa_format *formats[1];
+	uint8_t buffer[256];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod_frame f[2];
+
+	d->stream = pw_stream_new(d->remote, "test-rt-graph", NULL);
+	pw_stream_add_listener(d->stream, &d->stream_listener, &stream_events, d);
+
+	spa_pod_builder_format(&b, &f[0], d->type.format,
+		d->type.media_type.audio,
+		d->type.media_subtype.raw,
+		PROP(&f[1], d->type.format_audio.format, SPA_POD_TYPE_ID,
+			d->type.audio_format.S16),
+		PROP(&f[1], d->type.format_audio.layout, SPA_POD_TYPE_INT,
+			SPA_AUDIO_LAYOUT_INTERLEAVED),
+		PROP(&f[1], d->type.format_audio.rate, SPA_POD_TYPE_INT, 44100),
+		PROP(&f[1], d->type.format_audio.channels, SPA_POD_TYPE_INT, 2));
+	formats[0] = SPA_POD_BUILDER_DEREF(&b, f[0].ref, struct spa_format);
+
+	pw_stream_connect(d->stream, PW_DIRECTION_INPUT, PW_STREAM_MODE_BUFFER,
+			  NULL, PW_STREAM_FLAG_AUTOCONNECT, 1, formats);
+}
+
+static void on_state_changed(void *_data, enum pw_remote_state old,
+			     enum pw_remote_state state, const char *error)
+{
+	struct data *d = _data;
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		printf("FAIL: remote error: %s\n", error);
+		d->res = -1;
+		pw_main_loop_quit(d->loop);
+		break;
+	case PW_REMOTE_STATE_CONNECTED:
+		connect_stream(d);
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_state_changed,
+};
+
+static void on_timer(void *_data, uint64_t expirations)
+{
+	struct data *d = _data;
+
+	if (__atomic_load_n(&d->n_buffers, __ATOMIC_RELAXED) >= N_BUFFERS) {
+		pw_main_loop_quit(d->loop);
+	} else if ((d->elapsed += CHECK_MSEC * expirations) >= TIMEOUT_MSEC) {
+		printf("FAIL: timeout after %d buffers\n", d->n_buffers);
+		d->res = -1;
+		pw_main_loop_quit(d->loop);
+	}
+}
+
+static bool start_daemon(struct data *d)
+{
+	static const char *modules[][2] = {
+		{ "libpipewire-module-protocol-native", NULL },
+		{ "libpipewire-module-client-node", NULL },
+		{ "libpipewire-module-autolink", NULL },
+		{ "libpipewire-module-spa-node",
+		  "audiotestsrc/libspa-audiotestsrc audiotestsrc audiotestsrc media.class=Audio/Source" },
+	};
+	struct pw_properties *props;
+	int i;
+
+	d->daemon_loop = pw_thread_loop_new(pw_loop_new(NULL), "test-rt-graph-daemon");
+
+	props = pw_properties_new("pipewire.daemon", "1", NULL);
+	d->daemon = pw_core_new(pw_thread_loop_get_loop(d->daemon_loop), props);
+
+	for (i = 0; i < SPA_N_ELEMENTS(modules); i++) {
+		if (pw_module_load(d->daemon, modules[i][0], modules[i][1]) == NULL) {
+			printf("FAIL: can't load %s\n", modules[i][0]);
+			return false;
+		}
+	}
+	return pw_thread_loop_start(d->daemon_loop) == SPA_RESULT_OK;
+}
+
+static void stop_daemon(struct data *d)
+{
+	struct pw_loop *loop = pw_thread_loop_get_loop(d->daemon_loop);
+
+	pw_thread_loop_stop(d->daemon_loop);
+	pw_core_destroy(d->daemon);
+	pw_thread_loop_destroy(d->daemon_loop);
+	pw_loop_destroy(loop);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { { 0 } };
+	struct pw_loop *l;
+	struct timespec value;
+	uint32_t violations;
+	char name[64];
+
+	pw_init(&argc, &argv);
+
+	/* a daemon of our own, next to a real one */
+	snprintf(name, sizeof(name), "pipewire-test-rt-graph-%d", getpid());
+	setenv("PIPEWIRE_CORE", name, 1);
+	if (getenv("XDG_RUNTIME_DIR") == NULL)
+		setenv("XDG_RUNTIME_DIR", "/tmp", 1);
+
+	if (!start_daemon(&data)) {
+		stop_daemon(&data);
+		return -1;
+	}
+
+	data.loop = pw_main_loop_new(NULL);
+	l = pw_main_loop_get_loop(data.loop);
+	data.core = pw_core_new(l, NULL);
+	data.t = pw_core_get_type(data.core);
+	init_type(&data.type, data.t->map);
+
+	data.timer = pw_loop_add_timer(l, on_timer, &data);
+	value.tv_sec = 0;
+	value.tv_nsec = CHECK_MSEC * SPA_NSEC_PER_MSEC;
+	pw_loop_update_timer(l, data.timer, &value, &value, false);
+
+	data.remote = pw_remote_new(data.core, NULL);
+	pw_remote_add_listener(data.remote, &data.remote_listener, &remote_events, &data);
+	pw_remote_connect(data.remote);
+
+	pw_main_loop_run(data.loop);
+
+	violations = pw_rt_check_get_violations();
+	if (data.res == 0) {
+		printf("%d buffers: %u violations after warmup\n", data.n_buffers,
+		       violations - data.warmup_violations);
+		if (violations != data.warmup_violations) {
+			printf("FAIL: allocation or blocking call in a graph cycle\n");
+			data.res = -1;
+		}
+	}
+
+	pw_loop_destroy_source(l, data.timer);
+	if (data.stream)
+		pw_stream_destroy(data.stream);
+	pw_remote_destroy(data.remote);
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+
+	stop_daemon(&data);
+
+	if (data.res == 0)
+		printf("OK\n");
+
+	return data.res;
+}
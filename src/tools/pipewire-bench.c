@@ -0,0 +1,602 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/interfaces.h>
+#include <pipewire/type.h>
+#include <pipewire/global.h>
+#include <pipewire/module.h>
+
+#include <extensions/client-node.h>
+
+/* benchmark of the control plane of the native protocol.
+ *
+ * A daemon is started in a child process on a private socket, unless an
+ * existing daemon is given with --remote. A number of clients is then
+ * connected and all of them run the same test concurrently:
+ *
+ *  sync:     core sync ping-pong
+ *  registry: get a registry and wait for all globals
+ *  snapshot: get a registry snapshot with all globals
+ *  node:     create and destroy a client-node
+ *
+ * The latency of each operation is measured and the percentiles and the
+ * throughput are printed.
+ *
+ * The daemon keeps a registry until its client disconnects, the registry
+ * and snapshot tests use a new connection for each operation so that they
+ * don't measure a growing list of registries. The connect is not in the
+ * latency but it is in the throughput of these tests. */
+
+#define BENCH_TYPE	PW_TYPE_INTERFACE_BASE "Bench"
+
+#define DEFAULT_CLIENTS		4
+#define DEFAULT_ITERATIONS	10000
+#define DEFAULT_GLOBALS		100
+
+enum test {
+	TEST_SYNC,
+	TEST_REGISTRY,
+	TEST_SNAPSHOT,
+	TEST_NODE,
+	TEST_LAST,
+};
+
+static const char *test_names[] = {
+	[TEST_SYNC] = "sync",
+	[TEST_REGISTRY] = "registry",
+	[TEST_SNAPSHOT] = "snapshot",
+	[TEST_NODE] = "node",
+};
+
+struct data;
+
+struct client {
+	struct data *data;
+	int index;
+
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+
+	struct pw_core_proxy *core_proxy;
+	struct pw_registry_proxy *registry_proxy;
+	struct spa_hook registry_listener;
+	struct pw_client_node_proxy *node_proxy;
+
+	uint32_t seq;
+	int iteration;
+	int step;
+	uint32_t n_globals;
+	uint64_t start;
+	bool connected;
+	bool reconnect;		/**< make a new connection for the next operation */
+};
+
+struct data {
+	struct pw_loop *loop;
+	struct pw_core *core;
+	uint32_t type_client_node;
+
+	enum test test;
+	int n_clients;
+	int n_iterations;
+	int n_globals;
+	bool failed;
+
+	struct client *clients;
+	int n_connected;
+	int n_done;
+
+	uint64_t *latencies;
+	uint32_t n_latencies;
+	uint64_t n_messages;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * SPA_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void do_quit(void *data, int signal_number)
+{
+	struct pw_main_loop *loop = data;
+	pw_main_loop_quit(loop);
+}
+
+static int run_daemon(const char *name, int n_globals)
+{
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_properties *props;
+	struct pw_type *t;
+	uint32_t type;
+	int i;
+
+	pw_init(NULL, NULL);
+
+	/* the registry tests disconnect after every sample, don't log
+	 * each hangup unless asked to */
+	if (getenv("PIPEWIRE_DEBUG") == NULL)
+		pw_log_set_level(SPA_LOG_LEVEL_NONE);
+
+	props = pw_properties_new("pipewire.core.name", name,
+				  "pipewire.daemon", "1", NULL);
+
+	loop = pw_main_loop_new(props);
+	pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGINT, do_quit, loop);
+	pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGTERM, do_quit, loop);
+
+	core = pw_core_new(pw_main_loop_get_loop(loop), props);
+
+	if (pw_module_load(core, "libpipewire-module-protocol-native", NULL) == NULL ||
+	    pw_module_load(core, "libpipewire-module-client-node", NULL) == NULL) {
+		fprintf(stderr, "daemon: can't load modules\n");
+		return -1;
+	}
+
+	/* extra globals for the registry test, they can't be bound */
+	t = pw_core_get_type(core);
+	type = spa_type_map_get_id(t->map, BENCH_TYPE);
+	for (i = 0; i < n_globals; i++)
+		pw_core_add_global(core, NULL, NULL, type, 0, NULL, NULL);
+
+	pw_main_loop_run(loop);
+
+	pw_core_destroy(core);
+	pw_main_loop_destroy(loop);
+
+	return 0;
+}
+
+static bool wait_for_socket(const char *name)
+{
+	const char *runtime_dir;
+	char path[PATH_MAX];
+	struct stat st;
+	int i;
+
+	if ((runtime_dir = getenv("XDG_RUNTIME_DIR")) == NULL)
+		return false;
+
+	snprintf(path, sizeof(path), "%s/%s", runtime_dir, name);
+
+	for (i = 0; i < 500; i++) {
+		if (stat(path, &st) == 0)
+			return true;
+		usleep(10000);
+	}
+	return false;
+}
+
+static void client_done(struct client *c)
+{
+	c->data->n_done++;
+}
+
+static void add_latency(struct client *c)
+{
+	struct data *d = c->data;
+	uint64_t now = get_time();
+
+	d->latencies[d->n_latencies++] = now - c->start;
+	c->start = now;
+}
+
+static void registry_event_global(void *data, uint32_t id, uint32_t parent_id,
+				  uint32_t permissions, uint32_t type, uint32_t version)
+{
+	struct client *c = data;
+	c->n_globals++;
+}
+
+static void registry_event_snapshot(void *data, uint32_t generation, uint32_t flags,
+				    uint32_t n_globals, const struct pw_registry_global *globals,
+				    uint32_t n_removed, const uint32_t *removed)
+{
+	struct client *c = data;
+	c->n_globals += n_globals;
+}
+
+static const struct pw_registry_proxy_events registry_events = {
+	PW_VERSION_REGISTRY_PROXY_EVENTS,
+	.global = registry_event_global,
+	.snapshot = registry_event_snapshot,
+};
+
+/* start the next operation of the test */
+static void client_step(struct client *c)
+{
+	struct data *d = c->data;
+	struct pw_type *t = pw_core_get_type(d->core);
+
+	if (c->iteration == d->n_iterations) {
+		client_done(c);
+		return;
+	}
+
+	switch (d->test) {
+	case TEST_SYNC:
+		pw_core_proxy_sync(c->core_proxy, ++c->seq);
+		d->n_messages += 2;
+		c->iteration++;
+		break;
+
+	case TEST_REGISTRY:
+	case TEST_SNAPSHOT:
+		if (c->registry_proxy)
+			pw_proxy_destroy((struct pw_proxy *) c->registry_proxy);
+		c->n_globals = 0;
+		if (d->test == TEST_REGISTRY)
+			c->registry_proxy = pw_core_proxy_get_registry(c->core_proxy,
+								       t->registry,
+								       PW_VERSION_REGISTRY, 0);
+		else
+			c->registry_proxy = pw_core_proxy_get_registry_snapshot(c->core_proxy,
+										t->registry,
+										PW_VERSION_REGISTRY, 0);
+		pw_registry_proxy_add_listener(c->registry_proxy,
+					       &c->registry_listener,
+					       &registry_events, c);
+		pw_core_proxy_sync(c->core_proxy, ++c->seq);
+		d->n_messages += d->test == TEST_REGISTRY ? 3 : 4;
+		c->iteration++;
+		break;
+
+	case TEST_NODE:
+		if (c->step == 0) {
+			c->node_proxy = pw_core_proxy_create_node(c->core_proxy,
+								  "client-node",
+								  "bench-node",
+								  d->type_client_node,
+								  PW_VERSION_CLIENT_NODE,
+								  NULL, 0);
+			c->step = 1;
+		} else {
+			pw_client_node_proxy_destroy(c->node_proxy);
+			pw_proxy_destroy((struct pw_proxy *) c->node_proxy);
+			c->node_proxy = NULL;
+			c->step = 0;
+			c->iteration++;
+		}
+		pw_core_proxy_sync(c->core_proxy, ++c->seq);
+		d->n_messages += 3;
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void on_sync_reply(void *data, uint32_t seq)
+{
+	struct client *c = data;
+	struct data *d = c->data;
+
+	if (seq == 0 || seq != c->seq)
+		return;
+
+	switch (d->test) {
+	case TEST_REGISTRY:
+	case TEST_SNAPSHOT:
+		if (c->n_globals < d->n_globals) {
+			fprintf(stderr, "client %d: got %u globals, expected at least %d\n",
+				c->index, c->n_globals, d->n_globals);
+			d->failed = true;
+		}
+		if (d->test == TEST_REGISTRY)
+			d->n_messages += c->n_globals;
+		add_latency(c);
+		if (c->iteration < d->n_iterations) {
+			/* can't destroy the remote from its own callback */
+			c->reconnect = true;
+			return;
+		}
+		break;
+	case TEST_NODE:
+		/* one latency for a complete create/destroy cycle */
+		if (c->step == 0)
+			add_latency(c);
+		break;
+	default:
+		add_latency(c);
+		break;
+	}
+	client_step(c);
+}
+
+static void on_state_changed(void *_data, enum pw_remote_state old,
+			     enum pw_remote_state state, const char *error)
+{
+	struct client *c = _data;
+	struct data *d = c->data;
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		fprintf(stderr, "client %d: remote error: %s\n", c->index, error);
+		d->failed = true;
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		c->core_proxy = pw_remote_get_core_proxy(c->remote);
+		if (c->connected) {
+			/* a new connection for the next operation */
+			c->start = get_time();
+			client_step(c);
+			break;
+		}
+		c->connected = true;
+		d->n_connected++;
+		break;
+
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.sync_reply = on_sync_reply,
+	.state_changed = on_state_changed,
+};
+
+static void connect_client(struct client *c)
+{
+	struct data *d = c->data;
+
+	c->remote = pw_remote_new(d->core, NULL);
+	pw_remote_add_listener(c->remote, &c->remote_listener, &remote_events, c);
+	if (pw_remote_connect(c->remote) < 0) {
+		fprintf(stderr, "client %d: can't connect\n", c->index);
+		d->failed = true;
+	}
+}
+
+static void reconnect_client(struct client *c)
+{
+	c->reconnect = false;
+	pw_remote_destroy(c->remote);
+	c->registry_proxy = NULL;
+	c->core_proxy = NULL;
+	connect_client(c);
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	uint64_t la = *(const uint64_t *) a, lb = *(const uint64_t *) b;
+	return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+static double percentile(struct data *d, double p)
+{
+	uint32_t index = (uint32_t) (p * (d->n_latencies - 1));
+	return d->latencies[index] / 1000.0;
+}
+
+static void report(struct data *d, uint64_t elapsed)
+{
+	double secs = elapsed / (double) SPA_NSEC_PER_SEC;
+
+	if (d->n_latencies == 0)
+		return;
+
+	qsort(d->latencies, d->n_latencies, sizeof(uint64_t), compare_latency);
+
+	printf("%-10s %4d %10u %10.0f %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+	       test_names[d->test], d->n_clients, d->n_latencies,
+	       d->n_latencies / secs, d->n_messages / secs,
+	       percentile(d, 0.0), percentile(d, 0.50), percentile(d, 0.90),
+	       percentile(d, 0.99), percentile(d, 1.0));
+}
+
+static int run_test(struct data *d, enum test test)
+{
+	uint64_t start;
+	int i;
+
+	d->test = test;
+	d->n_connected = 0;
+	d->n_done = 0;
+	d->n_latencies = 0;
+	d->n_messages = 0;
+
+	for (i = 0; i < d->n_clients; i++) {
+		struct client *c = &d->clients[i];
+
+		spa_zero(*c);
+		c->data = d;
+		c->index = i;
+		connect_client(c);
+	}
+
+	while (!d->failed && d->n_connected < d->n_clients)
+		pw_loop_iterate(d->loop, -1);
+
+	start = get_time();
+	for (i = 0; i < d->n_clients && !d->failed; i++) {
+		d->clients[i].start = start;
+		client_step(&d->clients[i]);
+	}
+	while (!d->failed && d->n_done < d->n_clients) {
+		pw_loop_iterate(d->loop, -1);
+		for (i = 0; i < d->n_clients; i++) {
+			if (d->clients[i].reconnect)
+				reconnect_client(&d->clients[i]);
+		}
+	}
+
+	if (!d->failed)
+		report(d, get_time() - start);
+
+	for (i = 0; i < d->n_clients; i++)
+		pw_remote_destroy(d->clients[i].remote);
+
+	return d->failed ? -1 : 0;
+}
+
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options] [test...]\n"
+		"  -h, --help                            Show this help\n"
+		"  -c, --clients=N                       Number of concurrent clients (default %d)\n"
+		"  -n, --iterations=N                    Iterations per client (default %d)\n"
+		"  -g, --globals=M                       Extra globals in the daemon (default %d)\n"
+		"  -r, --remote=NAME                     Use a running daemon\n"
+		"\n"
+		"tests: sync, registry, snapshot, node (default all)\n",
+		name, DEFAULT_CLIENTS, DEFAULT_ITERATIONS, DEFAULT_GLOBALS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	static const struct option long_options[] = {
+		{"help",	0, NULL, 'h'},
+		{"clients",	1, NULL, 'c'},
+		{"iterations",	1, NULL, 'n'},
+		{"globals",	1, NULL, 'g'},
+		{"remote",	1, NULL, 'r'},
+		{NULL,		0, NULL, 0}
+	};
+	bool tests[TEST_LAST] = { false, };
+	const char *remote = NULL;
+	char name[64];
+	pid_t daemon = -1;
+	int c, i, res = 0;
+	bool all = true;
+
+	data.n_clients = DEFAULT_CLIENTS;
+	data.n_iterations = DEFAULT_ITERATIONS;
+	data.n_globals = DEFAULT_GLOBALS;
+
+	while ((c = getopt_long(argc, argv, "hc:n:g:r:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 'c':
+			data.n_clients = atoi(optarg);
+			break;
+		case 'n':
+			data.n_iterations = atoi(optarg);
+			break;
+		case 'g':
+			data.n_globals = atoi(optarg);
+			break;
+		case 'r':
+			remote = optarg;
+			break;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+	for (; optind < argc; optind++) {
+		for (i = 0; i < TEST_LAST; i++) {
+			if (strcmp(argv[optind], test_names[i]) == 0)
+				break;
+		}
+		if (i == TEST_LAST) {
+			fprintf(stderr, "unknown test %s\n", argv[optind]);
+			return -1;
+		}
+		tests[i] = true;
+		all = false;
+	}
+	if (data.n_clients <= 0 || data.n_iterations <= 0 || data.n_globals < 0) {
+		show_help(argv[0]);
+		return -1;
+	}
+
+	if (getenv("XDG_RUNTIME_DIR") == NULL) {
+		fprintf(stderr, "XDG_RUNTIME_DIR not set in the environment\n");
+		return -1;
+	}
+
+	if (remote == NULL) {
+		snprintf(name, sizeof(name), "pipewire-bench-%d", getpid());
+		remote = name;
+
+		/* fork before we create any threads */
+		if ((daemon = fork()) == 0) {
+			setenv("PIPEWIRE_CORE", remote, 1);
+			exit(run_daemon(remote, data.n_globals));
+		} else if (daemon < 0) {
+			perror("fork");
+			return -1;
+		}
+		if (!wait_for_socket(remote)) {
+			fprintf(stderr, "daemon did not start\n");
+			res = -1;
+			goto exit;
+		}
+	}
+	setenv("PIPEWIRE_CORE", remote, 1);
+
+	pw_init(&argc, &argv);
+
+	data.loop = pw_loop_new(NULL);
+	data.core = pw_core_new(data.loop, NULL);
+	data.type_client_node = spa_type_map_get_id(pw_core_get_type(data.core)->map,
+						    PW_TYPE_INTERFACE__ClientNode);
+	data.clients = calloc(data.n_clients, sizeof(struct client));
+	/* node test does 2 operations per iteration, but only measures one */
+	data.latencies = calloc(data.n_clients * data.n_iterations, sizeof(uint64_t));
+	if (data.clients == NULL || data.latencies == NULL) {
+		res = -1;
+		goto exit_core;
+	}
+
+	printf("%-10s %4s %10s %10s %10s %9s %9s %9s %9s %9s\n",
+	       "test", "cli", "ops", "ops/s", "msgs/s",
+	       "min(us)", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+
+	pw_loop_enter(data.loop);
+	for (i = 0; i < TEST_LAST; i++) {
+		if (!all && !tests[i])
+			continue;
+		if ((res = run_test(&data, i)) < 0)
+			break;
+	}
+	pw_loop_leave(data.loop);
+
+      exit_core:
+	free(data.latencies);
+	free(data.clients);
+	pw_core_destroy(data.core);
+	pw_loop_destroy(data.loop);
+      exit:
+	if (daemon > 0) {
+		kill(daemon, SIGTERM);
+		waitpid(daemon, NULL, 0);
+	}
+	return res;
+}
@@ -0,0 +1,346 @@
+/* PipeWire
+ * Copyright (C) 2017 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <pipewire/stats.h>
+
+/* live view of the nodes of a daemon.
+ *
+ * The daemon must have the stats.shm property, pipewire-top maps that
+ * file in XDG_RUNTIME_DIR read-only and shows the values that changed since the
+ * previous refresh. It does not connect to the daemon, reading the stats
+ * does not wake up any thread of the daemon.
+ *
+ *  QUANT:  samples the device wakes up for
+ *  RATE:   sample rate of the device
+ *  PERIOD: time between the last two cycles started by the node
+ *  CYCLE:  time the graph needed for the cycles started by the node
+ *  PROC:   time in the process functions of the node
+ *  LOAD:   average cycle time relative to the period
+ *  FILL:   samples in the device buffer and its size
+ *  XRUNS:  underruns and overruns of the device
+ *
+ * Times are in microseconds, averages and 99th percentiles of the
+ * interval. Nodes that don't start cycles only have a PROC time. */
+
+#define DEFAULT_SHM		"pipewire-0-stats"
+#define DEFAULT_DELAY		0.25
+#define REOPEN_TIMEOUT		5	/* seconds to wait for a new daemon */
+
+struct node {
+	uint32_t seq;
+	struct spa_histogram cycle_time;
+	struct spa_histogram process_time;
+};
+
+struct data {
+	const char *name;
+	char *path;
+	int fd;
+	struct pw_stats_header *stats;
+	size_t size;
+	struct node *nodes;
+
+	bool batch;
+};
+
+static void close_stats(struct data *d)
+{
+	if (d->stats)
+		munmap(d->stats, d->size);
+	if (d->fd >= 0)
+		close(d->fd);
+	free(d->nodes);
+	d->stats = NULL;
+	d->fd = -1;
+	d->nodes = NULL;
+}
+
+static int open_stats(struct data *d)
+{
+	struct pw_stats_header *h;
+	struct stat st;
+
+	if ((d->fd = open(d->path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -errno;
+
+	if (fstat(d->fd, &st) < 0 || st.st_size < sizeof(struct pw_stats_header))
+		goto invalid;
+
+	h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, d->fd, 0);
+	if (h == MAP_FAILED)
+		goto invalid;
+
+	d->stats = h;
+	d->size = st.st_size;
+
+	if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != PW_STATS_MAGIC ||
+	    h->version != PW_STATS_VERSION ||
+	    pw_stats_size(h->n_nodes) > d->size)
+		goto invalid;
+
+	d->nodes = calloc(h->n_nodes, sizeof(struct node));
+	if (d->nodes == NULL)
+		goto invalid;
+
+	return 0;
+
+      invalid:
+	close_stats(d);
+	return -EINVAL;
+}
+
+/* the daemon unlinks the file when it exits, a new daemon makes a new
+ * one with the same name */
+static bool stats_removed(struct data *d)
+{
+	struct stat st;
+	return fstat(d->fd, &st) < 0 || st.st_nlink == 0;
+}
+
+/* wait for a restarted daemon to make the stats again */
+static int reopen_stats(struct data *d, const struct timespec *delay)
+{
+	struct timespec now, end;
+	int res;
+
+	close_stats(d);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += REOPEN_TIMEOUT;
+	while ((res = open_stats(d)) < 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (SPA_TIMESPEC_TO_TIME(&now) >= SPA_TIMESPEC_TO_TIME(&end))
+			return res;
+		nanosleep(delay, NULL);
+	}
+	return 0;
+}
+
+/* the values added to a histogram since the copy in @prev, @prev is
+ * updated */
+static void histogram_delta(const struct spa_histogram *hist,
+			    struct spa_histogram *prev, struct spa_histogram *delta)
+{
+	struct spa_histogram now;
+	uint32_t i, last = 0;
+
+	spa_histogram_read(hist, &now);
+
+	delta->count = 0;
+	for (i = 0; i < SPA_HISTOGRAM_BUCKETS; i++) {
+		delta->buckets[i] = now.buckets[i] - prev->buckets[i];
+		delta->count += delta->buckets[i];
+		if (delta->buckets[i])
+			last = i;
+	}
+	delta->total = now.total - prev->total;
+	delta->max = SPA_MIN((2ULL << last) - 1, now.max);
+
+	*prev = now;
+}
+
+static void print_time(uint64_t count, uint64_t nsec)
+{
+	if (count == 0)
+		printf(" %8s", "-");
+	else
+		printf(" %8.1f", nsec / 1000.0);
+}
+
+static void print_node(struct pw_node_stats *stats, struct node *n, uint32_t id, const char *name)
+{
+	struct spa_histogram cycle, process;
+	struct spa_clock_stats clock;
+	uint64_t period;
+
+	histogram_delta(&stats->cycle_time, &n->cycle_time, &cycle);
+	histogram_delta(&stats->graph.process_time, &n->process_time, &process);
+
+	period = __atomic_load_n(&stats->period, __ATOMIC_RELAXED);
+	clock.rate = __atomic_load_n(&stats->clock.rate, __ATOMIC_RELAXED);
+	clock.quantum = __atomic_load_n(&stats->clock.quantum, __ATOMIC_RELAXED);
+	clock.fill = __atomic_load_n(&stats->clock.fill, __ATOMIC_RELAXED);
+	clock.size = __atomic_load_n(&stats->clock.size, __ATOMIC_RELAXED);
+	clock.xruns = __atomic_load_n(&stats->clock.xruns, __ATOMIC_RELAXED);
+
+	printf("%5u %-24.24s", id, name);
+
+	if (clock.rate) {
+		printf(" %6u %6u", clock.quantum, clock.rate);
+	} else
+		printf(" %6s %6s", "-", "-");
+
+	print_time(cycle.count, period);
+	print_time(cycle.count, cycle.count ? cycle.total / cycle.count : 0);
+	print_time(cycle.count, spa_histogram_percentile(&cycle, 99));
+	print_time(process.count, process.count ? process.total / process.count : 0);
+	print_time(process.count, spa_histogram_percentile(&process, 99));
+
+	if (cycle.count && period)
+		printf(" %5.1f%%", 100.0 * cycle.total / cycle.count / period);
+	else
+		printf(" %6s", "-");
+
+	if (clock.size)
+		printf(" %6u/%-6u %6u", clock.fill, clock.size, clock.xruns);
+	else
+		printf(" %13s %6s", "-", "-");
+
+	printf("\n");
+}
+
+static void refresh(struct data *d)
+{
+	struct pw_stats_header *h = d->stats;
+	char name[PW_STATS_MAX_NAME];
+	uint32_t i, id, seq, n_nodes = 0;
+
+	if (!d->batch)
+		printf("\033[H\033[2J");
+
+	for (i = 0; i < h->n_nodes; i++) {
+		if (__atomic_load_n(&pw_stats_get_node(h, i)->id, __ATOMIC_RELAXED) != SPA_ID_INVALID)
+			n_nodes++;
+	}
+	printf("%s: %u nodes, times in usec\n\n", d->name, n_nodes);
+	printf("%5s %-24s %6s %6s %8s %8s %8s %8s %8s %6s %13s %6s\n",
+	       "ID", "NAME", "QUANT", "RATE", "PERIOD", "CYCLE", "CYC-P99",
+	       "PROC", "PROC-P99", "LOAD", "FILL", "XRUNS");
+
+	for (i = 0; i < h->n_nodes; i++) {
+		struct pw_node_stats *stats = pw_stats_get_node(h, i);
+		struct node *n = &d->nodes[i];
+
+		seq = pw_node_stats_read_info(stats, &id, name);
+		if (id == SPA_ID_INVALID)
+			continue;
+
+		/* the slot has a new node, its counters started from 0 */
+		if (seq != n->seq) {
+			memset(n, 0, sizeof(*n));
+			n->seq = seq;
+		}
+		print_node(stats, n, id, name);
+	}
+	if (d->batch)
+		printf("\n");
+	fflush(stdout);
+}
+
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options]\n"
+		"  -h, --help                            Show this help\n"
+		"  -s, --shm=NAME                        Name of the stats file in XDG_RUNTIME_DIR\n"
+		"                                        (default %s)\n"
+		"  -d, --delay=SECS                      Time between refreshes (default %.2f)\n"
+		"  -n, --iterations=N                    Exit after N refreshes\n"
+		"  -b, --batch                           Don't clear the screen\n",
+		name, DEFAULT_SHM, DEFAULT_DELAY);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	static const struct option long_options[] = {
+		{"help",	0, NULL, 'h'},
+		{"shm",		1, NULL, 's'},
+		{"delay",	1, NULL, 'd'},
+		{"iterations",	1, NULL, 'n'},
+		{"batch",	0, NULL, 'b'},
+		{NULL,		0, NULL, 0}
+	};
+	double delay = DEFAULT_DELAY;
+	struct timespec ts;
+	const char *runtime_dir;
+	int c, res, iterations = 0;
+
+	data.name = DEFAULT_SHM;
+	data.fd = -1;
+
+	while ((c = getopt_long(argc, argv, "hs:d:n:b", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 's':
+			data.name = optarg;
+			break;
+		case 'd':
+			delay = atof(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'b':
+			data.batch = true;
+			break;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+	if (delay <= 0.0 || iterations < 0) {
+		show_help(argv[0]);
+		return -1;
+	}
+	if ((runtime_dir = getenv("XDG_RUNTIME_DIR")) == NULL) {
+		fprintf(stderr, "XDG_RUNTIME_DIR not set in the environment\n");
+		return -1;
+	}
+	if (asprintf(&data.path, "%s/%s", runtime_dir, data.name) < 0)
+		return -1;
+
+	ts.tv_sec = (time_t) delay;
+	ts.tv_nsec = (long) ((delay - ts.tv_sec) * SPA_NSEC_PER_SEC);
+
+	if ((res = open_stats(&data)) < 0) {
+		fprintf(stderr, "can't open stats %s: %s\n", data.path, strerror(-res));
+		fprintf(stderr, "is the daemon running with the stats.shm property?\n");
+		return -1;
+	}
+
+	while (true) {
+		if (stats_removed(&data) && reopen_stats(&data, &ts) < 0) {
+			fprintf(stderr, "the daemon exited\n");
+			free(data.path);
+			return -1;
+		}
+		refresh(&data);
+
+		if (iterations && --iterations == 0)
+			break;
+		nanosleep(&ts, NULL);
+	}
+	close_stats(&data);
+	free(data.path);
+
+	return 0;
+}